@@ -2,6 +2,7 @@
 import argparse
 import fileinput
 import os
+import struct
 import subprocess
 import sys
 import time
@@ -93,6 +94,7 @@ parser.add_argument('--slangc', type=str, help='path to slangc executable')
 parser.add_argument('--outputDir', type=str, help='compile shaders output path')
 parser.add_argument('--sample', type=str, help='compile shaders for a single sample only')
 parser.add_argument('--force', action='store_true', help='force recompile all shaders')
+parser.add_argument('--no-archive', action='store_true', help='do not pack the compiled shaders into shaders.spvpak')
 args = parser.parse_args()
 
 compiler_path = "..\\external\\slang\\bin\\slangc.exe"
@@ -147,6 +149,54 @@ def getShaderStages(filename):
     
     return stages
 
+# 与 vks::tools::hashBytes 相同的 64 位 FNV-1a
+def fnv1a64(data):
+    h = 0xcbf29ce484222325
+    for b in data:
+        h ^= b
+        h = (h * 0x100000001b3) & 0xFFFFFFFFFFFFFFFF
+    return h
+
+# 把输出目录中的所有 .spv 打包成一个文件，格式见 src/base/VulkanShaderArchive.h
+# 头部(magic, version, 数量, 保留) + 按文件名哈希排序的条目表(名称哈希, 内容哈希, 偏移, 大小) + 16 字节对齐的 SPIR-V
+ARCHIVE_NAME = "shaders.spvpak"
+ARCHIVE_ALIGNMENT = 16
+def writeShaderArchive(directory):
+    blobs = []
+    for name in sorted(os.listdir(directory)):
+        if not name.endswith(".spv"):
+            continue
+        with open(os.path.join(directory, name), 'rb') as f:
+            data = f.read()
+        blobs.append((fnv1a64(name.encode('utf-8')), name, data))
+    blobs.sort(key=lambda blob: blob[0])
+    for i in range(1, len(blobs)):
+        if blobs[i - 1][0] == blobs[i][0]:
+            print(f"ERROR: shader name hash collision: {blobs[i - 1][1]} / {blobs[i][1]}")
+            sys.exit(1)
+
+    header_size = 16
+    entry_size = 32
+    offset = header_size + entry_size * len(blobs)
+    entries = b""
+    payload = b""
+    for name_hash, name, data in blobs:
+        padding = (-offset) % ARCHIVE_ALIGNMENT
+        payload += b"\0" * padding
+        offset += padding
+        entries += struct.pack("<QQQQ", name_hash, fnv1a64(data), offset, len(data))
+        payload += data
+        offset += len(data)
+
+    archive_path = os.path.join(directory, ARCHIVE_NAME)
+    temp_path = archive_path + ".tmp"
+    with open(temp_path, 'wb') as f:
+        f.write(struct.pack("<IIII", 0x41565053, 1, len(blobs), 0))
+        f.write(entries)
+        f.write(payload)
+    os.replace(temp_path, archive_path)
+    print(f"\n打包 {len(blobs)} 个shader -> {os.path.abspath(archive_path)} ({offset} bytes)")
+
 # 计时开始
 total_start = time.time()
 compiled_count = 0
@@ -256,6 +306,9 @@ for root, dirs, files in os.walk(base_dir):
     checkRenameFiles(sample_name)
     print("结束编译")
 
+if not args.no_archive:
+    writeShaderArchive(out_dir)
+
 # 输出统计信息
 total_time = time.time() - total_start
 print("\n编译情况统计:")
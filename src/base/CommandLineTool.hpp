@@ -0,0 +1,58 @@
+/*
+* Helpers shared by the command line tools (benchmarks, offline bakers) built into the main executable
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <limits>
+#if defined(_WIN32)
+#include <windows.h>
+#endif
+
+namespace vks
+{
+	namespace tool
+	{
+		/**
+		* Redirects stdout and stderr to a console
+		*
+		* @note WinMain programs have no console, output goes to the command prompt that started the tool or to a new console window. Does nothing on other platforms
+		*/
+		inline void attachConsole()
+		{
+#if defined(_WIN32)
+			if (!AttachConsole(ATTACH_PARENT_PROCESS)) {
+				AllocConsole();
+			}
+			FILE* stream;
+			freopen_s(&stream, "CONOUT$", "w+", stdout);
+			freopen_s(&stream, "CONOUT$", "w+", stderr);
+#endif
+		}
+
+		/**
+		* Runs fn repeatedly and returns the duration of the fastest run
+		*
+		* @note Taking the minimum instead of the average filters out scheduling and cache warm-up noise
+		* @return Duration of the fastest run in seconds
+		*/
+		template <typename Function>
+		double measureBest(uint32_t repetitions, Function&& fn)
+		{
+			double best = std::numeric_limits<double>::max();
+			for (uint32_t i = 0; i < repetitions; i++) {
+				const auto tStart = std::chrono::high_resolution_clock::now();
+				fn();
+				const auto tEnd = std::chrono::high_resolution_clock::now();
+				best = std::min(best, std::chrono::duration<double>(tEnd - tStart).count());
+			}
+			return best;
+		}
+	}
+}
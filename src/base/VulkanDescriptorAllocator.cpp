@@ -0,0 +1,196 @@
+/*
+* Vulkan descriptor allocation helpers
+*
+* Growable descriptor allocator and descriptor set layout cache
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#include "VulkanDescriptorAllocator.h"
+
+namespace vks
+{
+	std::vector<DescriptorAllocator::PoolSizeRatio> DescriptorAllocator::defaultRatios()
+	{
+		return {
+			{ VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 2.0f },
+			{ VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1.0f },
+			{ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 4.0f },
+			{ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1.0f },
+			{ VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1.0f },
+		};
+	}
+
+	void DescriptorAllocator::init(VkDevice device, uint32_t initialSets, const std::vector<PoolSizeRatio>& ratios, VkDescriptorPoolCreateFlags flags)
+	{
+		this->device = device;
+		this->ratios = ratios;
+		this->flags = flags;
+		setsPerPool = initialSets;
+	}
+
+	VkDescriptorPool DescriptorAllocator::createPool(uint32_t setCount)
+	{
+		std::vector<VkDescriptorPoolSize> poolSizes;
+		poolSizes.reserve(ratios.size());
+		for (const PoolSizeRatio& ratio : ratios) {
+			poolSizes.push_back(vks::initializers::descriptorPoolSize(ratio.type, std::max(1u, static_cast<uint32_t>(ratio.ratio * setCount))));
+		}
+		VkDescriptorPoolCreateInfo descriptorPoolCI = vks::initializers::descriptorPoolCreateInfo(poolSizes, setCount);
+		descriptorPoolCI.flags = flags;
+		VkDescriptorPool pool{ VK_NULL_HANDLE };
+		VK_CHECK_RESULT(vkCreateDescriptorPool(device, &descriptorPoolCI, nullptr, &pool));
+		return pool;
+	}
+
+	VkDescriptorPool DescriptorAllocator::getPool()
+	{
+		if (!readyPools.empty()) {
+			VkDescriptorPool pool = readyPools.back();
+			readyPools.pop_back();
+			return pool;
+		}
+		// Grow each new pool so that content heavy scenes settle on a small number of pools
+		VkDescriptorPool pool = createPool(setsPerPool);
+		setsPerPool = std::min(setsPerPool * 2, maxSetsPerPool);
+		return pool;
+	}
+
+	VkDescriptorSet DescriptorAllocator::allocate(VkDescriptorSetLayout layout, const void* pNext)
+	{
+		assert(device);
+		VkDescriptorPool pool = getPool();
+
+		VkDescriptorSetAllocateInfo allocInfo = vks::initializers::descriptorSetAllocateInfo(pool, &layout, 1);
+		allocInfo.pNext = pNext;
+		VkDescriptorSet descriptorSet{ VK_NULL_HANDLE };
+		VkResult result = vkAllocateDescriptorSets(device, &allocInfo, &descriptorSet);
+		if (result == VK_ERROR_OUT_OF_POOL_MEMORY || result == VK_ERROR_FRAGMENTED_POOL) {
+			// Retire the exhausted pool and retry once with a fresh one
+			fullPools.push_back(pool);
+			pool = getPool();
+			allocInfo.descriptorPool = pool;
+			result = vkAllocateDescriptorSets(device, &allocInfo, &descriptorSet);
+		}
+		VK_CHECK_RESULT(result);
+		readyPools.push_back(pool);
+		return descriptorSet;
+	}
+
+	void DescriptorAllocator::resetPools()
+	{
+		for (VkDescriptorPool pool : readyPools) {
+			vkResetDescriptorPool(device, pool, 0);
+		}
+		for (VkDescriptorPool pool : fullPools) {
+			vkResetDescriptorPool(device, pool, 0);
+			readyPools.push_back(pool);
+		}
+		fullPools.clear();
+	}
+
+	void DescriptorAllocator::destroyPools()
+	{
+		for (VkDescriptorPool pool : readyPools) {
+			vkDestroyDescriptorPool(device, pool, nullptr);
+		}
+		for (VkDescriptorPool pool : fullPools) {
+			vkDestroyDescriptorPool(device, pool, nullptr);
+		}
+		readyPools.clear();
+		fullPools.clear();
+	}
+
+	void DescriptorLayoutCache::init(VkDevice device)
+	{
+		this->device = device;
+	}
+
+	bool DescriptorLayoutCache::LayoutInfo::operator==(const LayoutInfo& other) const
+	{
+		if (flags != other.flags || bindings.size() != other.bindings.size() || bindingFlags != other.bindingFlags) {
+			return false;
+		}
+		for (size_t i = 0; i < bindings.size(); i++) {
+			const VkDescriptorSetLayoutBinding& a = bindings[i];
+			const VkDescriptorSetLayoutBinding& b = other.bindings[i];
+			if (a.binding != b.binding || a.descriptorType != b.descriptorType || a.descriptorCount != b.descriptorCount || a.stageFlags != b.stageFlags || a.pImmutableSamplers != b.pImmutableSamplers) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	size_t DescriptorLayoutCache::LayoutInfo::hash() const
+	{
+		// Bindings are sorted, so the hash only depends on the layout contents and not on declaration order
+		size_t result = std::hash<uint32_t>()(flags);
+		auto combine = [&result](size_t value) {
+			result ^= value + 0x9e3779b97f4a7c15ull + (result << 6) + (result >> 2);
+		};
+		for (const VkDescriptorSetLayoutBinding& binding : bindings) {
+			combine(binding.binding);
+			combine(binding.descriptorType);
+			combine(binding.descriptorCount);
+			combine(binding.stageFlags);
+		}
+		for (VkDescriptorBindingFlags bindingFlag : bindingFlags) {
+			combine(bindingFlag);
+		}
+		return result;
+	}
+
+	VkDescriptorSetLayout DescriptorLayoutCache::createDescriptorSetLayout(const VkDescriptorSetLayoutCreateInfo& createInfo)
+	{
+		LayoutInfo layoutInfo{};
+		layoutInfo.flags = createInfo.flags;
+		layoutInfo.bindings.assign(createInfo.pBindings, createInfo.pBindings + createInfo.bindingCount);
+
+		// Per-binding flags (descriptor indexing) are part of the layout identity
+		const VkDescriptorSetLayoutBindingFlagsCreateInfo* bindingFlagsCI = nullptr;
+		for (const VkBaseInStructure* next = static_cast<const VkBaseInStructure*>(createInfo.pNext); next; next = next->pNext) {
+			if (next->sType == VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO) {
+				bindingFlagsCI = reinterpret_cast<const VkDescriptorSetLayoutBindingFlagsCreateInfo*>(next);
+			}
+		}
+		std::vector<size_t> order(layoutInfo.bindings.size());
+		for (size_t i = 0; i < order.size(); i++) {
+			order[i] = i;
+		}
+		std::sort(order.begin(), order.end(), [&](size_t a, size_t b) { return layoutInfo.bindings[a].binding < layoutInfo.bindings[b].binding; });
+		std::vector<VkDescriptorSetLayoutBinding> sortedBindings;
+		sortedBindings.reserve(order.size());
+		for (size_t i : order) {
+			sortedBindings.push_back(layoutInfo.bindings[i]);
+			if (bindingFlagsCI && bindingFlagsCI->bindingCount > 0) {
+				layoutInfo.bindingFlags.push_back(bindingFlagsCI->pBindingFlags[i]);
+			}
+		}
+		layoutInfo.bindings = std::move(sortedBindings);
+
+		std::lock_guard<std::mutex> lock(mutex);
+		auto it = layouts.find(layoutInfo);
+		if (it != layouts.end()) {
+			return it->second;
+		}
+		VkDescriptorSetLayout layout{ VK_NULL_HANDLE };
+		VK_CHECK_RESULT(vkCreateDescriptorSetLayout(device, &createInfo, nullptr, &layout));
+		layouts[layoutInfo] = layout;
+		return layout;
+	}
+
+	VkDescriptorSetLayout DescriptorLayoutCache::createDescriptorSetLayout(const std::vector<VkDescriptorSetLayoutBinding>& bindings, VkDescriptorSetLayoutCreateFlags flags)
+	{
+		VkDescriptorSetLayoutCreateInfo descriptorLayoutCI = vks::initializers::descriptorSetLayoutCreateInfo(bindings);
+		descriptorLayoutCI.flags = flags;
+		return createDescriptorSetLayout(descriptorLayoutCI);
+	}
+
+	void DescriptorLayoutCache::destroy()
+	{
+		for (auto& [info, layout] : layouts) {
+			vkDestroyDescriptorSetLayout(device, layout, nullptr);
+		}
+		layouts.clear();
+	}
+}
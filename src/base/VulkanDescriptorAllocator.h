@@ -0,0 +1,96 @@
+/*
+* Vulkan descriptor allocation helpers
+*
+* Growable descriptor allocator and descriptor set layout cache
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <vector>
+#include <unordered_map>
+#include <mutex>
+
+#include "vulkan/vulkan.h"
+#include "VulkanTools.h"
+
+namespace vks
+{
+	/**
+	* @brief Descriptor set allocator that grows on demand
+	* @note Pools are sized from per-type ratios instead of exact counts. When a pool runs out (VK_ERROR_OUT_OF_POOL_MEMORY or VK_ERROR_FRAGMENTED_POOL)
+	* it is retired and a new, larger pool is created, so callers never need to hand-size pools for their content.
+	*/
+	class DescriptorAllocator
+	{
+	public:
+		struct PoolSizeRatio {
+			VkDescriptorType type;
+			float ratio;
+		};
+
+		/** @brief Default ratios covering uniform buffers, samplers and storage buffers */
+		static std::vector<PoolSizeRatio> defaultRatios();
+
+		/**
+		* Prepare the allocator, the first pool is created lazily on the first allocation
+		*
+		* @param device Logical device
+		* @param initialSets Number of sets the first pool is sized for
+		* @param ratios Descriptors per set for each descriptor type
+		* @param flags Pool create flags (e.g. VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT)
+		*/
+		void init(VkDevice device, uint32_t initialSets = 64, const std::vector<PoolSizeRatio>& ratios = defaultRatios(), VkDescriptorPoolCreateFlags flags = 0);
+		/** @brief Allocates a single descriptor set, growing the pool list if required */
+		VkDescriptorSet allocate(VkDescriptorSetLayout layout, const void* pNext = nullptr);
+		/** @brief Resets all pools at once, invalidating every set allocated from this allocator */
+		void resetPools();
+		/** @brief Destroys all pools owned by this allocator */
+		void destroyPools();
+
+		uint32_t poolCount() const { return static_cast<uint32_t>(readyPools.size() + fullPools.size()); }
+
+	private:
+		VkDescriptorPool getPool();
+		VkDescriptorPool createPool(uint32_t setCount);
+
+		VkDevice device{ VK_NULL_HANDLE };
+		VkDescriptorPoolCreateFlags flags{ 0 };
+		std::vector<PoolSizeRatio> ratios;
+		std::vector<VkDescriptorPool> readyPools;
+		std::vector<VkDescriptorPool> fullPools;
+		uint32_t setsPerPool{ 0 };
+		static constexpr uint32_t maxSetsPerPool{ 4096 };
+	};
+
+	/**
+	* @brief Caches descriptor set layouts by a hash of their bindings
+	* @note Identical layouts requested from different places return the same handle, the cache owns all layouts it hands out
+	*/
+	class DescriptorLayoutCache
+	{
+	public:
+		void init(VkDevice device);
+		/** @brief Returns a cached layout matching the create info (including binding flags passed through pNext), creating it if necessary */
+		VkDescriptorSetLayout createDescriptorSetLayout(const VkDescriptorSetLayoutCreateInfo& createInfo);
+		VkDescriptorSetLayout createDescriptorSetLayout(const std::vector<VkDescriptorSetLayoutBinding>& bindings, VkDescriptorSetLayoutCreateFlags flags = 0);
+		void destroy();
+
+	private:
+		struct LayoutInfo {
+			VkDescriptorSetLayoutCreateFlags flags{ 0 };
+			std::vector<VkDescriptorSetLayoutBinding> bindings;
+			std::vector<VkDescriptorBindingFlags> bindingFlags;
+			bool operator==(const LayoutInfo& other) const;
+			size_t hash() const;
+		};
+		struct LayoutHash {
+			size_t operator()(const LayoutInfo& info) const { return info.hash(); }
+		};
+
+		VkDevice device{ VK_NULL_HANDLE };
+		std::mutex mutex;
+		std::unordered_map<LayoutInfo, VkDescriptorSetLayout, LayoutHash> layouts;
+	};
+}
@@ -0,0 +1,198 @@
+/*
+* Persistent Vulkan pipeline cache helpers
+*
+* Loads and stores VkPipelineCache blobs on disk and collects cache hit statistics
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#include "VulkanPipelineCache.h"
+
+#include <atomic>
+#include <filesystem>
+#include <iostream>
+
+namespace vks
+{
+	namespace pipelinecache
+	{
+		namespace
+		{
+			std::atomic<uint32_t> pipelineCount{ 0 };
+			std::atomic<uint32_t> hitCount{ 0 };
+			std::atomic<uint32_t> missCount{ 0 };
+			std::atomic<uint64_t> creationTimeNs{ 0 };
+			std::atomic<bool> feedbackAvailable{ false };
+		}
+
+		bool validateHeader(const std::vector<char>& data, const VkPipelineCacheHeaderVersionOne& expected, std::string& reason)
+		{
+			if (data.size() < sizeof(VkPipelineCacheHeaderVersionOne)) {
+				reason = "file too small";
+				return false;
+			}
+			VkPipelineCacheHeaderVersionOne header{};
+			memcpy(&header, data.data(), sizeof(header));
+			if (header.headerSize < sizeof(VkPipelineCacheHeaderVersionOne) || header.headerSize > data.size()) {
+				reason = "invalid header size";
+				return false;
+			}
+			if (header.headerVersion != VK_PIPELINE_CACHE_HEADER_VERSION_ONE) {
+				reason = "unsupported header version";
+				return false;
+			}
+			if (header.vendorID != expected.vendorID || header.deviceID != expected.deviceID) {
+				reason = "created on a different device";
+				return false;
+			}
+			if (memcmp(header.pipelineCacheUUID, expected.pipelineCacheUUID, VK_UUID_SIZE) != 0) {
+				reason = "cache UUID mismatch (driver changed)";
+				return false;
+			}
+			return true;
+		}
+
+		bool create(VkDevice device, const VkPhysicalDeviceProperties& properties, const std::string& fileName, VkPipelineCache* pipelineCache)
+		{
+			std::vector<char> data;
+			if (!fileName.empty() && vks::tools::fileExists(fileName)) {
+				std::ifstream is(fileName, std::ios::binary | std::ios::ate);
+				if (is.is_open()) {
+					data.resize(static_cast<size_t>(is.tellg()));
+					is.seekg(0, std::ios::beg);
+					is.read(data.data(), data.size());
+				}
+			}
+
+			bool seeded = false;
+			if (!data.empty()) {
+				VkPipelineCacheHeaderVersionOne expected{};
+				expected.vendorID = properties.vendorID;
+				expected.deviceID = properties.deviceID;
+				memcpy(expected.pipelineCacheUUID, properties.pipelineCacheUUID, VK_UUID_SIZE);
+				std::string reason;
+				seeded = validateHeader(data, expected, reason);
+				if (!seeded) {
+					std::cout << "Discarding pipeline cache \"" << fileName << "\": " << reason << "\n";
+				}
+			}
+
+			VkPipelineCacheCreateInfo pipelineCacheCreateInfo{};
+			pipelineCacheCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+			if (seeded) {
+				pipelineCacheCreateInfo.initialDataSize = data.size();
+				pipelineCacheCreateInfo.pInitialData = data.data();
+			}
+			VkResult result = vkCreatePipelineCache(device, &pipelineCacheCreateInfo, nullptr, pipelineCache);
+			if (seeded && result != VK_SUCCESS) {
+				// The driver may still reject data that passed the header check, fall back to an empty cache
+				std::cout << "Pipeline cache data rejected by the driver (" << vks::tools::errorString(result) << "), starting with an empty cache\n";
+				pipelineCacheCreateInfo.initialDataSize = 0;
+				pipelineCacheCreateInfo.pInitialData = nullptr;
+				seeded = false;
+				result = vkCreatePipelineCache(device, &pipelineCacheCreateInfo, nullptr, pipelineCache);
+			}
+			VK_CHECK_RESULT(result);
+			if (seeded) {
+				std::cout << "Loaded pipeline cache \"" << fileName << "\" (" << data.size() << " bytes)\n";
+			}
+			return seeded;
+		}
+
+		bool save(VkDevice device, VkPipelineCache pipelineCache, const std::string& fileName)
+		{
+			if (fileName.empty() || pipelineCache == VK_NULL_HANDLE) {
+				return false;
+			}
+			size_t size{ 0 };
+			VK_CHECK_RESULT(vkGetPipelineCacheData(device, pipelineCache, &size, nullptr));
+			if (size == 0) {
+				return false;
+			}
+			std::vector<char> data(size);
+			VK_CHECK_RESULT(vkGetPipelineCacheData(device, pipelineCache, &size, data.data()));
+
+			const std::string tempFileName = fileName + ".tmp";
+			{
+				std::ofstream os(tempFileName, std::ios::binary | std::ios::trunc);
+				if (!os.is_open()) {
+					std::cerr << "Could not write pipeline cache \"" << tempFileName << "\"\n";
+					return false;
+				}
+				os.write(data.data(), size);
+				if (!os.good()) {
+					std::cerr << "Could not write pipeline cache \"" << tempFileName << "\"\n";
+					return false;
+				}
+			}
+			// Rename replaces the old cache in one step
+			std::error_code ec;
+			std::filesystem::rename(tempFileName, fileName, ec);
+			if (ec) {
+				std::cerr << "Could not replace pipeline cache \"" << fileName << "\": " << ec.message() << "\n";
+				std::filesystem::remove(tempFileName, ec);
+				return false;
+			}
+			return true;
+		}
+
+		void setFeedbackEnabled(bool enabled)
+		{
+			feedbackAvailable = enabled;
+		}
+
+		bool feedbackEnabled()
+		{
+			return feedbackAvailable;
+		}
+
+		VkPipelineCreationFeedbackCreateInfo feedbackCreateInfo(VkPipelineCreationFeedback* pipelineFeedback)
+		{
+			VkPipelineCreationFeedbackCreateInfo feedbackCI{};
+			feedbackCI.sType = VK_STRUCTURE_TYPE_PIPELINE_CREATION_FEEDBACK_CREATE_INFO;
+			feedbackCI.pPipelineCreationFeedback = pipelineFeedback;
+			return feedbackCI;
+		}
+
+		void recordFeedback(const VkPipelineCreationFeedback& feedback)
+		{
+			// Without feedback support the structure was never chained and holds no data
+			if (!feedbackAvailable) {
+				return;
+			}
+			pipelineCount++;
+			if (!(feedback.flags & VK_PIPELINE_CREATION_FEEDBACK_VALID_BIT)) {
+				return;
+			}
+			if (feedback.flags & VK_PIPELINE_CREATION_FEEDBACK_APPLICATION_PIPELINE_CACHE_HIT_BIT) {
+				hitCount++;
+			} else {
+				missCount++;
+			}
+			creationTimeNs += feedback.duration;
+		}
+
+		Statistics getStatistics()
+		{
+			Statistics statistics{};
+			statistics.pipelines = pipelineCount;
+			statistics.cacheHits = hitCount;
+			statistics.cacheMisses = missCount;
+			statistics.creationTime = static_cast<double>(creationTimeNs) / 1000000.0;
+			return statistics;
+		}
+
+		void printStatistics()
+		{
+			const Statistics statistics = getStatistics();
+			if (statistics.pipelines == 0) {
+				return;
+			}
+			std::cout << "Pipeline cache: " << statistics.pipelines << " pipelines, " << statistics.cacheHits << " hits, " << statistics.cacheMisses << " misses";
+			if (statistics.cacheHits + statistics.cacheMisses < statistics.pipelines) {
+				std::cout << ", " << statistics.pipelines - statistics.cacheHits - statistics.cacheMisses << " without feedback";
+			}
+			std::cout << ", " << statistics.creationTime << " ms creation time\n";
+		}
+	}
+}
@@ -0,0 +1,55 @@
+/*
+* Persistent Vulkan pipeline cache helpers
+*
+* Loads and stores VkPipelineCache blobs on disk and collects cache hit statistics
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "vulkan/vulkan.h"
+#include "VulkanTools.h"
+
+namespace vks
+{
+	namespace pipelinecache
+	{
+		struct Statistics {
+			uint32_t pipelines{ 0 };
+			uint32_t cacheHits{ 0 };
+			uint32_t cacheMisses{ 0 };
+			double creationTime{ 0.0 };
+		};
+
+		/**
+		* Create a pipeline cache, seeded with the contents of fileName if it exists and matches the current device
+		*
+		* @note The blob is validated against VkPipelineCacheHeaderVersionOne (header version, vendor ID, device ID and cache UUID), mismatching data is discarded
+		* @return True if the cache was seeded from disk
+		*/
+		bool create(VkDevice device, const VkPhysicalDeviceProperties& properties, const std::string& fileName, VkPipelineCache* pipelineCache);
+		/** @brief Serializes the pipeline cache to fileName, writing to a temporary file first and renaming it so that a crash never leaves a truncated cache behind */
+		bool save(VkDevice device, VkPipelineCache pipelineCache, const std::string& fileName);
+		/** @brief Validates a pipeline cache blob against the given device properties */
+		bool validateHeader(const std::vector<char>& data, const VkPipelineCacheHeaderVersionOne& expected, std::string& reason);
+
+		/**
+		* Sets whether pipeline creation feedback may be chained into pipeline create infos
+		*
+		* @note Only enable this if the device uses Vulkan 1.3 or VK_EXT_pipeline_creation_feedback has been enabled on it
+		*/
+		void setFeedbackEnabled(bool enabled);
+		/** @brief True if a feedback create info may be chained into pipeline create infos */
+		bool feedbackEnabled();
+		/** @brief Returns a feedback create info to chain into a pipeline create info (VK_EXT_pipeline_creation_feedback, core in Vulkan 1.3) */
+		VkPipelineCreationFeedbackCreateInfo feedbackCreateInfo(VkPipelineCreationFeedback* pipelineFeedback);
+		/** @brief Records the feedback of a created pipeline, thread safe, does nothing if feedback is not enabled */
+		void recordFeedback(const VkPipelineCreationFeedback& feedback);
+		Statistics getStatistics();
+		void printStatistics();
+	}
+}
@@ -0,0 +1,158 @@
+/*
+* Packed SPIR-V shader archive
+*
+* Read-only access to the single file shader archive written by shaders/compileshaders.py
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#include "VulkanShaderArchive.h"
+#include "VulkanTools.h"
+
+#include <algorithm>
+#include <iostream>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace vks
+{
+	ShaderArchive::~ShaderArchive()
+	{
+		close();
+	}
+
+	uint64_t ShaderArchive::hashName(const std::string& fileName)
+	{
+		const size_t separator = fileName.find_last_of("/\\");
+		const std::string name = separator == std::string::npos ? fileName : fileName.substr(separator + 1);
+		return vks::tools::hashBytes(name.data(), name.size());
+	}
+
+	bool ShaderArchive::open(const std::string& fileName)
+	{
+		close();
+#if defined(_WIN32)
+		HANDLE file = CreateFileA(fileName.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_RANDOM_ACCESS, nullptr);
+		if (file == INVALID_HANDLE_VALUE) {
+			return false;
+		}
+		LARGE_INTEGER fileSize{};
+		GetFileSizeEx(file, &fileSize);
+		HANDLE mapping = fileSize.QuadPart > 0 ? CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr) : nullptr;
+		const void* view = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+		if (!view) {
+			if (mapping) {
+				CloseHandle(mapping);
+			}
+			CloseHandle(file);
+			return false;
+		}
+		fileHandle = file;
+		mappingHandle = mapping;
+		size = static_cast<size_t>(fileSize.QuadPart);
+#else
+		int fd = ::open(fileName.c_str(), O_RDONLY);
+		if (fd < 0) {
+			return false;
+		}
+		struct stat fileStat{};
+		void* view = MAP_FAILED;
+		if (fstat(fd, &fileStat) == 0 && fileStat.st_size > 0) {
+			view = mmap(nullptr, static_cast<size_t>(fileStat.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+		}
+		// The mapping keeps its own reference to the file
+		::close(fd);
+		if (view == MAP_FAILED) {
+			return false;
+		}
+		size = static_cast<size_t>(fileStat.st_size);
+#endif
+		data = static_cast<const uint8_t*>(view);
+
+		std::string reason;
+		if (!validate(reason)) {
+			std::cerr << "Ignoring shader archive \"" << fileName << "\": " << reason << "\n";
+			close();
+			return false;
+		}
+		const Header* header = reinterpret_cast<const Header*>(data);
+		count = header->entryCount;
+		entries = reinterpret_cast<const Entry*>(data + sizeof(Header));
+		std::cout << "Mapped shader archive \"" << fileName << "\" (" << count << " shaders, " << size << " bytes)\n";
+		return true;
+	}
+
+	bool ShaderArchive::validate(std::string& reason) const
+	{
+		if (size < sizeof(Header)) {
+			reason = "file too small";
+			return false;
+		}
+		const Header* header = reinterpret_cast<const Header*>(data);
+		if (header->magic != magic || header->version != version) {
+			reason = "unknown format or version";
+			return false;
+		}
+		if (sizeof(Header) + static_cast<uint64_t>(header->entryCount) * sizeof(Entry) > size) {
+			reason = "entry table out of bounds";
+			return false;
+		}
+		const Entry* table = reinterpret_cast<const Entry*>(data + sizeof(Header));
+		for (uint32_t i = 0; i < header->entryCount; i++) {
+			const Entry& entry = table[i];
+			if (entry.offset > size || entry.size > size - entry.offset || entry.offset % 4 != 0 || entry.size % 4 != 0) {
+				reason = "blob out of bounds";
+				return false;
+			}
+			if (i > 0 && table[i - 1].nameHash > entry.nameHash) {
+				reason = "entry table not sorted";
+				return false;
+			}
+		}
+		return true;
+	}
+
+	void ShaderArchive::close()
+	{
+		if (!data) {
+			return;
+		}
+#if defined(_WIN32)
+		UnmapViewOfFile(data);
+		CloseHandle(static_cast<HANDLE>(mappingHandle));
+		CloseHandle(static_cast<HANDLE>(fileHandle));
+		mappingHandle = nullptr;
+		fileHandle = nullptr;
+#else
+		munmap(const_cast<uint8_t*>(data), size);
+#endif
+		data = nullptr;
+		size = 0;
+		entries = nullptr;
+		count = 0;
+	}
+
+	bool ShaderArchive::find(const std::string& fileName, Blob& blob) const
+	{
+		if (!data) {
+			return false;
+		}
+		const uint64_t nameHash = hashName(fileName);
+		const Entry* end = entries + count;
+		const Entry* it = std::lower_bound(entries, end, nameHash, [](const Entry& entry, uint64_t hash) { return entry.nameHash < hash; });
+		if (it == end || it->nameHash != nameHash) {
+			return false;
+		}
+		blob.code = reinterpret_cast<const uint32_t*>(data + it->offset);
+		blob.size = static_cast<size_t>(it->size);
+		blob.contentHash = it->contentHash;
+		return true;
+	}
+}
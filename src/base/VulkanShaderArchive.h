@@ -0,0 +1,88 @@
+/*
+* Packed SPIR-V shader archive
+*
+* Read-only access to the single file shader archive written by shaders/compileshaders.py
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace vks
+{
+	/**
+	* @brief Memory mapped archive of SPIR-V blobs
+	* @note Layout (little endian): a 16 byte header (magic "SPVA", version, entry count, reserved), followed by the entry table
+	* sorted by name hash and the blobs, each aligned to 16 bytes. Entries store the 64 bit FNV-1a hash of the file name,
+	* the hash of the SPIR-V content (same function as vks::tools::hashBytes), offset and size.
+	* The file is mapped once and lookups return pointers into the mapping, so no code is copied or read through file I/O.
+	*/
+	class ShaderArchive
+	{
+	public:
+		static constexpr uint32_t magic = 0x41565053;	// "SPVA"
+		static constexpr uint32_t version = 1;
+		static constexpr const char* defaultFileName = "shaders.spvpak";
+
+		struct Header {
+			uint32_t magic;
+			uint32_t version;
+			uint32_t entryCount;
+			uint32_t reserved;
+		};
+
+		struct Entry {
+			uint64_t nameHash;
+			uint64_t contentHash;
+			uint64_t offset;
+			uint64_t size;
+		};
+
+		/** @brief Zero-copy view of one SPIR-V blob inside the mapping */
+		struct Blob {
+			const uint32_t* code;
+			size_t size;
+			uint64_t contentHash;
+		};
+
+		ShaderArchive() = default;
+		ShaderArchive(const ShaderArchive&) = delete;
+		ShaderArchive& operator=(const ShaderArchive&) = delete;
+		~ShaderArchive();
+
+		/** @brief Maps the archive, returns false (and stays closed) if the file is missing or malformed */
+		bool open(const std::string& fileName);
+		void close();
+		bool isOpen() const { return data != nullptr; }
+
+		/**
+		* Looks up a shader by file name, only the part after the last path separator is used
+		*
+		* @param fileName File name as passed to loadShader (e.g. ".../pbrtexture.frag.spv")
+		* @param blob View into the mapped file, valid until close()
+		* @return True if the archive contains the shader
+		*/
+		bool find(const std::string& fileName, Blob& blob) const;
+
+		uint32_t entryCount() const { return count; }
+
+		/** @brief Hash used for the entry table, must match the one in compileshaders.py */
+		static uint64_t hashName(const std::string& fileName);
+
+	private:
+		bool validate(std::string& reason) const;
+
+		const uint8_t* data{ nullptr };
+		size_t size{ 0 };
+		const Entry* entries{ nullptr };
+		uint32_t count{ 0 };
+#if defined(_WIN32)
+		void* fileHandle{ nullptr };
+		void* mappingHandle{ nullptr };
+#endif
+	};
+}
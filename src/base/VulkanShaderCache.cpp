@@ -0,0 +1,184 @@
+/*
+* Vulkan shader module cache
+*
+* Shares shader modules by SPIR-V content hash and keeps them alive through reference counting
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#include "VulkanShaderCache.h"
+
+#include <fstream>
+#include <iostream>
+
+#if defined(__ANDROID__)
+#include "VulkanAndroid.h"
+#endif
+
+namespace vks
+{
+	void ShaderModuleCache::init(VkDevice device)
+	{
+		this->device = device;
+	}
+
+	void ShaderModuleCache::setInlineModules(bool enabled)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		// Switching modes with live entries would mix both kinds of stage infos
+		assert(entries.empty());
+		inlineCode = enabled;
+	}
+
+	void ShaderModuleCache::setArchive(const ShaderArchive* archive)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		this->archive = archive;
+	}
+
+	bool ShaderModuleCache::readFile(const std::string& fileName, std::vector<uint32_t>& code)
+	{
+#if defined(__ANDROID__)
+		AAsset* asset = AAssetManager_open(androidApp->activity->assetManager, fileName.c_str(), AASSET_MODE_STREAMING);
+		if (!asset) {
+			return false;
+		}
+		size_t size = AAsset_getLength(asset);
+		code.resize((size + 3) / 4);
+		AAsset_read(asset, code.data(), size);
+		AAsset_close(asset);
+#else
+		std::ifstream is(fileName, std::ios::binary | std::ios::in | std::ios::ate);
+		if (!is.is_open()) {
+			return false;
+		}
+		size_t size = is.tellg();
+		is.seekg(0, std::ios::beg);
+		code.resize((size + 3) / 4);
+		is.read(reinterpret_cast<char*>(code.data()), size);
+#endif
+		// SPIR-V is a stream of 32 bit words
+		return size > 0 && size % 4 == 0;
+	}
+
+	VkPipelineShaderStageCreateInfo ShaderModuleCache::load(const std::string& fileName, VkShaderStageFlagBits stage)
+	{
+		assert(device != VK_NULL_HANDLE);
+		std::lock_guard<std::mutex> lock(mutex);
+		loadCount++;
+
+		Entry* entry = nullptr;
+		auto fileIt = fileHashes.find(fileName);
+		if (fileIt != fileHashes.end()) {
+			entry = entries.at(fileIt->second).get();
+		} else {
+			// Archived shaders are used in place, their content hash is stored in the entry table
+			ShaderArchive::Blob blob{};
+			std::vector<uint32_t> code;
+			if (archive && archive->find(fileName, blob)) {
+				archiveHitCount++;
+			} else {
+				fileReadCount++;
+				if (!readFile(fileName, code)) {
+					vks::tools::exitFatal("Could not load shader file \"" + fileName + "\"", -1);
+				}
+				blob.code = code.data();
+				blob.size = code.size() * sizeof(uint32_t);
+				blob.contentHash = vks::tools::hashBytes(blob.code, blob.size);
+			}
+			const uint64_t hash = blob.contentHash;
+			auto it = entries.find(hash);
+			if (it == entries.end()) {
+				auto newEntry = std::make_unique<Entry>();
+				newEntry->code = std::move(code);
+				newEntry->createInfo = {};
+				newEntry->createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+				newEntry->createInfo.codeSize = blob.size;
+				newEntry->createInfo.pCode = newEntry->code.empty() ? blob.code : newEntry->code.data();
+				newEntry->module = VK_NULL_HANDLE;
+				newEntry->refCount = 0;
+				if (inlineCode) {
+					vks::tools::setShaderCodeHash(newEntry->createInfo.pCode, hash);
+				} else {
+					VK_CHECK_RESULT(vkCreateShaderModule(device, &newEntry->createInfo, nullptr, &newEntry->module));
+					vks::tools::setShaderModuleHash(newEntry->module, hash);
+					// The code is only needed again for inline stages
+					newEntry->code.clear();
+					newEntry->code.shrink_to_fit();
+					newEntry->createInfo.pCode = nullptr;
+				}
+				it = entries.emplace(hash, std::move(newEntry)).first;
+			}
+			fileHashes[fileName] = hash;
+			entry = it->second.get();
+		}
+		entry->refCount++;
+
+		VkPipelineShaderStageCreateInfo shaderStage{};
+		shaderStage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+		shaderStage.stage = stage;
+		shaderStage.pName = "main";
+		if (inlineCode) {
+			shaderStage.pNext = &entry->createInfo;
+		} else {
+			shaderStage.module = entry->module;
+		}
+		return shaderStage;
+	}
+
+	std::unordered_map<uint64_t, std::unique_ptr<ShaderModuleCache::Entry>>::iterator ShaderModuleCache::findEntry(const VkPipelineShaderStageCreateInfo& shaderStage)
+	{
+		for (auto it = entries.begin(); it != entries.end(); ++it) {
+			const Entry& entry = *it->second;
+			if (shaderStage.module != VK_NULL_HANDLE ? entry.module == shaderStage.module : shaderStage.pNext == &entry.createInfo) {
+				return it;
+			}
+		}
+		return entries.end();
+	}
+
+	void ShaderModuleCache::destroyEntry(Entry& entry)
+	{
+		if (entry.module != VK_NULL_HANDLE) {
+			vks::tools::setShaderModuleHash(entry.module, 0);
+			vkDestroyShaderModule(device, entry.module, nullptr);
+		} else {
+			vks::tools::setShaderCodeHash(entry.createInfo.pCode, 0);
+		}
+	}
+
+	void ShaderModuleCache::release(const VkPipelineShaderStageCreateInfo& shaderStage)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		auto it = findEntry(shaderStage);
+		if (it == entries.end()) {
+			return;
+		}
+		assert(it->second->refCount > 0);
+		if (--it->second->refCount > 0) {
+			return;
+		}
+		const uint64_t hash = it->first;
+		destroyEntry(*it->second);
+		entries.erase(it);
+		for (auto fileIt = fileHashes.begin(); fileIt != fileHashes.end();) {
+			fileIt = fileIt->second == hash ? fileHashes.erase(fileIt) : std::next(fileIt);
+		}
+	}
+
+	void ShaderModuleCache::destroy()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		for (auto& [hash, entry] : entries) {
+			destroyEntry(*entry);
+		}
+		entries.clear();
+		fileHashes.clear();
+	}
+
+	ShaderModuleCache::Statistics ShaderModuleCache::getStatistics()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		return { loadCount, fileReadCount, archiveHitCount, static_cast<uint32_t>(entries.size()) };
+	}
+}
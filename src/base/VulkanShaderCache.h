@@ -0,0 +1,87 @@
+/*
+* Vulkan shader module cache
+*
+* Shares shader modules by SPIR-V content hash and keeps them alive through reference counting
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "vulkan/vulkan.h"
+#include "VulkanTools.h"
+#include "VulkanShaderArchive.h"
+
+namespace vks
+{
+	/**
+	* @brief Caches shader modules by a hash of their SPIR-V code
+	* @note Each file is read from disk once, identical SPIR-V loaded through different file names shares one module.
+	* Every load() takes a reference that is dropped again with release(), the module is destroyed with its last reference.
+	* With inline modules enabled (VK_KHR_maintenance5 / Vulkan 1.4) no VkShaderModule objects are created at all,
+	* the returned stage info chains the cached VkShaderModuleCreateInfo through pNext instead.
+	*/
+	class ShaderModuleCache
+	{
+	public:
+		struct Statistics {
+			uint32_t loads;
+			uint32_t fileReads;
+			uint32_t archiveHits;
+			uint32_t modules;
+		};
+
+		void init(VkDevice device);
+		/** @brief Pass shader code inline through the stage info instead of creating modules, requires the maintenance5 feature to be enabled */
+		void setInlineModules(bool enabled);
+		bool inlineModules() const { return inlineCode; }
+		/** @brief Looks shaders up in a mapped archive before falling back to loose files, the archive must outlive the cache entries */
+		void setArchive(const ShaderArchive* archive);
+
+		/**
+		* Returns a shader stage for the SPIR-V file, reading and creating the module only on the first request
+		*
+		* @param fileName Path of the SPIR-V file
+		* @param stage Shader stage the code is used for
+		* @return Shader stage create info, the module (or inline create info) stays valid until the matching release()
+		*/
+		VkPipelineShaderStageCreateInfo load(const std::string& fileName, VkShaderStageFlagBits stage);
+		/** @brief Drops a reference taken by load(), pipelines created from the stage are not affected */
+		void release(const VkPipelineShaderStageCreateInfo& shaderStage);
+		/** @brief Destroys all cached modules regardless of their reference count */
+		void destroy();
+
+		Statistics getStatistics();
+
+	private:
+		struct Entry {
+			// Empty when the code lives in the mapped archive
+			std::vector<uint32_t> code;
+			VkShaderModuleCreateInfo createInfo;
+			VkShaderModule module;
+			uint32_t refCount;
+		};
+
+		bool readFile(const std::string& fileName, std::vector<uint32_t>& code);
+		std::unordered_map<uint64_t, std::unique_ptr<Entry>>::iterator findEntry(const VkPipelineShaderStageCreateInfo& shaderStage);
+		void destroyEntry(Entry& entry);
+
+		VkDevice device{ VK_NULL_HANDLE };
+		bool inlineCode{ false };
+		const ShaderArchive* archive{ nullptr };
+		std::mutex mutex;
+		// File name -> content hash, so repeated loads of the same file skip the disk
+		std::unordered_map<std::string, uint64_t> fileHashes;
+		// Content hash -> module, entries are heap allocated so the inline create infos keep their address
+		std::unordered_map<uint64_t, std::unique_ptr<Entry>> entries;
+		uint32_t loadCount{ 0 };
+		uint32_t fileReadCount{ 0 };
+		uint32_t archiveHitCount{ 0 };
+	};
+}
@@ -10,6 +10,7 @@
 
 #include "VulkanSwapChain.h"
 
+#if !defined(VK_USE_PLATFORM_HEADLESS_EXT)
 /** @brief Creates the platform specific surface abstraction of the native platform window used for presentation */	
 #if defined(VK_USE_PLATFORM_WIN32_KHR)
 void VulkanSwapChain::initSurface(void* platformHandle, void* platformWindow)
@@ -25,7 +26,7 @@ void VulkanSwapChain::initSurface(xcb_connection_t* connection, xcb_window_t win
 void VulkanSwapChain::initSurface(void* view)
 #elif defined(VK_USE_PLATFORM_METAL_EXT)
 void VulkanSwapChain::initSurface(CAMetalLayer* metalLayer)
-#elif (defined(_DIRECT2DISPLAY) || defined(VK_USE_PLATFORM_HEADLESS_EXT))
+#elif defined(_DIRECT2DISPLAY)
 void VulkanSwapChain::initSurface(uint32_t width, uint32_t height)
 #elif defined(VK_USE_PLATFORM_SCREEN_QNX)
 void VulkanSwapChain::initSurface(screen_context_t screen_context, screen_window_t screen_window)
@@ -86,14 +87,6 @@ void VulkanSwapChain::initSurface(screen_context_t screen_context, screen_window
 	surfaceCreateInfo.connection = connection;
 	surfaceCreateInfo.window = window;
 	err = vkCreateXcbSurfaceKHR(instance, &surfaceCreateInfo, nullptr, &surface);
-#elif defined(VK_USE_PLATFORM_HEADLESS_EXT)
-	VkHeadlessSurfaceCreateInfoEXT surfaceCreateInfo = {};
-	surfaceCreateInfo.sType = VK_STRUCTURE_TYPE_HEADLESS_SURFACE_CREATE_INFO_EXT;
-	PFN_vkCreateHeadlessSurfaceEXT fpCreateHeadlessSurfaceEXT = (PFN_vkCreateHeadlessSurfaceEXT)vkGetInstanceProcAddr(instance, "vkCreateHeadlessSurfaceEXT");
-	if (!fpCreateHeadlessSurfaceEXT){
-		vks::tools::exitFatal("Could not fetch function pointer for the headless extension!", -1);
-	}
-	err = fpCreateHeadlessSurfaceEXT(instance, &surfaceCreateInfo, nullptr, &surface);
 #elif defined(VK_USE_PLATFORM_SCREEN_QNX)
 	VkScreenSurfaceCreateInfoQNX surfaceCreateInfo = {};
 	surfaceCreateInfo.sType = VK_STRUCTURE_TYPE_SCREEN_SURFACE_CREATE_INFO_QNX;
@@ -412,6 +405,145 @@ void VulkanSwapChain::cleanup()
 	surface = VK_NULL_HANDLE;
 	swapChain = VK_NULL_HANDLE;
 }
+#else
+/*
+* Headless builds render without a surface or swap chain into offscreen images owned by this class
+* Acquiring an image cycles through them and presenting is a no-op, so frames are only paced by the frame timeline
+* The images end each frame in finalLayout (transfer source), the last one can be copied out e.g. for regression tests
+*/
+
+// Number of offscreen images, same as a typical triple buffered swap chain
+static constexpr uint32_t offscreenImageCount = 3;
+
+void VulkanSwapChain::initSurface(uint32_t width, uint32_t height)
+{
+	// There is nothing to present to, any queue family with graphics support will do
+	uint32_t queueCount;
+	vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueCount, NULL);
+	std::vector<VkQueueFamilyProperties> queueProps(queueCount);
+	vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueCount, queueProps.data());
+	for (uint32_t i = 0; i < queueCount; i++)
+	{
+		if ((queueProps[i].queueFlags & VK_QUEUE_GRAPHICS_BIT) != 0)
+		{
+			queueNodeIndex = i;
+			break;
+		}
+	}
+	if (queueNodeIndex == UINT32_MAX)
+	{
+		vks::tools::exitFatal("Could not find a graphics queue!", -1);
+	}
+
+	// Same preference as for surface formats, the images are rendered to and copied from
+	const std::vector<VkFormat> preferredImageFormats = {
+		VK_FORMAT_B8G8R8A8_UNORM,
+		VK_FORMAT_R8G8B8A8_UNORM,
+	};
+	const VkFormatFeatureFlags requiredFeatures = VK_FORMAT_FEATURE_COLOR_ATTACHMENT_BIT | VK_FORMAT_FEATURE_TRANSFER_SRC_BIT;
+	colorFormat = VK_FORMAT_UNDEFINED;
+	for (VkFormat format : preferredImageFormats) {
+		VkFormatProperties formatProperties;
+		vkGetPhysicalDeviceFormatProperties(physicalDevice, format, &formatProperties);
+		if ((formatProperties.optimalTilingFeatures & requiredFeatures) == requiredFeatures) {
+			colorFormat = format;
+			break;
+		}
+	}
+	if (colorFormat == VK_FORMAT_UNDEFINED) {
+		vks::tools::exitFatal("Could not find a color format for offscreen rendering!", -1);
+	}
+	colorSpace = VK_COLOR_SPACE_SRGB_NONLINEAR_KHR;
+	finalLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+}
+
+void VulkanSwapChain::create(uint32_t& width, uint32_t& height, bool vsync, bool fullscreen)
+{
+	assert(physicalDevice);
+	assert(device);
+
+	// Unlike a swap chain there is nothing to hand over, images from a previous call are simply replaced
+	cleanup();
+
+	VkPhysicalDeviceMemoryProperties memoryProperties;
+	vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties);
+
+	imageCount = offscreenImageCount;
+	images.resize(imageCount);
+	imageViews.resize(imageCount);
+	imageMemory.resize(imageCount);
+	for (uint32_t i = 0; i < imageCount; i++)
+	{
+		VkImageCreateInfo imageCI{ VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO };
+		imageCI.imageType = VK_IMAGE_TYPE_2D;
+		imageCI.format = colorFormat;
+		imageCI.extent = { width, height, 1 };
+		imageCI.mipLevels = 1;
+		imageCI.arrayLayers = 1;
+		imageCI.samples = VK_SAMPLE_COUNT_1_BIT;
+		imageCI.tiling = VK_IMAGE_TILING_OPTIMAL;
+		imageCI.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+		imageCI.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+		imageCI.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		VK_CHECK_RESULT(vkCreateImage(device, &imageCI, nullptr, &images[i]));
+
+		// Prefer device local memory, CPU implementations may only offer host visible types
+		VkMemoryRequirements memReqs;
+		vkGetImageMemoryRequirements(device, images[i], &memReqs);
+		uint32_t memoryTypeIndex = UINT32_MAX;
+		for (uint32_t type = 0; type < memoryProperties.memoryTypeCount; type++)
+		{
+			if ((memReqs.memoryTypeBits & (1u << type)) == 0) {
+				continue;
+			}
+			if (memoryTypeIndex == UINT32_MAX) {
+				memoryTypeIndex = type;
+			}
+			if (memoryProperties.memoryTypes[type].propertyFlags & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT) {
+				memoryTypeIndex = type;
+				break;
+			}
+		}
+		VkMemoryAllocateInfo memAllocInfo{ VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO };
+		memAllocInfo.allocationSize = memReqs.size;
+		memAllocInfo.memoryTypeIndex = memoryTypeIndex;
+		VK_CHECK_RESULT(vkAllocateMemory(device, &memAllocInfo, nullptr, &imageMemory[i]));
+		VK_CHECK_RESULT(vkBindImageMemory(device, images[i], imageMemory[i], 0));
+
+		VkImageViewCreateInfo colorAttachmentView{ VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO };
+		colorAttachmentView.viewType = VK_IMAGE_VIEW_TYPE_2D;
+		colorAttachmentView.format = colorFormat;
+		colorAttachmentView.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+		colorAttachmentView.image = images[i];
+		VK_CHECK_RESULT(vkCreateImageView(device, &colorAttachmentView, nullptr, &imageViews[i]));
+	}
+}
+
+VkResult VulkanSwapChain::acquireNextImage(VkSemaphore presentCompleteSemaphore, uint32_t& imageIndex)
+{
+	// There is no presentation engine to wait for. With more frames in flight than images an earlier frame may still be
+	// copying from the image for readback, the frame graph imports it with the transfer stage in the first barrier's source scope
+	imageIndex = (imageIndex + 1) % imageCount;
+	return VK_SUCCESS;
+}
+
+VkResult VulkanSwapChain::queuePresent(VkQueue queue, uint32_t imageIndex, VkSemaphore waitSemaphore)
+{
+	return VK_SUCCESS;
+}
+
+void VulkanSwapChain::cleanup()
+{
+	for (uint32_t i = 0; i < images.size(); i++) {
+		vkDestroyImageView(device, imageViews[i], nullptr);
+		vkDestroyImage(device, images[i], nullptr);
+		vkFreeMemory(device, imageMemory[i], nullptr);
+	}
+	images.clear();
+	imageViews.clear();
+	imageMemory.clear();
+}
+#endif
 
 #if defined(_DIRECT2DISPLAY)
 /**
@@ -34,6 +34,10 @@ private:
 	VkDevice device{ VK_NULL_HANDLE };
 	VkPhysicalDevice physicalDevice{ VK_NULL_HANDLE };
 	VkSurfaceKHR surface{ VK_NULL_HANDLE };
+#if defined(VK_USE_PLATFORM_HEADLESS_EXT)
+	// Headless builds have no surface, the "swap chain" is a set of offscreen images owned by this class
+	std::vector<VkDeviceMemory> imageMemory{};
+#endif
 public:
 	VkFormat colorFormat{};
 	VkColorSpaceKHR colorSpace{};
@@ -42,6 +46,8 @@ public:
 	std::vector<VkImageView> imageViews{};
 	uint32_t queueNodeIndex{ UINT32_MAX };
 	uint32_t imageCount{ 0 };
+	/** @brief Layout the images have to be in at the end of a frame (offscreen images are left as transfer source for reading them back) */
+	VkImageLayout finalLayout{ VK_IMAGE_LAYOUT_PRESENT_SRC_KHR };
 
 #if defined(VK_USE_PLATFORM_WIN32_KHR)
 	void initSurface(void* platformHandle, void* platformWindow);
@@ -82,6 +88,7 @@ public:
 	* @param imageIndex Pointer to the image index that will be increased if the next image could be acquired
 	* 
 	* @note The function will always wait until the next image has been acquired by setting timeout to UINT64_MAX
+	* @note Headless builds cycle through the offscreen images and do not signal the semaphore
 	* 
 	* @return VkResult of the image acquisition
 	*/
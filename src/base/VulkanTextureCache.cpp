@@ -0,0 +1,254 @@
+/*
+* Persistent texture cache helpers
+*
+* Stores GPU generated images as KTX files so they can be loaded with vks::Texture2D / vks::TextureCubeMap on later runs
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#include "VulkanTextureCache.h"
+#include "VulkanBuffer.h"
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+namespace vks
+{
+	namespace texturecache
+	{
+		namespace
+		{
+			const uint8_t ktxIdentifier[12] = { 0xAB, 0x4B, 0x54, 0x58, 0x20, 0x31, 0x31, 0xBB, 0x0D, 0x0A, 0x1A, 0x0A };
+			const uint32_t ktxEndianness = 0x04030201;
+
+			// KTX 1 header following the identifier, all fields are 32 bit
+			struct KTXHeader {
+				uint32_t endianness;
+				uint32_t glType;
+				uint32_t glTypeSize;
+				uint32_t glFormat;
+				uint32_t glInternalFormat;
+				uint32_t glBaseInternalFormat;
+				uint32_t pixelWidth;
+				uint32_t pixelHeight;
+				uint32_t pixelDepth;
+				uint32_t numberOfArrayElements;
+				uint32_t numberOfFaces;
+				uint32_t numberOfMipmapLevels;
+				uint32_t bytesOfKeyValueData;
+			};
+
+			// OpenGL enums used by KTX 1 for the supported formats
+			bool glFormatInfo(VkFormat format, KTXHeader& header)
+			{
+				const uint32_t GL_UNSIGNED_BYTE = 0x1401;
+				const uint32_t GL_HALF_FLOAT = 0x140B;
+				const uint32_t GL_FLOAT = 0x1406;
+				const uint32_t GL_RG = 0x8227;
+				const uint32_t GL_RGBA = 0x1908;
+				switch (format) {
+				case VK_FORMAT_R8G8B8A8_UNORM:
+					header.glType = GL_UNSIGNED_BYTE;
+					header.glTypeSize = 1;
+					header.glFormat = GL_RGBA;
+					header.glInternalFormat = 0x8058;	// GL_RGBA8
+					break;
+				case VK_FORMAT_R8G8B8A8_SRGB:
+					header.glType = GL_UNSIGNED_BYTE;
+					header.glTypeSize = 1;
+					header.glFormat = GL_RGBA;
+					header.glInternalFormat = 0x8C43;	// GL_SRGB8_ALPHA8
+					break;
+				case VK_FORMAT_R16G16_SFLOAT:
+					header.glType = GL_HALF_FLOAT;
+					header.glTypeSize = 2;
+					header.glFormat = GL_RG;
+					header.glInternalFormat = 0x822F;	// GL_RG16F
+					break;
+				case VK_FORMAT_R16G16B16A16_SFLOAT:
+					header.glType = GL_HALF_FLOAT;
+					header.glTypeSize = 2;
+					header.glFormat = GL_RGBA;
+					header.glInternalFormat = 0x881A;	// GL_RGBA16F
+					break;
+				case VK_FORMAT_R32G32B32A32_SFLOAT:
+					header.glType = GL_FLOAT;
+					header.glTypeSize = 4;
+					header.glFormat = GL_RGBA;
+					header.glInternalFormat = 0x8814;	// GL_RGBA32F
+					break;
+				default:
+					return false;
+				}
+				header.glBaseInternalFormat = header.glFormat;
+				return true;
+			}
+
+			VkDeviceSize levelSize(const ImageInfo& info, uint32_t level)
+			{
+				return static_cast<VkDeviceSize>(std::max(1u, info.width >> level)) * std::max(1u, info.height >> level) * formatSize(info.format);
+			}
+
+			VkDeviceSize imageSize(const ImageInfo& info)
+			{
+				VkDeviceSize size = 0;
+				for (uint32_t level = 0; level < info.mipLevels; level++) {
+					size += levelSize(info, level) * info.faces;
+				}
+				return size;
+			}
+
+			KTXHeader makeHeader(const ImageInfo& info)
+			{
+				KTXHeader header{};
+				glFormatInfo(info.format, header);
+				header.endianness = ktxEndianness;
+				header.pixelWidth = info.width;
+				header.pixelHeight = info.height;
+				header.numberOfFaces = info.faces;
+				header.numberOfMipmapLevels = info.mipLevels;
+				return header;
+			}
+		}
+
+		std::string fileName(const std::string& directory, const std::string& name, uint64_t key)
+		{
+			std::stringstream ss;
+			ss << directory << "/" << name << "_" << std::hex << std::setw(16) << std::setfill('0') << key << ".ktx";
+			return ss.str();
+		}
+
+		uint32_t formatSize(VkFormat format)
+		{
+			switch (format) {
+			case VK_FORMAT_R8G8B8A8_UNORM:
+			case VK_FORMAT_R8G8B8A8_SRGB:
+			case VK_FORMAT_R16G16_SFLOAT:
+				return 4;
+			case VK_FORMAT_R16G16B16A16_SFLOAT:
+				return 8;
+			case VK_FORMAT_R32G32B32A32_SFLOAT:
+				return 16;
+			default:
+				return 0;
+			}
+		}
+
+		bool isValid(const std::string& fileName, const ImageInfo& info)
+		{
+			std::ifstream is(fileName, std::ios::binary | std::ios::ate);
+			if (!is.is_open()) {
+				return false;
+			}
+			const size_t fileSize = static_cast<size_t>(is.tellg());
+			is.seekg(0, std::ios::beg);
+			uint8_t identifier[sizeof(ktxIdentifier)]{};
+			KTXHeader header{};
+			is.read(reinterpret_cast<char*>(identifier), sizeof(identifier));
+			is.read(reinterpret_cast<char*>(&header), sizeof(header));
+			if (!is.good() || memcmp(identifier, ktxIdentifier, sizeof(ktxIdentifier)) != 0) {
+				return false;
+			}
+			const KTXHeader expected = makeHeader(info);
+			if (memcmp(&header, &expected, sizeof(KTXHeader)) != 0) {
+				return false;
+			}
+			// Every mip level is preceded by its 32 bit image size
+			const VkDeviceSize expectedSize = sizeof(ktxIdentifier) + sizeof(KTXHeader) + info.mipLevels * sizeof(uint32_t) + imageSize(info);
+			return fileSize == expectedSize;
+		}
+
+		void readImage(vks::VulkanDevice* device, VkQueue queue, VkImage image, VkImageLayout imageLayout, const ImageInfo& info, std::vector<uint8_t>& data)
+		{
+			const VkDeviceSize size = imageSize(info);
+			vks::Buffer stagingBuffer;
+			VK_CHECK_RESULT(device->createBuffer(VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &stagingBuffer, size));
+
+			// One region per mip level, the faces of a level are written back to back
+			std::vector<VkBufferImageCopy> regions(info.mipLevels);
+			VkDeviceSize offset = 0;
+			for (uint32_t level = 0; level < info.mipLevels; level++) {
+				VkBufferImageCopy& region = regions[level];
+				region.bufferOffset = offset;
+				region.imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, level, 0, info.faces };
+				region.imageExtent = { std::max(1u, info.width >> level), std::max(1u, info.height >> level), 1 };
+				offset += levelSize(info, level) * info.faces;
+			}
+
+			VkImageSubresourceRange subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, info.mipLevels, 0, info.faces };
+			VkCommandBuffer copyCmd = device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+			vks::tools::setImageLayout(copyCmd, image, imageLayout, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, subresourceRange);
+			vkCmdCopyImageToBuffer(copyCmd, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, stagingBuffer.buffer, static_cast<uint32_t>(regions.size()), regions.data());
+			vks::tools::setImageLayout(copyCmd, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, imageLayout, subresourceRange);
+			device->flushCommandBuffer(copyCmd, queue);
+
+			VK_CHECK_RESULT(stagingBuffer.map());
+			data.resize(static_cast<size_t>(size));
+			memcpy(data.data(), stagingBuffer.mapped, data.size());
+			stagingBuffer.destroy();
+		}
+
+		bool writeKTX(const std::string& fileName, const ImageInfo& info, const std::vector<uint8_t>& data)
+		{
+			KTXHeader header{};
+			if (!glFormatInfo(info.format, header) || data.size() != imageSize(info)) {
+				std::cerr << "Could not write \"" << fileName << "\": unsupported format or size mismatch\n";
+				return false;
+			}
+			header = makeHeader(info);
+
+			const std::string tempFileName = fileName + ".tmp";
+			{
+				std::ofstream os(tempFileName, std::ios::binary | std::ios::trunc);
+				if (!os.is_open()) {
+					std::cerr << "Could not write \"" << tempFileName << "\"\n";
+					return false;
+				}
+				os.write(reinterpret_cast<const char*>(ktxIdentifier), sizeof(ktxIdentifier));
+				os.write(reinterpret_cast<const char*>(&header), sizeof(header));
+				// All supported formats have rows that are a multiple of 4 bytes, so KTX needs no row, face or level padding
+				size_t offset = 0;
+				for (uint32_t level = 0; level < info.mipLevels; level++) {
+					const VkDeviceSize faceSize = levelSize(info, level);
+					// For non-array cube maps the image size is the size of a single face
+					const uint32_t ktxImageSize = static_cast<uint32_t>(info.faces == 6 ? faceSize : faceSize * info.faces);
+					os.write(reinterpret_cast<const char*>(&ktxImageSize), sizeof(ktxImageSize));
+					os.write(reinterpret_cast<const char*>(data.data() + offset), static_cast<std::streamsize>(faceSize * info.faces));
+					offset += static_cast<size_t>(faceSize * info.faces);
+				}
+				if (!os.good()) {
+					std::cerr << "Could not write \"" << tempFileName << "\"\n";
+					return false;
+				}
+			}
+			std::error_code ec;
+			std::filesystem::rename(tempFileName, fileName, ec);
+			if (ec) {
+				std::cerr << "Could not replace \"" << fileName << "\": " << ec.message() << "\n";
+				std::filesystem::remove(tempFileName, ec);
+				return false;
+			}
+			return true;
+		}
+
+		bool save(const std::string& fileName, vks::VulkanDevice* device, VkQueue queue, VkImage image, VkImageLayout imageLayout, const ImageInfo& info)
+		{
+			if (formatSize(info.format) == 0) {
+				return false;
+			}
+			std::error_code ec;
+			const std::filesystem::path directory = std::filesystem::path(fileName).parent_path();
+			if (!directory.empty()) {
+				std::filesystem::create_directories(directory, ec);
+			}
+			std::vector<uint8_t> data;
+			readImage(device, queue, image, imageLayout, info, data);
+			return writeKTX(fileName, info, data);
+		}
+	}
+}
@@ -0,0 +1,57 @@
+/*
+* Persistent texture cache helpers
+*
+* Stores GPU generated images as KTX files so they can be loaded with vks::Texture2D / vks::TextureCubeMap on later runs
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "vulkan/vulkan.h"
+#include "VulkanDevice.h"
+#include "VulkanTools.h"
+
+namespace vks
+{
+	namespace texturecache
+	{
+		/** @brief Dimensions and format of a cached image, faces is 6 for cube maps and 1 otherwise */
+		struct ImageInfo {
+			VkFormat format;
+			uint32_t width;
+			uint32_t height;
+			uint32_t faces;
+			uint32_t mipLevels;
+		};
+
+		/** @brief Builds the cache file name for a named image, the key is part of the name so stale entries are never picked up */
+		std::string fileName(const std::string& directory, const std::string& name, uint64_t key);
+		/** @brief Returns the size of one texel, 0 for formats the KTX writer does not support */
+		uint32_t formatSize(VkFormat format);
+
+		/**
+		* Checks that a cached KTX file exists and matches the expected image
+		*
+		* @note Only the header and the total file size are checked, this is enough to reject files from older generators and truncated writes
+		*/
+		bool isValid(const std::string& fileName, const ImageInfo& info);
+
+		/**
+		* Copies all mip levels and faces of an image back to the host
+		*
+		* @param imageLayout Layout the image is in, it is restored after the copy
+		* @param data Tightly packed texels, mip level by mip level with the faces of each level stored consecutively (KTX order)
+		*/
+		void readImage(vks::VulkanDevice* device, VkQueue queue, VkImage image, VkImageLayout imageLayout, const ImageInfo& info, std::vector<uint8_t>& data);
+
+		/** @brief Writes image data as a KTX 1 file, writing to a temporary file first and renaming it so that a crash never leaves a truncated file behind */
+		bool writeKTX(const std::string& fileName, const ImageInfo& info, const std::vector<uint8_t>& data);
+
+		/** @brief Reads the image back (see readImage) and stores it with writeKTX, the image must have been created with VK_IMAGE_USAGE_TRANSFER_SRC_BIT */
+		bool save(const std::string& fileName, vks::VulkanDevice* device, VkQueue queue, VkImage image, VkImageLayout imageLayout, const ImageInfo& info);
+	}
+}
@@ -7,6 +7,8 @@
  */
 
 #include "VulkanTools.h"
+#include <mutex>
+#include <unordered_map>
 
 #if !(defined(VK_USE_PLATFORM_IOS_MVK) || defined(VK_USE_PLATFORM_MACOS_MVK) || defined(VK_USE_PLATFORM_METAL_EXT))
 // iOS & macOS: getAssetPath() and getShaderBasePath() implemented externally for access to Obj-C++ path utilities
@@ -399,6 +401,7 @@ namespace vks
 				moduleCreateInfo.pCode = (uint32_t*)shaderCode;
 
 				VK_CHECK_RESULT(vkCreateShaderModule(device, &moduleCreateInfo, NULL, &shaderModule));
+				setShaderModuleHash(shaderModule, hashBytes(shaderCode, size));
 
 				delete[] shaderCode;
 
@@ -418,6 +421,70 @@ namespace vks
 			return !f.fail();
 		}
 
+		uint64_t hashBytes(const void* data, size_t size, uint64_t seed)
+		{
+			const uint8_t* bytes = static_cast<const uint8_t*>(data);
+			uint64_t hash = seed;
+			for (size_t i = 0; i < size; i++) {
+				hash ^= bytes[i];
+				hash *= 0x100000001b3ull;
+			}
+			return hash;
+		}
+
+		namespace
+		{
+			std::mutex shaderModuleHashMutex;
+			std::unordered_map<VkShaderModule, uint64_t> shaderModuleHashes;
+			std::unordered_map<const uint32_t*, uint64_t> shaderCodeHashes;
+		}
+
+		uint64_t getShaderModuleHash(VkShaderModule shaderModule)
+		{
+			std::lock_guard<std::mutex> lock(shaderModuleHashMutex);
+			auto it = shaderModuleHashes.find(shaderModule);
+			return it != shaderModuleHashes.end() ? it->second : 0;
+		}
+
+		void setShaderModuleHash(VkShaderModule shaderModule, uint64_t hash)
+		{
+			std::lock_guard<std::mutex> lock(shaderModuleHashMutex);
+			if (hash == 0) {
+				shaderModuleHashes.erase(shaderModule);
+			} else {
+				shaderModuleHashes[shaderModule] = hash;
+			}
+		}
+
+		void setShaderCodeHash(const uint32_t* code, uint64_t hash)
+		{
+			std::lock_guard<std::mutex> lock(shaderModuleHashMutex);
+			if (hash == 0) {
+				shaderCodeHashes.erase(code);
+			} else {
+				shaderCodeHashes[code] = hash;
+			}
+		}
+
+		uint64_t getShaderStageHash(const VkPipelineShaderStageCreateInfo& shaderStage)
+		{
+			if (shaderStage.module != VK_NULL_HANDLE) {
+				return getShaderModuleHash(shaderStage.module);
+			}
+			// Inline code is chained as VkShaderModuleCreateInfo
+			const VkBaseInStructure* next = static_cast<const VkBaseInStructure*>(shaderStage.pNext);
+			while (next && next->sType != VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO) {
+				next = next->pNext;
+			}
+			if (!next) {
+				return 0;
+			}
+			const VkShaderModuleCreateInfo* moduleCI = reinterpret_cast<const VkShaderModuleCreateInfo*>(next);
+			std::lock_guard<std::mutex> lock(shaderModuleHashMutex);
+			auto it = shaderCodeHashes.find(moduleCI->pCode);
+			return it != shaderCodeHashes.end() ? it->second : 0;
+		}
+
 		uint32_t alignedSize(uint32_t value, uint32_t alignment)
         {
 	        return (value + alignment - 1) & ~(alignment - 1);
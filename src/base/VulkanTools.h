@@ -138,6 +138,17 @@ namespace vks
 		/** @brief Checks if a file exists */
 		bool fileExists(const std::string &filename);
 
+		/** @brief 64 bit FNV-1a hash, pass the previous result as seed to hash several blocks */
+		uint64_t hashBytes(const void* data, size_t size, uint64_t seed = 0xcbf29ce484222325ull);
+		/** @brief Returns the SPIR-V content hash recorded when the module was created by loadShader, 0 for unknown modules */
+		uint64_t getShaderModuleHash(VkShaderModule shaderModule);
+		/** @brief Records the SPIR-V content hash of a shader module (thread safe), a hash of 0 forgets the module */
+		void setShaderModuleHash(VkShaderModule shaderModule, uint64_t hash);
+		/** @brief Records the content hash of SPIR-V code passed inline through VkShaderModuleCreateInfo (maintenance5), a hash of 0 forgets the code */
+		void setShaderCodeHash(const uint32_t* code, uint64_t hash);
+		/** @brief Returns the content hash of a shader stage's module or inline code, 0 if unknown */
+		uint64_t getShaderStageHash(const VkPipelineShaderStageCreateInfo& shaderStage);
+
 		uint32_t alignedSize(uint32_t value, uint32_t alignment);
 		VkDeviceSize alignedVkSize(VkDeviceSize value, VkDeviceSize alignment);
 	}
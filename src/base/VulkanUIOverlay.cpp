@@ -8,6 +8,7 @@
 */
 
 #include "VulkanUIOverlay.h"
+#include "VulkanPipelineCache.h"
 
 namespace vks 
 {
@@ -273,7 +274,7 @@ namespace vks
 			pipelineRenderingCreateInfo.colorAttachmentCount = 1;
 			pipelineRenderingCreateInfo.pColorAttachmentFormats = &colorFormat;
 			pipelineRenderingCreateInfo.depthAttachmentFormat = depthFormat;
-			pipelineRenderingCreateInfo.stencilAttachmentFormat = depthFormat;
+			pipelineRenderingCreateInfo.stencilAttachmentFormat = vks::tools::formatHasStencil(depthFormat) ? depthFormat : VK_FORMAT_UNDEFINED;
 			pipelineCreateInfo.pNext = &pipelineRenderingCreateInfo;
 		}
 #endif
@@ -295,7 +296,16 @@ namespace vks
 
 		pipelineCreateInfo.pVertexInputState = &vertexInputState;
 
+		// Report whether the pipeline was served from the pipeline cache
+		VkPipelineCreationFeedback pipelineFeedback{};
+		VkPipelineCreationFeedbackCreateInfo pipelineFeedbackCreateInfo = vks::pipelinecache::feedbackCreateInfo(&pipelineFeedback);
+		if (vks::pipelinecache::feedbackEnabled()) {
+			pipelineFeedbackCreateInfo.pNext = pipelineCreateInfo.pNext;
+			pipelineCreateInfo.pNext = &pipelineFeedbackCreateInfo;
+		}
+
 		VK_CHECK_RESULT(vkCreateGraphicsPipelines(device->logicalDevice, pipelineCache, 1, &pipelineCreateInfo, nullptr, &pipeline));
+		vks::pipelinecache::recordFeedback(pipelineFeedback);
 	}
 
 	/** Update vertex and index buffer containing the imGui elements when required */
@@ -23,8 +23,10 @@
 #include "VulkanDevice.h"
 
 #include "../external/imgui/imgui.h"
+#if defined(_WIN32)
 #include "imgui_impl_win32.h"
 extern IMGUI_IMPL_API LRESULT ImGui_ImplWin32_WndProcHandler(HWND hWnd, UINT msg, WPARAM wParam, LPARAM lParam);
+#endif
 
 #if defined(__ANDROID__)
 #include "VulkanAndroid.h"
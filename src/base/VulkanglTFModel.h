@@ -22,6 +22,7 @@
 
 #include "vulkan/vulkan.h"
 #include "VulkanDevice.h"
+#include "VulkanDescriptorAllocator.h"
 
 #include <ktx.h>
 #include <ktxvulkan.h>
@@ -97,9 +98,13 @@ namespace vkglTF
 		vkglTF::Texture* diffuseTexture;
 
 		VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+		/** @brief Index into an application-side material table, pushed per primitive with RenderFlags::PushMaterialIndex. UINT32_MAX until the material has been registered (matches BindlessTable::invalidIndex) */
+		uint32_t index = UINT32_MAX;
+		/** @brief Application-selected pipeline for this material (e.g. a shader permutation), bound per primitive with RenderFlags::BindMaterialPipelines */
+		VkPipeline pipeline = VK_NULL_HANDLE;
 
 		Material(vks::VulkanDevice* device) : device(device) {};
-		void createDescriptorSet(VkDescriptorPool descriptorPool, VkDescriptorSetLayout descriptorSetLayout, uint32_t descriptorBindingFlags);
+		void createDescriptorSet(vks::DescriptorAllocator& descriptorAllocator, VkDescriptorSetLayout descriptorSetLayout, uint32_t descriptorBindingFlags);
 	};
 
 	/*
@@ -248,7 +253,9 @@ namespace vkglTF
 		BindImages = 0x00000001,
 		RenderOpaqueNodes = 0x00000002,
 		RenderAlphaMaskedNodes = 0x00000004,
-		RenderAlphaBlendedNodes = 0x00000008
+		RenderAlphaBlendedNodes = 0x00000008,
+		PushMaterialIndex = 0x00000010,
+		BindMaterialPipelines = 0x00000020
 	};
 
 	/*
@@ -259,9 +266,11 @@ namespace vkglTF
 		vkglTF::Texture* getTexture(uint32_t index);
 		vkglTF::Texture emptyTexture;
 		void createEmptyTexture(VkQueue transferQueue);
+		void buildDrawList(Node* node);
+		void drawPrimitive(Primitive* primitive, VkCommandBuffer commandBuffer, uint32_t renderFlags, VkPipelineLayout pipelineLayout, uint32_t bindImageSet, VkPipeline& boundPipeline);
 	public:
 		vks::VulkanDevice* device;
-		VkDescriptorPool descriptorPool;
+		vks::DescriptorAllocator descriptorAllocator;
 
 		struct Vertices {
 			int count;
@@ -276,6 +285,8 @@ namespace vkglTF
 
 		std::vector<Node*> nodes;
 		std::vector<Node*> linearNodes;
+		// All mesh primitives in the order draw() renders them, lets callers split the draws into ranges (see drawRange)
+		std::vector<Primitive*> drawList;
 
 		std::vector<Skin*> skins;
 
@@ -293,6 +304,8 @@ namespace vkglTF
 
 		bool metallicRoughnessWorkflow = true;
 		bool buffersBound = false;
+		// Last pipeline bound by RenderFlags::BindMaterialPipelines during the current draw()
+		VkPipeline boundPipeline = VK_NULL_HANDLE;
 		std::string path;
 
 		Model() {};
@@ -306,6 +319,12 @@ namespace vkglTF
 		void bindBuffers(VkCommandBuffer commandBuffer);
 		void drawNode(Node* node, VkCommandBuffer commandBuffer, uint32_t renderFlags = 0, VkPipelineLayout pipelineLayout = VK_NULL_HANDLE, uint32_t bindImageSet = 1);
 		void draw(VkCommandBuffer commandBuffer, uint32_t renderFlags = 0, VkPipelineLayout pipelineLayout = VK_NULL_HANDLE, uint32_t bindImageSet = 1);
+		/**
+		* Draws drawList[first, first + count), always binding the vertex and index buffers
+		*
+		* @note Does not touch any model state, so disjoint ranges can be recorded into different command buffers on different threads
+		*/
+		void drawRange(VkCommandBuffer commandBuffer, uint32_t first, uint32_t count, uint32_t renderFlags = 0, VkPipelineLayout pipelineLayout = VK_NULL_HANDLE, uint32_t bindImageSet = 1);
 		void getNodeDimensions(Node* node, glm::vec3& min, glm::vec3& max);
 		void getSceneDimensions();
 		void updateAnimation(uint32_t index, float time);
@@ -25,7 +25,12 @@ std::vector<const char*> VulkanEngineBase::args;
 
 VkResult VulkanEngineBase::createInstance()
 {
+#if defined(VK_USE_PLATFORM_HEADLESS_EXT)
+	// Headless builds render into offscreen images and need no surface extensions
+	std::vector<const char*> instanceExtensions;
+#else
 	std::vector<const char*> instanceExtensions = { VK_KHR_SURFACE_EXTENSION_NAME };
+#endif
 
 	// Enable surface extensions depending on os
 #if defined(_WIN32)
@@ -46,8 +51,6 @@ VkResult VulkanEngineBase::createInstance()
 	instanceExtensions.push_back(VK_MVK_MACOS_SURFACE_EXTENSION_NAME);
 #elif defined(VK_USE_PLATFORM_METAL_EXT)
 	instanceExtensions.push_back(VK_EXT_METAL_SURFACE_EXTENSION_NAME);
-#elif defined(VK_USE_PLATFORM_HEADLESS_EXT)
-	instanceExtensions.push_back(VK_EXT_HEADLESS_SURFACE_EXTENSION_NAME);
 #elif defined(VK_USE_PLATFORM_SCREEN_QNX)
 	instanceExtensions.push_back(VK_QNX_SCREEN_SURFACE_EXTENSION_NAME);
 #endif
@@ -89,11 +92,23 @@ VkResult VulkanEngineBase::createInstance()
 		}
 	}
 
-	// Shaders generated by Slang require a certain SPIR-V environment that can't be satisfied by Vulkan 1.0, so we need to expliclity up that to at least 1.1 and enable some required extensions
+	// Frame synchronization uses a timeline semaphore and the Vulkan 1.1/1.2 feature structures, so Vulkan 1.2 is the minimum
+	// vkEnumerateInstanceVersion is missing from Vulkan 1.0 loaders
+	uint32_t instanceVersion = VK_API_VERSION_1_0;
+	PFN_vkEnumerateInstanceVersion enumerateInstanceVersion = reinterpret_cast<PFN_vkEnumerateInstanceVersion>(vkGetInstanceProcAddr(nullptr, "vkEnumerateInstanceVersion"));
+	if (enumerateInstanceVersion) {
+		enumerateInstanceVersion(&instanceVersion);
+	}
+	if (instanceVersion < VK_API_VERSION_1_2) {
+		vks::tools::exitFatal("Vulkan 1.2 is required, the installed Vulkan loader only supports " + std::to_string(VK_API_VERSION_MAJOR(instanceVersion)) + "." + std::to_string(VK_API_VERSION_MINOR(instanceVersion)), -1);
+		return VK_ERROR_INCOMPATIBLE_DRIVER;
+	}
+	if (apiVersion < VK_API_VERSION_1_2) {
+		apiVersion = VK_API_VERSION_1_2;
+	}
+
+	// Shaders generated by Slang require a certain SPIR-V environment that can't be satisfied by Vulkan 1.0, so we need to enable some required extensions
 	if (shaderType == "slang") {
-		if (apiVersion < VK_API_VERSION_1_1) {
-			apiVersion = VK_API_VERSION_1_1;
-		}
 		enabledDeviceExtensions.push_back(VK_KHR_SPIRV_1_4_EXTENSION_NAME);
 		enabledDeviceExtensions.push_back(VK_KHR_SHADER_FLOAT_CONTROLS_EXTENSION_NAME);
 	}
@@ -190,6 +205,7 @@ std::string VulkanEngineBase::getWindowTitle() const
 
 void VulkanEngineBase::createCommandBuffers()
 {
+	drawCmdBuffers.resize(maxConcurrentFrames);
 	VkCommandBufferAllocateInfo cmdBufAllocateInfo = vks::initializers::commandBufferAllocateInfo(cmdPool, VK_COMMAND_BUFFER_LEVEL_PRIMARY, static_cast<uint32_t>(drawCmdBuffers.size()));
 	VK_CHECK_RESULT(vkAllocateCommandBuffers(device, &cmdBufAllocateInfo, drawCmdBuffers.data()));
 }
@@ -207,9 +223,8 @@ std::string VulkanEngineBase::getShadersPath() const
 
 void VulkanEngineBase::createPipelineCache()
 {
-	VkPipelineCacheCreateInfo pipelineCacheCreateInfo = {};
-	pipelineCacheCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
-	VK_CHECK_RESULT(vkCreatePipelineCache(device, &pipelineCacheCreateInfo, nullptr, &pipelineCache));
+	// Seed the cache from the previous run so pipelines don't have to be compiled from scratch on every start
+	vks::pipelinecache::create(device, deviceProperties, pipelineCacheFile, &pipelineCache);
 }
 
 void VulkanEngineBase::prepare()
@@ -220,9 +235,22 @@ void VulkanEngineBase::prepare()
 	createCommandBuffers();
 	createSynchronizationPrimitives();
 	setupDepthStencil();
-	setupRenderPass();
+	// With dynamic rendering the attachments are passed when recording, so there are no render pass or frame buffer objects to create
+	if (!dynamicRendering) {
+		setupRenderPass();
+	}
 	createPipelineCache();
-	setupFrameBuffer();
+	if (!dynamicRendering) {
+		setupFrameBuffer();
+	}
+	shaderModuleCache.init(device);
+#if !defined(__ANDROID__)
+	if (shaderArchive.open(getShadersPath() + vks::ShaderArchive::defaultFileName)) {
+		shaderModuleCache.setArchive(&shaderArchive);
+	}
+#endif
+	descriptorLayoutCache.init(device);
+	descriptorAllocator.init(device);
 	settings.overlay = settings.overlay && (!benchmark.active);
 	if (settings.overlay) {
 		uiOverlay.maxConcurrentFrames = maxConcurrentFrames;
@@ -239,18 +267,13 @@ void VulkanEngineBase::prepare()
 
 VkPipelineShaderStageCreateInfo VulkanEngineBase::loadShader(std::string fileName, VkShaderStageFlagBits stage)
 {
-	VkPipelineShaderStageCreateInfo shaderStage = {};
-	shaderStage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-	shaderStage.stage = stage;
-#if defined(VK_USE_PLATFORM_ANDROID_KHR)
-	shaderStage.module = vks::tools::loadShader(androidApp->activity->assetManager, fileName.c_str(), device);
-#else
-	shaderStage.module = vks::tools::loadShader(fileName.c_str(), device);
-#endif
-	shaderStage.pName = "main";
-	assert(shaderStage.module != VK_NULL_HANDLE);
-	shaderModules.push_back(shaderStage.module);
-	return shaderStage;
+	// Files are only read and turned into modules on their first use
+	return shaderModuleCache.load(fileName, stage);
+}
+
+void VulkanEngineBase::releaseShader(const VkPipelineShaderStageCreateInfo& shaderStage)
+{
+	shaderModuleCache.release(shaderStage);
 }
 
 void VulkanEngineBase::nextFrame()
@@ -590,29 +613,25 @@ void VulkanEngineBase::renderLoop()
 		updateOverlay();
 	}
 #elif defined(VK_USE_PLATFORM_HEADLESS_EXT)
-	while (!quit)
+	// Render a fixed number of frames into the offscreen images and report the throughput
+	// The time includes waiting for the last frame, so it measures what the device sustains rather than how fast frames are queued
+	uint32_t renderedFrames = 0;
+	const auto tLoopStart = std::chrono::high_resolution_clock::now();
+	while (!quit && (renderedFrames < headlessFrames))
 	{
-		auto tStart = std::chrono::high_resolution_clock::now();
-		render();
-		frameCounter++;
-		auto tEnd = std::chrono::high_resolution_clock::now();
-		auto tDiff = std::chrono::duration<double, std::milli>(tEnd - tStart).count();
-		frameTimer = tDiff / 1000.0f;
-		camera.update(frameTimer);
-		// Convert to clamped timer value
-		timer += timerSpeed * frameTimer;
-		if (timer > 1.0)
-		{
-			timer -= 1.0f;
-		}
-		float fpsTimer = std::chrono::duration<double, std::milli>(tEnd - lastTimestamp).count();
-		if (fpsTimer > 1000.0f)
-		{
-			lastFPS = (float)frameCounter * (1000.0f / fpsTimer);
-			frameCounter = 0;
-			lastTimestamp = tEnd;
+		if (prepared) {
+			nextFrame();
+			renderedFrames++;
 		}
-		updateOverlay();
+	}
+	vkDeviceWaitIdle(device);
+	const double loopTime = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - tLoopStart).count();
+	std::cout << std::fixed << std::setprecision(3);
+	std::cout << "Rendered " << renderedFrames << " frames at " << width << "x" << height << " on " << deviceProperties.deviceName << "\n";
+	std::cout << "time   : " << loopTime << " ms\n";
+	std::cout << "fps    : " << renderedFrames / (loopTime / 1000.0) << "\n";
+	if (!headlessOutputFile.empty() && (renderedFrames > 0)) {
+		saveOffscreenImage(headlessOutputFile);
 	}
 #elif (defined(VK_USE_PLATFORM_MACOS_MVK) || defined(VK_USE_PLATFORM_METAL_EXT)) && defined(VK_EXAMPLE_XCODE_GENERATED)
 	[NSApp run];
@@ -642,7 +661,9 @@ void VulkanEngineBase::updateOverlay()
 	io.DeltaTime = frameTimer;
 
 	ImGui::NewFrame();
+#if defined(_WIN32)
 	ImGui_ImplWin32_NewFrame();
+#endif
 	//ImGui::PushStyleVar(ImGuiStyleVar_WindowRounding, 0);
 	//ImGui::SetNextWindowPos(ImVec2(10 * ui.scale, 10 * ui.scale));
 	//ImGui::SetNextWindowSize(ImVec2(0, 0), ImGuiSetCond_FirstUseEver);
@@ -688,12 +709,29 @@ void VulkanEngineBase::drawUI(const VkCommandBuffer commandBuffer)
 	}
 }
 
-void VulkanEngineBase::prepareFrame(bool waitForFence)
+void VulkanEngineBase::waitForFrameTimeline(uint64_t value)
+{
+	if (value <= frameTimelineCompleted) {
+		return;
+	}
+	VK_CHECK_RESULT(vkGetSemaphoreCounterValue(device, frameTimeline, &frameTimelineCompleted));
+	if (value <= frameTimelineCompleted) {
+		return;
+	}
+	VkSemaphoreWaitInfo waitInfo{ .sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO };
+	waitInfo.semaphoreCount = 1;
+	waitInfo.pSemaphores = &frameTimeline;
+	waitInfo.pValues = &value;
+	VK_CHECK_RESULT(vkWaitSemaphores(device, &waitInfo, UINT64_MAX));
+	frameTimelineCompleted = value;
+}
+
+void VulkanEngineBase::prepareFrame(bool waitForFrame)
 {
 	// Ensure command buffer execution has finished
-	if (waitForFence) {
-		VK_CHECK_RESULT(vkWaitForFences(device, 1, &waitFences[currentBuffer], VK_TRUE, UINT64_MAX));
-		VK_CHECK_RESULT(vkResetFences(device, 1, &waitFences[currentBuffer]));
+	// Unlike a fence the timeline needs no reset, so a frame that is skipped after this point (e.g. on resize) leaves nothing in a bad state
+	if (waitForFrame) {
+		waitForFrameTimeline(frameTimelineValues[currentBuffer]);
 	}
 	updateOverlay();
 	// Acquire the next image from the swap chain
@@ -719,13 +757,29 @@ void VulkanEngineBase::submitFrame(bool skipQueueSubmit)
 		submitInfo.pWaitDstStageMask = &waitPipelineStage;
 		submitInfo.commandBufferCount = 1;
 		submitInfo.pCommandBuffers = &drawCmdBuffers[currentBuffer];
+		frameTimelineValue++;
+#if defined(VK_USE_PLATFORM_HEADLESS_EXT)
+		// Offscreen images are neither acquired nor presented, only the frame timeline is signalled
+		const std::array<VkSemaphore, 1> signalSemaphores = { frameTimeline };
+		const std::array<uint64_t, 1> signalValues = { frameTimelineValue };
+#else
 		submitInfo.pWaitSemaphores = &presentCompleteSemaphores[currentBuffer];
 		submitInfo.waitSemaphoreCount = 1;
-		submitInfo.pSignalSemaphores = &renderCompleteSemaphores[currentImageIndex];
-		submitInfo.signalSemaphoreCount = 1;
-		VK_CHECK_RESULT(vkQueueSubmit(queue, 1, &submitInfo, waitFences[currentBuffer]));
+		// The binary render complete semaphore is waited on by the presentation engine, the timeline value by the next use of this frame slot
+		const std::array<VkSemaphore, 2> signalSemaphores = { renderCompleteSemaphores[currentImageIndex], frameTimeline };
+		const std::array<uint64_t, 2> signalValues = { 0, frameTimelineValue };
+#endif
+		VkTimelineSemaphoreSubmitInfo timelineSubmitInfo{ .sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO };
+		timelineSubmitInfo.signalSemaphoreValueCount = static_cast<uint32_t>(signalValues.size());
+		timelineSubmitInfo.pSignalSemaphoreValues = signalValues.data();
+		submitInfo.pNext = &timelineSubmitInfo;
+		submitInfo.pSignalSemaphores = signalSemaphores.data();
+		submitInfo.signalSemaphoreCount = static_cast<uint32_t>(signalSemaphores.size());
+		VK_CHECK_RESULT(vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE));
+		frameTimelineValues[currentBuffer] = frameTimelineValue;
 	}
 
+#if !defined(VK_USE_PLATFORM_HEADLESS_EXT)
 	VkPresentInfoKHR presentInfo{ .sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR };
 	presentInfo.waitSemaphoreCount = 1;
 	presentInfo.pWaitSemaphores = &renderCompleteSemaphores[currentImageIndex];
@@ -743,6 +797,7 @@ void VulkanEngineBase::submitFrame(bool skipQueueSubmit)
 	else {
 		VK_CHECK_RESULT(result);
 	}
+#endif
 	// Select the next frame to render to, based on the max. no. of concurrent frames
 	currentBuffer = (currentBuffer + 1) % maxConcurrentFrames;
 }
@@ -766,6 +821,17 @@ VulkanEngineBase::VulkanEngineBase()
 	commandLineParser.add("benchmarkresultfile", { "-bf", "--benchfilename" }, 1, "Set file name for benchmark results");
 	commandLineParser.add("benchmarkresultframes", { "-bt", "--benchframetimes" }, 0, "Save frame times to benchmark results file");
 	commandLineParser.add("benchmarkframes", { "-bfs", "--benchmarkframes" }, 1, "Only render the given number of frames");
+	commandLineParser.add("pipelinecache", { "-pc", "--pipelinecache" }, 1, "Set file the pipeline cache is loaded from and saved to (\"none\" disables it)");
+	commandLineParser.add("iblcache", { "-ic", "--iblcache" }, 1, "Set directory precomputed IBL maps are cached in (\"none\" disables it)");
+	commandLineParser.add("framesinflight", { "-fif", "--framesinflight" }, 1, "Set number of frames the CPU may record ahead of the GPU (1-4, default 2)");
+	commandLineParser.add("renderpass", { "-rpass", "--renderpass" }, 0, "Use a render pass and frame buffers even if dynamic rendering is supported");
+	commandLineParser.add("jobthreads", { "-jt", "--jobthreads" }, 1, "Set number of job system threads, e.g. for recording draw commands (default: all hardware threads, 1 runs all jobs on the main thread)");
+	commandLineParser.add("readback", { "-rb", "--readback" }, 1, "Copy every rendered frame back to host memory through a ring of the given number of buffers (e.g. 4)");
+	commandLineParser.add("gpuprofile", { "-gp", "--gpuprofile" }, 1, "Write the GPU time of every labelled pass to the given JSON file on exit");
+#if defined(VK_USE_PLATFORM_HEADLESS_EXT)
+	commandLineParser.add("frames", { "--frames" }, 1, "Set number of frames to render before exiting (default 100)");
+	commandLineParser.add("output", { "-o", "--output" }, 1, "Save the last rendered frame to a PPM file");
+#endif
 #if (!(defined(VK_USE_PLATFORM_IOS_MVK) || defined(VK_USE_PLATFORM_MACOS_MVK) || defined(VK_USE_PLATFORM_METAL_EXT)))
 	commandLineParser.add("resourcepath", { "-rp", "--resourcepath" }, 1, "Set path for dir where assets folder is present");
 	commandLineParser.add("shadersspvpath", { "-ssp", "--shadersspvpath" }, 1, "Set path for dir where shaders folder is present");
@@ -825,6 +891,44 @@ VulkanEngineBase::VulkanEngineBase()
 	if (commandLineParser.isSet("benchmarkframes")) {
 		benchmark.outputFrames = commandLineParser.getValueAsInt("benchmarkframes", benchmark.outputFrames);
 	}
+	if (commandLineParser.isSet("pipelinecache")) {
+		pipelineCacheFile = commandLineParser.getValueAsString("pipelinecache", pipelineCacheFile);
+		if (pipelineCacheFile == "none") {
+			pipelineCacheFile.clear();
+		}
+	}
+	if (commandLineParser.isSet("iblcache")) {
+		iblCacheDirectory = commandLineParser.getValueAsString("iblcache", iblCacheDirectory);
+		if (iblCacheDirectory == "none") {
+			iblCacheDirectory.clear();
+		}
+	}
+	if (commandLineParser.isSet("framesinflight")) {
+		const int32_t frames = commandLineParser.getValueAsInt("framesinflight", static_cast<int32_t>(maxConcurrentFrames));
+		maxConcurrentFrames = static_cast<uint32_t>(std::clamp(frames, 1, static_cast<int32_t>(maxConcurrentFramesLimit)));
+	}
+	if (commandLineParser.isSet("renderpass")) {
+		settings.renderPass = true;
+	}
+	if (commandLineParser.isSet("jobthreads")) {
+		jobThreads = static_cast<uint32_t>(commandLineParser.getValueAsInt("jobthreads", 0));
+	}
+	if (commandLineParser.isSet("readback")) {
+		readbackSlots = static_cast<uint32_t>(std::max(commandLineParser.getValueAsInt("readback", 0), 0));
+	}
+	if (commandLineParser.isSet("gpuprofile")) {
+		gpuProfileFile = commandLineParser.getValueAsString("gpuprofile", gpuProfileFile);
+	}
+#if defined(VK_USE_PLATFORM_HEADLESS_EXT)
+	if (commandLineParser.isSet("frames")) {
+		headlessFrames = static_cast<uint32_t>(std::max(commandLineParser.getValueAsInt("frames", static_cast<int32_t>(headlessFrames)), 0));
+	}
+	if (commandLineParser.isSet("output")) {
+		headlessOutputFile = commandLineParser.getValueAsString("output", headlessOutputFile);
+	}
+	// The overlay needs the Win32 ImGui backend and a Windows system font
+	settings.overlay = false;
+#endif
 #if (!(defined(VK_USE_PLATFORM_IOS_MVK) || defined(VK_USE_PLATFORM_MACOS_MVK) || defined(VK_USE_PLATFORM_METAL_EXT)))
 	if(commandLineParser.isSet("resourcepath")) {
 		vks::tools::resourcePath = commandLineParser.getValueAsString("resourcepath", "");
@@ -894,10 +998,8 @@ VulkanEngineBase::~VulkanEngineBase()
 {
 	// Clean up Vulkan resources
 	swapChain.cleanup();
-	if (descriptorPool != VK_NULL_HANDLE)
-	{
-		vkDestroyDescriptorPool(device, descriptorPool, nullptr);
-	}
+	descriptorAllocator.destroyPools();
+	descriptorLayoutCache.destroy();
 	destroyCommandBuffers();
 	if (renderPass != VK_NULL_HANDLE)
 	{
@@ -908,21 +1010,21 @@ VulkanEngineBase::~VulkanEngineBase()
 		vkDestroyFramebuffer(device, frameBuffer, nullptr);
 	}
 
-	for (auto& shaderModule : shaderModules)
-	{
-		vkDestroyShaderModule(device, shaderModule, nullptr);
-	}
+	shaderModuleCache.destroy();
+	shaderArchive.close();
 	vkDestroyImageView(device, depthStencil.view, nullptr);
 	vkDestroyImage(device, depthStencil.image, nullptr);
 	vkFreeMemory(device, depthStencil.memory, nullptr);
 
+	if (pipelineCache != VK_NULL_HANDLE) {
+		vks::pipelinecache::printStatistics();
+		vks::pipelinecache::save(device, pipelineCache, pipelineCacheFile);
+	}
 	vkDestroyPipelineCache(device, pipelineCache, nullptr);
 
 	vkDestroyCommandPool(device, cmdPool, nullptr);
 
-	for (auto& fence : waitFences) {
-		vkDestroyFence(device, fence, nullptr);
-	}
+	vkDestroySemaphore(device, frameTimeline, nullptr);
 
 	for (auto& semaphore : presentCompleteSemaphores) {
 		vkDestroySemaphore(device, semaphore, nullptr);
@@ -931,7 +1033,9 @@ VulkanEngineBase::~VulkanEngineBase()
 		vkDestroySemaphore(device, semaphore, nullptr);
 	}
 
+#if defined(_WIN32)
 	ImGui_ImplWin32_Shutdown();
+#endif
 	if (settings.overlay) {
 		uiOverlay.freeResources();
 	}
@@ -1059,6 +1163,10 @@ bool VulkanEngineBase::initVulkan()
 
 	// Store properties (including limits), features and memory properties of the physical device (so that examples can check against them)
 	vkGetPhysicalDeviceProperties(physicalDevice, &deviceProperties);
+	if (deviceProperties.apiVersion < VK_API_VERSION_1_2) {
+		vks::tools::exitFatal(std::string("Vulkan 1.2 is required, the selected GPU \"") + deviceProperties.deviceName + "\" only supports " + std::to_string(VK_API_VERSION_MAJOR(deviceProperties.apiVersion)) + "." + std::to_string(VK_API_VERSION_MINOR(deviceProperties.apiVersion)), -1);
+		return false;
+	}
 	vkGetPhysicalDeviceFeatures(physicalDevice, &deviceFeatures);
 	vkGetPhysicalDeviceMemoryProperties(physicalDevice, &deviceMemoryProperties);
 
@@ -1073,7 +1181,22 @@ bool VulkanEngineBase::initVulkan()
 	// Derived examples can enable extensions based on the list of supported extensions read from the physical device
 	getEnabledExtensions();
 
+	// Pipeline creation feedback (used for pipeline cache statistics) is core in Vulkan 1.3, older devices need the extension
+	bool pipelineCreationFeedback = (apiVersion >= VK_API_VERSION_1_3) && (deviceProperties.apiVersion >= VK_API_VERSION_1_3);
+	if (!pipelineCreationFeedback && vulkanDevice->extensionSupported(VK_EXT_PIPELINE_CREATION_FEEDBACK_EXTENSION_NAME)) {
+		if (std::find_if(enabledDeviceExtensions.begin(), enabledDeviceExtensions.end(), [](const char* name) { return strcmp(name, VK_EXT_PIPELINE_CREATION_FEEDBACK_EXTENSION_NAME) == 0; }) == enabledDeviceExtensions.end()) {
+			enabledDeviceExtensions.push_back(VK_EXT_PIPELINE_CREATION_FEEDBACK_EXTENSION_NAME);
+		}
+		pipelineCreationFeedback = true;
+	}
+	vks::pipelinecache::setFeedbackEnabled(pipelineCreationFeedback);
+
+#if defined(VK_USE_PLATFORM_HEADLESS_EXT)
+	// No swap chain, so the swap chain device extension is not required (CPU implementations like lavapipe work without a display)
+	result = vulkanDevice->createLogicalDevice(enabledFeatures, enabledDeviceExtensions, deviceCreatepNextChain, false);
+#else
 	result = vulkanDevice->createLogicalDevice(enabledFeatures, enabledDeviceExtensions, deviceCreatepNextChain);
+#endif
 	if (result != VK_SUCCESS) {
 		vks::tools::exitFatal("Could not create Vulkan device: \n" + vks::tools::errorString(result), result);
 		return false;
@@ -2939,8 +3062,59 @@ void VulkanExampleBase::setupWindow()
 		}
 	}
 }
+#elif defined(VK_USE_PLATFORM_HEADLESS_EXT)
+void VulkanEngineBase::setupWindow()
+{
+}
+
+void VulkanEngineBase::saveOffscreenImage(const std::string& filename)
+{
+	// The image was left in swapChain.finalLayout (transfer source) by the last frame
+	vks::Buffer readback;
+	VK_CHECK_RESULT(vulkanDevice->createBuffer(VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &readback, static_cast<VkDeviceSize>(width) * height * 4));
+	VkCommandBuffer copyCmd = vulkanDevice->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+	// Make the color attachment writes of the last frame visible to the copy
+	VkImageMemoryBarrier imageMemoryBarrier = vks::initializers::imageMemoryBarrier();
+	imageMemoryBarrier.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+	imageMemoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+	imageMemoryBarrier.oldLayout = swapChain.finalLayout;
+	imageMemoryBarrier.newLayout = swapChain.finalLayout;
+	imageMemoryBarrier.image = swapChain.images[currentImageIndex];
+	imageMemoryBarrier.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+	vkCmdPipelineBarrier(copyCmd, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &imageMemoryBarrier);
+	VkBufferImageCopy region{};
+	region.imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+	region.imageExtent = { width, height, 1 };
+	vkCmdCopyImageToBuffer(copyCmd, swapChain.images[currentImageIndex], swapChain.finalLayout, readback.buffer, 1, &region);
+	vulkanDevice->flushCommandBuffer(copyCmd, queue);
+
+	std::ofstream file(filename, std::ios::out | std::ios::binary);
+	if (!file.is_open()) {
+		std::cerr << "Could not write offscreen image to " << filename << "\n";
+		readback.destroy();
+		return;
+	}
+	file << "P6\n" << width << "\n" << height << "\n" << 255 << "\n";
+	VK_CHECK_RESULT(readback.map());
+	// PPM stores RGB, swizzle BGRA images
+	const bool swizzle = (swapChain.colorFormat == VK_FORMAT_B8G8R8A8_UNORM);
+	const uint8_t* pixels = static_cast<const uint8_t*>(readback.mapped);
+	std::vector<uint8_t> row(static_cast<size_t>(width) * 3);
+	for (uint32_t y = 0; y < height; y++) {
+		for (uint32_t x = 0; x < width; x++) {
+			const uint8_t* pixel = pixels + (static_cast<size_t>(y) * width + x) * 4;
+			row[x * 3 + 0] = swizzle ? pixel[2] : pixel[0];
+			row[x * 3 + 1] = pixel[1];
+			row[x * 3 + 2] = swizzle ? pixel[0] : pixel[2];
+		}
+		file.write(reinterpret_cast<const char*>(row.data()), row.size());
+	}
+	file.close();
+	readback.destroy();
+	std::cout << "Offscreen image saved to " << filename << "\n";
+}
 #else
-void VulkanExampleBase::setupWindow()
+void VulkanEngineBase::setupWindow()
 {
 }
 #endif
@@ -2951,12 +3125,19 @@ void VulkanEngineBase::mouseMoved(double x, double y, bool & handled) {}
 
 void VulkanEngineBase::createSynchronizationPrimitives()
 {
-	// Wait fences to sync command buffer access
-	VkFenceCreateInfo fenceCreateInfo = vks::initializers::fenceCreateInfo(VK_FENCE_CREATE_SIGNALED_BIT);
-	for (auto& fence : waitFences) {
-		VK_CHECK_RESULT(vkCreateFence(device, &fenceCreateInfo, nullptr, &fence));
+	// Timeline semaphore to sync command buffer access, a frame slot that has never been submitted waits for value 0 which is always reached
+	// It is kept across swap chain recreation, the values it has reached stay valid
+	if (frameTimeline == VK_NULL_HANDLE) {
+		VkSemaphoreTypeCreateInfo semaphoreTypeCI{ .sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO };
+		semaphoreTypeCI.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+		semaphoreTypeCI.initialValue = 0;
+		VkSemaphoreCreateInfo semaphoreCI{ VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO };
+		semaphoreCI.pNext = &semaphoreTypeCI;
+		VK_CHECK_RESULT(vkCreateSemaphore(device, &semaphoreCI, nullptr, &frameTimeline));
+		frameTimelineValues.assign(maxConcurrentFrames, 0);
 	}
 	// Used to ensure that image presentation is complete before starting to submit again
+	presentCompleteSemaphores.resize(maxConcurrentFrames);
 	for (auto& semaphore : presentCompleteSemaphores) {
 		VkSemaphoreCreateInfo semaphoreCI{ VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO };
 		VK_CHECK_RESULT(vkCreateSemaphore(device, &semaphoreCI, nullptr, &semaphore));
@@ -3053,7 +3234,7 @@ void VulkanEngineBase::setupRenderPass()
 	attachments[0].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
 	attachments[0].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
 	attachments[0].initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-	attachments[0].finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+	attachments[0].finalLayout = swapChain.finalLayout;
 	// Depth attachment
 	attachments[1].format = depthFormat;
 	attachments[1].samples = VK_SAMPLE_COUNT_1_BIT;
@@ -3097,6 +3278,10 @@ void VulkanEngineBase::setupRenderPass()
 	dependencies[1].srcSubpass = VK_SUBPASS_EXTERNAL;
 	dependencies[1].dstSubpass = 0;
 	dependencies[1].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+	// Offscreen (headless) images are not handed back by a presentation engine, an earlier frame may still be copying from the image for readback
+	if (swapChain.finalLayout == VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL) {
+		dependencies[1].srcStageMask |= VK_PIPELINE_STAGE_TRANSFER_BIT;
+	}
 	dependencies[1].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
 	dependencies[1].srcAccessMask = 0;
 	dependencies[1].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_COLOR_ATTACHMENT_READ_BIT;
@@ -3140,10 +3325,12 @@ void VulkanEngineBase::windowResize()
 	vkDestroyImage(device, depthStencil.image, nullptr);
 	vkFreeMemory(device, depthStencil.memory, nullptr);
 	setupDepthStencil();
-	for (auto& frameBuffer : frameBuffers) {
-		vkDestroyFramebuffer(device, frameBuffer, nullptr);
+	if (!dynamicRendering) {
+		for (auto& frameBuffer : frameBuffers) {
+			vkDestroyFramebuffer(device, frameBuffer, nullptr);
+		}
+		setupFrameBuffer();
 	}
-	setupFrameBuffer();
 
 	if ((width > 0.0f) && (height > 0.0f)) {
 		if (settings.overlay) {
@@ -3157,9 +3344,6 @@ void VulkanEngineBase::windowResize()
 	for (auto& semaphore : renderCompleteSemaphores) {
 		vkDestroySemaphore(device, semaphore, nullptr);
 	}
-	for (auto& fence : waitFences) {
-		vkDestroyFence(device, fence, nullptr);
-	}
 	createSynchronizationPrimitives();
 
 	vkDeviceWaitIdle(device);
@@ -3174,6 +3358,16 @@ void VulkanEngineBase::windowResize()
 	prepared = true;
 }
 
+void VulkanEngineBase::resize(uint32_t newWidth, uint32_t newHeight)
+{
+	if ((newWidth == width) && (newHeight == height)) {
+		return;
+	}
+	destWidth = newWidth;
+	destHeight = newHeight;
+	windowResize();
+}
+
 void VulkanEngineBase::handleMouseMove(int32_t x, int32_t y)
 {
 	int32_t dx = (int32_t)mouseState.position.x - x;
@@ -68,12 +68,16 @@
 #include "VulkanBuffer.h"
 #include "VulkanDevice.h"
 #include "VulkanTexture.h"
+#include "VulkanDescriptorAllocator.h"
+#include "VulkanPipelineCache.h"
+#include "VulkanShaderCache.h"
 
 #include "VulkanInitializers.hpp"
 #include "camera.hpp"
 #include "benchmark.hpp"
 
-constexpr uint32_t maxConcurrentFrames{ 2 };
+/** @brief Upper bound for VulkanEngineBase::maxConcurrentFrames */
+constexpr uint32_t maxConcurrentFramesLimit{ 4 };
 
 class VulkanEngineBase
 {
@@ -127,28 +131,56 @@ public:
 	VkFormat depthFormat{VK_FORMAT_UNDEFINED};
 	// Command buffer pool
 	VkCommandPool cmdPool{ VK_NULL_HANDLE };
-	// Command buffers used for rendering
-	std::array<VkCommandBuffer, maxConcurrentFrames> drawCmdBuffers;
+	// Command buffers used for rendering, one per frame in flight
+	std::vector<VkCommandBuffer> drawCmdBuffers;
 	// Global render pass for frame buffer writes
 	VkRenderPass renderPass{ VK_NULL_HANDLE };
 	// List of available frame buffers (same as number of swap chain images)
 	std::vector<VkFramebuffer>frameBuffers;
-	// Descriptor set pool
-	VkDescriptorPool descriptorPool{ VK_NULL_HANDLE };
-	// List of shader modules created (stored for cleanup)
-	std::vector<VkShaderModule> shaderModules;
+	// Render to the swap chain with dynamic rendering (VK_KHR_dynamic_rendering, core in Vulkan 1.3) instead of renderPass and frameBuffers
+	// Set by derived classes in getEnabledFeatures() after enabling the feature; renderPass then stays VK_NULL_HANDLE and no frame buffers are created
+	bool dynamicRendering{ false };
+	// Growable descriptor allocator for long lived descriptor sets
+	vks::DescriptorAllocator descriptorAllocator;
+	// Descriptor set layouts shared by a hash of their bindings
+	vks::DescriptorLayoutCache descriptorLayoutCache;
+	// Shader modules shared by SPIR-V content hash, loadShader() takes a reference and releaseShader() drops it
+	vks::ShaderModuleCache shaderModuleCache;
+	// Single file SPIR-V archive (shaders.spvpak), mapped at startup when present next to the shaders
+	vks::ShaderArchive shaderArchive;
 	// Pipeline cache object
 	VkPipelineCache pipelineCache{ VK_NULL_HANDLE };
+	// File the pipeline cache is loaded from at startup and written to on shutdown (empty disables persistence)
+	std::string pipelineCacheFile = "pipelinecache.bin";
+	// Directory for precomputed image based lighting maps, keyed by the environment map and generator settings (empty disables the cache)
+	std::string iblCacheDirectory = "iblcache";
 	// Wraps the swap chain to present images (framebuffers) to the windowing system
 	VulkanSwapChain swapChain;
 
 	// Synchronization related objects and variables
 	// These are used to have multiple frame buffers "in flight" to get some CPU/GPU parallelism
+	// Number of frames the CPU may record ahead of the GPU (1 to maxConcurrentFramesLimit), fixed once prepare() has been called
+	// Fewer frames lower the input latency, more frames keep the GPU busy when the CPU frame time varies
+	uint32_t maxConcurrentFrames{ 2 };
+	// Number of job system threads including the main thread, used e.g. for parallel command recording (0 uses all hardware threads)
+	uint32_t jobThreads{ 0 };
+	// Number of host buffers rendered frames are copied into without stalling the GPU, frames are handed to the application a few frames later (0 disables readback)
+	uint32_t readbackSlots{ 0 };
+	// JSON file the per-pass GPU timings are written to on shutdown (empty disables it)
+	std::string gpuProfileFile;
 	uint32_t currentImageIndex{ 0 };
 	uint32_t currentBuffer{ 0 };
-	std::array<VkSemaphore, maxConcurrentFrames> presentCompleteSemaphores{};
+	std::vector<VkSemaphore> presentCompleteSemaphores{};
 	std::vector<VkSemaphore> renderCompleteSemaphores{};
-	std::array<VkFence, maxConcurrentFrames> waitFences;
+	// Timeline semaphore signalled with an increasing value by every frame submission, replaces per-frame fences
+	// Derived classes must enable VkPhysicalDeviceVulkan12Features::timelineSemaphore
+	VkSemaphore frameTimeline{ VK_NULL_HANDLE };
+	// Value signalled by the last submitted frame
+	uint64_t frameTimelineValue{ 0 };
+	// Highest value the GPU is known to have reached, saves querying the semaphore for frames that are already done
+	uint64_t frameTimelineCompleted{ 0 };
+	// Value each frame slot has to reach before its command buffer and per-frame resources can be reused
+	std::vector<uint64_t> frameTimelineValues{};
 
 	bool requiresStencil{ false };
 public:
@@ -178,6 +210,8 @@ public:
 		bool vsync = false;
 		/** @brief Enable UI overlay */
 		bool overlay = true;
+		/** @brief Keep using a render pass and frame buffers even if dynamic rendering is supported */
+		bool renderPass = false;
 	} settings;
 
 	/** @brief State of gamepad input (only used on Android) */
@@ -273,6 +307,10 @@ public:
 	xcb_intern_atom_reply_t *atom_wm_delete_window;
 #elif defined(VK_USE_PLATFORM_HEADLESS_EXT)
 	bool quit = false;
+	// Number of frames renderLoop() renders into the offscreen images before returning
+	uint32_t headlessFrames = 100;
+	// PPM file the last rendered frame is written to after the render loop (empty disables it)
+	std::string headlessOutputFile;
 #elif defined(VK_USE_PLATFORM_SCREEN_QNX)
 	screen_context_t screen_context = nullptr;
 	screen_window_t screen_window = nullptr;
@@ -338,6 +376,10 @@ public:
 #elif defined(VK_USE_PLATFORM_SCREEN_QNX)
 	void setupWindow();
 	void handleEvent();
+#elif defined(VK_USE_PLATFORM_HEADLESS_EXT)
+	void setupWindow();
+	/** @brief Copies the current offscreen image to a binary PPM file, the device must be idle */
+	void saveOffscreenImage(const std::string& filename);
 #else
 	void setupWindow();
 #endif
@@ -367,8 +409,12 @@ public:
 
 	/** @brief Loads a SPIR-V shader file for the given shader stage */
 	VkPipelineShaderStageCreateInfo loadShader(std::string fileName, VkShaderStageFlagBits stage);
+	/** @brief Drops the reference a loadShader() call took, call once the pipelines using the stage have been created */
+	void releaseShader(const VkPipelineShaderStageCreateInfo& shaderStage);
 
 	void windowResize();
+	/** @brief Recreates the swap chain (or offscreen images) and all size dependent resources at the given size, e.g. for rendering at sizes not tied to a window */
+	void resize(uint32_t newWidth, uint32_t newHeight);
 
 	/** @brief Entry point for the main render loop */
 	void renderLoop();
@@ -377,7 +423,9 @@ public:
 	void drawUI(const VkCommandBuffer commandBuffer);
 
 	/** Prepare the next frame for workload submission by acquiring the next swap chain image and waiting for the previous command buffer to finish */
-	void prepareFrame(bool waitForFence = true);
+	void prepareFrame(bool waitForFrame = true);
+	/** @brief Blocks until the GPU has reached the given frameTimeline value, returns immediately for values known to be complete */
+	void waitForFrameTimeline(uint64_t value);
 	/** @brief Presents the current image to the swap chain */
 	void submitFrame(bool skipQueueSubmit = false);
 
@@ -0,0 +1,84 @@
+#include "AsyncPipelineCompiler.h"
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+
+AsyncPipelineCompiler::~AsyncPipelineCompiler() {
+    stop();
+}
+
+void AsyncPipelineCompiler::start(VkPipelineCache pipelineCache, uint32_t threadCount) {
+    assert(workers.empty());
+    this->pipelineCache = pipelineCache;
+    stopping = false;
+    for (uint32_t i = 0; i < std::max(1u, threadCount); i++) {
+        workers.emplace_back(&AsyncPipelineCompiler::workerLoop, this);
+    }
+}
+
+void AsyncPipelineCompiler::stop() {
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        stopping = true;
+        queue.clear();
+    }
+    queueCondition.notify_all();
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    workers.clear();
+    pending.clear();
+}
+
+VkPipeline AsyncPipelineCompiler::request(const PipelineBuilder& builder, VkRenderPass renderPass, VkPipelineLayout pipelineLayout, VkPipeline fallback) {
+    PipelineBuilder::StateKey stateKey = builder.computeStateKey(renderPass, pipelineLayout);
+    VkPipeline pipeline = PipelineBuilder::findCachedPipeline(stateKey);
+    if (pipeline != VK_NULL_HANDLE) {
+        return pipeline;
+    }
+    if (workers.empty()) {
+        return fallback;
+    }
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        if (failed.count(stateKey) == 0 && pending.insert(stateKey).second) {
+            queue.push_back({ builder, renderPass, pipelineLayout, std::move(stateKey) });
+            queueCondition.notify_one();
+        }
+    }
+    return fallback;
+}
+
+size_t AsyncPipelineCompiler::pendingCount() {
+    std::lock_guard<std::mutex> lock(queueMutex);
+    return pending.size();
+}
+
+void AsyncPipelineCompiler::workerLoop() {
+    while (true) {
+        std::optional<Job> job;
+        {
+            std::unique_lock<std::mutex> lock(queueMutex);
+            queueCondition.wait(lock, [this] { return stopping || !queue.empty(); });
+            if (stopping) {
+                return;
+            }
+            job.emplace(std::move(queue.front()));
+            queue.pop_front();
+        }
+
+        auto tStart = std::chrono::high_resolution_clock::now();
+        VkPipeline pipeline{ VK_NULL_HANDLE };
+        VkResult result = job->builder.buildPipeline(job->renderPass, pipelineCache, job->pipelineLayout, pipeline);
+        auto tEnd = std::chrono::high_resolution_clock::now();
+        std::lock_guard<std::mutex> lock(queueMutex);
+        pending.erase(job->stateKey);
+        if (result != VK_SUCCESS) {
+            // 失败的请求之后一直使用备用管线，而不是每帧重新排队
+            failed.insert(job->stateKey);
+            std::cerr << "Background pipeline compile failed: " << vks::tools::errorString(result) << std::endl;
+            continue;
+        }
+        std::cout << "Background pipeline compiled in " << std::chrono::duration<double, std::milli>(tEnd - tStart).count() << " ms" << std::endl;
+    }
+}
@@ -0,0 +1,48 @@
+#pragma once
+#include <vulkan/vulkan.h>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+#include "PipelineBuilder.h"
+
+// 运行时管线的异步编译
+// request() 不会阻塞：状态缓存里已有对应管线时直接返回，否则把构建器拷贝交给后台线程编译并返回调用方指定的
+// 备用管线(例如基础的 pipelines.pbr)。编译完成的管线进入 PipelineBuilder 的状态缓存，之后某一帧再次 request() 时自动换上
+class AsyncPipelineCompiler {
+public:
+    ~AsyncPipelineCompiler();
+
+    // 启动后台编译线程
+    void start(VkPipelineCache pipelineCache, uint32_t threadCount = 1);
+    // 等待正在编译的管线完成并结束后台线程，未开始的请求会被丢弃
+    void stop();
+
+    // 返回立即可用的管线：最终管线或 fallback
+    VkPipeline request(const PipelineBuilder& builder, VkRenderPass renderPass, VkPipelineLayout pipelineLayout, VkPipeline fallback);
+
+    // 排队或正在编译的请求数
+    size_t pendingCount();
+
+private:
+    struct Job {
+        PipelineBuilder builder;
+        VkRenderPass renderPass;
+        VkPipelineLayout pipelineLayout;
+        PipelineBuilder::StateKey stateKey;
+    };
+    void workerLoop();
+
+    VkPipelineCache pipelineCache{ VK_NULL_HANDLE };
+    std::vector<std::thread> workers;
+    std::mutex queueMutex;
+    std::condition_variable queueCondition;
+    std::deque<Job> queue;
+    // 已排队或正在编译的状态，避免同一管线重复排队
+    std::unordered_set<PipelineBuilder::StateKey, PipelineBuilder::StateKeyHash> pending;
+    std::unordered_set<PipelineBuilder::StateKey, PipelineBuilder::StateKeyHash> failed;
+    bool stopping{ false };
+};
@@ -0,0 +1,180 @@
+#include "BindlessTable.h"
+#include <algorithm>
+
+void BindlessTable::create(vks::VulkanDevice* device, bool updateUnusedWhilePending, uint32_t maxTextures, uint32_t maxMaterials)
+{
+    this->device = device;
+    this->updateUnusedWhilePending = updateUnusedWhilePending;
+
+    // 根据设备限制收紧纹理数组大小
+    VkPhysicalDeviceVulkan12Properties vulkan12Properties{};
+    vulkan12Properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_PROPERTIES;
+    VkPhysicalDeviceProperties2 deviceProperties2{};
+    deviceProperties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+    deviceProperties2.pNext = &vulkan12Properties;
+    vkGetPhysicalDeviceProperties2(device->physicalDevice, &deviceProperties2);
+    this->maxTextures = std::min({ maxTextures, vulkan12Properties.maxDescriptorSetUpdateAfterBindSampledImages, vulkan12Properties.maxPerStageDescriptorUpdateAfterBindSamplers });
+    this->maxMaterials = maxMaterials;
+
+    // Descriptor set layout
+    std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings = {
+        vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT, 0, this->maxTextures),
+        vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_FRAGMENT_BIT, 1),
+    };
+    // 纹理数组允许部分绑定、可变数量，并且在绑定后仍可更新(运行时加载新纹理)
+    // UPDATE_AFTER_BIND 只允许在描述符集绑定之后、提交之前更新；帧仍在执行时写入新元素还需要 UPDATE_UNUSED_WHILE_PENDING
+    VkDescriptorBindingFlags textureFlags = VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT | VK_DESCRIPTOR_BINDING_VARIABLE_DESCRIPTOR_COUNT_BIT | VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT;
+    if (updateUnusedWhilePending) {
+        textureFlags |= VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT;
+    }
+    std::vector<VkDescriptorBindingFlags> bindingFlags = {
+        textureFlags,
+        0
+    };
+    VkDescriptorSetLayoutBindingFlagsCreateInfo bindingFlagsCI{};
+    bindingFlagsCI.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO;
+    bindingFlagsCI.bindingCount = static_cast<uint32_t>(bindingFlags.size());
+    bindingFlagsCI.pBindingFlags = bindingFlags.data();
+    VkDescriptorSetLayoutCreateInfo descriptorLayoutCI = vks::initializers::descriptorSetLayoutCreateInfo(setLayoutBindings);
+    descriptorLayoutCI.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT;
+    descriptorLayoutCI.pNext = &bindingFlagsCI;
+    VK_CHECK_RESULT(vkCreateDescriptorSetLayout(device->logicalDevice, &descriptorLayoutCI, nullptr, &setLayout));
+
+    // Descriptor pool
+    std::vector<VkDescriptorPoolSize> poolSizes = {
+        vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, this->maxTextures),
+        vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1)
+    };
+    VkDescriptorPoolCreateInfo descriptorPoolCI = vks::initializers::descriptorPoolCreateInfo(poolSizes, 1);
+    descriptorPoolCI.flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT;
+    VK_CHECK_RESULT(vkCreateDescriptorPool(device->logicalDevice, &descriptorPoolCI, nullptr, &descriptorPool));
+
+    // 整个表只分配一个描述符集，在帧开始时绑定一次
+    VkDescriptorSetVariableDescriptorCountAllocateInfo variableCountAI{};
+    variableCountAI.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_VARIABLE_DESCRIPTOR_COUNT_ALLOCATE_INFO;
+    variableCountAI.descriptorSetCount = 1;
+    variableCountAI.pDescriptorCounts = &this->maxTextures;
+    VkDescriptorSetAllocateInfo allocInfo = vks::initializers::descriptorSetAllocateInfo(descriptorPool, &setLayout, 1);
+    allocInfo.pNext = &variableCountAI;
+    VK_CHECK_RESULT(vkAllocateDescriptorSets(device->logicalDevice, &allocInfo, &descriptorSet));
+
+    // 材质缓冲常驻映射，注册材质时直接写入
+    VK_CHECK_RESULT(device->createBuffer(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &materialBuffer, sizeof(MaterialData) * maxMaterials));
+    VK_CHECK_RESULT(materialBuffer.map());
+    VkWriteDescriptorSet writeDescriptorSet = vks::initializers::writeDescriptorSet(descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, &materialBuffer.descriptor);
+    vkUpdateDescriptorSets(device->logicalDevice, 1, &writeDescriptorSet, 0, nullptr);
+}
+
+void BindlessTable::destroy()
+{
+    if (!device) {
+        return;
+    }
+    materialBuffer.destroy();
+    vkDestroyDescriptorPool(device->logicalDevice, descriptorPool, nullptr);
+    vkDestroyDescriptorSetLayout(device->logicalDevice, setLayout, nullptr);
+    textures.clear();
+    textureIndices.clear();
+    materials.clear();
+    freeTextures.clear();
+    freeMaterials.clear();
+    device = nullptr;
+}
+
+uint32_t BindlessTable::registerTexture(const VkDescriptorImageInfo& descriptor)
+{
+    auto it = textureIndices.find(descriptor.imageView);
+    if (it != textureIndices.end()) {
+        return it->second;
+    }
+    uint32_t index;
+    if (!freeTextures.empty()) {
+        index = freeTextures.back();
+        freeTextures.pop_back();
+        textures[index] = descriptor;
+    } else {
+        if (textures.size() >= maxTextures) {
+            vks::tools::exitFatal("Bindless texture table is full (" + std::to_string(maxTextures) + " textures)", -1);
+        }
+        index = static_cast<uint32_t>(textures.size());
+        textures.push_back(descriptor);
+    }
+    textureIndices[descriptor.imageView] = index;
+
+    VkWriteDescriptorSet writeDescriptorSet = vks::initializers::writeDescriptorSet(descriptorSet, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 0, &textures[index]);
+    writeDescriptorSet.dstArrayElement = index;
+    vkUpdateDescriptorSets(device->logicalDevice, 1, &writeDescriptorSet, 0, nullptr);
+    return index;
+}
+
+uint32_t BindlessTable::registerMaterial(const MaterialData& material)
+{
+    uint32_t index;
+    if (!freeMaterials.empty()) {
+        index = freeMaterials.back();
+        freeMaterials.pop_back();
+        materials[index] = material;
+    } else {
+        if (materials.size() >= maxMaterials) {
+            vks::tools::exitFatal("Bindless material buffer is full (" + std::to_string(maxMaterials) + " materials)", -1);
+        }
+        index = static_cast<uint32_t>(materials.size());
+        materials.push_back(material);
+    }
+    memcpy(static_cast<MaterialData*>(materialBuffer.mapped) + index, &material, sizeof(MaterialData));
+    return index;
+}
+
+void BindlessTable::registerModelMaterials(vkglTF::Model& model)
+{
+    for (auto& material : model.materials) {
+        MaterialData data{};
+        if (material.baseColorTexture) {
+            data.albedoMap = registerTexture(material.baseColorTexture->descriptor);
+        }
+        if (material.normalTexture) {
+            data.normalMap = registerTexture(material.normalTexture->descriptor);
+        }
+        if (material.occlusionTexture) {
+            data.aoMap = registerTexture(material.occlusionTexture->descriptor);
+        }
+        if (material.metallicRoughnessTexture) {
+            data.metallicMap = data.roughnessMap = registerTexture(material.metallicRoughnessTexture->descriptor);
+            data.flags |= PackedMetallicRoughness;
+        }
+        data.baseColorFactor = material.baseColorFactor;
+        data.metallicFactor = material.metallicFactor;
+        data.roughnessFactor = material.roughnessFactor;
+        material.index = registerMaterial(data);
+    }
+}
+
+void BindlessTable::releaseTexture(uint32_t index)
+{
+    if (index == invalidIndex) {
+        return;
+    }
+    // 同一张纹理可能被多个材质引用，只有第一次释放生效
+    auto it = textureIndices.find(textures[index].imageView);
+    if (it == textureIndices.end() || it->second != index) {
+        return;
+    }
+    textureIndices.erase(it);
+    freeTextures.push_back(index);
+}
+
+void BindlessTable::releaseModelMaterials(vkglTF::Model& model)
+{
+    for (auto& material : model.materials) {
+        // 没有注册过的材质不占用任何位置
+        if (material.index == invalidIndex || material.index >= materials.size()) {
+            continue;
+        }
+        const MaterialData& data = materials[material.index];
+        for (uint32_t texture : { data.albedoMap, data.normalMap, data.aoMap, data.metallicMap, data.roughnessMap }) {
+            releaseTexture(texture);
+        }
+        freeMaterials.push_back(material.index);
+        material.index = invalidIndex;
+    }
+}
@@ -0,0 +1,77 @@
+#pragma once
+#include <vulkan/vulkan.h>
+#include <unordered_map>
+#include <vector>
+#include "VulkanDevice.h"
+#include "VulkanBuffer.h"
+#include "VulkanglTFModel.h"
+
+// 全局无绑定(bindless)纹理表
+// set 1, binding 0: 可变数量的 COMBINED_IMAGE_SAMPLER 数组，所有纹理只注册一次
+// set 1, binding 1: 材质 SSBO，材质通过索引引用纹理
+class BindlessTable {
+public:
+    static constexpr uint32_t invalidIndex = 0xFFFFFFFFu;
+
+    enum MaterialFlags : uint32_t {
+        // 金属度/粗糙度打包在同一张纹理中(glTF: G = 粗糙度, B = 金属度)
+        PackedMetallicRoughness = 0x00000001
+    };
+
+    // 与 pbrtexture.slang 中的 Material 结构保持一致(std430)
+    struct MaterialData {
+        uint32_t albedoMap = invalidIndex;
+        uint32_t normalMap = invalidIndex;
+        uint32_t aoMap = invalidIndex;
+        uint32_t metallicMap = invalidIndex;
+        uint32_t roughnessMap = invalidIndex;
+        uint32_t flags = 0;
+        uint32_t pad[2]{};
+        glm::vec4 baseColorFactor = glm::vec4(1.0f);
+        float metallicFactor = 1.0f;
+        float roughnessFactor = 1.0f;
+        float pad1[2]{};
+    };
+
+    // 创建描述符布局、UPDATE_AFTER_BIND 池以及材质缓冲
+    // updateUnusedWhilePending 为 true 时设备已启用 descriptorBindingUpdateUnusedWhilePending，
+    // 纹理数组带上 UPDATE_UNUSED_WHILE_PENDING，在途命令缓冲没有用到的元素可以直接写入
+    void create(vks::VulkanDevice* device, bool updateUnusedWhilePending, uint32_t maxTextures = 1024, uint32_t maxMaterials = 256);
+    void destroy();
+
+    // 注册纹理并返回其在数组中的索引，同一个 image view 只会注册一次
+    // updatesWhilePending() 为 false 时，调用前使用描述符集的命令缓冲必须已经执行完毕
+    uint32_t registerTexture(const VkDescriptorImageInfo& descriptor);
+    // 写入材质并返回材质索引
+    uint32_t registerMaterial(const MaterialData& material);
+    // 注册 glTF 模型的所有材质，并把材质索引写回 vkglTF::Material::index
+    void registerModelMaterials(vkglTF::Model& model);
+    // 释放模型的材质及其纹理的索引，之后注册的纹理与材质复用这些位置
+    // 调用前使用这些索引的命令缓冲必须已经执行完毕
+    void releaseModelMaterials(vkglTF::Model& model);
+
+    uint32_t textureCount() const { return static_cast<uint32_t>(textures.size() - freeTextures.size()); }
+    uint32_t materialCount() const { return static_cast<uint32_t>(materials.size() - freeMaterials.size()); }
+    const MaterialData& getMaterial(uint32_t index) const { return materials.at(index); }
+    bool updatesWhilePending() const { return updateUnusedWhilePending; }
+
+public:
+    vks::VulkanDevice* device{ nullptr };
+    VkDescriptorSetLayout setLayout{ VK_NULL_HANDLE };
+    VkDescriptorPool descriptorPool{ VK_NULL_HANDLE };
+    VkDescriptorSet descriptorSet{ VK_NULL_HANDLE };
+    vks::Buffer materialBuffer;
+
+private:
+    uint32_t maxTextures{ 0 };
+    uint32_t maxMaterials{ 0 };
+    bool updateUnusedWhilePending{ false };
+    std::vector<VkDescriptorImageInfo> textures;
+    std::unordered_map<VkImageView, uint32_t> textureIndices;
+    std::vector<MaterialData> materials;
+    // 已释放、可以复用的纹理与材质索引
+    std::vector<uint32_t> freeTextures;
+    std::vector<uint32_t> freeMaterials;
+
+    void releaseTexture(uint32_t index);
+};
@@ -0,0 +1,105 @@
+#include "EncodeQueue.h"
+#include <algorithm>
+#include <chrono>
+
+EncodeQueue::EncodeQueue(uint32_t threadCount, size_t capacity)
+    : capacity(std::max<size_t>(capacity, 1))
+{
+    if (threadCount == 0) {
+        threadCount = std::max(1u, std::thread::hardware_concurrency() / 2);
+    }
+    threads.reserve(threadCount);
+    for (uint32_t i = 0; i < threadCount; i++) {
+        threads.emplace_back([this]() { workerLoop(); });
+    }
+}
+
+EncodeQueue::~EncodeQueue()
+{
+    wait();
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    taskAvailable.notify_all();
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+}
+
+void EncodeQueue::push(Task task)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    if (tasks.size() >= capacity) {
+        const auto tStart = std::chrono::steady_clock::now();
+        spaceAvailable.wait(lock, [this]() { return tasks.size() < capacity; });
+        statistics.blockedPushes++;
+        statistics.blockedSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - tStart).count();
+    }
+    tasks.push_back(std::move(task));
+    lock.unlock();
+    taskAvailable.notify_one();
+}
+
+void EncodeQueue::wait(size_t maxInFlight)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    taskFinished.wait(lock, [this, maxInFlight]() { return tasks.size() + running <= maxInFlight; });
+}
+
+size_t EncodeQueue::inFlight() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return tasks.size() + running;
+}
+
+EncodeQueue::Statistics EncodeQueue::getStatistics() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return statistics;
+}
+
+void EncodeQueue::workerLoop()
+{
+    ImageEncoder encoder;
+    std::vector<uint8_t> data;
+    while (true) {
+        std::unique_lock<std::mutex> lock(mutex);
+        taskAvailable.wait(lock, [this]() { return stopping || !tasks.empty(); });
+        if (tasks.empty()) {
+            return;
+        }
+        Task task = std::move(tasks.front());
+        tasks.pop_front();
+        running++;
+        lock.unlock();
+        spaceAvailable.notify_one();
+
+        const auto tStart = std::chrono::steady_clock::now();
+        std::string error;
+        bool succeeded;
+        size_t encodedBytes = 0;
+        if (task.output.empty()) {
+            succeeded = encoder.encode(task.image, task.format, task.options, data, error);
+            encodedBytes = data.size();
+        } else {
+            succeeded = encoder.write(task.output, task.image, task.format, task.options, error);
+            std::error_code ec;
+            const std::uintmax_t fileSize = succeeded ? std::filesystem::file_size(task.output, ec) : 0;
+            encodedBytes = ec ? 0 : static_cast<size_t>(fileSize);
+        }
+        const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - tStart).count();
+        if (task.onComplete) {
+            task.onComplete(succeeded, error);
+        }
+
+        lock.lock();
+        running--;
+        (succeeded ? statistics.completed : statistics.failed)++;
+        statistics.pixels += static_cast<uint64_t>(task.image.width) * task.image.height;
+        statistics.encodedBytes += encodedBytes;
+        statistics.encodeSeconds += seconds;
+        lock.unlock();
+        taskFinished.notify_all();
+    }
+}
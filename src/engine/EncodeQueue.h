@@ -0,0 +1,71 @@
+#pragma once
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "ImageEncoder.h"
+
+// 图像编码的工作线程池
+// 任务放入有界队列，由固定数量的编码线程取出，每个线程使用自己的 ImageEncoder(临时缓冲在任务之间复用)
+// 队列已满时 push 阻塞到有线程取走任务为止，编码跟不上时渲染线程随之减速(背压)，而不是无限积压读回的图像
+// 编码一张图像需要数毫秒到数十毫秒，线程在条件变量上等待任务，不占用任务系统的工作线程
+class EncodeQueue {
+public:
+    struct Task {
+        // 像素在 onComplete 调用之前必须保持有效(例如保留的读回槽位)
+        ImageEncoder::Image image;
+        ImageEncoder::FileFormat format{ ImageEncoder::FileFormat::PNG };
+        ImageEncoder::Options options;
+        // 为空时只编码到内存并丢弃结果，用于基准测试
+        std::filesystem::path output;
+        // 在编码线程上调用
+        std::function<void(bool succeeded, const std::string& error)> onComplete;
+    };
+
+    struct Statistics {
+        uint64_t completed{ 0 };
+        uint64_t failed{ 0 };
+        uint64_t pixels{ 0 };
+        uint64_t encodedBytes{ 0 };
+        // 各线程编码耗时之和
+        double encodeSeconds{ 0.0 };
+        // 队列已满而阻塞的 push 次数与阻塞的总时间
+        uint64_t blockedPushes{ 0 };
+        double blockedSeconds{ 0.0 };
+    };
+
+    // threadCount 为 0 时使用一半的硬件线程(其余留给渲染与任务系统)，capacity 为等待编码的最多任务数(不含正在编码的任务)
+    EncodeQueue(uint32_t threadCount, size_t capacity);
+    // 等待全部任务完成后结束线程
+    ~EncodeQueue();
+    EncodeQueue(const EncodeQueue&) = delete;
+    EncodeQueue& operator=(const EncodeQueue&) = delete;
+
+    void push(Task task);
+    // 等待到排队与正在编码的任务不超过 maxInFlight 个
+    void wait(size_t maxInFlight = 0);
+    size_t inFlight() const;
+
+    uint32_t getThreadCount() const { return static_cast<uint32_t>(threads.size()); }
+    size_t getCapacity() const { return capacity; }
+    Statistics getStatistics() const;
+
+private:
+    void workerLoop();
+
+    std::vector<std::thread> threads;
+    size_t capacity;
+    std::deque<Task> tasks;
+    size_t running{ 0 };
+    bool stopping{ false };
+    mutable std::mutex mutex;
+    std::condition_variable taskAvailable;
+    std::condition_variable spaceAvailable;
+    std::condition_variable taskFinished;
+    Statistics statistics;
+};
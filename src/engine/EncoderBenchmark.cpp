@@ -0,0 +1,204 @@
+#include "EncoderBenchmark.h"
+#include "EncodeQueue.h"
+#include "ImageEncoder.h"
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include "CommandLineParser.hpp"
+#include "CommandLineTool.hpp"
+
+namespace
+{
+    // 截断尾数的单精度转半精度，只用于生成测试图像
+    uint16_t floatToHalf(float value)
+    {
+        uint32_t bits;
+        memcpy(&bits, &value, sizeof(bits));
+        const uint16_t sign = static_cast<uint16_t>((bits >> 16) & 0x8000u);
+        const int32_t exponent = static_cast<int32_t>((bits >> 23) & 0xFF) - 127 + 15;
+        if (exponent <= 0) {
+            return sign;
+        }
+        if (exponent >= 31) {
+            return static_cast<uint16_t>(sign | 0x7C00u);
+        }
+        return static_cast<uint16_t>(sign | (exponent << 10) | ((bits >> 13) & 0x3FFu));
+    }
+
+    // 合成的 HDR 渲染结果: 天空的渐变、几个带高光的球与平坦的地面，加上少量噪声，压缩率与真实的渲染结果接近
+    std::vector<float> makeHdrImage(uint32_t width, uint32_t height)
+    {
+        std::vector<float> pixels(static_cast<size_t>(width) * height * 4);
+        uint32_t seed = 1;
+        for (uint32_t y = 0; y < height; y++) {
+            for (uint32_t x = 0; x < width; x++) {
+                const float u = float(x) / float(width);
+                const float v = float(y) / float(height);
+                float color[3] = { 0.3f + 0.4f * v, 0.45f + 0.3f * v, 0.9f - 0.2f * u };
+                if (v > 0.7f) {
+                    color[0] = color[1] = color[2] = ((x / 64 + y / 64) % 2) ? 0.25f : 0.18f;
+                }
+                for (uint32_t i = 0; i < 3; i++) {
+                    const float cx = 0.25f + 0.25f * i;
+                    const float dx = (u - cx) * float(width) / float(height);
+                    const float dy = v - 0.45f;
+                    const float r2 = dx * dx + dy * dy;
+                    if (r2 < 0.015f) {
+                        const float shade = 1.0f - r2 / 0.015f;
+                        color[i] = 0.2f + 2.0f * shade + 12.0f * std::pow(shade, 40.0f);
+                        color[(i + 1) % 3] = 0.1f + 0.5f * shade;
+                        color[(i + 2) % 3] = 0.05f + 0.2f * shade;
+                    }
+                }
+                seed = seed * 1664525u + 1013904223u;
+                const float noise = 1.0f + (float(seed >> 16) / 65536.0f - 0.5f) * 0.01f;
+                float* pixel = pixels.data() + (static_cast<size_t>(y) * width + x) * 4;
+                pixel[0] = color[0] * noise / 4.5f;
+                pixel[1] = color[1] * noise / 4.5f;
+                pixel[2] = color[2] * noise / 4.5f;
+                pixel[3] = 1.0f;
+            }
+        }
+        return pixels;
+    }
+
+    uint64_t checksum(const std::vector<uint8_t>& data)
+    {
+        uint64_t hash = 14695981039346656037ull;
+        for (uint8_t value : data) {
+            hash = (hash ^ value) * 1099511628211ull;
+        }
+        return hash;
+    }
+
+    // 取若干次中最快的一次，返回每秒百万像素
+    double measure(uint32_t repetitions, uint64_t pixels, const std::function<void()>& fn)
+    {
+        return double(pixels) / vks::tool::measureBest(repetitions, fn) / 1.0e6;
+    }
+
+    bool report(const char* name, double scalar, double simd, uint64_t scalarChecksum, uint64_t simdChecksum, const std::string& extra = "")
+    {
+        const bool match = scalarChecksum == simdChecksum;
+        std::cout << "  " << std::left << std::setw(18) << name << std::right << ": scalar " << std::setw(8) << scalar << " MP/s, SSE2 " << std::setw(8) << simd << " MP/s, "
+            << simd / scalar << "x" << extra << (match ? "" : "  (output mismatch)") << std::endl;
+        return match;
+    }
+}
+
+bool EncoderBenchmark::runFromCommandLine(const std::vector<const char*>& args, int& exitCode)
+{
+    CommandLineParser parser;
+    parser.add("benchmarkencode", { "--benchmarkencode" }, 0, "Measure image conversion and PNG/QOI encoding throughput and exit");
+    parser.add("benchmarkencodewidth", { "--benchmarkencodewidth" }, 1, "Width of the --benchmarkencode test image (default 1920)");
+    parser.add("benchmarkencodeheight", { "--benchmarkencodeheight" }, 1, "Height of the --benchmarkencode test image (default 1080)");
+    parser.add("benchmarkencodethreads", { "--benchmarkencodethreads" }, 1, "Maximum number of encoder threads for --benchmarkencode (default: all hardware threads)");
+    parser.parse(args);
+    if (!parser.isSet("benchmarkencode")) {
+        return false;
+    }
+
+    vks::tool::attachConsole();
+
+    const uint32_t width = static_cast<uint32_t>(std::max(parser.getValueAsInt("benchmarkencodewidth", 1920), 1));
+    const uint32_t height = static_cast<uint32_t>(std::max(parser.getValueAsInt("benchmarkencodeheight", 1080), 1));
+    int32_t maxThreads = parser.getValueAsInt("benchmarkencodethreads", 0);
+    if (maxThreads <= 0) {
+        maxThreads = static_cast<int32_t>(std::max(1u, std::thread::hardware_concurrency()));
+    }
+    const uint64_t pixelCount = static_cast<uint64_t>(width) * height;
+    constexpr uint32_t repetitions = 5;
+
+    // 三种输入格式: 32 位与 16 位浮点的 HDR 图像，以及色调映射后按交换链的 BGRA 顺序存放的 LDR 图像
+    const std::vector<float> hdr32 = makeHdrImage(width, height);
+    std::vector<uint16_t> hdr16(hdr32.size());
+    std::transform(hdr32.begin(), hdr32.end(), hdr16.begin(), floatToHalf);
+    const ImageEncoder::Options options;
+    ImageEncoder::Options scalarOptions;
+    scalarOptions.simd = false;
+    ImageEncoder encoder;
+    const ImageEncoder::Image image32{ width, height, VK_FORMAT_R32G32B32A32_SFLOAT, 0, { reinterpret_cast<const uint8_t*>(hdr32.data()), hdr32.size() * sizeof(float) } };
+    const ImageEncoder::Image image16{ width, height, VK_FORMAT_R16G16B16A16_SFLOAT, 0, { reinterpret_cast<const uint8_t*>(hdr16.data()), hdr16.size() * sizeof(uint16_t) } };
+    std::vector<uint8_t> bgra = encoder.convertToRGBA8(image32, options);
+    for (size_t i = 0; i < bgra.size(); i += 4) {
+        std::swap(bgra[i], bgra[i + 2]);
+    }
+    const ImageEncoder::Image image8{ width, height, VK_FORMAT_B8G8R8A8_UNORM, 0, { bgra.data(), bgra.size() } };
+
+    std::cout << std::fixed << std::setprecision(1);
+    std::cout << "Image encoder benchmark, " << width << "x" << height << " (best of " << repetitions << ")" << std::endl;
+    bool passed = true;
+
+    std::cout << "Conversion to RGBA8" << std::endl;
+    const std::pair<const char*, const ImageEncoder::Image*> conversions[] = {
+        { "BGRA8 swizzle", &image8 },
+        { "RGBA16F tonemap", &image16 },
+        { "RGBA32F tonemap", &image32 },
+    };
+    for (const auto& [name, image] : conversions) {
+        const double scalar = measure(repetitions, pixelCount, [&]() { encoder.convertToRGBA8(*image, scalarOptions); });
+        const uint64_t scalarChecksum = checksum(encoder.convertToRGBA8(*image, scalarOptions));
+        const double simd = measure(repetitions, pixelCount, [&]() { encoder.convertToRGBA8(*image, options); });
+        const uint64_t simdChecksum = checksum(encoder.convertToRGBA8(*image, options));
+        passed &= report(name, scalar, simd, scalarChecksum, simdChecksum);
+    }
+
+    // 编码的耗时包含从 BGRA8 的转换
+    std::cout << "Encoding from BGRA8 (single thread)" << std::endl;
+    const std::pair<const char*, ImageEncoder::FileFormat> formats[] = {
+        { "PNG", ImageEncoder::FileFormat::PNG },
+        { "QOI", ImageEncoder::FileFormat::QOI },
+        { "PPM", ImageEncoder::FileFormat::PPM },
+    };
+    std::vector<uint8_t> data;
+    std::string error;
+    for (const auto& [name, format] : formats) {
+        const double scalar = measure(repetitions, pixelCount, [&]() { encoder.encode(image8, format, scalarOptions, data, error); });
+        const uint64_t scalarChecksum = checksum(data);
+        const double simd = measure(repetitions, pixelCount, [&]() { encoder.encode(image8, format, options, data, error); });
+        const uint64_t simdChecksum = checksum(data);
+        std::stringstream ratio;
+        ratio << std::fixed << std::setprecision(1) << ", " << data.size() / 1024 << " KiB (" << 100.0 * double(data.size()) / double(pixelCount * 4) << "%)";
+        passed &= report(name, scalar, simd, scalarChecksum, simdChecksum, ratio.str());
+    }
+
+    // 编码队列: 每轮编码 imageCount 张 PNG，线程数逐次加倍，队列容量为线程数的两倍
+    std::cout << "Encode queue, PNG from BGRA8" << std::endl;
+    const uint32_t imageCount = static_cast<uint32_t>(std::max(maxThreads * 4, 16));
+    double singleThread = 0.0;
+    for (int32_t threads = 1;; threads = std::min(threads * 2, maxThreads)) {
+        EncodeQueue queue(static_cast<uint32_t>(threads), static_cast<size_t>(threads) * 2);
+        const auto tStart = std::chrono::high_resolution_clock::now();
+        for (uint32_t i = 0; i < imageCount; i++) {
+            EncodeQueue::Task task;
+            task.image = image8;
+            task.format = ImageEncoder::FileFormat::PNG;
+            queue.push(std::move(task));
+        }
+        queue.wait();
+        const double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - tStart).count();
+        const EncodeQueue::Statistics statistics = queue.getStatistics();
+        const double megapixels = double(statistics.pixels) / seconds / 1.0e6;
+        if (threads == 1) {
+            singleThread = megapixels;
+        }
+        std::cout << "  " << std::setw(2) << threads << " threads: " << std::setw(8) << megapixels << " MP/s, " << megapixels / singleThread << "x, "
+            << imageCount / seconds << " images/s, " << statistics.blockedPushes << " blocked pushes (" << statistics.blockedSeconds * 1000.0 << " ms)" << std::endl;
+        passed &= statistics.completed == imageCount;
+        if (threads == maxThreads) {
+            break;
+        }
+    }
+
+    exitCode = passed ? 0 : 1;
+    return true;
+}
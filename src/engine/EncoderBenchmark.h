@@ -0,0 +1,11 @@
+#pragma once
+#include <vector>
+
+// 图像编码的 CPU 基准测试，不需要 Vulkan 设备
+// 在合成的渲染结果上分别测量格式转换(通道交换、HDR 色调映射)与 PNG/QOI 编码的标量与 SSE2 实现，
+// 以及编码队列在不同线程数下的吞吐量，结果以每秒百万像素表示；标量与 SSE2 的结果必须逐字节一致
+class EncoderBenchmark {
+public:
+    // 命令行入口，参数中包含 --benchmarkencode 时执行并返回 true，exitCode 为进程退出码
+    static bool runFromCommandLine(const std::vector<const char*>& args, int& exitCode);
+};
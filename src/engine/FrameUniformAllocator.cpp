@@ -0,0 +1,92 @@
+#include "FrameUniformAllocator.h"
+#include <algorithm>
+#include <cassert>
+#include <string>
+#include "VulkanTools.h"
+
+FrameUniformAllocator::~FrameUniformAllocator()
+{
+    destroy();
+}
+
+VkDeviceSize FrameUniformAllocator::align(VkDeviceSize value) const
+{
+    return (value + alignment - 1) & ~(alignment - 1);
+}
+
+uint32_t FrameUniformAllocator::reserveBlock(VkDeviceSize size)
+{
+    assert(!device);
+    blocks.push_back({ 0, size, {} });
+    return static_cast<uint32_t>(blocks.size() - 1);
+}
+
+void FrameUniformAllocator::create(vks::VulkanDevice* device, uint32_t frameCount, VkDeviceSize linearSize)
+{
+    this->device = device;
+    this->frameCount = frameCount;
+    // 规范保证该限制是 2 的幂
+    alignment = std::max<VkDeviceSize>(device->properties.limits.minUniformBufferOffsetAlignment, 1);
+
+    blocksSize = 0;
+    for (Block& block : blocks) {
+        block.offset = blocksSize;
+        block.frameHashes.assign(frameCount, 0);
+        blocksSize += align(block.size);
+    }
+    frameStride = align(blocksSize + linearSize);
+    // 动态偏移是 32 位的
+    if (frameStride * frameCount > UINT32_MAX) {
+        vks::tools::exitFatal("Frame uniform buffer exceeds the range of dynamic offsets", -1);
+    }
+
+    VK_CHECK_RESULT(device->createBuffer(VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &buffer, frameStride * frameCount));
+    VK_CHECK_RESULT(buffer.map());
+    beginFrame(0);
+}
+
+void FrameUniformAllocator::destroy()
+{
+    if (!device) {
+        return;
+    }
+    buffer.destroy();
+    blocks.clear();
+    device = nullptr;
+}
+
+void FrameUniformAllocator::beginFrame(uint32_t frame)
+{
+    assert(frame < frameCount);
+    currentFrame = frame;
+    cursor = blocksSize;
+}
+
+FrameUniformAllocator::Allocation FrameUniformAllocator::allocate(VkDeviceSize size)
+{
+    if (cursor + size > frameStride) {
+        vks::tools::exitFatal("Frame uniform allocator is out of space (" + std::to_string(frameStride - blocksSize) + " bytes per frame)", -1);
+    }
+    const VkDeviceSize offset = currentFrame * frameStride + cursor;
+    cursor = align(cursor + size);
+    return { static_cast<uint8_t*>(buffer.mapped) + offset, static_cast<uint32_t>(offset) };
+}
+
+uint32_t FrameUniformAllocator::updateBlock(uint32_t block, const void* data, VkDeviceSize size)
+{
+    Block& target = blocks[block];
+    assert(size <= target.size);
+    const VkDeviceSize offset = currentFrame * frameStride + target.offset;
+    // 该帧的副本可能已被更早的帧写入过相同内容(例如参数只在界面调整时变化)，此时不必再写
+    const uint64_t hash = vks::tools::hashBytes(data, static_cast<size_t>(size));
+    if (target.frameHashes[currentFrame] != hash) {
+        memcpy(static_cast<uint8_t*>(buffer.mapped) + offset, data, static_cast<size_t>(size));
+        target.frameHashes[currentFrame] = hash;
+    }
+    return static_cast<uint32_t>(offset);
+}
+
+VkDescriptorBufferInfo FrameUniformAllocator::descriptor(VkDeviceSize range) const
+{
+    return { buffer.buffer, 0, range };
+}
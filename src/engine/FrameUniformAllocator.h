@@ -0,0 +1,67 @@
+#pragma once
+#include <vulkan/vulkan.h>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include "VulkanDevice.h"
+#include "VulkanBuffer.h"
+
+// 每帧的 uniform 线性分配器
+// 所有在途帧共用一个常驻映射的缓冲，每帧占一段：开头是预留的固定块，之后是每帧重置的线性区域
+// 分配结果都按 minUniformBufferOffsetAlignment 对齐，以动态偏移绑定到 UNIFORM_BUFFER_DYNAMIC 描述符，
+// 描述符集只需要写入一次，不再随帧或随缓冲变化
+// 固定块在每帧的同一位置，按内容哈希跟踪各帧副本，内容未变化时跳过写入
+class FrameUniformAllocator {
+public:
+    struct Allocation {
+        void* mapped{ nullptr };
+        // 相对缓冲起点的偏移，直接用作动态偏移
+        uint32_t offset{ 0 };
+    };
+
+    ~FrameUniformAllocator();
+
+    // 预留一个每帧都有的固定块，返回块编号，必须在 create 之前调用
+    uint32_t reserveBlock(VkDeviceSize size);
+    // linearSize 为每帧线性区域的大小
+    void create(vks::VulkanDevice* device, uint32_t frameCount, VkDeviceSize linearSize);
+    void destroy();
+
+    // 重置 frame 的线性区域，调用前该帧之前的提交必须已经执行完毕
+    void beginFrame(uint32_t frame);
+    // 从当前帧的线性区域分配，超出容量时报错退出
+    Allocation allocate(VkDeviceSize size);
+    template <typename T>
+    uint32_t push(const T& data)
+    {
+        const Allocation allocation = allocate(sizeof(T));
+        memcpy(allocation.mapped, &data, sizeof(T));
+        return allocation.offset;
+    }
+    // 把数据写入当前帧的固定块并返回其动态偏移，内容与该帧上次写入的相同时不写
+    uint32_t updateBlock(uint32_t block, const void* data, VkDeviceSize size);
+
+    // 描述符的偏移为 0，range 为绑定的结构大小，实际位置由动态偏移决定
+    VkDescriptorBufferInfo descriptor(VkDeviceSize range) const;
+
+private:
+    VkDeviceSize align(VkDeviceSize value) const;
+
+    struct Block {
+        VkDeviceSize offset;
+        VkDeviceSize size;
+        // 各帧副本最近一次写入内容的哈希，0 表示尚未写入
+        std::vector<uint64_t> frameHashes;
+    };
+
+    vks::VulkanDevice* device{ nullptr };
+    vks::Buffer buffer;
+    VkDeviceSize alignment{ 1 };
+    // 固定块总大小(已对齐)，也是线性区域在每帧中的起点
+    VkDeviceSize blocksSize{ 0 };
+    VkDeviceSize frameStride{ 0 };
+    uint32_t frameCount{ 0 };
+    uint32_t currentFrame{ 0 };
+    VkDeviceSize cursor{ 0 };
+    std::vector<Block> blocks;
+};
@@ -0,0 +1,344 @@
+#include "GpuProfiler.h"
+#include <algorithm>
+#include <cassert>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include "VulkanTools.h"
+
+namespace
+{
+    // 指数滑动平均的权重，约为最近 20 帧
+    constexpr double averageWeight = 0.05;
+
+    GpuProfiler::Node& findChild(GpuProfiler::Node& node, const std::string& name)
+    {
+        for (GpuProfiler::Node& child : node.children) {
+            if (child.name == name) {
+                return child;
+            }
+        }
+        GpuProfiler::Node& child = node.children.emplace_back();
+        child.name = name;
+        return child;
+    }
+
+    // 把一次结果的树合并到累计的树，子节点按名字对应，新出现的作用域加到末尾
+    void accumulate(GpuProfiler::Node& node, const GpuProfiler::Node& sample)
+    {
+        node.milliseconds = sample.milliseconds;
+        node.average = node.count == 0 ? sample.milliseconds : node.average + (sample.milliseconds - node.average) * averageWeight;
+        node.total += sample.milliseconds;
+        node.count++;
+        for (const GpuProfiler::Node& child : sample.children) {
+            accumulate(findChild(node, child.name), child);
+        }
+    }
+
+    void writeString(std::ostream& stream, const std::string& value)
+    {
+        stream << '"';
+        for (const char c : value) {
+            if (c == '"' || c == '\\') {
+                stream << '\\' << c;
+            } else if (static_cast<unsigned char>(c) < 0x20) {
+                stream << "\\u" << std::hex << std::setw(4) << std::setfill('0') << static_cast<int>(c) << std::dec << std::setfill(' ');
+            } else {
+                stream << c;
+            }
+        }
+        stream << '"';
+    }
+
+    void writeNode(std::ostream& stream, const GpuProfiler::Node& node, uint32_t depth)
+    {
+        const std::string indent(depth * 2, ' ');
+        stream << "{\n" << indent << "  \"name\": ";
+        writeString(stream, node.name);
+        stream << ",\n" << indent << "  \"lastMs\": " << node.milliseconds
+            << ",\n" << indent << "  \"averageMs\": " << node.average
+            << ",\n" << indent << "  \"totalMs\": " << node.total
+            << ",\n" << indent << "  \"count\": " << node.count
+            << ",\n" << indent << "  \"children\": [";
+        for (size_t i = 0; i < node.children.size(); i++) {
+            stream << (i == 0 ? "\n" : ",\n") << indent << "    ";
+            writeNode(stream, node.children[i], depth + 2);
+        }
+        stream << (node.children.empty() ? "]\n" : "\n" + indent + "  ]\n") << indent << "}";
+    }
+}
+
+GpuProfiler::~GpuProfiler()
+{
+    destroy();
+}
+
+void GpuProfiler::create(vks::VulkanDevice* device, uint32_t queueFamilyIndex, uint32_t frameCount, bool synchronization2, uint32_t maxScopes)
+{
+    assert(frames.empty());
+    this->device = device;
+    this->synchronization2 = synchronization2;
+    maxQueries = std::max(maxScopes, 1u) * 2;
+    current = nullptr;
+    frameSequence = 0;
+    frameTree = {};
+    immediateTree = {};
+    statistics = {};
+
+    // timestampValidBits 为 0 的队列不能写入时间戳
+    const uint32_t validBits = device->queueFamilyProperties[queueFamilyIndex].timestampValidBits;
+    if (validBits == 0) {
+        std::cout << "Warning: the graphics queue does not support timestamps, GPU timing is disabled" << std::endl;
+        return;
+    }
+    timestampMask = validBits >= 64 ? ~0ull : (1ull << validBits) - 1;
+    millisecondsPerTick = static_cast<double>(device->properties.limits.timestampPeriod) / 1.0e6;
+
+    frames.resize(std::max(frameCount, 1u));
+    for (QuerySet& set : frames) {
+        createQuerySet(set);
+    }
+    createQuerySet(immediate);
+}
+
+void GpuProfiler::destroy()
+{
+    for (QuerySet& set : frames) {
+        vkDestroyQueryPool(device->logicalDevice, set.pool, nullptr);
+    }
+    frames.clear();
+    if (immediate.pool != VK_NULL_HANDLE) {
+        vkDestroyQueryPool(device->logicalDevice, immediate.pool, nullptr);
+    }
+    immediate = {};
+    current = nullptr;
+}
+
+void GpuProfiler::createQuerySet(QuerySet& set)
+{
+    VkQueryPoolCreateInfo queryPoolCI{ VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO };
+    queryPoolCI.queryType = VK_QUERY_TYPE_TIMESTAMP;
+    queryPoolCI.queryCount = maxQueries;
+    VK_CHECK_RESULT(vkCreateQueryPool(device->logicalDevice, &queryPoolCI, nullptr, &set.pool));
+    // 新建的查询处于未定义状态，第一次使用前同样需要重置
+    vkResetQueryPool(device->logicalDevice, set.pool, 0, maxQueries);
+    set.queryCount = 0;
+}
+
+void GpuProfiler::beginFrame(uint32_t frameIndex)
+{
+    if (!valid()) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    QuerySet& set = frames[frameIndex % frames.size()];
+    if (set.queryCount > 0) {
+        (resolve(set, frameTree) ? statistics.resolvedFrames : statistics.incompleteFrames)++;
+    }
+    reset(set);
+    set.sequence = ++frameSequence;
+    current = &set;
+}
+
+void GpuProfiler::endFrame()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    current = nullptr;
+}
+
+void GpuProfiler::beginScope(VkCommandBuffer commandBuffer, const char* name)
+{
+    if (!valid()) {
+        return;
+    }
+    std::unique_lock<std::mutex> lock(mutex);
+    QuerySet& set = current ? *current : immediate;
+    CommandBufferScopes& state = set.commandBuffers[commandBuffer];
+    if (set.queryCount + 2 > maxQueries) {
+        // 仍然入栈，使之后的 endScope 与之对应
+        state.stack.push_back(noScope);
+        statistics.droppedScopes++;
+        return;
+    }
+    // 没有计时的外层作用域被跳过，挂到更外层的作用域下
+    uint32_t parent = noScope;
+    for (auto it = state.stack.rbegin(); it != state.stack.rend(); it++) {
+        if (*it != noScope) {
+            parent = *it;
+            break;
+        }
+    }
+    const uint32_t index = static_cast<uint32_t>(set.scopes.size());
+    const uint32_t query = set.queryCount;
+    set.scopes.push_back({ name, query, parent });
+    set.queryCount += 2;
+    if (parent == noScope) {
+        state.roots.push_back(index);
+    }
+    state.stack.push_back(index);
+    const VkQueryPool pool = set.pool;
+    lock.unlock();
+    writeTimestamp(commandBuffer, true, pool, query);
+}
+
+void GpuProfiler::endScope(VkCommandBuffer commandBuffer)
+{
+    if (!valid()) {
+        return;
+    }
+    std::unique_lock<std::mutex> lock(mutex);
+    QuerySet& set = current ? *current : immediate;
+    auto it = set.commandBuffers.find(commandBuffer);
+    if (it == set.commandBuffers.end() || it->second.stack.empty()) {
+        return;
+    }
+    const uint32_t index = it->second.stack.back();
+    it->second.stack.pop_back();
+    if (index == noScope) {
+        return;
+    }
+    const uint32_t query = set.scopes[index].query + 1;
+    const VkQueryPool pool = set.pool;
+    lock.unlock();
+    writeTimestamp(commandBuffer, false, pool, query);
+}
+
+void GpuProfiler::executeCommands(VkCommandBuffer primary, std::span<const VkCommandBuffer> secondaries)
+{
+    if (!valid()) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    QuerySet& set = current ? *current : immediate;
+    uint32_t parent = noScope;
+    auto primaryScopes = set.commandBuffers.find(primary);
+    if (primaryScopes != set.commandBuffers.end()) {
+        for (auto it = primaryScopes->second.stack.rbegin(); it != primaryScopes->second.stack.rend(); it++) {
+            if (*it != noScope) {
+                parent = *it;
+                break;
+            }
+        }
+    }
+    for (VkCommandBuffer secondary : secondaries) {
+        auto it = set.commandBuffers.find(secondary);
+        if (it == set.commandBuffers.end()) {
+            continue;
+        }
+        for (uint32_t root : it->second.roots) {
+            set.scopes[root].parent = parent;
+        }
+    }
+}
+
+void GpuProfiler::resolveImmediate()
+{
+    if (!valid()) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    if (immediate.queryCount > 0 && !resolve(immediate, immediateTree)) {
+        std::cout << "Warning: GPU timestamps of a one-time submission were not available" << std::endl;
+    }
+    reset(immediate);
+}
+
+void GpuProfiler::resolvePending()
+{
+    if (!valid()) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    std::vector<QuerySet*> pending;
+    for (QuerySet& set : frames) {
+        if (set.queryCount > 0 && &set != current) {
+            pending.push_back(&set);
+        }
+    }
+    std::sort(pending.begin(), pending.end(), [](const QuerySet* a, const QuerySet* b) { return a->sequence < b->sequence; });
+    for (QuerySet* set : pending) {
+        (resolve(*set, frameTree) ? statistics.resolvedFrames : statistics.incompleteFrames)++;
+        reset(*set);
+    }
+}
+
+void GpuProfiler::writeTimestamp(VkCommandBuffer commandBuffer, bool begin, VkQueryPool pool, uint32_t query)
+{
+    // 开始时间戳在之前的命令开始执行时写入，结束时间戳等作用域内的命令全部完成
+    if (synchronization2) {
+        vkCmdWriteTimestamp2(commandBuffer, begin ? VK_PIPELINE_STAGE_2_TOP_OF_PIPE_BIT : VK_PIPELINE_STAGE_2_BOTTOM_OF_PIPE_BIT, pool, query);
+    } else {
+        vkCmdWriteTimestamp(commandBuffer, begin ? VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT : VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, pool, query);
+    }
+}
+
+bool GpuProfiler::resolve(QuerySet& set, Node& tree)
+{
+    // 不等待：调用时提交已经完成，仍有查询不可用说明这些命令没有提交，VK_NOT_READY 时整组结果丢弃
+    std::vector<uint64_t> timestamps(set.queryCount);
+    const VkResult result = vkGetQueryPoolResults(device->logicalDevice, set.pool, 0, set.queryCount, timestamps.size() * sizeof(uint64_t), timestamps.data(),
+        sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+    if (result == VK_NOT_READY) {
+        return false;
+    }
+    VK_CHECK_RESULT(result);
+
+    // 父作用域可能在子作用域之后才开始(二级命令缓冲先于主命令缓冲录制)，先按父节点分组再递归
+    std::vector<std::vector<uint32_t>> children(set.scopes.size());
+    std::vector<uint32_t> roots;
+    for (uint32_t i = 0; i < set.scopes.size(); i++) {
+        const uint32_t parent = set.scopes[i].parent;
+        (parent == noScope ? roots : children[parent]).push_back(i);
+    }
+    auto addScopes = [&](auto& self, Node& node, const std::vector<uint32_t>& indices) -> void {
+        for (uint32_t index : indices) {
+            const Scope& scope = set.scopes[index];
+            const uint64_t ticks = (timestamps[scope.query + 1] - timestamps[scope.query]) & timestampMask;
+            Node& child = findChild(node, scope.name);
+            child.milliseconds += static_cast<double>(ticks) * millisecondsPerTick;
+            self(self, child, children[index]);
+        }
+    };
+    Node sample;
+    addScopes(addScopes, sample, roots);
+    for (const Node& child : sample.children) {
+        sample.milliseconds += child.milliseconds;
+    }
+    accumulate(tree, sample);
+    return true;
+}
+
+void GpuProfiler::reset(QuerySet& set)
+{
+    if (set.queryCount > 0) {
+        vkResetQueryPool(device->logicalDevice, set.pool, 0, set.queryCount);
+    }
+    set.queryCount = 0;
+    set.scopes.clear();
+    set.commandBuffers.clear();
+}
+
+bool GpuProfiler::writeJson(const std::filesystem::path& path, std::string& error) const
+{
+    std::ofstream file(path, std::ios::out | std::ios::trunc);
+    if (!file) {
+        error = "could not open \"" + path.string() + "\" for writing";
+        return false;
+    }
+    file << std::fixed << std::setprecision(4);
+    file << "{\n  \"device\": ";
+    writeString(file, device ? device->properties.deviceName : "");
+    file << ",\n  \"resolvedFrames\": " << statistics.resolvedFrames
+        << ",\n  \"incompleteFrames\": " << statistics.incompleteFrames
+        << ",\n  \"droppedScopes\": " << statistics.droppedScopes
+        << ",\n  \"frame\": ";
+    writeNode(file, frameTree, 1);
+    file << ",\n  \"immediate\": ";
+    writeNode(file, immediateTree, 1);
+    file << "\n}\n";
+    if (!file) {
+        error = "could not write \"" + path.string() + "\"";
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,117 @@
+#pragma once
+#include <vulkan/vulkan.h>
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <span>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "VulkanDevice.h"
+
+// GPU 时间戳计时
+// 每个作用域在开始与结束时各写入一个时间戳查询，查询来自当前在途帧自己的查询池；
+// 该帧的槽位下一次被使用时(prepareFrame 已经等到上次提交完成)读取结果，不等待 GPU，结果比录制晚 maxConcurrentFrames 帧
+// 作用域按命令缓冲分别维护嵌套关系，可以在多个录制线程上同时使用；二级命令缓冲的最外层作用域
+// 在 executeCommands 时挂到主命令缓冲当前打开的作用域下，整帧的结果合并成一棵按名字区分的树，同一父节点下同名的作用域耗时相加
+// 没有打开的帧时(例如启动时的 IBL 预计算)作用域写入单独的查询池，一次性命令缓冲提交并等待完成后由 resolveImmediate 读取
+// 查询池用 vkResetQueryPool 在主机上重置，需要启用 hostQueryReset；队列不支持时间戳时不创建，所有调用都不做任何事
+class GpuProfiler {
+public:
+    struct Node {
+        std::string name;
+        // 最近一次的耗时、指数滑动平均与累计耗时，毫秒
+        double milliseconds{ 0.0 };
+        double average{ 0.0 };
+        double total{ 0.0 };
+        // 出现过的帧数(或一次性提交的次数)
+        uint64_t count{ 0 };
+        std::vector<Node> children;
+    };
+
+    struct Statistics {
+        uint64_t resolvedFrames{ 0 };
+        // 查询结果不完整而丢弃的帧(例如录制后没有提交)
+        uint64_t incompleteFrames{ 0 };
+        // 查询池已满而没有计时的作用域
+        uint64_t droppedScopes{ 0 };
+    };
+
+    ~GpuProfiler();
+
+    // frameCount 为在途帧数，maxScopes 为每帧(以及一次性提交)最多的作用域数
+    // synchronization2 为 true 时用 vkCmdWriteTimestamp2 写入时间戳，否则退回 vkCmdWriteTimestamp
+    void create(vks::VulkanDevice* device, uint32_t queueFamilyIndex, uint32_t frameCount, bool synchronization2, uint32_t maxScopes = 256);
+    void destroy();
+    bool valid() const { return !frames.empty(); }
+
+    // 在 prepareFrame 之后调用，读取该槽位上一次录制的结果并重置查询池，之后的作用域属于这一帧
+    void beginFrame(uint32_t frameIndex);
+    // 在提交之前调用，之后的作用域不再属于帧
+    void endFrame();
+
+    // 可以在任意线程上调用，同一个命令缓冲只能在一个线程上录制；name 在调用之后不需要保持有效
+    void beginScope(VkCommandBuffer commandBuffer, const char* name);
+    void endScope(VkCommandBuffer commandBuffer);
+    // 在主命令缓冲中执行二级命令缓冲之前调用，二级命令缓冲的作用域成为 primary 当前作用域的子节点
+    void executeCommands(VkCommandBuffer primary, std::span<const VkCommandBuffer> secondaries);
+
+    // 一次性命令缓冲执行完成后调用，结果累加到 getImmediateTree
+    void resolveImmediate();
+    // 所有提交都已完成时调用(例如退出前)，按录制顺序读取尚未读取的帧
+    void resolvePending();
+
+    // 根节点没有名字，耗时为子节点之和
+    const Node& getFrameTree() const { return frameTree; }
+    const Node& getImmediateTree() const { return immediateTree; }
+    const Statistics& getStatistics() const { return statistics; }
+    // 两棵树与统计写成 JSON
+    bool writeJson(const std::filesystem::path& path, std::string& error) const;
+
+private:
+    static constexpr uint32_t noScope = UINT32_MAX;
+
+    struct Scope {
+        std::string name;
+        // 第一个查询的序号，结束时间戳在下一个查询
+        uint32_t query{ 0 };
+        // 父作用域在 scopes 中的序号
+        uint32_t parent{ noScope };
+    };
+    struct CommandBufferScopes {
+        // 打开的作用域，查询池已满时为 noScope
+        std::vector<uint32_t> stack;
+        // 最外层的作用域，在 executeCommands 时接到主命令缓冲下
+        std::vector<uint32_t> roots;
+    };
+    struct QuerySet {
+        VkQueryPool pool{ VK_NULL_HANDLE };
+        uint32_t queryCount{ 0 };
+        // 录制顺序，resolvePending 按它读取
+        uint64_t sequence{ 0 };
+        std::vector<Scope> scopes;
+        std::unordered_map<VkCommandBuffer, CommandBufferScopes> commandBuffers;
+    };
+
+    void createQuerySet(QuerySet& set);
+    void writeTimestamp(VkCommandBuffer commandBuffer, bool begin, VkQueryPool pool, uint32_t query);
+    // 读取 set 中全部作用域的耗时合并到 tree 并重置查询池，结果不完整时返回 false
+    bool resolve(QuerySet& set, Node& tree);
+    void reset(QuerySet& set);
+
+    vks::VulkanDevice* device{ nullptr };
+    bool synchronization2{ false };
+    uint32_t maxQueries{ 0 };
+    uint64_t timestampMask{ 0 };
+    // 每个时间戳计数对应的毫秒数
+    double millisecondsPerTick{ 0.0 };
+    std::vector<QuerySet> frames;
+    QuerySet immediate;
+    // 当前打开的帧，为空时作用域写入 immediate
+    QuerySet* current{ nullptr };
+    uint64_t frameSequence{ 0 };
+    std::mutex mutex;
+    Node frameTree;
+    Node immediateTree;
+    Statistics statistics;
+};
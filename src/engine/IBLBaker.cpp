@@ -0,0 +1,789 @@
+#include "IBLBaker.h"
+#include "VulkanTools.h"
+#include <ktx.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/packing.hpp>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <thread>
+#include "CommandLineParser.hpp"
+#include "CommandLineTool.hpp"
+
+#if defined(_M_X64) || defined(__SSE2__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define IBL_BAKER_SSE 1
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+    // genbrdflut / prefilterenvmap 使用的 PI
+    constexpr float PI = 3.1415926536f;
+    // 与 VulkanEngine::environmentMapFile 的默认值相同
+    const std::string defaultEnvironmentFile = "textures/hdr/gcanyon_cube.ktx";
+#if defined(IBL_BAKER_SSE)
+    const char* simdName = "SSE2";
+#else
+    const char* simdName = "scalar";
+#endif
+
+    // 四路 float 向量，SSE2 不可用时退化为逐通道的标量运算
+    struct Float4 {
+#if defined(IBL_BAKER_SSE)
+        __m128 v;
+
+        static Float4 load(const float* p) { return { _mm_loadu_ps(p) }; }
+        static Float4 splat(float f) { return { _mm_set1_ps(f) }; }
+        void store(float* p) const { _mm_storeu_ps(p, v); }
+
+        friend Float4 operator+(Float4 a, Float4 b) { return { _mm_add_ps(a.v, b.v) }; }
+        friend Float4 operator-(Float4 a, Float4 b) { return { _mm_sub_ps(a.v, b.v) }; }
+        friend Float4 operator*(Float4 a, Float4 b) { return { _mm_mul_ps(a.v, b.v) }; }
+        friend Float4 operator/(Float4 a, Float4 b) { return { _mm_div_ps(a.v, b.v) }; }
+        friend Float4 maximum(Float4 a, Float4 b) { return { _mm_max_ps(a.v, b.v) }; }
+        friend Float4 squareRoot(Float4 a) { return { _mm_sqrt_ps(a.v) }; }
+        // a > b 的通道保留 value，其余通道置零(被丢弃通道中的 NaN/Inf 也一并清除)
+        friend Float4 selectGreater(Float4 a, Float4 b, Float4 value) { return { _mm_and_ps(_mm_cmpgt_ps(a.v, b.v), value.v) }; }
+#else
+        float v[4];
+
+        static Float4 load(const float* p) { return { { p[0], p[1], p[2], p[3] } }; }
+        static Float4 splat(float f) { return { { f, f, f, f } }; }
+        void store(float* p) const { memcpy(p, v, sizeof(v)); }
+
+        template<typename Op>
+        static Float4 apply(Float4 a, Float4 b, Op op) { return { { op(a.v[0], b.v[0]), op(a.v[1], b.v[1]), op(a.v[2], b.v[2]), op(a.v[3], b.v[3]) } }; }
+        friend Float4 operator+(Float4 a, Float4 b) { return apply(a, b, [](float x, float y) { return x + y; }); }
+        friend Float4 operator-(Float4 a, Float4 b) { return apply(a, b, [](float x, float y) { return x - y; }); }
+        friend Float4 operator*(Float4 a, Float4 b) { return apply(a, b, [](float x, float y) { return x * y; }); }
+        friend Float4 operator/(Float4 a, Float4 b) { return apply(a, b, [](float x, float y) { return x / y; }); }
+        friend Float4 maximum(Float4 a, Float4 b) { return apply(a, b, [](float x, float y) { return x > y ? x : y; }); }
+        friend Float4 squareRoot(Float4 a) { return apply(a, a, [](float x, float) { return std::sqrt(x); }); }
+        friend Float4 selectGreater(Float4 a, Float4 b, Float4 value)
+        {
+            Float4 result{};
+            for (int i = 0; i < 4; i++) {
+                result.v[i] = a.v[i] > b.v[i] ? value.v[i] : 0.0f;
+            }
+            return result;
+        }
+#endif
+    };
+
+    Float4 lerp(Float4 a, Float4 b, float t)
+    {
+        return a + (b - a) * Float4::splat(t);
+    }
+
+    // 以下函数与着色器中的同名函数一一对应
+
+    // Based omn http://byteblacksmith.com/improvements-to-the-canonical-one-liner-glsl-rand-for-opengl-es-2-0/
+    // GPU 的 sin 精度与 CPU 不同，乘以大常数后结果基本不相关，只影响 0.1 弧度以内的采样旋转
+    float random(float x, float y)
+    {
+        const float dt = x * 12.9898f + y * 78.233f;
+        const float sn = std::fmod(dt, 3.14f);
+        const float value = std::sin(sn) * 43758.5453f;
+        return value - std::floor(value);
+    }
+
+    glm::vec2 hammersley2d(uint32_t i, uint32_t N)
+    {
+        uint32_t bits = (i << 16u) | (i >> 16u);
+        bits = ((bits & 0x55555555u) << 1u) | ((bits & 0xAAAAAAAAu) >> 1u);
+        bits = ((bits & 0x33333333u) << 2u) | ((bits & 0xCCCCCCCCu) >> 2u);
+        bits = ((bits & 0x0F0F0F0Fu) << 4u) | ((bits & 0xF0F0F0F0u) >> 4u);
+        bits = ((bits & 0x00FF00FFu) << 8u) | ((bits & 0xFF00FF00u) >> 8u);
+        return glm::vec2(float(i) / float(N), float(bits) * 2.3283064365386963e-10f);
+    }
+
+    // importanceSample_GGX 拆成两部分: 与像素无关的切线空间采样(cosTheta、sinTheta 与不含随机扰动的 phi)按 mip 预先计算，
+    // 像素只负责随机扰动的旋转与切线空间到世界空间的变换，避免每个采样重复计算三角函数
+    struct GGXSample {
+        float cosTheta;
+        float sinTheta;
+        float cosPhi;
+        float sinPhi;
+    };
+
+    GGXSample ggxSample(glm::vec2 Xi, float roughness)
+    {
+        const float alpha = roughness * roughness;
+        const float phi = 2.0f * PI * Xi.x;
+        const float cosTheta = std::sqrt((1.0f - Xi.y) / (1.0f + (alpha * alpha - 1.0f) * Xi.y));
+        const float sinTheta = std::sqrt(1.0f - cosTheta * cosTheta);
+        return { cosTheta, sinTheta, std::cos(phi), std::sin(phi) };
+    }
+
+    struct TangentFrame {
+        glm::vec3 normal;
+        glm::vec3 tangentX;
+        glm::vec3 tangentY;
+        // random(normal.xz) * 0.1 的正弦与余弦
+        float cosJitter;
+        float sinJitter;
+    };
+
+    TangentFrame tangentFrame(const glm::vec3& normal)
+    {
+        const glm::vec3 up = std::abs(normal.z) < 0.999f ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(1.0f, 0.0f, 0.0f);
+        TangentFrame frame{};
+        frame.normal = normal;
+        frame.tangentX = glm::normalize(glm::cross(up, normal));
+        frame.tangentY = glm::normalize(glm::cross(normal, frame.tangentX));
+        const float jitter = random(normal.x, normal.z) * 0.1f;
+        frame.cosJitter = std::cos(jitter);
+        frame.sinJitter = std::sin(jitter);
+        return frame;
+    }
+
+    glm::vec3 importanceSample_GGX(const GGXSample& sample, const TangentFrame& frame)
+    {
+        // cos/sin(phi + jitter) 由和角公式得到
+        const float cosPhi = sample.cosPhi * frame.cosJitter - sample.sinPhi * frame.sinJitter;
+        const float sinPhi = sample.sinPhi * frame.cosJitter + sample.cosPhi * frame.sinJitter;
+        const glm::vec3 H(sample.sinTheta * cosPhi, sample.sinTheta * sinPhi, sample.cosTheta);
+        return glm::normalize(frame.tangentX * H.x + frame.tangentY * H.y + frame.normal * H.z);
+    }
+
+    float D_GGX(float dotNH, float roughness)
+    {
+        const float alpha = roughness * roughness;
+        const float alpha2 = alpha * alpha;
+        const float denom = dotNH * dotNH * (alpha2 - 1.0f) + 1.0f;
+        return alpha2 / (PI * denom * denom);
+    }
+
+    // Direction through the center of a cube map texel, faces in Vulkan order (+X, -X, +Y, -Y, +Z, -Z)
+    glm::vec3 cubeDirection(uint32_t x, uint32_t y, uint32_t face, float size)
+    {
+        const float u = (float(x) + 0.5f) / size * 2.0f - 1.0f;
+        const float v = (float(y) + 0.5f) / size * 2.0f - 1.0f;
+        switch (face) {
+        case 0: return glm::normalize(glm::vec3(1.0f, -v, -u));
+        case 1: return glm::normalize(glm::vec3(-1.0f, -v, u));
+        case 2: return glm::normalize(glm::vec3(u, 1.0f, v));
+        case 3: return glm::normalize(glm::vec3(u, -1.0f, -v));
+        case 4: return glm::normalize(glm::vec3(u, -v, 1.0f));
+        default: return glm::normalize(glm::vec3(-u, -v, -1.0f));
+        }
+    }
+
+    // 立方体贴图寻址，与 Vulkan 规范一致: 按主轴选面，另两个分量映射到 [0, 1]
+    void cubeFaceCoords(const glm::vec3& dir, uint32_t& face, float& s, float& t)
+    {
+        const glm::vec3 a = glm::abs(dir);
+        float sc, tc, ma;
+        if (a.x >= a.y && a.x >= a.z) {
+            face = dir.x >= 0.0f ? 0 : 1;
+            ma = a.x;
+            sc = dir.x >= 0.0f ? -dir.z : dir.z;
+            tc = -dir.y;
+        } else if (a.y >= a.z) {
+            face = dir.y >= 0.0f ? 2 : 3;
+            ma = a.y;
+            sc = dir.x;
+            tc = dir.y >= 0.0f ? dir.z : -dir.z;
+        } else {
+            face = dir.z >= 0.0f ? 4 : 5;
+            ma = a.z;
+            sc = dir.z >= 0.0f ? dir.x : -dir.x;
+            tc = -dir.y;
+        }
+        s = 0.5f * (sc / ma + 1.0f);
+        t = 0.5f * (tc / ma + 1.0f);
+    }
+
+    // 面内双线性过滤，边缘钳制到本面(GPU 的无缝立方体贴图会跨面混合，只影响边缘一个像素以内)
+    Float4 bilinear(const IBLBaker::Image& image, uint32_t level, uint32_t face, float s, float t)
+    {
+        const uint32_t dim = image.levelDim(level);
+        const int32_t last = static_cast<int32_t>(dim) - 1;
+        const float x = s * float(dim) - 0.5f;
+        const float y = t * float(dim) - 0.5f;
+        const float fx = std::floor(x);
+        const float fy = std::floor(y);
+        const int32_t x0 = std::clamp(static_cast<int32_t>(fx), 0, last);
+        const int32_t x1 = std::clamp(static_cast<int32_t>(fx) + 1, 0, last);
+        const int32_t y0 = std::clamp(static_cast<int32_t>(fy), 0, last);
+        const int32_t y1 = std::clamp(static_cast<int32_t>(fy) + 1, 0, last);
+        const float* row0 = image.row(level, face, y0);
+        const float* row1 = image.row(level, face, y1);
+        const Float4 top = lerp(Float4::load(row0 + x0 * 4), Float4::load(row0 + x1 * 4), x - fx);
+        const Float4 bottom = lerp(Float4::load(row1 + x0 * 4), Float4::load(row1 + x1 * 4), x - fx);
+        return lerp(top, bottom, y - fy);
+    }
+
+    // samplerEnv.SampleLevel(dir, lod) 的三线性过滤
+    Float4 sampleLevel(const IBLBaker::Image& image, const glm::vec3& dir, float lod)
+    {
+        uint32_t face;
+        float s, t;
+        cubeFaceCoords(dir, face, s, t);
+        lod = std::clamp(lod, 0.0f, float(image.mipLevels - 1));
+        const uint32_t level = static_cast<uint32_t>(lod);
+        const float fraction = lod - float(level);
+        const Float4 color = bilinear(image, level, face, s, t);
+        if (fraction == 0.0f || level + 1 >= image.mipLevels) {
+            return color;
+        }
+        return lerp(color, bilinear(image, level + 1, face, s, t), fraction);
+    }
+
+    uint32_t channelCount(VkFormat format)
+    {
+        return format == VK_FORMAT_R16G16_SFLOAT ? 2 : 4;
+    }
+
+    // RGBA32F 图像与缓存文件格式之间的转换，texel 数据按 KTX 顺序(逐 mip、逐面)排列
+    std::vector<uint8_t> encode(const IBLBaker::Image& image, VkFormat format)
+    {
+        const uint32_t channels = channelCount(format);
+        const bool half = format != VK_FORMAT_R32G32B32A32_SFLOAT;
+        std::vector<uint8_t> data(image.texels.size() / 4 * vks::texturecache::formatSize(format));
+        uint8_t* dst = data.data();
+        for (size_t i = 0; i < image.texels.size(); i += 4) {
+            for (uint32_t c = 0; c < channels; c++) {
+                if (half) {
+                    const uint16_t value = glm::packHalf1x16(image.texels[i + c]);
+                    memcpy(dst, &value, sizeof(value));
+                    dst += sizeof(value);
+                } else {
+                    memcpy(dst, &image.texels[i + c], sizeof(float));
+                    dst += sizeof(float);
+                }
+            }
+        }
+        return data;
+    }
+
+    // firstLevel 为文件中与 image 第 0 层对应的 mip
+    bool decode(ktxTexture* texture, VkFormat format, IBLBaker::Image& image, uint32_t firstLevel = 0)
+    {
+        const uint32_t channels = channelCount(format);
+        const bool half = format != VK_FORMAT_R32G32B32A32_SFLOAT;
+        const uint8_t* data = ktxTexture_GetData(texture);
+        for (uint32_t level = 0; level < image.mipLevels; level++) {
+            const uint32_t dim = image.levelDim(level);
+            for (uint32_t face = 0; face < image.faces; face++) {
+                ktx_size_t offset;
+                if (ktxTexture_GetImageOffset(texture, firstLevel + level, 0, face, &offset) != KTX_SUCCESS) {
+                    return false;
+                }
+                const uint8_t* src = data + offset;
+                for (uint32_t y = 0; y < dim; y++) {
+                    float* dst = image.row(level, face, y);
+                    for (uint32_t x = 0; x < dim; x++) {
+                        float texel[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
+                        for (uint32_t c = 0; c < channels; c++) {
+                            if (half) {
+                                uint16_t value;
+                                memcpy(&value, src, sizeof(value));
+                                texel[c] = glm::unpackHalf1x16(value);
+                                src += sizeof(value);
+                            } else {
+                                memcpy(&texel[c], src, sizeof(float));
+                                src += sizeof(float);
+                            }
+                        }
+                        memcpy(dst + x * 4, texel, sizeof(texel));
+                    }
+                }
+            }
+        }
+        return true;
+    }
+
+    // 逐 mip 输出 RMSE、相对 RMSE 与最大误差，相对 RMSE 超过 tolerance 的 mip 会被标出，返回各 mip 中最大的相对 RMSE
+    double compareImages(const IBLBaker::Image& reference, const IBLBaker::Image& baked, uint32_t channels, float tolerance)
+    {
+        double worst = 0.0;
+        for (uint32_t level = 0; level < reference.mipLevels; level++) {
+            const size_t begin = reference.levelOffsets[level];
+            const size_t end = level + 1 < reference.mipLevels ? reference.levelOffsets[level + 1] : reference.texels.size();
+            double squaredError = 0.0;
+            double squaredReference = 0.0;
+            double maxError = 0.0;
+            size_t count = 0;
+            size_t nonFinite = 0;
+            for (size_t t = begin; t < end; t += 4) {
+                for (uint32_t c = 0; c < channels; c++) {
+                    const float expected = reference.texels[t + c];
+                    const float actual = baked.texels[t + c];
+                    // 方向退化的像素(如 1x1 mip 的 +Y 面)在两边都可能是 NaN，不参与统计
+                    if (!std::isfinite(expected) || !std::isfinite(actual)) {
+                        nonFinite++;
+                        continue;
+                    }
+                    const double error = double(actual) - double(expected);
+                    squaredError += error * error;
+                    squaredReference += double(expected) * double(expected);
+                    maxError = std::max(maxError, std::abs(error));
+                    count++;
+                }
+            }
+            const double rmse = count > 0 ? std::sqrt(squaredError / count) : 0.0;
+            const double rms = count > 0 ? std::sqrt(squaredReference / count) : 0.0;
+            const double relative = rms > 0.0 ? rmse / rms : rmse;
+            const bool passed = relative <= tolerance;
+            worst = std::max(worst, relative);
+            std::cout << "  mip " << level << ": rmse " << rmse << ", relative rmse " << relative << ", max error " << maxError;
+            if (nonFinite > 0) {
+                std::cout << ", " << nonFinite << " non-finite values skipped";
+            }
+            std::cout << (passed ? "" : " (above tolerance)") << std::endl;
+        }
+        return worst;
+    }
+
+    void printStatistics(const char* name, const IBLBaker::Statistics& statistics, uint32_t threadCount)
+    {
+        const double seconds = statistics.milliseconds / 1000.0;
+        std::cout << "  " << name << ": " << statistics.milliseconds << " ms on " << threadCount << " threads, "
+            << statistics.texels / seconds / 1.0e6 << " Mtexels/s, " << statistics.samples / seconds / 1.0e6 << " Msamples/s" << std::endl;
+    }
+}
+
+void IBLBaker::Image::allocate(uint32_t dim, uint32_t faces, uint32_t mipLevels)
+{
+    this->dim = dim;
+    this->faces = faces;
+    this->mipLevels = mipLevels;
+    levelOffsets.resize(mipLevels);
+    size_t size = 0;
+    for (uint32_t level = 0; level < mipLevels; level++) {
+        levelOffsets[level] = size;
+        size += static_cast<size_t>(levelDim(level)) * levelDim(level) * faces * 4;
+    }
+    texels.assign(size, 0.0f);
+}
+
+float* IBLBaker::Image::row(uint32_t level, uint32_t face, uint32_t y)
+{
+    const size_t levelSize = levelDim(level);
+    return texels.data() + levelOffsets[level] + (face * levelSize + y) * levelSize * 4;
+}
+
+const float* IBLBaker::Image::row(uint32_t level, uint32_t face, uint32_t y) const
+{
+    const size_t levelSize = levelDim(level);
+    return texels.data() + levelOffsets[level] + (face * levelSize + y) * levelSize * 4;
+}
+
+IBLBaker::IBLBaker(uint32_t threadCount)
+{
+    setThreadCount(threadCount);
+}
+
+void IBLBaker::setThreadCount(uint32_t threadCount)
+{
+    this->threadCount = threadCount > 0 ? threadCount : std::max(1u, std::thread::hardware_concurrency());
+}
+
+template<typename Fn>
+void IBLBaker::parallelFor(uint32_t count, Fn&& fn)
+{
+    // 工作线程从共享计数器领取任务(一行像素)，行与行之间的耗时差异不会拖住某个线程
+    std::atomic<uint32_t> next{ 0 };
+    auto worker = [&]() {
+        for (uint32_t i = next++; i < count; i = next++) {
+            fn(i);
+        }
+    };
+    const uint32_t workers = std::min(threadCount, count);
+    std::vector<std::thread> threads;
+    threads.reserve(workers > 0 ? workers - 1 : 0);
+    for (uint32_t i = 1; i < workers; i++) {
+        threads.emplace_back(worker);
+    }
+    worker();
+    for (auto& thread : threads) {
+        thread.join();
+    }
+}
+
+bool IBLBaker::loadEnvironment(const std::string& fileName, uint32_t maxDim)
+{
+    ktxTexture* texture = nullptr;
+    if (ktxTexture_CreateFromNamedFile(fileName.c_str(), KTX_TEXTURE_CREATE_LOAD_IMAGE_DATA_BIT, &texture) != KTX_SUCCESS) {
+        std::cerr << "Could not load environment map \"" << fileName << "\"" << std::endl;
+        return false;
+    }
+    VkFormat format = VK_FORMAT_UNDEFINED;
+    if (texture->glInternalformat == 0x881A) {			// GL_RGBA16F
+        format = VK_FORMAT_R16G16B16A16_SFLOAT;
+    } else if (texture->glInternalformat == 0x8814) {	// GL_RGBA32F
+        format = VK_FORMAT_R32G32B32A32_SFLOAT;
+    }
+    bool result = format != VK_FORMAT_UNDEFINED && texture->numFaces == 6 && texture->baseWidth == texture->baseHeight;
+    if (result) {
+        uint32_t firstLevel = 0;
+        while (maxDim > 0 && firstLevel + 1 < texture->numLevels && (texture->baseWidth >> firstLevel) > maxDim) {
+            firstLevel++;
+        }
+        environment.allocate(texture->baseWidth >> firstLevel, 6, texture->numLevels - firstLevel);
+        result = decode(texture, format, environment, firstLevel);
+    }
+    ktxTexture_Destroy(texture);
+    if (!result) {
+        std::cerr << "Environment map \"" << fileName << "\" must be a square RGBA16F or RGBA32F cube map" << std::endl;
+    }
+    return result;
+}
+
+IBLBaker::Statistics IBLBaker::bakeBRDFLut()
+{
+    auto tStart = std::chrono::high_resolution_clock::now();
+    const uint32_t dim = ibl::parameters.lutDim;
+    const uint32_t numSamples = ibl::parameters.lutSamples;
+    lut.allocate(dim, 1, 1);
+
+    // 法线固定为 +Z，一行像素的粗糙度相同，半程向量对整行只计算一次，四个相邻像素(不同的 NoV)用 SIMD 同时累加
+    const TangentFrame frame = tangentFrame(glm::vec3(0.0f, 0.0f, 1.0f));
+    parallelFor(dim, [&](uint32_t y) {
+        const float roughness = (float(y) + 0.5f) / float(dim);
+        std::vector<glm::vec3> halfVectors(numSamples);
+        for (uint32_t i = 0; i < numSamples; i++) {
+            halfVectors[i] = importanceSample_GGX(ggxSample(hammersley2d(i, numSamples), roughness), frame);
+        }
+        const float k = (roughness * roughness) / 2.0f;
+        const Float4 zero = Float4::splat(0.0f);
+        const Float4 one = Float4::splat(1.0f);
+        const Float4 two = Float4::splat(2.0f);
+        const Float4 kVec = Float4::splat(k);
+        const Float4 oneMinusK = Float4::splat(1.0f - k);
+        float* dst = lut.row(0, 0, y);
+        for (uint32_t x = 0; x < dim; x += 4) {
+            float nov[4];
+            for (uint32_t lane = 0; lane < 4; lane++) {
+                nov[lane] = (float(std::min(x + lane, dim - 1)) + 0.5f) / float(dim);
+            }
+            const Float4 NoV = Float4::load(nov);
+            // V = (sqrt(1 - NoV^2), 0, NoV)
+            const Float4 Vx = squareRoot(one - NoV * NoV);
+            const Float4 dotNV = maximum(NoV, zero);
+            const Float4 GV = dotNV / (dotNV * oneMinusK + kVec);
+            Float4 sumScale = zero;
+            Float4 sumBias = zero;
+            for (const glm::vec3& H : halfVectors) {
+                const Float4 Hx = Float4::splat(H.x);
+                const Float4 Hz = Float4::splat(H.z);
+                const Float4 VdotH = Vx * Hx + NoV * Hz;
+                // L = 2 * dot(V, H) * H - V，N = +Z 时 dot(N, L) 即 L.z
+                const Float4 NdotL = two * VdotH * Hz - NoV;
+                const Float4 dotNL = maximum(NdotL, zero);
+                const Float4 dotVH = maximum(VdotH, zero);
+                const Float4 dotNH = maximum(Hz, zero);
+                const Float4 GL = dotNL / (dotNL * oneMinusK + kVec);
+                const Float4 G_Vis = (GL * GV * dotVH) / (dotNH * dotNV);
+                const Float4 f = one - dotVH;
+                const Float4 Fc = f * f * f * f * f;
+                sumScale = sumScale + selectGreater(dotNL, zero, (one - Fc) * G_Vis);
+                sumBias = sumBias + selectGreater(dotNL, zero, Fc * G_Vis);
+            }
+            const Float4 invCount = Float4::splat(1.0f / float(numSamples));
+            float scale[4], bias[4];
+            (sumScale * invCount).store(scale);
+            (sumBias * invCount).store(bias);
+            for (uint32_t lane = 0; lane < 4 && x + lane < dim; lane++) {
+                float* texel = dst + (x + lane) * 4;
+                texel[0] = scale[lane];
+                texel[1] = bias[lane];
+                texel[2] = 0.0f;
+                texel[3] = 1.0f;
+            }
+        }
+    });
+
+    Statistics statistics;
+    statistics.milliseconds = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - tStart).count();
+    statistics.texels = static_cast<uint64_t>(dim) * dim;
+    statistics.samples = statistics.texels * numSamples;
+    return statistics;
+}
+
+IBLBaker::Statistics IBLBaker::bakePrefiltered(const ibl::PrefilterSettings& settings)
+{
+    auto tStart = std::chrono::high_resolution_clock::now();
+    const uint32_t dim = ibl::parameters.prefilteredDim;
+    const uint32_t numMips = ibl::mipLevelCount(dim);
+    prefiltered.allocate(dim, 6, numMips);
+
+    // V = N 时 dot(N, H) 与 dot(V, H) 都等于切线空间的 cosTheta，
+    // 因此 dot(N, L)、pdf 与采样的 mip 层级只取决于采样序号和粗糙度，按 mip 预先计算
+    struct PrefilterSample {
+        GGXSample ggx;
+        float dotNL;
+        float mipLevel;
+    };
+    const float omegaP = 4.0f * PI / (6.0f * float(environment.dim) * float(environment.dim));
+
+    uint64_t texels = 0;
+    uint64_t totalSamples = 0;
+    for (uint32_t m = 0; m < numMips; m++) {
+        const float roughness = (float)m / (float)(numMips - 1);
+        const uint32_t numSamples = settings.sampleCount(m);
+        std::vector<PrefilterSample> samples;
+        for (uint32_t i = 0; i < numSamples; i++) {
+            const GGXSample ggx = ggxSample(hammersley2d(i, numSamples), roughness);
+            const float dotNH = std::clamp(ggx.cosTheta, 0.0f, 1.0f);
+            const float dotNL = std::clamp(2.0f * dotNH * dotNH - 1.0f, 0.0f, 1.0f);
+            if (dotNL <= 0.0f) {
+                continue;
+            }
+            float mipLevel = 0.0f;
+            if (settings.filteredSampling && roughness != 0.0f) {
+                const float pdf = D_GGX(dotNH, roughness) * dotNH / (4.0f * dotNH) + 0.0001f;
+                const float omegaS = 1.0f / (float(numSamples) * pdf);
+                mipLevel = std::max(0.5f * std::log2(omegaS / omegaP) + settings.lodBias, 0.0f);
+            }
+            samples.push_back({ ggx, dotNL, mipLevel });
+        }
+
+        const uint32_t mipDim = prefiltered.levelDim(m);
+        texels += static_cast<uint64_t>(mipDim) * mipDim * 6;
+        totalSamples += static_cast<uint64_t>(mipDim) * mipDim * 6 * numSamples;
+        parallelFor(mipDim * 6, [&](uint32_t index) {
+            const uint32_t face = index / mipDim;
+            const uint32_t y = index % mipDim;
+            float* dst = prefiltered.row(m, face, y);
+            for (uint32_t x = 0; x < mipDim; x++) {
+                const TangentFrame frame = tangentFrame(cubeDirection(x, y, face, float(mipDim)));
+                Float4 color = Float4::splat(0.0f);
+                float totalWeight = 0.0f;
+                for (const PrefilterSample& sample : samples) {
+                    const glm::vec3 H = importanceSample_GGX(sample.ggx, frame);
+                    const glm::vec3 L = 2.0f * glm::dot(frame.normal, H) * H - frame.normal;
+                    color = color + sampleLevel(environment, L, sample.mipLevel) * Float4::splat(sample.dotNL);
+                    totalWeight += sample.dotNL;
+                }
+                (color / Float4::splat(totalWeight)).store(dst + x * 4);
+                dst[x * 4 + 3] = 1.0f;
+            }
+        });
+    }
+
+    Statistics statistics;
+    statistics.milliseconds = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - tStart).count();
+    statistics.texels = texels;
+    statistics.samples = totalSamples;
+    return statistics;
+}
+
+IBLBaker::Statistics IBLBaker::projectIrradianceSH()
+{
+    auto tStart = std::chrono::high_resolution_clock::now();
+    uint32_t level = 0;
+    while (level + 1 < environment.mipLevels && environment.levelDim(level) > ibl::parameters.shProjectionDim) {
+        level++;
+    }
+    const uint32_t dim = environment.levelDim(level);
+
+    // 每行像素累加到自己的部分和，所有行完成后再按固定顺序归约，结果与线程数无关
+    struct RowSum {
+        Float4 coefficients[9];
+        float weight;
+    };
+    std::vector<RowSum> rows(dim * 6);
+    parallelFor(dim * 6, [&](uint32_t index) {
+        const uint32_t face = index / dim;
+        const uint32_t y = index % dim;
+        const float* src = environment.row(level, face, y);
+        RowSum sum{};
+        for (Float4& coefficient : sum.coefficients) {
+            coefficient = Float4::splat(0.0f);
+        }
+        for (uint32_t x = 0; x < dim; x++) {
+            // 像素对应的立体角 (2 / dim)^2 / (1 + u^2 + v^2)^1.5
+            const float u = (float(x) + 0.5f) / float(dim) * 2.0f - 1.0f;
+            const float v = (float(y) + 0.5f) / float(dim) * 2.0f - 1.0f;
+            const float r2 = 1.0f + u * u + v * v;
+            const float weight = 4.0f / (float(dim) * float(dim) * r2 * std::sqrt(r2));
+            const glm::vec3 n = cubeDirection(x, y, face, float(dim));
+            // 实数球谐基函数，与着色器中 irradianceSH 的顺序一致
+            const float basis[9] = {
+                0.282095f,
+                0.488603f * n.y,
+                0.488603f * n.z,
+                0.488603f * n.x,
+                1.092548f * n.x * n.y,
+                1.092548f * n.y * n.z,
+                0.315392f * (3.0f * n.z * n.z - 1.0f),
+                1.092548f * n.x * n.z,
+                0.546274f * (n.x * n.x - n.y * n.y),
+            };
+            const Float4 color = Float4::load(src + x * 4) * Float4::splat(weight);
+            for (uint32_t i = 0; i < 9; i++) {
+                sum.coefficients[i] = sum.coefficients[i] + color * Float4::splat(basis[i]);
+            }
+            sum.weight += weight;
+        }
+        rows[index] = sum;
+    });
+
+    Float4 coefficients[9];
+    for (Float4& coefficient : coefficients) {
+        coefficient = Float4::splat(0.0f);
+    }
+    float totalWeight = 0.0f;
+    for (const RowSum& row : rows) {
+        for (uint32_t i = 0; i < 9; i++) {
+            coefficients[i] = coefficients[i] + row.coefficients[i];
+        }
+        totalWeight += row.weight;
+    }
+
+    // 立体角之和归一化到 4π 以消除离散误差，再乘以余弦瓣卷积的各阶因子 π、2π/3、π/4 并除以 π
+    const float normalization = 4.0f * PI / totalWeight;
+    const float bandFactors[9] = { 1.0f, 2.0f / 3.0f, 2.0f / 3.0f, 2.0f / 3.0f, 0.25f, 0.25f, 0.25f, 0.25f, 0.25f };
+    for (uint32_t i = 0; i < 9; i++) {
+        float value[4];
+        (coefficients[i] * Float4::splat(normalization * bandFactors[i])).store(value);
+        irradianceSH[i] = glm::vec4(value[0], value[1], value[2], 0.0f);
+    }
+
+    Statistics statistics;
+    statistics.milliseconds = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - tStart).count();
+    statistics.texels = static_cast<uint64_t>(dim) * dim * 6;
+    statistics.samples = statistics.texels;
+    return statistics;
+}
+
+bool IBLBaker::save(const std::string& directory, uint64_t key) const
+{
+    std::error_code ec;
+    std::filesystem::create_directories(directory, ec);
+    const std::array<ibl::CacheFile, 2> files = ibl::cacheFiles(directory, key);
+    const std::array<const Image*, 2> images = { &lut, &prefiltered };
+    bool result = true;
+    for (size_t i = 0; i < files.size(); i++) {
+        if (!vks::texturecache::writeKTX(files[i].fileName, files[i].info, encode(*images[i], files[i].info.format))) {
+            result = false;
+            continue;
+        }
+        std::cout << "Wrote \"" << files[i].fileName << "\"" << std::endl;
+    }
+    return result;
+}
+
+bool IBLBaker::compare(const std::string& directory, uint64_t key, float tolerance) const
+{
+    const std::array<ibl::CacheFile, 2> files = ibl::cacheFiles(directory, key);
+    const std::array<const Image*, 2> images = { &lut, &prefiltered };
+    bool result = true;
+    for (size_t i = 0; i < files.size(); i++) {
+        const ibl::CacheFile& file = files[i];
+        ktxTexture* texture = nullptr;
+        if (!vks::texturecache::isValid(file.fileName, file.info) ||
+            ktxTexture_CreateFromNamedFile(file.fileName.c_str(), KTX_TEXTURE_CREATE_LOAD_IMAGE_DATA_BIT, &texture) != KTX_SUCCESS) {
+            std::cerr << "No valid reference file \"" << file.fileName << "\"" << std::endl;
+            result = false;
+            continue;
+        }
+        Image reference;
+        reference.allocate(file.info.width, file.info.faces, file.info.mipLevels);
+        const bool decoded = decode(texture, file.info.format, reference);
+        ktxTexture_Destroy(texture);
+        if (!decoded) {
+            std::cerr << "Could not read \"" << file.fileName << "\"" << std::endl;
+            result = false;
+            continue;
+        }
+
+        // LUT 只有两个通道，立方体贴图比较 RGB
+        const uint32_t channels = channelCount(file.info.format) == 2 ? 2 : 3;
+        std::cout << file.fileName << std::endl;
+        result = compareImages(reference, *images[i], channels, tolerance) <= tolerance && result;
+    }
+    return result;
+}
+
+bool IBLBaker::runFromCommandLine(const std::vector<const char*>& args, int& exitCode)
+{
+    CommandLineParser parser;
+    parser.add("bakeibl", { "--bakeibl" }, 1, "Bake the IBL maps on the CPU into the given directory and exit");
+    parser.add("bakeiblbenchmark", { "--bakeiblbenchmark" }, 0, "Measure the CPU IBL baker single and multithreaded and exit");
+    parser.add("bakeiblcompare", { "--bakeiblcompare" }, 1, "Compare the CPU baked IBL maps against the cache files in the given directory");
+    parser.add("bakeiblprefiltertest", { "--bakeiblprefiltertest" }, 0, "Compare the pre-filtered cube against a high sample count reference and exit");
+    parser.add("bakeibltolerance", { "--bakeibltolerance" }, 1, "Maximum relative RMSE per mip level for --bakeiblcompare and --bakeiblprefiltertest (default 0.05)");
+    parser.add("bakeiblthreads", { "--bakeiblthreads" }, 1, "Number of CPU IBL baker threads (default: all hardware threads)");
+    parser.add("bakeiblenvironment", { "--bakeiblenvironment" }, 1, "Environment cube map relative to the asset path");
+    parser.add("resourcepath", { "-rp", "--resourcepath" }, 1, "Set path for dir where assets and shaders folder is present");
+    parser.parse(args);
+    const bool benchmark = parser.isSet("bakeiblbenchmark");
+    const bool prefilterTest = parser.isSet("bakeiblprefiltertest");
+    if (!parser.isSet("bakeibl") && !benchmark && !prefilterTest) {
+        return false;
+    }
+
+    vks::tool::attachConsole();
+
+    if (parser.isSet("resourcepath")) {
+        vks::tools::resourcePath = parser.getValueAsString("resourcepath", "");
+    }
+    const std::string environmentFile = getAssetPath() + parser.getValueAsString("bakeiblenvironment", defaultEnvironmentFile);
+    // 实现与计算路径一致，使用计算路径的缓存键
+    const uint64_t key = ibl::cacheKey(environmentFile, true);
+
+    IBLBaker baker(static_cast<uint32_t>(parser.getValueAsInt("bakeiblthreads", 0)));
+    if (!baker.loadEnvironment(environmentFile)) {
+        exitCode = 1;
+        return true;
+    }
+    const float tolerance = strtof(parser.getValueAsString("bakeibltolerance", "0.05").c_str(), nullptr);
+
+    if (prefilterTest) {
+        // 以每个 mip 都取 prefilterReferenceSamples 个采样的结果为基准，比较默认的自适应采样数与固定 32 个采样、+1 层级偏移(改为自适应之前的默认值)，
+        // 自适应结果最差一级 mip 的相对 RMSE 不超过固定采样数的结果加 tolerance 时通过
+        const ibl::PrefilterSettings fixedSettings{ true, false, 32, 1.0f };
+        std::cout << "Pre-filtered cube for \"" << environmentFile << "\" against " << ibl::parameters.prefilterReferenceSamples << " samples per texel" << std::endl;
+        const Statistics referenceStatistics = baker.bakePrefiltered(ibl::referencePrefilterSettings);
+        printStatistics("Reference", referenceStatistics, baker.getThreadCount());
+        const Image reference = std::move(baker.prefiltered);
+        const Statistics fixedStatistics = baker.bakePrefiltered(fixedSettings);
+        printStatistics("Fixed", fixedStatistics, baker.getThreadCount());
+        const double fixedError = compareImages(reference, baker.prefiltered, 3, 1.0f);
+        const Statistics statistics = baker.bakePrefiltered(ibl::prefilterSettings);
+        printStatistics("Adaptive", statistics, baker.getThreadCount());
+        const double adaptiveError = compareImages(reference, baker.prefiltered, 3, static_cast<float>(fixedError) + tolerance);
+        std::cout << "  Adaptive sampling takes " << double(referenceStatistics.samples) / double(statistics.samples) << "x fewer samples than the reference and "
+            << double(fixedStatistics.samples) / double(statistics.samples) << "x fewer than fixed sampling, worst relative rmse "
+            << adaptiveError << " (fixed " << fixedError << ")" << std::endl;
+        exitCode = adaptiveError <= fixedError + tolerance ? 0 : 1;
+        return true;
+    }
+
+    auto bakeAll = [&baker]() {
+        printStatistics("BRDF LUT", baker.bakeBRDFLut(), baker.getThreadCount());
+        printStatistics("Pre-filtered cube", baker.bakePrefiltered(), baker.getThreadCount());
+        printStatistics("Irradiance SH", baker.projectIrradianceSH(), baker.getThreadCount());
+    };
+    if (benchmark) {
+        // 单线程一轮作为基准，再用全部线程各跑一轮，对比两者的吞吐量即可得到并行加速比
+        const uint32_t threadCount = baker.getThreadCount();
+        std::cout << "Benchmarking CPU IBL baker (" << simdName << ")" << std::endl;
+        baker.setThreadCount(1);
+        bakeAll();
+        baker.setThreadCount(threadCount);
+    }
+    std::cout << "Baking IBL maps for \"" << environmentFile << "\" on the CPU" << std::endl;
+    bakeAll();
+    const IBLBaker::IrradianceSH& sh = baker.getIrradianceSH();
+    for (uint32_t i = 0; i < sh.size(); i++) {
+        std::cout << "  SH " << i << ": " << sh[i].r << " " << sh[i].g << " " << sh[i].b << std::endl;
+    }
+
+    bool result = true;
+    if (parser.isSet("bakeibl")) {
+        result = baker.save(parser.getValueAsString("bakeibl", ""), key) && result;
+    }
+    if (parser.isSet("bakeiblcompare")) {
+        result = baker.compare(parser.getValueAsString("bakeiblcompare", ""), key, tolerance) && result;
+    }
+    exitCode = result ? 0 : 1;
+    return true;
+}
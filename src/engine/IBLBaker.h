@@ -0,0 +1,76 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+#include "IBLParameters.h"
+
+// IBL 预计算的 CPU 实现，不需要 Vulkan 设备，用于在没有 GPU 的构建机上生成资源
+// 两个生成器与 genbrdflut / prefilterenvmap 的 computeMain 逐项对应，
+// 结果按 GPU 磁盘缓存的格式与文件名写出(计算路径的缓存键)，拷进 iblcache 目录即可被引擎直接加载；
+// 也可以与 GPU 写出的缓存文件逐 mip 比较，作为计算路径的正确性基准
+// 漫反射辐照度的球谐投影也在这里实现，引擎启动时直接调用
+// 像素按 (面, 行) 分给工作线程，采样、插值与累加使用 SSE 一次处理 RGBA 四个通道(或 LUT 的四个像素)
+class IBLBaker {
+public:
+    // RGBA32F 图像的全部 mip 与面，存放顺序与 KTX 相同: 逐 mip，每个 mip 内各面连续存放
+    struct Image {
+        uint32_t dim{ 0 };
+        uint32_t faces{ 0 };
+        uint32_t mipLevels{ 0 };
+        std::vector<float> texels;
+        std::vector<size_t> levelOffsets;
+
+        void allocate(uint32_t dim, uint32_t faces, uint32_t mipLevels);
+        uint32_t levelDim(uint32_t level) const { return dim >> level > 0 ? dim >> level : 1; }
+        float* row(uint32_t level, uint32_t face, uint32_t y);
+        const float* row(uint32_t level, uint32_t face, uint32_t y) const;
+    };
+
+    // 各生成器的耗时与采样数，基准测试模式据此输出吞吐量
+    struct Statistics {
+        double milliseconds{ 0.0 };
+        uint64_t texels{ 0 };
+        uint64_t samples{ 0 };
+    };
+
+    // threadCount 为 0 时使用硬件线程数
+    explicit IBLBaker(uint32_t threadCount = 0);
+
+    // L2 球谐的 9 个 RGB 系数(w 未使用)，顺序与 pbrtexture.slang 的 irradianceSH 一致
+    using IrradianceSH = std::array<glm::vec4, 9>;
+
+    // 读取 RGBA16F 或 RGBA32F 的 KTX 立方体贴图，失败时返回 false
+    // maxDim 不为 0 时跳过边长大于它的 mip，只做球谐投影时不需要解码高分辨率的层级
+    bool loadEnvironment(const std::string& fileName, uint32_t maxDim = 0);
+
+    Statistics bakeBRDFLut();
+    // 默认使用与 GPU 路径和磁盘缓存相同的采样设置
+    Statistics bakePrefiltered(const ibl::PrefilterSettings& settings = ibl::prefilterSettings);
+    // 把环境贴图投影到 L2 球谐，系数已与余弦瓣卷积并除以 π，求值结果与原辐照度立方体贴图中的值相同
+    Statistics projectIrradianceSH();
+    const IrradianceSH& getIrradianceSH() const { return irradianceSH; }
+
+    // 按 ibl::cacheFiles 的格式与文件名写出结果图像
+    bool save(const std::string& directory, uint64_t key) const;
+    // 与目录中同一缓存键的文件逐 mip 比较，输出 RMSE 与最大误差
+    // 任一 mip 的相对 RMSE 超过 tolerance 或文件缺失时返回 false
+    bool compare(const std::string& directory, uint64_t key, float tolerance) const;
+
+    void setThreadCount(uint32_t threadCount);
+    uint32_t getThreadCount() const { return threadCount; }
+
+    // 命令行入口，参数中包含 --bakeibl、--bakeiblbenchmark 或 --bakeiblprefiltertest 时执行并返回 true，exitCode 为进程退出码
+    static bool runFromCommandLine(const std::vector<const char*>& args, int& exitCode);
+
+private:
+    template<typename Fn>
+    void parallelFor(uint32_t count, Fn&& fn);
+
+    uint32_t threadCount;
+    Image environment;
+    Image lut;
+    Image prefiltered;
+    IrradianceSH irradianceSH{};
+};
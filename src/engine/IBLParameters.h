@@ -0,0 +1,106 @@
+#pragma once
+#include <vulkan/vulkan.h>
+#include <array>
+#include <cmath>
+#include <fstream>
+#include <string>
+#include <vector>
+#include "VulkanTextureCache.h"
+
+// GPU 生成路径(vkUtils)与 CPU 烘焙器(IBLBaker)共用的 IBL 参数与缓存文件约定
+// 两边读取同一份定义，CPU 烘焙出的文件可以直接放进缓存目录被引擎加载
+namespace ibl
+{
+	// IBL 生成参数，同时参与磁盘缓存键的计算
+	// 修改参数或预计算着色器的算法时递增 version，使旧的缓存文件失效
+	struct Parameters {
+		uint32_t version = 4;
+		uint32_t lutDim = 512;
+		uint32_t prefilteredDim = 512;
+		// 预滤波每个像素的采样数；自适应时为 mip 1 的采样数，之后每级翻倍，不超过 prefilterMaxSamples
+		uint32_t prefilterSamples = 6;
+		uint32_t prefilterMaxSamples = 256;
+		// 按 PDF 选择的采样层级再加上的偏移；原先固定 +1，低粗糙度的层级因此模糊过度，采样数越少越明显
+		float prefilterLodBias = 0.0f;
+		// 参考结果每个像素的采样数，只用于检验预滤波的质量
+		uint32_t prefilterReferenceSamples = 1024;
+		// genbrdflut.slang 中 NUM_SAMPLES 特化常量的默认值
+		uint32_t lutSamples = 1024;
+		// 球谐投影使用环境贴图中边长不超过该值的第一个 mip，L2 球谐只保留低频，更高的分辨率不改变结果
+		uint32_t shProjectionDim = 64;
+	};
+	constexpr Parameters parameters{};
+
+	// 预滤波立方体贴图的采样方式，GPU 两条生成路径与 CPU 烘焙器共用
+	struct PrefilterSettings {
+		// 按采样的 PDF 从环境贴图 mip 链中选择采样层级(filtered importance sampling)，关闭时全部从 mip 0 采样
+		bool filteredSampling = true;
+		// 按 mip 调整采样数，关闭时每个 mip 都使用 samples 个采样
+		bool adaptiveSampleCount = true;
+		uint32_t samples = parameters.prefilterSamples;
+		// 只在 filteredSampling 时生效
+		float lodBias = parameters.prefilterLodBias;
+
+		uint32_t sampleCount(uint32_t mipLevel) const
+		{
+			if (!adaptiveSampleCount) {
+				return samples;
+			}
+			// mip 0 的粗糙度为 0，GGX 瓣退化为镜面方向，一个采样即为精确结果
+			if (mipLevel == 0) {
+				return 1;
+			}
+			// 滤波后的误差几乎与粗糙度无关，而每降一级 mip 像素数变为 1/4，
+			// 采样数逐级翻倍时每级的总开销仍然减半，用很小的代价降低高粗糙度层级的噪声
+			const uint32_t shift = mipLevel - 1 < 16 ? mipLevel - 1 : 16;
+			const uint32_t count = samples << shift;
+			return count < parameters.prefilterMaxSamples ? count : parameters.prefilterMaxSamples;
+		}
+	};
+	// 引擎与磁盘缓存使用的设置；缓存键只包含 parameters，使用其他设置生成的结果不应写入缓存
+	constexpr PrefilterSettings prefilterSettings{};
+	// 质量对比的基准: 滤波采样的模糊随采样数增加而消失，1024 个采样时已基本收敛；
+	// 不做滤波的暴力采样在同样的采样数下仍会被小而亮的光源(如太阳)主导噪声，不适合作为基准
+	// 基准保留原先的 +1 层级偏移，与改动之前的对比结果保持可比
+	constexpr PrefilterSettings referencePrefilterSettings{ true, false, parameters.prefilterReferenceSamples, 1.0f };
+
+	constexpr VkFormat lutFormat = VK_FORMAT_R16G16_SFLOAT;	// R16G16 is supported pretty much everywhere
+	constexpr VkFormat prefilteredFormat = VK_FORMAT_R16G16B16A16_SFLOAT;
+
+	inline uint32_t mipLevelCount(uint32_t dim)
+	{
+		return static_cast<uint32_t>(floor(log2(dim))) + 1;
+	}
+
+	// 磁盘缓存中的两张结果图像: BRDF LUT、预滤波立方体贴图
+	// 漫反射辐照度的球谐系数在启动时直接从环境贴图投影，耗时很短，不进入缓存
+	struct CacheFile {
+		std::string fileName;
+		vks::texturecache::ImageInfo info;
+	};
+
+	inline std::array<CacheFile, 2> cacheFiles(const std::string& directory, uint64_t key)
+	{
+		return { {
+			{ vks::texturecache::fileName(directory, "brdflut", key), { lutFormat, parameters.lutDim, parameters.lutDim, 1, 1 } },
+			{ vks::texturecache::fileName(directory, "prefiltered", key), { prefilteredFormat, parameters.prefilteredDim, parameters.prefilteredDim, 6, mipLevelCount(parameters.prefilteredDim) } },
+		} };
+	}
+
+	// 按文件内容而不是路径或修改时间计算，替换环境贴图后缓存自动失效
+	// 片段着色器路径与计算路径(以及按计算路径实现的 CPU 烘焙器)的采样细节不同，结果分开缓存
+	inline uint64_t cacheKey(const std::string& environmentFile, bool computePath)
+	{
+		std::ifstream is(environmentFile, std::ios::binary | std::ios::ate);
+		std::vector<char> data;
+		if (is.is_open()) {
+			data.resize(static_cast<size_t>(is.tellg()));
+			is.seekg(0, std::ios::beg);
+			is.read(data.data(), data.size());
+		}
+		uint64_t key = vks::tools::hashBytes(data.data(), data.size());
+		key = vks::tools::hashBytes(&parameters, sizeof(parameters), key);
+		const uint32_t path = computePath ? 1 : 0;
+		return vks::tools::hashBytes(&path, sizeof(path), key);
+	}
+}
@@ -0,0 +1,919 @@
+#include "ImageEncoder.h"
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cctype>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include "VulkanTextureCache.h"
+
+#if defined(_M_X64) || defined(__SSE2__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define IMAGE_ENCODER_SSE 1
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+    enum class Layout {
+        Unsupported,
+        RGBA8,
+        BGRA8,
+        RGBA16F,
+        RGBA32F,
+    };
+
+    Layout sourceLayout(VkFormat format)
+    {
+        switch (format) {
+        case VK_FORMAT_R8G8B8A8_UNORM:
+        case VK_FORMAT_R8G8B8A8_SRGB:
+            return Layout::RGBA8;
+        case VK_FORMAT_B8G8R8A8_UNORM:
+        case VK_FORMAT_B8G8R8A8_SRGB:
+            return Layout::BGRA8;
+        case VK_FORMAT_R16G16B16A16_SFLOAT:
+            return Layout::RGBA16F;
+        case VK_FORMAT_R32G32B32A32_SFLOAT:
+            return Layout::RGBA32F;
+        default:
+            return Layout::Unsupported;
+        }
+    }
+
+    // 色调映射的结果按 12 位量化后查表做伽马校正，避免逐通道调用 pow
+    constexpr uint32_t gammaLutBits = 12;
+    constexpr float gammaLutScale = float((1u << gammaLutBits) - 1);
+
+    // 与 pbrtexture.slang 中的 Uncharted2Tonemap 相同
+    float uncharted2Tonemap(float x)
+    {
+        const float A = 0.15f;
+        const float B = 0.50f;
+        const float C = 0.10f;
+        const float D = 0.20f;
+        const float E = 0.02f;
+        const float F = 0.30f;
+        return ((x * (A * x + C * B) + D * E) / (x * (A * x + B) + D * F)) - E / F;
+    }
+
+    const float whiteScale = 1.0f / uncharted2Tonemap(11.2f);
+
+    // 半精度转单精度: 指数与尾数左移到单精度的位置后乘以 2^112 修正指数偏移(非规格化数也随之规格化)，Inf/NaN 单独恢复指数
+    float halfToFloat(uint16_t h)
+    {
+        const uint32_t magnitude = h & 0x7FFFu;
+        uint32_t bits = magnitude << 13;
+        float value;
+        memcpy(&value, &bits, sizeof(value));
+        value *= 5.192296858534828e33f;
+        memcpy(&bits, &value, sizeof(bits));
+        if (magnitude >= 0x7C00u) {
+            bits |= 0x7F800000u;
+        }
+        bits |= static_cast<uint32_t>(h & 0x8000u) << 16;
+        memcpy(&value, &bits, sizeof(value));
+        return value;
+    }
+
+    // 标量与 SSE2 实现的比较与取舍顺序相同(NaN 与负数映射为 0，Inf 映射为 1)，两者结果逐字节一致
+    uint32_t tonemapIndex(float c, float exposure)
+    {
+        float x = c * exposure;
+        x = x > 0.0f ? x : 0.0f;
+        float v = uncharted2Tonemap(x) * whiteScale;
+        v = v < 1.0f ? v : 1.0f;
+        return static_cast<uint32_t>(v * gammaLutScale + 0.5f);
+    }
+
+    uint8_t alphaValue(float a)
+    {
+        a = a > 0.0f ? a : 0.0f;
+        a = a < 1.0f ? a : 1.0f;
+        return static_cast<uint8_t>(a * 255.0f + 0.5f);
+    }
+
+    void swizzleRowScalar(const uint8_t* src, uint8_t* dst, uint32_t begin, uint32_t count)
+    {
+        for (uint32_t x = begin; x < count; x++) {
+            dst[x * 4 + 0] = src[x * 4 + 2];
+            dst[x * 4 + 1] = src[x * 4 + 1];
+            dst[x * 4 + 2] = src[x * 4 + 0];
+            dst[x * 4 + 3] = src[x * 4 + 3];
+        }
+    }
+
+    void tonemapPixelScalar(const float* rgbaIn, uint8_t* dst, float exposure, const uint8_t* lut)
+    {
+        dst[0] = lut[tonemapIndex(rgbaIn[0], exposure)];
+        dst[1] = lut[tonemapIndex(rgbaIn[1], exposure)];
+        dst[2] = lut[tonemapIndex(rgbaIn[2], exposure)];
+        dst[3] = alphaValue(rgbaIn[3]);
+    }
+
+#if defined(IMAGE_ENCODER_SSE)
+    // 每个 32 位通道中交换第 0 与第 2 字节，一次处理 4 个像素
+    uint32_t swizzleRowSSE(const uint8_t* src, uint8_t* dst, uint32_t count)
+    {
+        const __m128i greenAlpha = _mm_set1_epi32(static_cast<int>(0xFF00FF00u));
+        const __m128i lowByte = _mm_set1_epi32(0xFF);
+        uint32_t x = 0;
+        for (; x + 4 <= count; x += 4) {
+            const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + x * 4));
+            const __m128i red = _mm_and_si128(_mm_srli_epi32(v, 16), lowByte);
+            const __m128i blue = _mm_slli_epi32(_mm_and_si128(v, lowByte), 16);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + x * 4), _mm_or_si128(_mm_and_si128(v, greenAlpha), _mm_or_si128(red, blue)));
+        }
+        return x;
+    }
+
+    __m128 uncharted2TonemapSSE(__m128 x)
+    {
+        const __m128 A = _mm_set1_ps(0.15f);
+        const __m128 B = _mm_set1_ps(0.50f);
+        const __m128 CB = _mm_set1_ps(0.10f * 0.50f);
+        const __m128 DE = _mm_set1_ps(0.20f * 0.02f);
+        const __m128 DF = _mm_set1_ps(0.20f * 0.30f);
+        const __m128 EF = _mm_set1_ps(0.02f / 0.30f);
+        const __m128 numerator = _mm_add_ps(_mm_mul_ps(x, _mm_add_ps(_mm_mul_ps(A, x), CB)), DE);
+        const __m128 denominator = _mm_add_ps(_mm_mul_ps(x, _mm_add_ps(_mm_mul_ps(A, x), B)), DF);
+        return _mm_sub_ps(_mm_div_ps(numerator, denominator), EF);
+    }
+
+    // 一个像素的 RGBA 占一个向量，RGB 通道得到查表下标，alpha 通道直接得到 8 位值
+    void tonemapPixelSSE(__m128 color, uint8_t* dst, __m128 exposure, const uint8_t* lut)
+    {
+        const __m128 zero = _mm_setzero_ps();
+        const __m128 one = _mm_set1_ps(1.0f);
+        const __m128 half = _mm_set1_ps(0.5f);
+        __m128 x = _mm_max_ps(_mm_mul_ps(color, exposure), zero);
+        __m128 v = _mm_min_ps(_mm_mul_ps(uncharted2TonemapSSE(x), _mm_set1_ps(whiteScale)), one);
+        __m128 alpha = _mm_min_ps(_mm_max_ps(color, zero), one);
+        alignas(16) int32_t index[4];
+        alignas(16) int32_t alphaByte[4];
+        _mm_store_si128(reinterpret_cast<__m128i*>(index), _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(v, _mm_set1_ps(gammaLutScale)), half)));
+        _mm_store_si128(reinterpret_cast<__m128i*>(alphaByte), _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(alpha, _mm_set1_ps(255.0f)), half)));
+        dst[0] = lut[index[0]];
+        dst[1] = lut[index[1]];
+        dst[2] = lut[index[2]];
+        dst[3] = static_cast<uint8_t>(alphaByte[3]);
+    }
+
+    // 与 halfToFloat 相同的位运算，一次转换一个像素的 4 个通道
+    __m128 halfToFloatSSE(const uint8_t* src)
+    {
+        const __m128i h = _mm_unpacklo_epi16(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(src)), _mm_setzero_si128());
+        const __m128i magnitude = _mm_and_si128(h, _mm_set1_epi32(0x7FFF));
+        const __m128i sign = _mm_slli_epi32(_mm_and_si128(h, _mm_set1_epi32(0x8000)), 16);
+        __m128 value = _mm_mul_ps(_mm_castsi128_ps(_mm_slli_epi32(magnitude, 13)), _mm_set1_ps(5.192296858534828e33f));
+        const __m128i infNan = _mm_and_si128(_mm_cmpgt_epi32(magnitude, _mm_set1_epi32(0x7BFF)), _mm_set1_epi32(0x7F800000));
+        return _mm_or_ps(value, _mm_castsi128_ps(_mm_or_si128(infNan, sign)));
+    }
+
+    // 有符号字节的绝对值之和(-128 计为 128)，用于选择滤波方式
+    __m128i sumAbs(__m128i sum, __m128i v)
+    {
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i magnitude = _mm_min_epu8(v, _mm_sub_epi8(zero, v));
+        return _mm_add_epi64(sum, _mm_sad_epu8(magnitude, zero));
+    }
+
+    __m128i abs16(__m128i v)
+    {
+        return _mm_max_epi16(v, _mm_sub_epi16(_mm_setzero_si128(), v));
+    }
+
+    // 8 个 16 位通道上的 Paeth 预测，比较顺序与 PNG 规范相同: 先 a，再 b，最后 c
+    __m128i paeth16(__m128i a, __m128i b, __m128i c)
+    {
+        const __m128i pa = abs16(_mm_sub_epi16(b, c));
+        const __m128i pb = abs16(_mm_sub_epi16(a, c));
+        const __m128i pc = abs16(_mm_sub_epi16(_mm_add_epi16(a, b), _mm_add_epi16(c, c)));
+        const __m128i notA = _mm_or_si128(_mm_cmpgt_epi16(pa, pb), _mm_cmpgt_epi16(pa, pc));
+        const __m128i useC = _mm_and_si128(notA, _mm_cmpgt_epi16(pb, pc));
+        const __m128i useB = _mm_andnot_si128(useC, notA);
+        return _mm_or_si128(_mm_andnot_si128(notA, a), _mm_or_si128(_mm_and_si128(useB, b), _mm_and_si128(useC, c)));
+    }
+#endif
+
+    // PNG 的 5 种滤波方式，编码时每个字节只依赖原始数据，没有逐字节的依赖，可以整行并行计算
+    constexpr uint32_t filterCount = 5;
+
+    uint8_t paethPredictor(int a, int b, int c)
+    {
+        const int pa = std::abs(b - c);
+        const int pb = std::abs(a - c);
+        const int pc = std::abs(a + b - 2 * c);
+        if ((pa <= pb) && (pa <= pc)) {
+            return static_cast<uint8_t>(a);
+        }
+        return static_cast<uint8_t>(pb <= pc ? b : c);
+    }
+
+    uint32_t absSigned(uint8_t v)
+    {
+        return v < 128 ? v : 256u - v;
+    }
+
+    // 计算 [begin, end) 的各滤波结果，sums 累加各滤波结果的有符号绝对值
+    void filterRowScalar(const uint8_t* cur, const uint8_t* prev, uint32_t bpp, size_t begin, size_t end, uint8_t* const out[filterCount], uint64_t sums[filterCount])
+    {
+        for (size_t i = begin; i < end; i++) {
+            const uint8_t a = i >= bpp ? cur[i - bpp] : 0;
+            const uint8_t b = prev[i];
+            const uint8_t c = i >= bpp ? prev[i - bpp] : 0;
+            const uint8_t x = cur[i];
+            const uint8_t values[filterCount] = {
+                x,
+                static_cast<uint8_t>(x - a),
+                static_cast<uint8_t>(x - b),
+                static_cast<uint8_t>(x - ((a + b) >> 1)),
+                static_cast<uint8_t>(x - paethPredictor(a, b, c)),
+            };
+            for (uint32_t f = 0; f < filterCount; f++) {
+                out[f][i] = values[f];
+                sums[f] += absSigned(values[f]);
+            }
+        }
+    }
+
+#if defined(IMAGE_ENCODER_SSE)
+    // 从 bpp 开始每次处理 16 字节，返回处理到的位置，剩余的字节由标量实现处理
+    size_t filterRowSSE(const uint8_t* cur, const uint8_t* prev, uint32_t bpp, size_t length, uint8_t* const out[filterCount], uint64_t sums[filterCount])
+    {
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i one = _mm_set1_epi8(1);
+        __m128i sum[filterCount];
+        for (uint32_t f = 0; f < filterCount; f++) {
+            sum[f] = zero;
+        }
+        size_t i = bpp;
+        for (; i + 16 <= length; i += 16) {
+            const __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(cur + i));
+            const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(cur + i - bpp));
+            const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(prev + i));
+            const __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(prev + i - bpp));
+            // _mm_avg_epu8 向上取整，减去两数之和的最低位得到向下取整的平均值
+            const __m128i average = _mm_sub_epi8(_mm_avg_epu8(a, b), _mm_and_si128(_mm_xor_si128(a, b), one));
+            const __m128i paeth = _mm_packus_epi16(
+                paeth16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero), _mm_unpacklo_epi8(c, zero)),
+                paeth16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero), _mm_unpackhi_epi8(c, zero)));
+            const __m128i values[filterCount] = {
+                x,
+                _mm_sub_epi8(x, a),
+                _mm_sub_epi8(x, b),
+                _mm_sub_epi8(x, average),
+                _mm_sub_epi8(x, paeth),
+            };
+            for (uint32_t f = 0; f < filterCount; f++) {
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(out[f] + i), values[f]);
+                sum[f] = sumAbs(sum[f], values[f]);
+            }
+        }
+        for (uint32_t f = 0; f < filterCount; f++) {
+            sums[f] += static_cast<uint64_t>(_mm_cvtsi128_si32(sum[f])) + static_cast<uint64_t>(_mm_cvtsi128_si32(_mm_unpackhi_epi64(sum[f], sum[f])));
+        }
+        return i;
+    }
+#endif
+
+    uint32_t crc32(const uint8_t* data, size_t size, uint32_t crc = 0)
+    {
+        static const std::array<uint32_t, 256> table = []() {
+            std::array<uint32_t, 256> t{};
+            for (uint32_t n = 0; n < 256; n++) {
+                uint32_t c = n;
+                for (int k = 0; k < 8; k++) {
+                    c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+                }
+                t[n] = c;
+            }
+            return t;
+        }();
+        crc = ~crc;
+        for (size_t i = 0; i < size; i++) {
+            crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+        }
+        return ~crc;
+    }
+
+    uint32_t adler32(const uint8_t* data, size_t size)
+    {
+        // 5552 是两个累加值不会溢出 32 位的最大字节数
+        uint32_t s1 = 1;
+        uint32_t s2 = 0;
+        while (size > 0) {
+            const size_t block = std::min<size_t>(size, 5552);
+            for (size_t i = 0; i < block; i++) {
+                s1 += data[i];
+                s2 += s1;
+            }
+            s1 %= 65521;
+            s2 %= 65521;
+            data += block;
+            size -= block;
+        }
+        return (s2 << 16) | s1;
+    }
+
+    void putBigEndian(std::vector<uint8_t>& data, uint32_t value)
+    {
+        data.push_back(static_cast<uint8_t>(value >> 24));
+        data.push_back(static_cast<uint8_t>(value >> 16));
+        data.push_back(static_cast<uint8_t>(value >> 8));
+        data.push_back(static_cast<uint8_t>(value));
+    }
+
+    void putString(std::vector<uint8_t>& data, const std::string& value)
+    {
+        data.insert(data.end(), value.begin(), value.end());
+    }
+
+    // 写出 PNG 数据块: 长度、类型、数据与 CRC，返回数据起始的位置
+    size_t beginChunk(std::vector<uint8_t>& data, const char* type)
+    {
+        putBigEndian(data, 0);
+        data.insert(data.end(), type, type + 4);
+        return data.size();
+    }
+
+    void endChunk(std::vector<uint8_t>& data, size_t start)
+    {
+        const uint32_t length = static_cast<uint32_t>(data.size() - start);
+        for (int i = 0; i < 4; i++) {
+            data[start - 8 + i] = static_cast<uint8_t>(length >> (24 - i * 8));
+        }
+        putBigEndian(data, crc32(data.data() + start - 4, length + 4));
+    }
+
+    // deflate 按最低位在前的顺序写出比特，霍夫曼码需要按位反转后写入
+    class BitWriter {
+    public:
+        explicit BitWriter(std::vector<uint8_t>& data) : data(data) {}
+
+        void put(uint32_t value, uint32_t count)
+        {
+            bits |= static_cast<uint64_t>(value) << bitCount;
+            bitCount += count;
+            while (bitCount >= 8) {
+                data.push_back(static_cast<uint8_t>(bits));
+                bits >>= 8;
+                bitCount -= 8;
+            }
+        }
+
+        void flush()
+        {
+            if (bitCount > 0) {
+                data.push_back(static_cast<uint8_t>(bits));
+            }
+            bits = 0;
+            bitCount = 0;
+        }
+
+    private:
+        std::vector<uint8_t>& data;
+        uint64_t bits{ 0 };
+        uint32_t bitCount{ 0 };
+    };
+
+    uint32_t reverseBits(uint32_t code, uint32_t length)
+    {
+        uint32_t result = 0;
+        for (uint32_t i = 0; i < length; i++) {
+            result = (result << 1) | ((code >> i) & 1);
+        }
+        return result;
+    }
+
+    // RFC 1951 3.2.5 与 3.2.6 的长度、距离码与固定霍夫曼码表
+    struct DeflateTables {
+        static constexpr uint16_t lengthBase[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+        static constexpr uint8_t lengthExtra[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+        static constexpr uint16_t distanceBase[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+        static constexpr uint8_t distanceExtra[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+        // 字面量/长度符号(0-287)的位反转码与码长
+        uint16_t literalCode[288];
+        uint8_t literalLength[288];
+        uint16_t distanceCode[30];
+        // 匹配长度(3-258)与距离(1-32768)对应的码
+        uint8_t lengthSymbol[259];
+        uint8_t distanceSymbol[32769];
+
+        DeflateTables()
+        {
+            for (uint32_t symbol = 0; symbol < 288; symbol++) {
+                uint32_t code;
+                uint32_t length;
+                if (symbol < 144) {
+                    code = 0x30 + symbol;
+                    length = 8;
+                } else if (symbol < 256) {
+                    code = 0x190 + symbol - 144;
+                    length = 9;
+                } else if (symbol < 280) {
+                    code = symbol - 256;
+                    length = 7;
+                } else {
+                    code = 0xC0 + symbol - 280;
+                    length = 8;
+                }
+                literalCode[symbol] = static_cast<uint16_t>(reverseBits(code, length));
+                literalLength[symbol] = static_cast<uint8_t>(length);
+            }
+            for (uint32_t symbol = 0; symbol < 30; symbol++) {
+                distanceCode[symbol] = static_cast<uint16_t>(reverseBits(symbol, 5));
+            }
+            uint32_t symbol = 0;
+            for (uint32_t length = 3; length <= 258; length++) {
+                while ((symbol + 1 < 29) && (lengthBase[symbol + 1] <= length)) {
+                    symbol++;
+                }
+                lengthSymbol[length] = static_cast<uint8_t>(symbol);
+            }
+            symbol = 0;
+            for (uint32_t distance = 1; distance <= 32768; distance++) {
+                while ((symbol + 1 < 30) && (distanceBase[symbol + 1] <= distance)) {
+                    symbol++;
+                }
+                distanceSymbol[distance] = static_cast<uint8_t>(symbol);
+            }
+        }
+    };
+
+    const DeflateTables& deflateTables()
+    {
+        static const DeflateTables tables;
+        return tables;
+    }
+
+    bool writeFile(const std::filesystem::path& path, const std::vector<uint8_t>& data, std::string& error)
+    {
+        const std::filesystem::path temporary = path.string() + ".tmp";
+        {
+            std::ofstream file(temporary, std::ios::out | std::ios::binary | std::ios::trunc);
+            if (!file.is_open()) {
+                error = "Could not open " + temporary.string() + " for writing";
+                return false;
+            }
+            file.write(reinterpret_cast<const char*>(data.data()), static_cast<std::streamsize>(data.size()));
+            file.close();
+            if (!file) {
+                error = "Could not write " + temporary.string();
+                return false;
+            }
+        }
+        std::error_code ec;
+        std::filesystem::rename(temporary, path, ec);
+        if (ec) {
+            error = "Could not rename " + temporary.string() + ": " + ec.message();
+            std::filesystem::remove(temporary, ec);
+            return false;
+        }
+        return true;
+    }
+}
+
+bool ImageEncoder::fileFormatFromPath(const std::filesystem::path& path, FileFormat& format)
+{
+    std::string extension = path.extension().string();
+    std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    if (extension == ".png") {
+        format = FileFormat::PNG;
+    } else if (extension == ".qoi") {
+        format = FileFormat::QOI;
+    } else if (extension == ".ktx") {
+        format = FileFormat::KTX;
+    } else if (extension == ".ppm") {
+        format = FileFormat::PPM;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+uint32_t ImageEncoder::bytesPerPixel(VkFormat format)
+{
+    switch (sourceLayout(format)) {
+    case Layout::RGBA8:
+    case Layout::BGRA8:
+        return 4;
+    case Layout::RGBA16F:
+        return 8;
+    case Layout::RGBA32F:
+        return 16;
+    default:
+        return 0;
+    }
+}
+
+bool ImageEncoder::isHdr(VkFormat format)
+{
+    const Layout layout = sourceLayout(format);
+    return (layout == Layout::RGBA16F) || (layout == Layout::RGBA32F);
+}
+
+const uint8_t* ImageEncoder::gammaTable(float gamma)
+{
+    if (gammaLut.empty() || (gammaLutValue != gamma)) {
+        gammaLut.resize((1u << gammaLutBits));
+        for (uint32_t i = 0; i < gammaLut.size(); i++) {
+            const float value = std::pow(static_cast<float>(i) / gammaLutScale, 1.0f / gamma);
+            gammaLut[i] = static_cast<uint8_t>(std::min(value, 1.0f) * 255.0f + 0.5f);
+        }
+        gammaLutValue = gamma;
+    }
+    return gammaLut.data();
+}
+
+const std::vector<uint8_t>& ImageEncoder::convertToRGBA8(const Image& image, const Options& options)
+{
+    const Layout layout = sourceLayout(image.format);
+    const size_t rowPitch = image.rowPitch > 0 ? image.rowPitch : static_cast<size_t>(image.width) * bytesPerPixel(image.format);
+    rgba.resize(static_cast<size_t>(image.width) * image.height * 4);
+    const uint8_t* lut = isHdr(image.format) ? gammaTable(options.gamma) : nullptr;
+    for (uint32_t y = 0; y < image.height; y++) {
+        const uint8_t* src = image.pixels.data() + rowPitch * y;
+        uint8_t* dst = rgba.data() + static_cast<size_t>(image.width) * 4 * y;
+        uint32_t x = 0;
+        switch (layout) {
+        case Layout::RGBA8:
+            memcpy(dst, src, static_cast<size_t>(image.width) * 4);
+            break;
+        case Layout::BGRA8:
+#if defined(IMAGE_ENCODER_SSE)
+            if (options.simd) {
+                x = swizzleRowSSE(src, dst, image.width);
+            }
+#endif
+            swizzleRowScalar(src, dst, x, image.width);
+            break;
+        case Layout::RGBA16F:
+#if defined(IMAGE_ENCODER_SSE)
+            if (options.simd) {
+                const __m128 exposure = _mm_set1_ps(options.exposure);
+                for (; x < image.width; x++) {
+                    tonemapPixelSSE(halfToFloatSSE(src + x * 8), dst + x * 4, exposure, lut);
+                }
+            }
+#endif
+            for (; x < image.width; x++) {
+                uint16_t half[4];
+                memcpy(half, src + x * 8, sizeof(half));
+                const float color[4] = { halfToFloat(half[0]), halfToFloat(half[1]), halfToFloat(half[2]), halfToFloat(half[3]) };
+                tonemapPixelScalar(color, dst + x * 4, options.exposure, lut);
+            }
+            break;
+        case Layout::RGBA32F:
+#if defined(IMAGE_ENCODER_SSE)
+            if (options.simd) {
+                const __m128 exposure = _mm_set1_ps(options.exposure);
+                for (; x < image.width; x++) {
+                    tonemapPixelSSE(_mm_loadu_ps(reinterpret_cast<const float*>(src + x * 16)), dst + x * 4, exposure, lut);
+                }
+            }
+#endif
+            for (; x < image.width; x++) {
+                float color[4];
+                memcpy(color, src + x * 16, sizeof(color));
+                tonemapPixelScalar(color, dst + x * 4, options.exposure, lut);
+            }
+            break;
+        default:
+            break;
+        }
+    }
+    return rgba;
+}
+
+bool ImageEncoder::encode(const Image& image, FileFormat format, const Options& options, std::vector<uint8_t>& data, std::string& error)
+{
+    data.clear();
+    const uint32_t pixelSize = bytesPerPixel(image.format);
+    if (pixelSize == 0) {
+        error = "Unsupported image format " + std::to_string(image.format);
+        return false;
+    }
+    const size_t rowPitch = image.rowPitch > 0 ? image.rowPitch : static_cast<size_t>(image.width) * pixelSize;
+    if ((image.width == 0) || (image.height == 0) || (image.pixels.size() < rowPitch * (image.height - 1) + static_cast<size_t>(image.width) * pixelSize)) {
+        error = "Image data does not match its size";
+        return false;
+    }
+    if (format == FileFormat::KTX) {
+        error = "KTX files can only be written with ImageEncoder::write";
+        return false;
+    }
+    convertToRGBA8(image, options);
+    switch (format) {
+    case FileFormat::PPM:
+        encodePPM(image.width, image.height, data);
+        break;
+    case FileFormat::PNG:
+        encodePNG(image.width, image.height, options.simd, data);
+        break;
+    case FileFormat::QOI:
+        encodeQOI(image.width, image.height, data);
+        break;
+    default:
+        break;
+    }
+    return true;
+}
+
+bool ImageEncoder::write(const std::filesystem::path& path, const Image& image, FileFormat format, const Options& options, std::string& error)
+{
+    if (format != FileFormat::KTX) {
+        return encode(image, format, options, fileData, error) && writeFile(path, fileData, error);
+    }
+
+    // KTX 保留 HDR 图像的原始数据，LDR 图像统一存为 RGBA8，行之间紧密排列
+    const uint32_t pixelSize = bytesPerPixel(image.format);
+    if (pixelSize == 0) {
+        error = "Unsupported image format " + std::to_string(image.format);
+        return false;
+    }
+    vks::texturecache::ImageInfo info{ image.format, image.width, image.height, 1, 1 };
+    const size_t rowSize = static_cast<size_t>(image.width) * pixelSize;
+    const size_t rowPitch = image.rowPitch > 0 ? image.rowPitch : rowSize;
+    if ((image.width == 0) || (image.height == 0) || (image.pixels.size() < rowPitch * (image.height - 1) + rowSize)) {
+        error = "Image data does not match its size";
+        return false;
+    }
+    const std::vector<uint8_t>* data = &fileData;
+    if (isHdr(image.format)) {
+        fileData.resize(rowSize * image.height);
+        for (uint32_t y = 0; y < image.height; y++) {
+            memcpy(fileData.data() + rowSize * y, image.pixels.data() + rowPitch * y, rowSize);
+        }
+    } else {
+        const bool srgb = (image.format == VK_FORMAT_R8G8B8A8_SRGB) || (image.format == VK_FORMAT_B8G8R8A8_SRGB);
+        info.format = srgb ? VK_FORMAT_R8G8B8A8_SRGB : VK_FORMAT_R8G8B8A8_UNORM;
+        data = &convertToRGBA8(image, options);
+    }
+    if (!vks::texturecache::writeKTX(path.string(), info, *data)) {
+        error = "Could not write " + path.string();
+        return false;
+    }
+    return true;
+}
+
+void ImageEncoder::encodePPM(uint32_t width, uint32_t height, std::vector<uint8_t>& data)
+{
+    putString(data, "P6\n" + std::to_string(width) + " " + std::to_string(height) + "\n255\n");
+    const size_t pixelCount = static_cast<size_t>(width) * height;
+    const size_t offset = data.size();
+    data.resize(offset + pixelCount * 3);
+    uint8_t* dst = data.data() + offset;
+    for (size_t i = 0; i < pixelCount; i++) {
+        dst[i * 3 + 0] = rgba[i * 4 + 0];
+        dst[i * 3 + 1] = rgba[i * 4 + 1];
+        dst[i * 3 + 2] = rgba[i * 4 + 2];
+    }
+}
+
+bool ImageEncoder::opaque(size_t pixelCount) const
+{
+    uint8_t alpha = 0xFF;
+    for (size_t i = 0; i < pixelCount; i++) {
+        alpha &= rgba[i * 4 + 3];
+    }
+    return alpha == 0xFF;
+}
+
+void ImageEncoder::encodePNG(uint32_t width, uint32_t height, bool simd, std::vector<uint8_t>& data)
+{
+    static const uint8_t signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+    data.insert(data.end(), signature, signature + sizeof(signature));
+
+    // 渲染结果通常不透明，去掉 alpha 通道可以少压缩四分之一的数据
+    const size_t pixelCount = static_cast<size_t>(width) * height;
+    const bool rgb = opaque(pixelCount);
+    const uint32_t bpp = rgb ? 3 : 4;
+    const uint8_t* pixels = rgba.data();
+    if (rgb) {
+        packed.resize(pixelCount * 3);
+        for (size_t i = 0; i < pixelCount; i++) {
+            packed[i * 3 + 0] = rgba[i * 4 + 0];
+            packed[i * 3 + 1] = rgba[i * 4 + 1];
+            packed[i * 3 + 2] = rgba[i * 4 + 2];
+        }
+        pixels = packed.data();
+    }
+
+    size_t start = beginChunk(data, "IHDR");
+    putBigEndian(data, width);
+    putBigEndian(data, height);
+    // 8 位，RGB(2) 或 RGBA(6)，deflate 压缩，自适应滤波，不交错
+    const uint8_t header[5] = { 8, static_cast<uint8_t>(rgb ? 2 : 6), 0, 0, 0 };
+    data.insert(data.end(), header, header + sizeof(header));
+    endChunk(data, start);
+
+    // 每行分别计算 5 种滤波，取有符号绝对值之和最小的一种(libpng 的默认启发式)
+    const size_t stride = static_cast<size_t>(width) * bpp;
+    candidates.resize(stride * (filterCount + 1));
+    filtered.resize((stride + 1) * height);
+    uint8_t* zeroRow = candidates.data() + stride * filterCount;
+    std::fill(zeroRow, zeroRow + stride, 0);
+    uint8_t* out[filterCount];
+    for (uint32_t f = 0; f < filterCount; f++) {
+        out[f] = candidates.data() + stride * f;
+    }
+    for (uint32_t y = 0; y < height; y++) {
+        const uint8_t* cur = pixels + stride * y;
+        const uint8_t* prev = y > 0 ? cur - stride : zeroRow;
+        uint64_t sums[filterCount] = {};
+        // 每行的前 bpp 个字节没有左侧像素，由标量实现处理
+        filterRowScalar(cur, prev, bpp, 0, std::min<size_t>(bpp, stride), out, sums);
+        size_t i = std::min<size_t>(bpp, stride);
+#if defined(IMAGE_ENCODER_SSE)
+        if (simd) {
+            i = filterRowSSE(cur, prev, bpp, stride, out, sums);
+        }
+#endif
+        filterRowScalar(cur, prev, bpp, i, stride, out, sums);
+        uint32_t best = 0;
+        for (uint32_t f = 1; f < filterCount; f++) {
+            if (sums[f] < sums[best]) {
+                best = f;
+            }
+        }
+        uint8_t* row = filtered.data() + (stride + 1) * y;
+        row[0] = static_cast<uint8_t>(best);
+        memcpy(row + 1, out[best], stride);
+    }
+
+    start = beginChunk(data, "IDAT");
+    deflate(filtered, data);
+    endChunk(data, start);
+    start = beginChunk(data, "IEND");
+    endChunk(data, start);
+}
+
+void ImageEncoder::deflate(std::span<const uint8_t> input, std::vector<uint8_t>& data)
+{
+    // zlib 头: 32K 窗口的 deflate，最快压缩级别
+    data.push_back(0x78);
+    data.push_back(0x01);
+
+    const DeflateTables& tables = deflateTables();
+    constexpr uint32_t hashBits = 15;
+    constexpr int32_t windowSize = 32768;
+    constexpr uint32_t maxChain = 32;
+    constexpr size_t minMatch = 3;
+    constexpr size_t maxMatch = 258;
+    hashHead.assign(size_t(1) << hashBits, -1);
+    hashPrev.resize(windowSize);
+    auto hash = [&input](size_t i) {
+        const uint32_t value = (uint32_t(input[i]) << 16) | (uint32_t(input[i + 1]) << 8) | input[i + 2];
+        return (value * 2654435761u) >> (32 - hashBits);
+    };
+    auto insert = [this, &hash](size_t i) {
+        const uint32_t h = hash(i);
+        hashPrev[i & (windowSize - 1)] = hashHead[h];
+        hashHead[h] = static_cast<int32_t>(i);
+    };
+
+    // 整个数据流为一个使用固定霍夫曼码的块，贪心地取哈希链上最长的匹配
+    BitWriter writer(data);
+    writer.put(1, 1);
+    writer.put(1, 2);
+    const uint8_t* bytes = input.data();
+    const size_t size = input.size();
+    size_t i = 0;
+    while (i < size) {
+        size_t bestLength = 0;
+        size_t bestDistance = 0;
+        if (i + minMatch <= size) {
+            const size_t limit = std::min(maxMatch, size - i);
+            int32_t candidate = hashHead[hash(i)];
+            uint32_t chain = maxChain;
+            while ((candidate >= 0) && (static_cast<int64_t>(i) - candidate <= windowSize) && (chain-- > 0)) {
+                const uint8_t* match = bytes + candidate;
+                if (match[bestLength] == bytes[i + bestLength]) {
+                    // 每次比较 8 字节，第一个不同的字节由最低的不同位确定(小端序)，不足 8 字节的部分逐字节比较
+                    size_t length = 0;
+                    while (length + 8 <= limit) {
+                        uint64_t a;
+                        uint64_t b;
+                        memcpy(&a, match + length, sizeof(a));
+                        memcpy(&b, bytes + i + length, sizeof(b));
+                        if (a != b) {
+                            length += static_cast<size_t>(std::countr_zero(a ^ b)) / 8;
+                            break;
+                        }
+                        length += 8;
+                    }
+                    while ((length < limit) && (match[length] == bytes[i + length])) {
+                        length++;
+                    }
+                    if (length > bestLength) {
+                        bestLength = length;
+                        bestDistance = i - candidate;
+                        if (length == limit) {
+                            break;
+                        }
+                    }
+                }
+                const int32_t next = hashPrev[candidate & (windowSize - 1)];
+                if (next >= candidate) {
+                    break;
+                }
+                candidate = next;
+            }
+            insert(i);
+        }
+        if (bestLength >= minMatch) {
+            const uint32_t lengthSymbol = tables.lengthSymbol[bestLength];
+            writer.put(tables.literalCode[257 + lengthSymbol], tables.literalLength[257 + lengthSymbol]);
+            writer.put(static_cast<uint32_t>(bestLength - DeflateTables::lengthBase[lengthSymbol]), DeflateTables::lengthExtra[lengthSymbol]);
+            const uint32_t distanceSymbol = tables.distanceSymbol[bestDistance];
+            writer.put(tables.distanceCode[distanceSymbol], 5);
+            writer.put(static_cast<uint32_t>(bestDistance - DeflateTables::distanceBase[distanceSymbol]), DeflateTables::distanceExtra[distanceSymbol]);
+            // 匹配覆盖的位置也放入哈希链，之后的数据可以引用它们
+            for (size_t j = i + 1; (j < i + bestLength) && (j + minMatch <= size); j++) {
+                insert(j);
+            }
+            i += bestLength;
+        } else {
+            writer.put(tables.literalCode[bytes[i]], tables.literalLength[bytes[i]]);
+            i++;
+        }
+    }
+    writer.put(tables.literalCode[256], tables.literalLength[256]);
+    writer.flush();
+    putBigEndian(data, adler32(input.data(), input.size()));
+}
+
+void ImageEncoder::encodeQOI(uint32_t width, uint32_t height, std::vector<uint8_t>& data)
+{
+    const size_t pixelCount = static_cast<size_t>(width) * height;
+    putString(data, "qoif");
+    putBigEndian(data, width);
+    putBigEndian(data, height);
+    // 通道数只是描述信息，编码方式与之无关；色彩空间 0 表示 sRGB 颜色与线性 alpha
+    data.push_back(opaque(pixelCount) ? 3 : 4);
+    data.push_back(0);
+    // 最坏情况下每个像素 5 字节
+    data.reserve(data.size() + pixelCount * 5 + 8);
+
+    struct Pixel {
+        uint8_t r, g, b, a;
+        bool operator==(const Pixel& other) const { return (r == other.r) && (g == other.g) && (b == other.b) && (a == other.a); }
+    };
+    Pixel index[64]{};
+    Pixel previous{ 0, 0, 0, 255 };
+    uint32_t run = 0;
+    for (size_t i = 0; i < pixelCount; i++) {
+        const Pixel pixel{ rgba[i * 4 + 0], rgba[i * 4 + 1], rgba[i * 4 + 2], rgba[i * 4 + 3] };
+        if (pixel == previous) {
+            run++;
+            if (run == 62) {
+                data.push_back(static_cast<uint8_t>(0xC0 | (run - 1)));
+                run = 0;
+            }
+            continue;
+        }
+        if (run > 0) {
+            data.push_back(static_cast<uint8_t>(0xC0 | (run - 1)));
+            run = 0;
+        }
+        const uint32_t hash = (pixel.r * 3 + pixel.g * 5 + pixel.b * 7 + pixel.a * 11) % 64;
+        if (index[hash] == pixel) {
+            data.push_back(static_cast<uint8_t>(hash));
+        } else {
+            index[hash] = pixel;
+            if (pixel.a == previous.a) {
+                const int8_t vr = static_cast<int8_t>(pixel.r - previous.r);
+                const int8_t vg = static_cast<int8_t>(pixel.g - previous.g);
+                const int8_t vb = static_cast<int8_t>(pixel.b - previous.b);
+                const int vgr = vr - vg;
+                const int vgb = vb - vg;
+                if ((vr > -3) && (vr < 2) && (vg > -3) && (vg < 2) && (vb > -3) && (vb < 2)) {
+                    data.push_back(static_cast<uint8_t>(0x40 | ((vr + 2) << 4) | ((vg + 2) << 2) | (vb + 2)));
+                } else if ((vgr > -9) && (vgr < 8) && (vg > -33) && (vg < 32) && (vgb > -9) && (vgb < 8)) {
+                    data.push_back(static_cast<uint8_t>(0x80 | (vg + 32)));
+                    data.push_back(static_cast<uint8_t>(((vgr + 8) << 4) | (vgb + 8)));
+                } else {
+                    data.push_back(0xFE);
+                    data.push_back(pixel.r);
+                    data.push_back(pixel.g);
+                    data.push_back(pixel.b);
+                }
+            } else {
+                data.push_back(0xFF);
+                data.push_back(pixel.r);
+                data.push_back(pixel.g);
+                data.push_back(pixel.b);
+                data.push_back(pixel.a);
+            }
+        }
+        previous = pixel;
+    }
+    if (run > 0) {
+        data.push_back(static_cast<uint8_t>(0xC0 | (run - 1)));
+    }
+    static const uint8_t padding[8] = { 0, 0, 0, 0, 0, 0, 0, 1 };
+    data.insert(data.end(), padding, padding + sizeof(padding));
+}
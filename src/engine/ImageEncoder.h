@@ -0,0 +1,77 @@
+#pragma once
+#include <vulkan/vulkan.h>
+#include <cstdint>
+#include <filesystem>
+#include <span>
+#include <string>
+#include <vector>
+
+// 渲染结果的图像编码: PNG、QOI、KTX 与 PPM
+// 输入为读回的像素(BGRA8/RGBA8 的 UNORM 或 SRGB，以及 RGBA16F/RGBA32F 的 HDR 图像)，先逐行转换为 RGBA8:
+// LDR 图像只交换通道，HDR 图像按 pbrtexture.slang 的 Uncharted2 色调映射与伽马校正转换；KTX 保留 HDR 图像的原始数据
+// 通道交换、色调映射与 PNG 的行滤波使用 SSE2 一次处理 16 字节(或 4 个像素)，SSE2 不可用时退化为标量实现；
+// PNG 的压缩为固定霍夫曼编码的 deflate(哈希链匹配)，不依赖 zlib
+// 每个实例保存转换与压缩用的临时缓冲，连续编码不重新分配内存，不能同时在多个线程上使用(每个编码线程一个实例)
+class ImageEncoder {
+public:
+    enum class FileFormat {
+        PPM,
+        PNG,
+        QOI,
+        KTX,
+    };
+
+    struct Image {
+        uint32_t width{ 0 };
+        uint32_t height{ 0 };
+        VkFormat format{ VK_FORMAT_UNDEFINED };
+        // 相邻两行的字节距离，为 0 时行之间紧密排列
+        size_t rowPitch{ 0 };
+        std::span<const uint8_t> pixels;
+    };
+
+    struct Options {
+        // 只用于 HDR 输入，与 UBOParams 中的同名参数含义相同
+        float exposure{ 4.5f };
+        float gamma{ 2.2f };
+        // 为 false 时使用标量实现，基准测试据此比较两者的速度并校验结果
+        bool simd{ true };
+    };
+
+    // 按扩展名(.png/.qoi/.ktx/.ppm，不区分大小写)确定文件格式，不支持时返回 false
+    static bool fileFormatFromPath(const std::filesystem::path& path, FileFormat& format);
+    // 每像素字节数，不支持的格式返回 0
+    static uint32_t bytesPerPixel(VkFormat format);
+    static bool isHdr(VkFormat format);
+
+    // 转换为行之间紧密排列的 RGBA8，结果在下一次调用前有效
+    const std::vector<uint8_t>& convertToRGBA8(const Image& image, const Options& options);
+    // 编码为内存中的文件数据(不支持 KTX)
+    bool encode(const Image& image, FileFormat format, const Options& options, std::vector<uint8_t>& data, std::string& error);
+    // 编码并写出文件，先写入临时文件再改名，读取输出的程序不会看到写了一半的图像
+    bool write(const std::filesystem::path& path, const Image& image, FileFormat format, const Options& options, std::string& error);
+
+private:
+    // 以下函数编码 convertToRGBA8 的结果
+    void encodePPM(uint32_t width, uint32_t height, std::vector<uint8_t>& data);
+    void encodePNG(uint32_t width, uint32_t height, bool simd, std::vector<uint8_t>& data);
+    void encodeQOI(uint32_t width, uint32_t height, std::vector<uint8_t>& data);
+    bool opaque(size_t pixelCount) const;
+    // 把 PNG 的滤波结果压缩为 zlib 数据流追加到 data 之后
+    void deflate(std::span<const uint8_t> input, std::vector<uint8_t>& data);
+    const uint8_t* gammaTable(float gamma);
+
+    std::vector<uint8_t> rgba;
+    // PNG: 去掉 alpha 通道的像素、各滤波方式的候选行与全部滤波后的行
+    std::vector<uint8_t> packed;
+    std::vector<uint8_t> candidates;
+    std::vector<uint8_t> filtered;
+    // write 编码的文件数据
+    std::vector<uint8_t> fileData;
+    // deflate 的哈希表与哈希链
+    std::vector<int32_t> hashHead;
+    std::vector<int32_t> hashPrev;
+    // [0, 1] 按 12 位量化后的伽马校正结果
+    std::vector<uint8_t> gammaLut;
+    float gammaLutValue{ 0.0f };
+};
@@ -0,0 +1,180 @@
+#include "JobBenchmark.h"
+#include "JobSystem.h"
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <string>
+#include "CommandLineParser.hpp"
+#include "CommandLineTool.hpp"
+#include "threadpool.hpp"
+
+namespace
+{
+    // 模拟一个任务的计算量，结果写入各自的槽位，避免测到的是共享变量上的争用
+    uint64_t work(uint64_t seed, uint32_t iterations)
+    {
+        uint64_t x = seed * 0x9E3779B97F4A7C15ull + 1;
+        for (uint32_t i = 0; i < iterations; i++) {
+            x ^= x << 13;
+            x ^= x >> 7;
+            x ^= x << 17;
+        }
+        return x;
+    }
+
+    uint64_t checksum(const std::vector<uint64_t>& results)
+    {
+        uint64_t sum = 0;
+        for (uint64_t value : results) {
+            sum += value;
+        }
+        return sum;
+    }
+
+    struct Result {
+        double milliseconds{ 0.0 };
+        uint64_t checksum{ 0 };
+    };
+
+    // 取若干次中最快的一次，减少线程调度带来的抖动
+    Result measure(uint32_t repetitions, const std::function<uint64_t()>& fn)
+    {
+        Result result;
+        result.milliseconds = vks::tool::measureBest(repetitions, [&]() { result.checksum = fn(); }) * 1000.0;
+        return result;
+    }
+
+    // vks::ThreadPool 的常见用法：把工作按线程数静态切分，依次放入各线程的队列
+    void poolSubmit(vks::ThreadPool& pool, uint32_t index, std::function<void()> job)
+    {
+        pool.threads[index % pool.threads.size()]->addJob(std::move(job));
+    }
+
+    bool report(const char* name, const Result& pool, const Result& jobs)
+    {
+        const bool match = pool.checksum == jobs.checksum;
+        std::cout << "  " << name << ": ThreadPool " << pool.milliseconds << " ms, JobSystem " << jobs.milliseconds << " ms, "
+            << pool.milliseconds / jobs.milliseconds << "x" << (match ? "" : "  (checksum mismatch)") << std::endl;
+        return match;
+    }
+}
+
+bool JobBenchmark::runFromCommandLine(const std::vector<const char*>& args, int& exitCode)
+{
+    CommandLineParser parser;
+    parser.add("benchmarkjobs", { "--benchmarkjobs" }, 0, "Compare the job system against vks::ThreadPool and exit");
+    parser.add("benchmarkjobsthreads", { "--benchmarkjobsthreads" }, 1, "Number of threads for --benchmarkjobs (default: all hardware threads)");
+    parser.parse(args);
+    if (!parser.isSet("benchmarkjobs")) {
+        return false;
+    }
+
+    vks::tool::attachConsole();
+
+    JobSystem jobSystem(static_cast<uint32_t>(parser.getValueAsInt("benchmarkjobsthreads", 0)));
+    const uint32_t threadCount = jobSystem.getThreadCount();
+    // 线程池不包含调用线程，调用线程只负责提交与等待，两边参与计算的线程数相同
+    vks::ThreadPool pool;
+    pool.setThreadCount(threadCount);
+    constexpr uint32_t repetitions = 5;
+    bool passed = true;
+    std::cout << "Job system benchmark on " << threadCount << " threads (best of " << repetitions << ")" << std::endl;
+
+    // 大量小任务：线程池每个任务都要拷贝 std::function 并加锁入队；任务系统在本线程队列中无锁入队，不分配内存
+    {
+        constexpr uint32_t jobCount = 100000;
+        constexpr uint32_t iterations = 200;
+        std::vector<uint64_t> results(jobCount);
+        const Result poolResult = measure(repetitions, [&]() {
+            for (uint32_t i = 0; i < jobCount; i++) {
+                poolSubmit(pool, i, [&results, i]() { results[i] = work(i, iterations); });
+            }
+            pool.wait();
+            return checksum(results);
+        });
+        std::fill(results.begin(), results.end(), 0);
+        const Result jobsResult = measure(repetitions, [&]() {
+            JobCounter counter;
+            for (uint32_t i = 0; i < jobCount; i++) {
+                jobSystem.schedule([&results, i]() { results[i] = work(i, iterations); }, &counter);
+            }
+            jobSystem.wait(counter);
+            return checksum(results);
+        });
+        passed &= report("100000 small jobs", poolResult, jobsResult);
+    }
+
+    // 负载不均的循环：第 i 项的计算量随 i 平方增长，静态切分时最后一个线程承担大部分工作，
+    // 任务系统的二分拆分让空闲线程窃取剩余的大块
+    {
+        constexpr uint32_t itemCount = 4096;
+        auto iterations = [](uint32_t i) { return 16 + (i * i) / 1024; };
+        std::vector<uint64_t> results(itemCount);
+        const Result poolResult = measure(repetitions, [&]() {
+            const uint32_t chunk = (itemCount + threadCount - 1) / threadCount;
+            for (uint32_t t = 0; t < threadCount; t++) {
+                poolSubmit(pool, t, [&, t]() {
+                    for (uint32_t i = t * chunk; i < std::min(itemCount, (t + 1) * chunk); i++) {
+                        results[i] = work(i, iterations(i));
+                    }
+                });
+            }
+            pool.wait();
+            return checksum(results);
+        });
+        std::fill(results.begin(), results.end(), 0);
+        const Result jobsResult = measure(repetitions, [&]() {
+            jobSystem.parallelFor(itemCount, 16, [&](uint32_t begin, uint32_t end) {
+                for (uint32_t i = begin; i < end; i++) {
+                    results[i] = work(i, iterations(i));
+                }
+            });
+            return checksum(results);
+        });
+        passed &= report("Imbalanced parallel for", poolResult, jobsResult);
+    }
+
+    // 按阶段依赖的任务：每个阶段读取上一阶段的结果。线程池只能在阶段之间整体等待；
+    // 任务系统用计数器表达依赖，全部任务一次提交，调用线程只在最后等待并参与执行
+    {
+        constexpr uint32_t stageCount = 32;
+        constexpr uint32_t jobsPerStage = 256;
+        constexpr uint32_t iterations = 2000;
+        std::vector<uint64_t> results(stageCount * jobsPerStage);
+        auto stageJob = [&results](uint32_t stage, uint32_t job) {
+            const uint64_t previous = stage > 0 ? results[(stage - 1) * jobsPerStage + (job * 7) % jobsPerStage] : job;
+            results[stage * jobsPerStage + job] = work(previous, iterations);
+        };
+        const Result poolResult = measure(repetitions, [&]() {
+            for (uint32_t stage = 0; stage < stageCount; stage++) {
+                for (uint32_t job = 0; job < jobsPerStage; job++) {
+                    poolSubmit(pool, job, [&stageJob, stage, job]() { stageJob(stage, job); });
+                }
+                pool.wait();
+            }
+            return checksum(results);
+        });
+        std::fill(results.begin(), results.end(), 0);
+        const Result jobsResult = measure(repetitions, [&]() {
+            std::unique_ptr<JobCounter[]> counters = std::make_unique<JobCounter[]>(stageCount);
+            for (uint32_t stage = 0; stage < stageCount; stage++) {
+                JobCounter* dependency = stage > 0 ? &counters[stage - 1] : nullptr;
+                for (uint32_t job = 0; job < jobsPerStage; job++) {
+                    jobSystem.schedule([&stageJob, stage, job]() { stageJob(stage, job); }, &counters[stage], dependency);
+                }
+            }
+            for (uint32_t stage = 0; stage < stageCount; stage++) {
+                jobSystem.wait(counters[stage]);
+            }
+            return checksum(results);
+        });
+        passed &= report("Dependent stages", poolResult, jobsResult);
+    }
+
+    exitCode = passed ? 0 : 1;
+    return true;
+}
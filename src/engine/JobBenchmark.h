@@ -0,0 +1,10 @@
+#pragma once
+#include <vector>
+
+// 任务系统与 vks::ThreadPool 的 CPU 基准测试，不需要 Vulkan 设备
+// 分别测量大量小任务、负载不均的并行循环与按阶段依赖的任务，两边结果的校验和必须一致
+class JobBenchmark {
+public:
+    // 命令行入口，参数中包含 --benchmarkjobs 时执行并返回 true，exitCode 为进程退出码
+    static bool runFromCommandLine(const std::vector<const char*>& args, int& exitCode);
+};
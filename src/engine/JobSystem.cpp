@@ -0,0 +1,259 @@
+#include "JobSystem.h"
+#include <cassert>
+#include <exception>
+#include <iostream>
+
+namespace {
+    // 线程序号的缓存，工作线程启动时直接写入，创建线程在第一次查询时写入
+    thread_local const JobSystem* cachedSystem = nullptr;
+    thread_local uint32_t cachedThreadIndex = 0;
+}
+
+bool JobDeque::push(Job* job)
+{
+    const int64_t b = bottom.load(std::memory_order_relaxed);
+    const int64_t t = top.load(std::memory_order_acquire);
+    if (b - t >= capacity) {
+        return false;
+    }
+    buffer[b & (capacity - 1)].store(job, std::memory_order_relaxed);
+    // 窃取线程以 acquire 读到新的 bottom 后，任务的内容对它可见
+    bottom.store(b + 1, std::memory_order_release);
+    return true;
+}
+
+Job* JobDeque::pop()
+{
+    // 论文中 bottom 的写入与 top 的读取之间是 seq_cst 栅栏，这里改为 seq_cst 的原子操作，效果相同，
+    // 而且 ThreadSanitizer 能够识别
+    const int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+    bottom.store(b, std::memory_order_seq_cst);
+    int64_t t = top.load(std::memory_order_seq_cst);
+    if (t > b) {
+        // 队列为空
+        bottom.store(b + 1, std::memory_order_relaxed);
+        return nullptr;
+    }
+    Job* job = buffer[b & (capacity - 1)].load(std::memory_order_relaxed);
+    if (t == b) {
+        // 只剩最后一个任务，与窃取线程竞争
+        if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+            job = nullptr;
+        }
+        bottom.store(b + 1, std::memory_order_relaxed);
+    }
+    return job;
+}
+
+Job* JobDeque::steal()
+{
+    int64_t t = top.load(std::memory_order_seq_cst);
+    const int64_t b = bottom.load(std::memory_order_seq_cst);
+    if (t >= b) {
+        return nullptr;
+    }
+    Job* job = buffer[t & (capacity - 1)].load(std::memory_order_relaxed);
+    if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+        // 被所属线程或其他窃取线程抢先
+        return nullptr;
+    }
+    return job;
+}
+
+JobSystem::JobSystem(uint32_t threadCount)
+{
+    this->threadCount = threadCount > 0 ? threadCount : std::max(1u, std::thread::hardware_concurrency());
+    workers = std::make_unique<Worker[]>(this->threadCount);
+    for (uint32_t i = 0; i < this->threadCount; i++) {
+        workers[i].jobs = std::make_unique<Job[]>(jobPoolSize);
+        workers[i].stealSeed = i * 2654435761u + 1;
+    }
+    ownerThread = std::this_thread::get_id();
+    cachedSystem = this;
+    cachedThreadIndex = 0;
+    for (uint32_t i = 1; i < this->threadCount; i++) {
+        threads.emplace_back(&JobSystem::workerLoop, this, i);
+    }
+}
+
+JobSystem::~JobSystem()
+{
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        stopping.store(true);
+    }
+    sleepCondition.notify_all();
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    if (cachedSystem == this) {
+        cachedSystem = nullptr;
+    }
+}
+
+uint32_t JobSystem::currentThreadIndex() const
+{
+    if (cachedSystem == this) {
+        return cachedThreadIndex;
+    }
+    if (std::this_thread::get_id() != ownerThread) {
+        std::cerr << "JobSystem used from a thread that does not belong to it" << std::endl;
+        std::terminate();
+    }
+    cachedSystem = this;
+    cachedThreadIndex = 0;
+    return 0;
+}
+
+Job* JobSystem::allocateJob(uint32_t thread)
+{
+    Worker& worker = workers[thread];
+    while (true) {
+        Job* job = &worker.jobs[worker.nextJob++ & (jobPoolSize - 1)];
+        if (!job->inUse.load(std::memory_order_acquire)) {
+            job->inUse.store(true, std::memory_order_relaxed);
+            job->next = nullptr;
+            return job;
+        }
+        // 环形分配绕了一圈，槽位上的任务还在队列中或正在执行，先帮忙执行一个任务
+        if (Job* pending = findJob(thread)) {
+            execute(pending);
+        } else {
+            std::this_thread::yield();
+        }
+    }
+}
+
+void JobSystem::submit(Job* job, JobCounter* dependency)
+{
+    if (dependency) {
+        std::lock_guard<std::mutex> lock(dependency->waitingMutex);
+        // 依赖计数器的最后一次递减在锁内进行，这里看到非零时它一定会在之后处理等待链表
+        if (dependency->value.load(std::memory_order_acquire) != 0) {
+            job->next = dependency->waiting;
+            dependency->waiting = job;
+            return;
+        }
+    }
+    enqueue(currentThreadIndex(), job);
+}
+
+void JobSystem::enqueue(uint32_t thread, Job* job)
+{
+    if (!workers[thread].deque.push(job)) {
+        // 队列已满，直接在当前线程执行
+        execute(job);
+        return;
+    }
+    queuedJobs.fetch_add(1, std::memory_order_seq_cst);
+    // 与 workerLoop 中先增加 sleepingThreads 再检查 queuedJobs 的顺序配对，不会漏掉唤醒
+    if (sleepingThreads.load(std::memory_order_seq_cst) > 0) {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        sleepCondition.notify_one();
+    }
+}
+
+Job* JobSystem::findJob(uint32_t thread)
+{
+    Worker& worker = workers[thread];
+    if (Job* job = worker.deque.pop()) {
+        queuedJobs.fetch_sub(1, std::memory_order_relaxed);
+        return job;
+    }
+    if (threadCount == 1) {
+        return nullptr;
+    }
+    // 从随机选择的线程开始依次窃取，避免所有空闲线程同时争抢同一个队列
+    uint32_t& seed = worker.stealSeed;
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+    const uint32_t start = seed % threadCount;
+    for (uint32_t i = 0; i < threadCount; i++) {
+        const uint32_t victim = (start + i) % threadCount;
+        if (victim == thread) {
+            continue;
+        }
+        if (Job* job = workers[victim].deque.steal()) {
+            queuedJobs.fetch_sub(1, std::memory_order_relaxed);
+            return job;
+        }
+    }
+    return nullptr;
+}
+
+void JobSystem::execute(Job* job)
+{
+    job->invoke(job->storage);
+    job->destroy(job->storage);
+    JobCounter* signal = job->signal;
+    job->inUse.store(false, std::memory_order_release);
+    if (signal) {
+        finish(*signal);
+    }
+}
+
+void JobSystem::finish(JobCounter& counter)
+{
+    // 不是最后一个任务时只做一次原子递减
+    uint32_t value = counter.value.load(std::memory_order_relaxed);
+    while (value > 1) {
+        if (counter.value.compare_exchange_weak(value, value - 1, std::memory_order_acq_rel, std::memory_order_relaxed)) {
+            return;
+        }
+    }
+    // 可能是最后一个任务：在锁内递减并取出等待链表，wait() 看到归零后也要获得一次锁，
+    // 保证计数器(通常在等待方的栈上)被销毁前这里已经不再访问它
+    Job* waiting = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(counter.waitingMutex);
+        if (counter.value.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            waiting = counter.waiting;
+            counter.waiting = nullptr;
+        }
+    }
+    const uint32_t thread = currentThreadIndex();
+    while (waiting) {
+        Job* next = waiting->next;
+        enqueue(thread, waiting);
+        waiting = next;
+    }
+}
+
+void JobSystem::wait(JobCounter& counter)
+{
+    const uint32_t thread = currentThreadIndex();
+    while (!counter.done()) {
+        if (Job* job = findJob(thread)) {
+            execute(job);
+        } else {
+            std::this_thread::yield();
+        }
+    }
+    std::lock_guard<std::mutex> lock(counter.waitingMutex);
+}
+
+void JobSystem::workerLoop(uint32_t thread)
+{
+    cachedSystem = this;
+    cachedThreadIndex = thread;
+    // 找不到任务时先让出时间片重试若干次，新任务通常很快就会到来；之后休眠到有任务入队
+    constexpr uint32_t idleSpins = 64;
+    uint32_t idle = 0;
+    while (!stopping.load(std::memory_order_acquire)) {
+        if (Job* job = findJob(thread)) {
+            execute(job);
+            idle = 0;
+            continue;
+        }
+        if (++idle < idleSpins) {
+            std::this_thread::yield();
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(sleepMutex);
+        sleepingThreads.fetch_add(1, std::memory_order_seq_cst);
+        sleepCondition.wait(lock, [this]() { return queuedJobs.load(std::memory_order_seq_cst) > 0 || stopping.load(std::memory_order_relaxed); });
+        sleepingThreads.fetch_sub(1, std::memory_order_seq_cst);
+        idle = 0;
+    }
+}
@@ -0,0 +1,178 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+struct Job;
+
+// 任务依赖计数器
+// schedule 时传入的 signal 计数器加一，任务执行完后减一；计数归零时，以它为 dependency 的任务被放入队列
+// 计数器归零后可以重复使用，销毁前必须归零
+class JobCounter {
+public:
+    JobCounter() = default;
+    JobCounter(const JobCounter&) = delete;
+    JobCounter& operator=(const JobCounter&) = delete;
+
+    bool done() const { return value.load(std::memory_order_acquire) == 0; }
+
+private:
+    friend class JobSystem;
+    std::atomic<uint32_t> value{ 0 };
+    // 等待该计数器的任务组成的单向链表(Job::next)，只在依赖未满足时访问
+    std::mutex waitingMutex;
+    Job* waiting{ nullptr };
+};
+
+// 任务在固定大小的内联存储中保存可调用对象，调度时不分配堆内存
+struct Job {
+    static constexpr size_t storageSize = 64;
+
+    void (*invoke)(void* storage){ nullptr };
+    void (*destroy)(void* storage){ nullptr };
+    JobCounter* signal{ nullptr };
+    Job* next{ nullptr };
+    // 任务池槽位是否被占用(从分配到执行完毕)
+    std::atomic<bool> inUse{ false };
+    alignas(std::max_align_t) unsigned char storage[storageSize];
+};
+
+// Chase-Lev 工作窃取双端队列(固定容量，Lê 等人 2013 年给出的 C11 内存序版本)
+// 只有所属线程调用 push/pop(在底部操作)，其他线程调用 steal(从顶部取走最早放入的任务)
+class JobDeque {
+public:
+    static constexpr int64_t capacity = 4096;
+
+    // 队列已满时返回 false，调用方直接执行任务
+    bool push(Job* job);
+    Job* pop();
+    Job* steal();
+    bool empty() const { return bottom.load(std::memory_order_relaxed) <= top.load(std::memory_order_relaxed); }
+
+private:
+    // top 与 bottom 分别由窃取线程与所属线程频繁写入，放在不同的缓存行上
+    alignas(64) std::atomic<int64_t> top{ 0 };
+    alignas(64) std::atomic<int64_t> bottom{ 0 };
+    alignas(64) std::atomic<Job*> buffer[capacity]{};
+};
+
+// 工作窃取任务系统，代替 vks::ThreadPool
+// 每个线程(创建任务系统的线程为 0 号，其余为工作线程)有自己的任务队列与任务池，
+// 新任务放入当前线程的队列，空闲线程从其他线程的队列顶部窃取；等待计数器的线程在等待期间执行队列中的任务
+// 只有创建任务系统的线程与工作线程可以调用 schedule、wait 与 parallelFor
+class JobSystem {
+public:
+    // threadCount 为参与执行的线程总数(含创建线程)，为 0 时使用硬件线程数
+    explicit JobSystem(uint32_t threadCount = 0);
+    ~JobSystem();
+    JobSystem(const JobSystem&) = delete;
+    JobSystem& operator=(const JobSystem&) = delete;
+
+    // 可调用对象按值保存在任务内，大小不能超过 Job::storageSize(较大的状态通过指针捕获)
+    // dependency 不为空且未归零时，任务在它归零后才进入队列
+    template<typename Fn>
+    void schedule(Fn&& fn, JobCounter* signal = nullptr, JobCounter* dependency = nullptr);
+
+    // 等待计数器归零，期间执行本线程与其他线程队列中的任务
+    void wait(JobCounter& counter);
+
+    // 对 [0, count) 调用 fn(begin, end) 并等待全部完成
+    // 范围按二分递归拆分，一半留给自己、另一半放入队列供其他线程窃取，负载不均时空闲线程会拿走尚未拆分的大块；
+    // 拆到不超过粒度为止，粒度取 minGrain 与 count / (线程数 * 8) 中较大的一个
+    template<typename Fn>
+    void parallelFor(uint32_t count, uint32_t minGrain, Fn&& fn);
+
+    uint32_t getThreadCount() const { return threadCount; }
+    // 当前线程的序号，0 为创建任务系统的线程
+    uint32_t currentThreadIndex() const;
+
+private:
+    // 每个线程的任务池容量，环形分配；下一个槽位仍被占用时先帮忙执行其他任务
+    static constexpr uint32_t jobPoolSize = 4096;
+
+    struct alignas(64) Worker {
+        JobDeque deque;
+        std::unique_ptr<Job[]> jobs;
+        uint32_t nextJob{ 0 };
+        uint32_t stealSeed{ 0 };
+    };
+
+    Job* allocateJob(uint32_t thread);
+    void submit(Job* job, JobCounter* dependency);
+    void enqueue(uint32_t thread, Job* job);
+    Job* findJob(uint32_t thread);
+    void execute(Job* job);
+    void finish(JobCounter& counter);
+    void workerLoop(uint32_t thread);
+
+    template<typename Fn>
+    void parallelForRange(Fn* fn, uint32_t begin, uint32_t end, uint32_t grain, JobCounter* counter);
+
+    uint32_t threadCount;
+    std::unique_ptr<Worker[]> workers;
+    std::vector<std::thread> threads;
+    std::thread::id ownerThread;
+    // 队列中尚未被取走的任务数，空闲线程据此决定是否休眠
+    std::atomic<int64_t> queuedJobs{ 0 };
+    std::atomic<uint32_t> sleepingThreads{ 0 };
+    std::mutex sleepMutex;
+    std::condition_variable sleepCondition;
+    std::atomic<bool> stopping{ false };
+};
+
+template<typename Fn>
+void JobSystem::schedule(Fn&& fn, JobCounter* signal, JobCounter* dependency)
+{
+    using Callable = std::decay_t<Fn>;
+    static_assert(sizeof(Callable) <= Job::storageSize, "Job callable too large, capture large state by pointer");
+    static_assert(alignof(Callable) <= alignof(std::max_align_t), "Job callable is over-aligned");
+
+    Job* job = allocateJob(currentThreadIndex());
+    new (job->storage) Callable(std::forward<Fn>(fn));
+    job->invoke = [](void* storage) { (*std::launder(reinterpret_cast<Callable*>(storage)))(); };
+    job->destroy = [](void* storage) { std::launder(reinterpret_cast<Callable*>(storage))->~Callable(); };
+    job->signal = signal;
+    if (signal) {
+        signal->value.fetch_add(1, std::memory_order_relaxed);
+    }
+    submit(job, dependency);
+}
+
+template<typename Fn>
+void JobSystem::parallelForRange(Fn* fn, uint32_t begin, uint32_t end, uint32_t grain, JobCounter* counter)
+{
+    // 先把后一半交出去再处理前一半，被窃取的总是剩余范围中最大的块
+    while (end - begin > grain) {
+        const uint32_t middle = begin + (end - begin) / 2;
+        schedule([this, fn, middle, end, grain, counter]() { parallelForRange(fn, middle, end, grain, counter); }, counter);
+        end = middle;
+    }
+    (*fn)(begin, end);
+}
+
+template<typename Fn>
+void JobSystem::parallelFor(uint32_t count, uint32_t minGrain, Fn&& fn)
+{
+    if (count == 0) {
+        return;
+    }
+    const uint32_t adaptiveGrain = count / (threadCount * 8);
+    const uint32_t grain = std::max<uint32_t>(1, std::max(minGrain, adaptiveGrain));
+    if (threadCount == 1 || count <= grain) {
+        fn(0u, count);
+        return;
+    }
+    JobCounter counter;
+    auto* callable = &fn;
+    parallelForRange(callable, 0, count, grain, &counter);
+    wait(counter);
+}
@@ -0,0 +1,89 @@
+#pragma once
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+// 按最近使用顺序淘汰的资源缓存
+// 值以 unique_ptr 保存，插入与淘汰不会移动其他值，取得的指针在该项被淘汰前一直有效；
+// 插入时超过容量，从最久未使用的一端淘汰，淘汰前调用 onEvict(例如等 GPU 不再使用后释放 Vulkan 资源)
+template<typename Value>
+class LruCache {
+public:
+    using EvictFn = std::function<void(const std::string& key, Value& value)>;
+
+    struct Statistics {
+        uint64_t hits{ 0 };
+        uint64_t misses{ 0 };
+        uint64_t evictions{ 0 };
+    };
+
+    explicit LruCache(size_t capacity = 1) : capacity(capacity > 0 ? capacity : 1) {}
+    ~LruCache() { clear(); }
+    LruCache(const LruCache&) = delete;
+    LruCache& operator=(const LruCache&) = delete;
+
+    void setCapacity(size_t capacity) { this->capacity = capacity > 0 ? capacity : 1; }
+    void setEvictCallback(EvictFn onEvict) { this->onEvict = std::move(onEvict); }
+
+    // 命中时把该项移到最近使用的一端，未命中返回 nullptr
+    Value* find(const std::string& key)
+    {
+        auto it = index.find(key);
+        if (it == index.end()) {
+            statistics.misses++;
+            return nullptr;
+        }
+        statistics.hits++;
+        entries.splice(entries.begin(), entries, it->second);
+        return it->second->value.get();
+    }
+
+    // 插入新项(键不能已存在)，先淘汰到容量以下，新项不会被自己的插入淘汰
+    Value& insert(const std::string& key, std::unique_ptr<Value> value)
+    {
+        while (entries.size() >= capacity) {
+            evict();
+        }
+        entries.push_front({ key, std::move(value) });
+        index[key] = entries.begin();
+        return *entries.front().value;
+    }
+
+    // 淘汰全部项，每一项都会调用 onEvict
+    void clear()
+    {
+        while (!entries.empty()) {
+            evict();
+        }
+    }
+
+    size_t size() const { return entries.size(); }
+    const Statistics& getStatistics() const { return statistics; }
+
+private:
+    struct Entry {
+        std::string key;
+        std::unique_ptr<Value> value;
+    };
+
+    void evict()
+    {
+        Entry& entry = entries.back();
+        if (onEvict) {
+            onEvict(entry.key, *entry.value);
+        }
+        index.erase(entry.key);
+        entries.pop_back();
+        statistics.evictions++;
+    }
+
+    size_t capacity;
+    // 前端为最近使用
+    std::list<Entry> entries;
+    std::unordered_map<std::string, typename std::list<Entry>::iterator> index;
+    EvictFn onEvict;
+    Statistics statistics;
+};
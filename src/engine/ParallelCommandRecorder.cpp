@@ -0,0 +1,95 @@
+#include "ParallelCommandRecorder.h"
+#include <algorithm>
+#include <cassert>
+#include "VulkanTools.h"
+#include "VulkanInitializers.hpp"
+
+ParallelCommandRecorder::~ParallelCommandRecorder() {
+    destroy();
+}
+
+void ParallelCommandRecorder::create(VkDevice device, uint32_t queueFamilyIndex, uint32_t frameCount, JobSystem& jobSystem) {
+    assert(pools.empty());
+    this->device = device;
+    this->frameCount = std::max(1u, frameCount);
+    this->jobSystem = &jobSystem;
+    threadCount = jobSystem.getThreadCount();
+    currentFrame = 0;
+
+    // 命令池整池重置，不需要 RESET_COMMAND_BUFFER_BIT；二级命令缓冲每帧都重新录制
+    VkCommandPoolCreateInfo poolCI = vks::initializers::commandPoolCreateInfo();
+    poolCI.queueFamilyIndex = queueFamilyIndex;
+    poolCI.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+    pools.resize(static_cast<size_t>(this->frameCount) * threadCount);
+    for (auto& framePool : pools) {
+        VK_CHECK_RESULT(vkCreateCommandPool(device, &poolCI, nullptr, &framePool.pool));
+    }
+}
+
+void ParallelCommandRecorder::destroy() {
+    for (auto& framePool : pools) {
+        // 销毁命令池时其中的命令缓冲一并释放
+        vkDestroyCommandPool(device, framePool.pool, nullptr);
+    }
+    pools.clear();
+}
+
+void ParallelCommandRecorder::beginFrame(uint32_t frame) {
+    assert(frame < frameCount);
+    currentFrame = frame;
+    for (uint32_t thread = 0; thread < threadCount; thread++) {
+        FramePool& pool = framePool(thread);
+        VK_CHECK_RESULT(vkResetCommandPool(device, pool.pool, 0));
+        pool.used = 0;
+    }
+}
+
+VkCommandBuffer ParallelCommandRecorder::beginCommandBuffer(FramePool& framePool, const VkCommandBufferInheritanceInfo& inheritance) {
+    if (framePool.used == framePool.commandBuffers.size()) {
+        VkCommandBufferAllocateInfo allocateInfo = vks::initializers::commandBufferAllocateInfo(framePool.pool, VK_COMMAND_BUFFER_LEVEL_SECONDARY, 1);
+        VkCommandBuffer commandBuffer{ VK_NULL_HANDLE };
+        VK_CHECK_RESULT(vkAllocateCommandBuffers(device, &allocateInfo, &commandBuffer));
+        framePool.commandBuffers.push_back(commandBuffer);
+    }
+    VkCommandBuffer commandBuffer = framePool.commandBuffers[framePool.used++];
+    VkCommandBufferBeginInfo beginInfo = vks::initializers::commandBufferBeginInfo();
+    // 整个命令缓冲都在主命令缓冲的渲染通道内执行
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT | VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    beginInfo.pInheritanceInfo = &inheritance;
+    VK_CHECK_RESULT(vkBeginCommandBuffer(commandBuffer, &beginInfo));
+    return commandBuffer;
+}
+
+VkCommandBuffer ParallelCommandRecorder::record(const VkCommandBufferInheritanceInfo& inheritance, const std::function<void(VkCommandBuffer)>& fn) {
+    VkCommandBuffer commandBuffer = beginCommandBuffer(framePool(jobSystem->currentThreadIndex()), inheritance);
+    fn(commandBuffer);
+    VK_CHECK_RESULT(vkEndCommandBuffer(commandBuffer));
+    return commandBuffer;
+}
+
+void ParallelCommandRecorder::recordRanges(const VkCommandBufferInheritanceInfo& inheritance, uint32_t count, uint32_t minItemsPerTask, const RangeFn& fn, std::vector<VkCommandBuffer>& commandBuffers) {
+    if (count == 0) {
+        return;
+    }
+    // 每块至少 minItemsPerTask 项，绘制很少时分块只会增加二级命令缓冲与线程同步的开销
+    const uint32_t minItems = std::max(1u, minItemsPerTask);
+    const uint32_t maxTasks = std::min(threadCount, (count + minItems - 1) / minItems);
+    const uint32_t itemsPerTask = (count + maxTasks - 1) / maxTasks;
+    // 向上取整后块数可能减少(例如 5 项分 4 块时每块 2 项，只需要 3 块)
+    const uint32_t taskCount = (count + itemsPerTask - 1) / itemsPerTask;
+    const size_t firstResult = commandBuffers.size();
+    commandBuffers.resize(firstResult + taskCount, VK_NULL_HANDLE);
+
+    // 每个线程只使用自己的命令池，结果写入各块自己的位置，录制期间不需要加锁
+    jobSystem->parallelFor(taskCount, 1, [&](uint32_t firstTask, uint32_t lastTask) {
+        FramePool& pool = framePool(jobSystem->currentThreadIndex());
+        for (uint32_t task = firstTask; task < lastTask; task++) {
+            const uint32_t first = task * itemsPerTask;
+            const uint32_t taskItems = std::min(itemsPerTask, count - first);
+            VkCommandBuffer commandBuffer = beginCommandBuffer(pool, inheritance);
+            fn(commandBuffer, first, taskItems);
+            VK_CHECK_RESULT(vkEndCommandBuffer(commandBuffer));
+            commandBuffers[firstResult + task] = commandBuffer;
+        }
+    });
+}
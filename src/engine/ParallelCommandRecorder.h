@@ -0,0 +1,51 @@
+#pragma once
+#include <vulkan/vulkan.h>
+#include <cstdint>
+#include <functional>
+#include <vector>
+#include "JobSystem.h"
+
+// 多线程录制二级命令缓冲
+// 任务系统的每个线程在每个在途帧都有自己的 VkCommandPool，命令池不能跨线程同时使用，
+// 分开之后录制过程不需要任何锁；帧开始时整池重置，二级命令缓冲在之后的帧里复用
+// 录制结果按分块顺序返回，由主命令缓冲在渲染通道内用 vkCmdExecuteCommands 执行
+class ParallelCommandRecorder {
+public:
+    // (二级命令缓冲, 起始下标, 数量)
+    using RangeFn = std::function<void(VkCommandBuffer, uint32_t, uint32_t)>;
+
+    ~ParallelCommandRecorder();
+
+    // 分块由 jobSystem 执行，必须在创建任务系统的线程上调用 record 与 recordRanges
+    void create(VkDevice device, uint32_t queueFamilyIndex, uint32_t frameCount, JobSystem& jobSystem);
+    void destroy();
+
+    // 重置 frame 对应的全部命令池，调用前该帧之前的提交必须已经执行完毕
+    void beginFrame(uint32_t frame);
+
+    // 在调用线程上录制一个二级命令缓冲(天空盒、UI 等少量绘制)
+    VkCommandBuffer record(const VkCommandBufferInheritanceInfo& inheritance, const std::function<void(VkCommandBuffer)>& fn);
+    // 把 [0, count) 按 minItemsPerTask 以上的粒度分块，交给任务系统并行录制(调用线程也参与)，
+    // 每块一个二级命令缓冲，使用执行它的线程的命令池，按块的顺序追加到 commandBuffers
+    void recordRanges(const VkCommandBufferInheritanceInfo& inheritance, uint32_t count, uint32_t minItemsPerTask, const RangeFn& fn, std::vector<VkCommandBuffer>& commandBuffers);
+
+    uint32_t getThreadCount() const { return threadCount; }
+
+private:
+    // 一个线程在一个在途帧使用的命令池，used 为本帧已经取出的命令缓冲数
+    struct FramePool {
+        VkCommandPool pool{ VK_NULL_HANDLE };
+        std::vector<VkCommandBuffer> commandBuffers;
+        uint32_t used{ 0 };
+    };
+    FramePool& framePool(uint32_t thread) { return pools[currentFrame * threadCount + thread]; }
+    VkCommandBuffer beginCommandBuffer(FramePool& framePool, const VkCommandBufferInheritanceInfo& inheritance);
+
+    VkDevice device{ VK_NULL_HANDLE };
+    uint32_t threadCount{ 0 };
+    uint32_t frameCount{ 0 };
+    uint32_t currentFrame{ 0 };
+    // 每帧 threadCount 个，按任务系统的线程序号索引
+    std::vector<FramePool> pools;
+    JobSystem* jobSystem{ nullptr };
+};
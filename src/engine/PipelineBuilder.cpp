@@ -1,5 +1,60 @@
 #include "PipelineBuilder.h"
 #include <cassert>
+#include <iostream>
+
+std::mutex PipelineBuilder::stateCacheMutex;
+std::unordered_map<PipelineBuilder::StateKey, PipelineBuilder::CachedPipeline, PipelineBuilder::StateKeyHash> PipelineBuilder::stateCache;
+std::unordered_map<PipelineBuilder::StateKey, PipelineBuilder::CachedPipeline, PipelineBuilder::StateKeyHash> PipelineBuilder::libraryCache;
+std::unordered_map<VkPipeline, VkPipeline> PipelineBuilder::upgradedPipelines;
+std::vector<PipelineBuilder::RetiredPipeline> PipelineBuilder::retiredPipelines;
+std::deque<PipelineBuilder::OptimizeJob> PipelineBuilder::optimizeQueue;
+std::condition_variable PipelineBuilder::optimizeCondition;
+std::thread PipelineBuilder::optimizeThread;
+bool PipelineBuilder::optimizeBusy = false;
+bool PipelineBuilder::optimizeStopping = false;
+bool PipelineBuilder::libraryMode = false;
+bool PipelineBuilder::libraryFastLinking = false;
+bool PipelineBuilder::libraryOptimizeInBackground = false;
+
+namespace {
+    // 追加结构体中从 first 到 last(含)之间按值存储的连续字段，跳过 sType/pNext 和尾部填充
+    template <typename First, typename Last>
+    void appendRange(std::vector<uint8_t>& key, const First& first, const Last& last) {
+        const uint8_t* begin = reinterpret_cast<const uint8_t*>(&first);
+        const uint8_t* end = reinterpret_cast<const uint8_t*>(&last) + sizeof(Last);
+        key.insert(key.end(), begin, end);
+    }
+
+    template <typename T>
+    void appendValue(std::vector<uint8_t>& key, const T& value) {
+        appendRange(key, value, value);
+    }
+
+    // 变长数据先写入长度，相邻的数组不会因为边界不同而拼出相同的字节
+    void appendBytes(std::vector<uint8_t>& key, const void* data, size_t size) {
+        appendValue(key, static_cast<uint64_t>(size));
+        if (size > 0) {
+            const uint8_t* bytes = static_cast<const uint8_t*>(data);
+            key.insert(key.end(), bytes, bytes + size);
+        }
+    }
+
+    // maintenance5 内联着色器代码的指针，使用模块时为空
+    const uint32_t* inlineShaderCode(const VkPipelineShaderStageCreateInfo& stage) {
+        if (stage.module != VK_NULL_HANDLE) {
+            return nullptr;
+        }
+        const VkBaseInStructure* next = static_cast<const VkBaseInStructure*>(stage.pNext);
+        while (next && next->sType != VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO) {
+            next = next->pNext;
+        }
+        return next ? reinterpret_cast<const VkShaderModuleCreateInfo*>(next)->pCode : nullptr;
+    }
+}
+
+void PipelineBuilder::StateKey::finalize() {
+    hash = vks::tools::hashBytes(bytes.data(), bytes.size());
+}
 
 PipelineBuilder::PipelineBuilder(VkDevice device)
     : device(device){
@@ -64,10 +119,21 @@ PipelineBuilder& PipelineBuilder::setDynamicStates(
 
 PipelineBuilder& PipelineBuilder::setVertexInputState(
     VkPipelineVertexInputStateCreateInfo* state) {
-    vertexInputState = state;
+    // 拷贝绑定与属性描述，vkglTF 返回的是共享的静态状态，后续调用会覆盖它
+    vertexInputState = vks::initializers::pipelineVertexInputStateCreateInfo();
+    vertexBindingDescriptions.clear();
+    vertexAttributeDescriptions.clear();
+    if (state) {
+        vertexBindingDescriptions.assign(state->pVertexBindingDescriptions, state->pVertexBindingDescriptions + state->vertexBindingDescriptionCount);
+        vertexAttributeDescriptions.assign(state->pVertexAttributeDescriptions, state->pVertexAttributeDescriptions + state->vertexAttributeDescriptionCount);
+    }
     return *this;
 }
 
+PipelineBuilder& PipelineBuilder::setEmptyVertexInputState() {
+    return setVertexInputState(nullptr);
+}
+
 PipelineBuilder& PipelineBuilder::addShaderStage(const VkPipelineShaderStageCreateInfo stage) {
     shaderStages.push_back(stage);
     return *this;
@@ -75,9 +141,179 @@ PipelineBuilder& PipelineBuilder::addShaderStage(const VkPipelineShaderStageCrea
 
 void PipelineBuilder::clearShaderStage() {
     shaderStages.clear();
+    specializations.clear();
 }
 
-VkResult PipelineBuilder::buildPipeline(VkRenderPass& renderPass, VkPipelineCache& pipelineCache, VkPipelineLayout& pipelineLayout, VkPipeline& outPipeline) {
+PipelineBuilder& PipelineBuilder::setSpecializationConstants(VkShaderStageFlagBits stage, const std::vector<VkSpecializationMapEntry>& mapEntries, const void* data, size_t dataSize) {
+    Specialization* specialization = nullptr;
+    for (Specialization& existing : specializations) {
+        if (existing.stage == stage) {
+            specialization = &existing;
+        }
+    }
+    if (!specialization) {
+        specialization = &specializations.emplace_back();
+        specialization->stage = stage;
+    }
+    specialization->mapEntries = mapEntries;
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    specialization->data.assign(bytes, bytes + dataSize);
+    return *this;
+}
+
+void PipelineBuilder::clearSpecializationConstants() {
+    specializations.clear();
+}
+
+PipelineBuilder& PipelineBuilder::setRenderingFormats(const std::vector<VkFormat>& colorFormats, VkFormat depthFormat, VkFormat stencilFormat) {
+    colorAttachmentFormats = colorFormats;
+    renderingCreateInfo = {};
+    renderingCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO;
+    renderingCreateInfo.depthAttachmentFormat = depthFormat;
+    renderingCreateInfo.stencilAttachmentFormat = stencilFormat;
+    return *this;
+}
+
+const PipelineBuilder::Specialization* PipelineBuilder::findSpecialization(VkShaderStageFlagBits stage) const {
+    for (const Specialization& specialization : specializations) {
+        if (specialization.stage == stage) {
+            return &specialization;
+        }
+    }
+    return nullptr;
+}
+
+void PipelineBuilder::fixupStatePointers() {
+    colorBlendState.attachmentCount = 1;
+    colorBlendState.pAttachments = &blendAttachmentState;
+    dynamicState.dynamicStateCount = static_cast<uint32_t>(dynamicStateEnables.size());
+    dynamicState.pDynamicStates = dynamicStateEnables.data();
+    vertexInputState.vertexBindingDescriptionCount = static_cast<uint32_t>(vertexBindingDescriptions.size());
+    vertexInputState.pVertexBindingDescriptions = vertexBindingDescriptions.data();
+    vertexInputState.vertexAttributeDescriptionCount = static_cast<uint32_t>(vertexAttributeDescriptions.size());
+    vertexInputState.pVertexAttributeDescriptions = vertexAttributeDescriptions.data();
+    renderingCreateInfo.colorAttachmentCount = static_cast<uint32_t>(colorAttachmentFormats.size());
+    renderingCreateInfo.pColorAttachmentFormats = colorAttachmentFormats.data();
+    for (Specialization& specialization : specializations) {
+        specialization.info.mapEntryCount = static_cast<uint32_t>(specialization.mapEntries.size());
+        specialization.info.pMapEntries = specialization.mapEntries.data();
+        specialization.info.dataSize = specialization.data.size();
+        specialization.info.pData = specialization.data.data();
+    }
+    for (VkPipelineShaderStageCreateInfo& stage : shaderStages) {
+        for (Specialization& specialization : specializations) {
+            if (specialization.stage == stage.stage) {
+                stage.pSpecializationInfo = &specialization.info;
+            }
+        }
+    }
+}
+
+void PipelineBuilder::appendShaderStages(bool fragment, std::vector<uint8_t>& key) const {
+    // 着色器按身份区分：模块句柄(maintenance5 内联代码时为代码指针)加上 SPIR-V 内容哈希
+    // ShaderModuleCache 让相同的 SPIR-V 共享同一个模块，因此相同的着色器仍然命中同一条管线；
+    // 句柄在存活的模块之间唯一，内容哈希用来区分销毁后被复用的句柄
+    for (const VkPipelineShaderStageCreateInfo& stage : shaderStages) {
+        if ((stage.stage == VK_SHADER_STAGE_FRAGMENT_BIT) != fragment) {
+            continue;
+        }
+        appendValue(key, stage.stage);
+        appendValue(key, stage.module);
+        appendValue(key, inlineShaderCode(stage));
+        appendValue(key, vks::tools::getShaderStageHash(stage));
+        appendBytes(key, stage.pName, strlen(stage.pName));
+        // 特化常量优先使用构建器持有的拷贝，stage 中的指针在构建器被拷贝后可能已经过期
+        if (const Specialization* specialization = findSpecialization(stage.stage)) {
+            appendBytes(key, specialization->mapEntries.data(), specialization->mapEntries.size() * sizeof(VkSpecializationMapEntry));
+            appendBytes(key, specialization->data.data(), specialization->data.size());
+        } else if (stage.pSpecializationInfo) {
+            const VkSpecializationInfo& info = *stage.pSpecializationInfo;
+            appendBytes(key, info.pMapEntries, info.mapEntryCount * sizeof(VkSpecializationMapEntry));
+            appendBytes(key, info.pData, info.dataSize);
+        } else {
+            appendBytes(key, nullptr, 0);
+            appendBytes(key, nullptr, 0);
+        }
+    }
+}
+
+void PipelineBuilder::appendVertexInputInterface(std::vector<uint8_t>& key) const {
+    appendRange(key, inputAssemblyState.flags, inputAssemblyState.primitiveRestartEnable);
+    // 顶点输入按内容，而不是按指针
+    appendBytes(key, vertexBindingDescriptions.data(), vertexBindingDescriptions.size() * sizeof(VkVertexInputBindingDescription));
+    appendBytes(key, vertexAttributeDescriptions.data(), vertexAttributeDescriptions.size() * sizeof(VkVertexInputAttributeDescription));
+}
+
+void PipelineBuilder::appendPreRasterization(VkRenderPass renderPass, VkPipelineLayout pipelineLayout, std::vector<uint8_t>& key) const {
+    appendRange(key, rasterizationState.flags, rasterizationState.lineWidth);
+    appendValue(key, viewportState.viewportCount);
+    appendValue(key, viewportState.scissorCount);
+    appendBytes(key, dynamicStateEnables.data(), dynamicStateEnables.size() * sizeof(VkDynamicState));
+    appendShaderStages(false, key);
+    // 渲染通道与管线布局按句柄区分(子通道固定为 0)
+    appendValue(key, renderPass);
+    appendRenderingFormats(renderPass, key);
+    appendValue(key, pipelineLayout);
+}
+
+void PipelineBuilder::appendFragmentShader(VkRenderPass renderPass, VkPipelineLayout pipelineLayout, std::vector<uint8_t>& key) const {
+    appendRange(key, depthStencilState.flags, depthStencilState.maxDepthBounds);
+    appendValue(key, multisampleState.rasterizationSamples);
+    appendValue(key, multisampleState.sampleShadingEnable);
+    appendValue(key, multisampleState.minSampleShading);
+    appendShaderStages(true, key);
+    appendValue(key, renderPass);
+    appendRenderingFormats(renderPass, key);
+    appendValue(key, pipelineLayout);
+}
+
+void PipelineBuilder::appendFragmentOutput(VkRenderPass renderPass, std::vector<uint8_t>& key) const {
+    appendValue(key, blendAttachmentState);
+    appendValue(key, colorBlendState.logicOpEnable);
+    appendValue(key, colorBlendState.logicOp);
+    appendValue(key, colorBlendState.blendConstants);
+    appendValue(key, multisampleState.rasterizationSamples);
+    appendValue(key, multisampleState.alphaToCoverageEnable);
+    appendValue(key, multisampleState.alphaToOneEnable);
+    appendValue(key, renderPass);
+    appendRenderingFormats(renderPass, key);
+}
+
+void PipelineBuilder::appendRenderingFormats(VkRenderPass renderPass, std::vector<uint8_t>& key) const {
+    if (renderPass != VK_NULL_HANDLE) {
+        return;
+    }
+    appendBytes(key, colorAttachmentFormats.data(), colorAttachmentFormats.size() * sizeof(VkFormat));
+    appendValue(key, renderingCreateInfo.depthAttachmentFormat);
+    appendValue(key, renderingCreateInfo.stencilAttachmentFormat);
+}
+
+PipelineBuilder::StateKey PipelineBuilder::computeStateKey(VkRenderPass renderPass, VkPipelineLayout pipelineLayout) const {
+    // 由四个管线库部分的状态拼接而成，整管线与库模式共用同一个键
+    StateKey key;
+    appendVertexInputInterface(key.bytes);
+    appendPreRasterization(renderPass, pipelineLayout, key.bytes);
+    appendFragmentShader(renderPass, pipelineLayout, key.bytes);
+    appendFragmentOutput(renderPass, key.bytes);
+    appendValue(key.bytes, pipelineLayout);
+    key.finalize();
+    return key;
+}
+
+void PipelineBuilder::setGraphicsPipelineLibrary(bool enabled, bool fastLinking, bool optimizeInBackground) {
+    std::lock_guard<std::mutex> lock(stateCacheMutex);
+    libraryMode = enabled;
+    libraryFastLinking = fastLinking;
+    // 不支持快速链接时直接做链接时优化，后台重新链接没有意义
+    libraryOptimizeInBackground = enabled && fastLinking && optimizeInBackground;
+}
+
+bool PipelineBuilder::graphicsPipelineLibraryEnabled() {
+    std::lock_guard<std::mutex> lock(stateCacheMutex);
+    return libraryMode;
+}
+
+VkResult PipelineBuilder::createMonolithicPipeline(VkRenderPass renderPass, VkPipelineCache pipelineCache, VkPipelineLayout pipelineLayout, VkPipeline& outPipeline) {
     // 准备管线创建信息
     VkGraphicsPipelineCreateInfo pipelineCI =
         vks::initializers::pipelineCreateInfo(pipelineLayout, renderPass);
@@ -92,10 +328,22 @@ VkResult PipelineBuilder::buildPipeline(VkRenderPass& renderPass, VkPipelineCach
     pipelineCI.pDynamicState = &dynamicState;
     pipelineCI.stageCount = static_cast<uint32_t>(shaderStages.size());
     pipelineCI.pStages = shaderStages.data();
-    pipelineCI.pVertexInputState = vertexInputState;
+    pipelineCI.pVertexInputState = &vertexInputState;
+
+    // 动态渲染时附件格式代替渲染通道
+    if (renderPass == VK_NULL_HANDLE) {
+        pipelineCI.pNext = &renderingCreateInfo;
+    }
+    // 通过 creation feedback 统计管线缓存命中情况，设备不支持时不挂接
+    VkPipelineCreationFeedback pipelineFeedback{};
+    VkPipelineCreationFeedbackCreateInfo pipelineFeedbackCI = vks::pipelinecache::feedbackCreateInfo(&pipelineFeedback);
+    if (vks::pipelinecache::feedbackEnabled()) {
+        pipelineFeedbackCI.pNext = pipelineCI.pNext;
+        pipelineCI.pNext = &pipelineFeedbackCI;
+    }
 
     // 创建管线
-    return vkCreateGraphicsPipelines(
+    VkResult result = vkCreateGraphicsPipelines(
         device,
         pipelineCache,
         1,
@@ -103,6 +351,343 @@ VkResult PipelineBuilder::buildPipeline(VkRenderPass& renderPass, VkPipelineCach
         nullptr,
         &outPipeline
     );
+    if (result == VK_SUCCESS) {
+        vks::pipelinecache::recordFeedback(pipelineFeedback);
+    }
+    return result;
+}
+
+VkResult PipelineBuilder::getLibrary(LibraryPart part, VkRenderPass renderPass, VkPipelineCache pipelineCache, VkPipelineLayout pipelineLayout, VkPipeline& outLibrary) {
+    // 库按 (部分, 该部分的状态) 缓存，不同材质共享相同的顶点输入、着色器与输出部分
+    StateKey key;
+    appendValue(key.bytes, part);
+    switch (part) {
+    case LibraryPart::VertexInputInterface:
+        appendVertexInputInterface(key.bytes);
+        break;
+    case LibraryPart::PreRasterizationShaders:
+        appendPreRasterization(renderPass, pipelineLayout, key.bytes);
+        break;
+    case LibraryPart::FragmentShader:
+        appendFragmentShader(renderPass, pipelineLayout, key.bytes);
+        break;
+    case LibraryPart::FragmentOutput:
+        appendFragmentOutput(renderPass, key.bytes);
+        break;
+    }
+    key.finalize();
+    {
+        std::lock_guard<std::mutex> lock(stateCacheMutex);
+        auto it = libraryCache.find(key);
+        if (it != libraryCache.end()) {
+            outLibrary = it->second.pipeline;
+            return VK_SUCCESS;
+        }
+    }
+
+    VkGraphicsPipelineLibraryCreateInfoEXT libraryCI{};
+    libraryCI.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_LIBRARY_CREATE_INFO_EXT;
+
+    VkGraphicsPipelineCreateInfo pipelineCI{};
+    pipelineCI.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+    pipelineCI.pNext = &libraryCI;
+    pipelineCI.flags = VK_PIPELINE_CREATE_LIBRARY_BIT_KHR | VK_PIPELINE_CREATE_RETAIN_LINK_TIME_OPTIMIZATION_INFO_BIT_EXT;
+
+    std::vector<VkPipelineShaderStageCreateInfo> stages;
+    switch (part) {
+    case LibraryPart::VertexInputInterface:
+        libraryCI.flags = VK_GRAPHICS_PIPELINE_LIBRARY_VERTEX_INPUT_INTERFACE_BIT_EXT;
+        pipelineCI.pInputAssemblyState = &inputAssemblyState;
+        pipelineCI.pVertexInputState = &vertexInputState;
+        break;
+    case LibraryPart::PreRasterizationShaders:
+        libraryCI.flags = VK_GRAPHICS_PIPELINE_LIBRARY_PRE_RASTERIZATION_SHADERS_BIT_EXT;
+        for (const VkPipelineShaderStageCreateInfo& stage : shaderStages) {
+            if (stage.stage != VK_SHADER_STAGE_FRAGMENT_BIT) {
+                stages.push_back(stage);
+            }
+        }
+        pipelineCI.pRasterizationState = &rasterizationState;
+        pipelineCI.pViewportState = &viewportState;
+        pipelineCI.pDynamicState = &dynamicState;
+        pipelineCI.layout = pipelineLayout;
+        pipelineCI.renderPass = renderPass;
+        break;
+    case LibraryPart::FragmentShader:
+        libraryCI.flags = VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_SHADER_BIT_EXT;
+        for (const VkPipelineShaderStageCreateInfo& stage : shaderStages) {
+            if (stage.stage == VK_SHADER_STAGE_FRAGMENT_BIT) {
+                stages.push_back(stage);
+            }
+        }
+        pipelineCI.pDepthStencilState = &depthStencilState;
+        pipelineCI.pMultisampleState = &multisampleState;
+        pipelineCI.layout = pipelineLayout;
+        pipelineCI.renderPass = renderPass;
+        break;
+    case LibraryPart::FragmentOutput:
+        libraryCI.flags = VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_OUTPUT_INTERFACE_BIT_EXT;
+        pipelineCI.pColorBlendState = &colorBlendState;
+        pipelineCI.pMultisampleState = &multisampleState;
+        pipelineCI.renderPass = renderPass;
+        break;
+    }
+    pipelineCI.stageCount = static_cast<uint32_t>(stages.size());
+    pipelineCI.pStages = stages.data();
+    // 除顶点输入外的三个部分都需要渲染通道或动态渲染的附件格式
+    if (part != LibraryPart::VertexInputInterface && renderPass == VK_NULL_HANDLE) {
+        libraryCI.pNext = &renderingCreateInfo;
+    }
+
+    VkPipeline library{ VK_NULL_HANDLE };
+    VkResult result = vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineCI, nullptr, &library);
+    if (result != VK_SUCCESS) {
+        return result;
+    }
+    std::lock_guard<std::mutex> lock(stateCacheMutex);
+    const VkRenderPass libraryRenderPass = part == LibraryPart::VertexInputInterface ? VK_NULL_HANDLE : renderPass;
+    // 顶点输入与片元输出部分不使用管线布局，可以在不同布局之间共享
+    const bool usesLayout = part == LibraryPart::PreRasterizationShaders || part == LibraryPart::FragmentShader;
+    auto [it, inserted] = libraryCache.emplace(key, CachedPipeline{ library, libraryRenderPass, usesLayout ? pipelineLayout : VK_NULL_HANDLE });
+    if (!inserted) {
+        vkDestroyPipeline(device, library, nullptr);
+    }
+    outLibrary = it->second.pipeline;
+    return VK_SUCCESS;
+}
+
+VkResult PipelineBuilder::linkLibraries(VkDevice device, const std::array<VkPipeline, 4>& libraries, VkPipelineCache pipelineCache, VkPipelineLayout pipelineLayout, bool optimize, VkPipeline& outPipeline) {
+    VkPipelineLibraryCreateInfoKHR linkingCI{};
+    linkingCI.sType = VK_STRUCTURE_TYPE_PIPELINE_LIBRARY_CREATE_INFO_KHR;
+    linkingCI.libraryCount = static_cast<uint32_t>(libraries.size());
+    linkingCI.pLibraries = libraries.data();
+
+    VkGraphicsPipelineCreateInfo pipelineCI{};
+    pipelineCI.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+    pipelineCI.pNext = &linkingCI;
+
+    VkPipelineCreationFeedback pipelineFeedback{};
+    VkPipelineCreationFeedbackCreateInfo pipelineFeedbackCI = vks::pipelinecache::feedbackCreateInfo(&pipelineFeedback);
+    if (vks::pipelinecache::feedbackEnabled()) {
+        pipelineFeedbackCI.pNext = &linkingCI;
+        pipelineCI.pNext = &pipelineFeedbackCI;
+    }
+    pipelineCI.layout = pipelineLayout;
+    // 不带链接时优化的链接只是拼接各部分的已编译代码，通常在微秒级完成
+    pipelineCI.flags = optimize ? VK_PIPELINE_CREATE_LINK_TIME_OPTIMIZATION_BIT_EXT : 0;
+
+    VkResult result = vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineCI, nullptr, &outPipeline);
+    if (result == VK_SUCCESS) {
+        vks::pipelinecache::recordFeedback(pipelineFeedback);
+    }
+    return result;
+}
+
+VkResult PipelineBuilder::createLibraryPipeline(VkRenderPass renderPass, VkPipelineCache pipelineCache, VkPipelineLayout pipelineLayout, bool fastLinking, std::array<VkPipeline, 4>& libraries, VkPipeline& outPipeline) {
+    VkResult result = getLibrary(LibraryPart::VertexInputInterface, renderPass, pipelineCache, pipelineLayout, libraries[0]);
+    if (result == VK_SUCCESS) {
+        result = getLibrary(LibraryPart::PreRasterizationShaders, renderPass, pipelineCache, pipelineLayout, libraries[1]);
+    }
+    if (result == VK_SUCCESS) {
+        result = getLibrary(LibraryPart::FragmentShader, renderPass, pipelineCache, pipelineLayout, libraries[2]);
+    }
+    if (result == VK_SUCCESS) {
+        result = getLibrary(LibraryPart::FragmentOutput, renderPass, pipelineCache, pipelineLayout, libraries[3]);
+    }
+    if (result != VK_SUCCESS) {
+        return result;
+    }
+    // 支持快速链接时先快速链接，优化版本稍后在后台生成
+    return linkLibraries(device, libraries, pipelineCache, pipelineLayout, !fastLinking, outPipeline);
+}
+
+VkResult PipelineBuilder::buildPipeline(VkRenderPass& renderPass, VkPipelineCache& pipelineCache, VkPipelineLayout& pipelineLayout, VkPipeline& outPipeline) {
+    fixupStatePointers();
+
+    // 先查状态缓存，命中时不再创建新的管线
+    const StateKey stateKey = computeStateKey(renderPass, pipelineLayout);
+    bool useLibraries;
+    bool fastLinking;
+    bool optimizeInBackground;
+    {
+        std::lock_guard<std::mutex> lock(stateCacheMutex);
+        auto it = stateCache.find(stateKey);
+        if (it != stateCache.end()) {
+            outPipeline = it->second.pipeline;
+            return VK_SUCCESS;
+        }
+        useLibraries = libraryMode;
+        fastLinking = libraryFastLinking;
+        optimizeInBackground = libraryOptimizeInBackground;
+    }
+
+    VkResult result = VK_ERROR_FEATURE_NOT_PRESENT;
+    std::array<VkPipeline, 4> libraries{};
+    if (useLibraries) {
+        result = createLibraryPipeline(renderPass, pipelineCache, pipelineLayout, fastLinking, libraries, outPipeline);
+        if (result != VK_SUCCESS) {
+            std::cerr << "Graphics pipeline library path failed (" << vks::tools::errorString(result) << "), falling back to a monolithic pipeline" << std::endl;
+            optimizeInBackground = false;
+        }
+    }
+    if (result != VK_SUCCESS) {
+        result = createMonolithicPipeline(renderPass, pipelineCache, pipelineLayout, outPipeline);
+    }
+    if (result != VK_SUCCESS) {
+        return result;
+    }
+
+    std::lock_guard<std::mutex> lock(stateCacheMutex);
+    auto [it, inserted] = stateCache.emplace(stateKey, CachedPipeline{ outPipeline, renderPass, pipelineLayout });
+    if (!inserted) {
+        // 其他线程已经创建了相同状态的管线，保留先插入的那个
+        vkDestroyPipeline(device, outPipeline, nullptr);
+        outPipeline = it->second.pipeline;
+        return VK_SUCCESS;
+    }
+    if (optimizeInBackground) {
+        // 后台做一次带链接时优化的重新链接，完成后替换状态缓存中的快速链接版本
+        // 所有重新链接在同一个工作线程上排队，不会因为一次创建大量管线而同时占满 CPU
+        optimizeQueue.push_back({ device, libraries, pipelineCache, pipelineLayout, renderPass, stateKey, outPipeline });
+        if (!optimizeThread.joinable()) {
+            optimizeStopping = false;
+            optimizeThread = std::thread(optimizeLoop);
+        }
+        optimizeCondition.notify_all();
+    }
+    return VK_SUCCESS;
+}
+
+VkPipeline PipelineBuilder::resolvePipeline(VkPipeline pipeline) {
+    std::lock_guard<std::mutex> lock(stateCacheMutex);
+    auto it = upgradedPipelines.find(pipeline);
+    return it != upgradedPipelines.end() ? it->second : pipeline;
+}
+
+void PipelineBuilder::retirePipelines(VkDevice device, VkSemaphore timeline, uint64_t lastUseValue) {
+    std::lock_guard<std::mutex> lock(stateCacheMutex);
+    if (retiredPipelines.empty()) {
+        return;
+    }
+    uint64_t completedValue = 0;
+    VK_CHECK_RESULT(vkGetSemaphoreCounterValue(device, timeline, &completedValue));
+    for (auto it = retiredPipelines.begin(); it != retiredPipelines.end();) {
+        if (it->lastUseValue == 0) {
+            it->lastUseValue = lastUseValue;
+        }
+        if (it->lastUseValue <= completedValue) {
+            upgradedPipelines.erase(it->entry.pipeline);
+            vkDestroyPipeline(device, it->entry.pipeline, nullptr);
+            it = retiredPipelines.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+void PipelineBuilder::optimizeLoop() {
+    std::unique_lock<std::mutex> lock(stateCacheMutex);
+    while (true) {
+        optimizeCondition.wait(lock, [] { return optimizeStopping || !optimizeQueue.empty(); });
+        if (optimizeStopping) {
+            return;
+        }
+        OptimizeJob job = std::move(optimizeQueue.front());
+        optimizeQueue.pop_front();
+        optimizeBusy = true;
+        lock.unlock();
+
+        VkPipeline optimized{ VK_NULL_HANDLE };
+        VkResult result = linkLibraries(job.device, job.libraries, job.pipelineCache, job.pipelineLayout, true, optimized);
+
+        lock.lock();
+        if (result == VK_SUCCESS) {
+            stateCache[job.stateKey] = { optimized, job.renderPass, job.pipelineLayout };
+            upgradedPipelines[job.fastLinked] = optimized;
+            // 快速链接的版本可能仍在使用中，由 retirePipelines 等到 GPU 用完后销毁
+            retiredPipelines.push_back({ { job.fastLinked, job.renderPass, job.pipelineLayout }, 0 });
+        }
+        optimizeBusy = false;
+        optimizeCondition.notify_all();
+    }
+}
+
+void PipelineBuilder::waitForOptimizeJobs() {
+    // 工作线程在链接时不持有锁，等待期间它可以继续处理队列
+    std::unique_lock<std::mutex> lock(stateCacheMutex);
+    optimizeCondition.wait(lock, [] { return optimizeQueue.empty() && !optimizeBusy; });
+}
+
+void PipelineBuilder::destroyCachedPipelines(VkDevice device) {
+    waitForOptimizeJobs();
+    // 结束工作线程，之后再有需要优化的管线时重新启动
+    if (optimizeThread.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(stateCacheMutex);
+            optimizeStopping = true;
+        }
+        optimizeCondition.notify_all();
+        optimizeThread.join();
+    }
+    std::lock_guard<std::mutex> lock(stateCacheMutex);
+    for (auto& [key, entry] : stateCache) {
+        vkDestroyPipeline(device, entry.pipeline, nullptr);
+    }
+    stateCache.clear();
+    for (const RetiredPipeline& retired : retiredPipelines) {
+        vkDestroyPipeline(device, retired.entry.pipeline, nullptr);
+    }
+    retiredPipelines.clear();
+    upgradedPipelines.clear();
+    for (auto& [key, entry] : libraryCache) {
+        vkDestroyPipeline(device, entry.pipeline, nullptr);
+    }
+    libraryCache.clear();
+}
+
+void PipelineBuilder::releaseRenderPass(VkDevice device, VkRenderPass renderPass) {
+    releaseCached(device, [renderPass](const CachedPipeline& entry) { return entry.renderPass == renderPass; });
+}
+
+void PipelineBuilder::releasePipelineLayout(VkDevice device, VkPipelineLayout pipelineLayout) {
+    releaseCached(device, [pipelineLayout](const CachedPipeline& entry) { return entry.pipelineLayout == pipelineLayout; });
+}
+
+void PipelineBuilder::releaseCached(VkDevice device, const std::function<bool(const CachedPipeline&)>& predicate) {
+    waitForOptimizeJobs();
+    std::lock_guard<std::mutex> lock(stateCacheMutex);
+    auto release = [&](std::unordered_map<StateKey, CachedPipeline, StateKeyHash>& cache) {
+        for (auto it = cache.begin(); it != cache.end();) {
+            if (predicate(it->second)) {
+                vkDestroyPipeline(device, it->second.pipeline, nullptr);
+                it = cache.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    };
+    release(stateCache);
+    release(libraryCache);
+    for (auto it = retiredPipelines.begin(); it != retiredPipelines.end();) {
+        if (predicate(it->entry)) {
+            upgradedPipelines.erase(it->entry.pipeline);
+            vkDestroyPipeline(device, it->entry.pipeline, nullptr);
+            it = retiredPipelines.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+VkPipeline PipelineBuilder::findCachedPipeline(const StateKey& stateKey) {
+    std::lock_guard<std::mutex> lock(stateCacheMutex);
+    auto it = stateCache.find(stateKey);
+    return it != stateCache.end() ? it->second.pipeline : VK_NULL_HANDLE;
+}
+
+size_t PipelineBuilder::cachedPipelineCount() {
+    std::lock_guard<std::mutex> lock(stateCacheMutex);
+    return stateCache.size();
 }
 
 void PipelineBuilder::reset() {
@@ -116,6 +701,8 @@ void PipelineBuilder::reset() {
     setDynamicStates();
     setVertexInputState();
 
-    // 清除着色器阶段和描述符集布局
+    // 清除着色器阶段、特化常量和描述符集布局
     shaderStages.clear();
+    specializations.clear();
+    setRenderingFormats({});
 }
@@ -1,12 +1,19 @@
 #pragma once
 #include <vulkan/vulkan.h>
+#include <array>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
 #include "vulkanEngine.h"
 #include "VulkanglTFModel.h"
 
 class PipelineBuilder {
 public:
-    // 构造函数，需要设备句柄
-    PipelineBuilder(VkDevice device);
+    // 构造函数，需要设备句柄(默认构造的构建器只用于保存状态，之后再赋值)
+    PipelineBuilder(VkDevice device = VK_NULL_HANDLE);
 
     // 析构函数
     ~PipelineBuilder();
@@ -59,17 +66,144 @@ public:
         vkglTF::VertexComponent::UV,
         vkglTF::VertexComponent::Color,
         vkglTF::VertexComponent::Tangent }));
+    // 不使用顶点缓冲(例如全屏三角形)
+    PipelineBuilder& setEmptyVertexInputState();
 
     // 添加着色器阶段
     PipelineBuilder& addShaderStage(const VkPipelineShaderStageCreateInfo stage);
+    // 清除着色器阶段及其特化常量
     void clearShaderStage();
 
-    // 构建图形管线
+    // 设置某个着色器阶段的特化常量，映射表与数据会被拷贝，同一阶段再次设置时覆盖
+    // 特化数据参与状态键，不同取值的管线分别缓存
+    PipelineBuilder& setSpecializationConstants(VkShaderStageFlagBits stage, const std::vector<VkSpecializationMapEntry>& mapEntries, const void* data, size_t dataSize);
+    void clearSpecializationConstants();
+
+    // 动态渲染的附件格式，buildPipeline 传入的渲染通道为 VK_NULL_HANDLE 时通过 VkPipelineRenderingCreateInfo 提供
+    // 格式参与状态键，渲染到不同格式的管线分别缓存
+    PipelineBuilder& setRenderingFormats(const std::vector<VkFormat>& colorFormats, VkFormat depthFormat = VK_FORMAT_UNDEFINED, VkFormat stencilFormat = VK_FORMAT_UNDEFINED);
+
+    // 构建图形管线，renderPass 为 VK_NULL_HANDLE 时使用 setRenderingFormats 设置的动态渲染格式
+    // 相同状态的管线只会创建一次，之后直接从状态缓存中返回
+    // 返回的管线归缓存所有，由 destroyCachedPipelines 统一销毁
     VkResult buildPipeline(VkRenderPass& renderPass, VkPipelineCache& pipelineCache, VkPipelineLayout& pipelineLayout, VkPipeline& outPipeline);
 
+    // 管线状态的规范化字节序列，缓存查找时逐字节比较，哈希只用来分桶，哈希碰撞不会返回错误的管线
+    struct StateKey {
+        std::vector<uint8_t> bytes;
+        uint64_t hash{ 0 };
+        // 写完 bytes 之后计算哈希
+        void finalize();
+        bool operator==(const StateKey& other) const { return hash == other.hash && bytes == other.bytes; }
+    };
+    struct StateKeyHash {
+        size_t operator()(const StateKey& key) const { return static_cast<size_t>(key.hash); }
+    };
+
+    // 计算所有管线状态的规范化键(着色器按模块与 SPIR-V 内容哈希，顶点输入按内容)
+    StateKey computeStateKey(VkRenderPass renderPass, VkPipelineLayout pipelineLayout) const;
+
     // 重置构建器状态，用于创建新的管线
     void reset();
 
+    // 销毁状态缓存中的所有管线与管线库
+    static void destroyCachedPipelines(VkDevice device);
+    // 销毁针对某个渲染通道创建的所有管线与管线库，在销毁渲染通道之前调用，避免句柄被复用后误命中
+    static void releaseRenderPass(VkDevice device, VkRenderPass renderPass);
+    // 销毁使用某个管线布局创建的所有管线与管线库，动态渲染的管线没有渲染通道，在销毁布局之前调用
+    static void releasePipelineLayout(VkDevice device, VkPipelineLayout pipelineLayout);
+    static size_t cachedPipelineCount();
+    // 按状态键查找已创建的管线，不存在时返回 VK_NULL_HANDLE
+    static VkPipeline findCachedPipeline(const StateKey& stateKey);
+
+    // VK_EXT_graphics_pipeline_library 模式
+    // 开启后管线拆成顶点输入、光栅化前着色器、片元着色器、片元输出四个库分别缓存，新组合只需要链接
+    // fastLinking 对应 graphicsPipelineLibraryFastLinking 属性，optimizeInBackground 时在后台重新做链接时优化
+    static void setGraphicsPipelineLibrary(bool enabled, bool fastLinking, bool optimizeInBackground = true);
+    static bool graphicsPipelineLibraryEnabled();
+    // 返回管线的后台优化版本(如果已经完成)，否则原样返回
+    static VkPipeline resolvePipeline(VkPipeline pipeline);
+    // 销毁已被优化版本替换、GPU 也不再使用的快速链接管线，每帧录制命令之前在主线程上调用
+    // 调用前要把持有的管线句柄都换成 resolvePipeline 的结果，此后录制的命令不再引用被替换的版本；
+    // 本次调用时新出现的被替换管线最晚被信号值为 lastUseValue 的提交使用，timeline 到达该值后销毁
+    static void retirePipelines(VkDevice device, VkSemaphore timeline, uint64_t lastUseValue);
+
+private:
+    // 修正内部指针，使拷贝后的构建器仍然指向自己的状态(颜色混合、动态状态、顶点输入、特化常量)
+    void fixupStatePointers();
+
+    struct Specialization {
+        VkShaderStageFlagBits stage;
+        std::vector<VkSpecializationMapEntry> mapEntries;
+        std::vector<uint8_t> data;
+        VkSpecializationInfo info;
+    };
+    const Specialization* findSpecialization(VkShaderStageFlagBits stage) const;
+
+    enum class LibraryPart : uint32_t {
+        VertexInputInterface,
+        PreRasterizationShaders,
+        FragmentShader,
+        FragmentOutput
+    };
+
+    // 把各管线库部分的状态追加到键中，computeStateKey 由它们拼接而成
+    void appendShaderStages(bool fragment, std::vector<uint8_t>& key) const;
+    void appendVertexInputInterface(std::vector<uint8_t>& key) const;
+    void appendPreRasterization(VkRenderPass renderPass, VkPipelineLayout pipelineLayout, std::vector<uint8_t>& key) const;
+    void appendFragmentShader(VkRenderPass renderPass, VkPipelineLayout pipelineLayout, std::vector<uint8_t>& key) const;
+    void appendFragmentOutput(VkRenderPass renderPass, std::vector<uint8_t>& key) const;
+    // 没有渲染通道时附件格式代替渲染通道句柄区分管线
+    void appendRenderingFormats(VkRenderPass renderPass, std::vector<uint8_t>& key) const;
+
+    VkResult createMonolithicPipeline(VkRenderPass renderPass, VkPipelineCache pipelineCache, VkPipelineLayout pipelineLayout, VkPipeline& outPipeline);
+    VkResult createLibraryPipeline(VkRenderPass renderPass, VkPipelineCache pipelineCache, VkPipelineLayout pipelineLayout, bool fastLinking, std::array<VkPipeline, 4>& libraries, VkPipeline& outPipeline);
+    VkResult getLibrary(LibraryPart part, VkRenderPass renderPass, VkPipelineCache pipelineCache, VkPipelineLayout pipelineLayout, VkPipeline& outLibrary);
+    static VkResult linkLibraries(VkDevice device, const std::array<VkPipeline, 4>& libraries, VkPipelineCache pipelineCache, VkPipelineLayout pipelineLayout, bool optimize, VkPipeline& outPipeline);
+    // 等待后台优化队列清空，调用时不能持有 stateCacheMutex
+    static void waitForOptimizeJobs();
+    static void optimizeLoop();
+
+    // 缓存的管线记录创建时使用的渲染通道与管线布局，以便在它们销毁时一起释放
+    struct CachedPipeline {
+        VkPipeline pipeline;
+        VkRenderPass renderPass;
+        VkPipelineLayout pipelineLayout;
+    };
+    // 销毁缓存中满足条件的管线与管线库
+    static void releaseCached(VkDevice device, const std::function<bool(const CachedPipeline&)>& predicate);
+
+    static std::mutex stateCacheMutex;
+    static std::unordered_map<StateKey, CachedPipeline, StateKeyHash> stateCache;
+    static std::unordered_map<StateKey, CachedPipeline, StateKeyHash> libraryCache;
+    // 快速链接版本 -> 后台优化版本
+    static std::unordered_map<VkPipeline, VkPipeline> upgradedPipelines;
+    // 被优化版本替换下来的快速链接管线，lastUseValue 为 0 时还没有经过 retirePipelines
+    struct RetiredPipeline {
+        CachedPipeline entry;
+        uint64_t lastUseValue;
+    };
+    static std::vector<RetiredPipeline> retiredPipelines;
+    // 后台重新做链接时优化的任务，由一个工作线程依次处理，队列与状态由 stateCacheMutex 保护
+    struct OptimizeJob {
+        VkDevice device;
+        std::array<VkPipeline, 4> libraries;
+        VkPipelineCache pipelineCache;
+        VkPipelineLayout pipelineLayout;
+        VkRenderPass renderPass;
+        StateKey stateKey;
+        VkPipeline fastLinked;
+    };
+    static std::deque<OptimizeJob> optimizeQueue;
+    static std::condition_variable optimizeCondition;
+    static std::thread optimizeThread;
+    // 工作线程正在链接一个已经出队的任务
+    static bool optimizeBusy;
+    static bool optimizeStopping;
+    static bool libraryMode;
+    static bool libraryFastLinking;
+    static bool libraryOptimizeInBackground;
+
 
 public:
     VkDevice device;
@@ -85,5 +219,13 @@ public:
     VkPipelineDynamicStateCreateInfo dynamicState;
     std::vector<VkDynamicState> dynamicStateEnables;
     std::vector<VkPipelineShaderStageCreateInfo> shaderStages;
-    VkPipelineVertexInputStateCreateInfo* vertexInputState;
+    // 顶点输入描述由构建器自己持有，拷贝后的构建器可以在其他线程上独立使用
+    VkPipelineVertexInputStateCreateInfo vertexInputState;
+    std::vector<VkVertexInputBindingDescription> vertexBindingDescriptions;
+    std::vector<VkVertexInputAttributeDescription> vertexAttributeDescriptions;
+    // 各着色器阶段的特化常量
+    std::vector<Specialization> specializations;
+    // 动态渲染的附件格式
+    std::vector<VkFormat> colorAttachmentFormats;
+    VkPipelineRenderingCreateInfo renderingCreateInfo;
 };
\ No newline at end of file
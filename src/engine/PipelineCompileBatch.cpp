@@ -0,0 +1,64 @@
+#include "PipelineCompileBatch.h"
+#include "VulkanUtil.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+void PipelineCompileBatch::add(const PipelineBuilder& builder, VkRenderPass renderPass, VkPipelineLayout pipelineLayout, VkPipeline* outPipeline, const std::string& name) {
+    assert(outPipeline);
+    jobs.push_back({ builder, renderPass, pipelineLayout, outPipeline, name });
+}
+
+VkResult PipelineCompileBatch::compile(VkPipelineCache pipelineCache, uint32_t threadCount) {
+    if (jobs.empty()) {
+        return VK_SUCCESS;
+    }
+    auto tStart = std::chrono::high_resolution_clock::now();
+
+    if (threadCount == 0) {
+        threadCount = std::max(1u, std::thread::hardware_concurrency());
+    }
+    threadCount = std::min(threadCount, static_cast<uint32_t>(jobs.size()));
+
+    // 工作线程从共享计数器领取任务，耗时长的管线不会拖住某个固定线程的队列
+    std::atomic<size_t> nextJob{ 0 };
+    auto worker = [&]() {
+        for (size_t i = nextJob++; i < jobs.size(); i = nextJob++) {
+            Job& job = jobs[i];
+            job.result = job.builder.buildPipeline(job.renderPass, pipelineCache, job.pipelineLayout, *job.outPipeline);
+        }
+    };
+    // 当前线程也参与编译
+    std::vector<std::thread> threads;
+    threads.reserve(threadCount - 1);
+    for (uint32_t i = 1; i < threadCount; i++) {
+        threads.emplace_back(worker);
+    }
+    worker();
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    // 调试名称在主线程上统一设置
+    VkResult result = VK_SUCCESS;
+    for (const Job& job : jobs) {
+        if (job.result != VK_SUCCESS) {
+            std::cerr << "Failed to compile pipeline \"" << job.name << "\": " << vks::tools::errorString(job.result) << std::endl;
+            if (result == VK_SUCCESS) {
+                result = job.result;
+            }
+            continue;
+        }
+        if (!job.name.empty()) {
+            vkUtils::setObjectDebugName(VK_OBJECT_TYPE_PIPELINE, (uint64_t)*job.outPipeline, job.name);
+        }
+    }
+
+    auto tEnd = std::chrono::high_resolution_clock::now();
+    auto takeTime = std::chrono::duration<double, std::milli>(tEnd - tStart).count();
+    std::cout << "Compiled " << jobs.size() << " pipelines on " << threadCount << " threads in " << takeTime << " ms" << std::endl;
+
+    jobs.clear();
+    return result;
+}
@@ -0,0 +1,33 @@
+#pragma once
+#include <vulkan/vulkan.h>
+#include <string>
+#include <vector>
+#include "PipelineBuilder.h"
+
+// 一批管线编译任务
+// 每个任务保存一份 PipelineBuilder 的拷贝，compile() 在工作线程上并行创建管线，
+// 所有线程共享同一个 VkPipelineCache(规范保证其内部同步)，compile() 返回时所有句柄均已写回
+class PipelineCompileBatch {
+public:
+    // 添加一个编译任务，builder 会被拷贝，之后可以继续修改或复用原构建器
+    // outPipeline 在 compile() 完成后写入，调用方需保证其在此之前有效
+    void add(const PipelineBuilder& builder, VkRenderPass renderPass, VkPipelineLayout pipelineLayout, VkPipeline* outPipeline, const std::string& name = "");
+
+    // 并行编译所有任务，threadCount 为 0 时使用硬件线程数
+    // 返回第一个失败的结果，全部成功时返回 VK_SUCCESS，完成后清空任务列表
+    VkResult compile(VkPipelineCache pipelineCache, uint32_t threadCount = 0);
+
+    size_t size() const { return jobs.size(); }
+    bool empty() const { return jobs.empty(); }
+
+private:
+    struct Job {
+        PipelineBuilder builder;
+        VkRenderPass renderPass;
+        VkPipelineLayout pipelineLayout;
+        VkPipeline* outPipeline;
+        std::string name;
+        VkResult result{ VK_NOT_READY };
+    };
+    std::vector<Job> jobs;
+};
@@ -0,0 +1,185 @@
+#include "ReadbackRing.h"
+#include <algorithm>
+#include <cassert>
+#include "VulkanTools.h"
+#include "VulkanInitializers.hpp"
+
+ReadbackRing::~ReadbackRing()
+{
+    destroy();
+}
+
+void ReadbackRing::create(vks::VulkanDevice* device, uint32_t slotCount, uint32_t width, uint32_t height, VkFormat format)
+{
+    assert(slots.empty());
+    this->device = device;
+    this->width = width;
+    this->height = height;
+    this->format = format;
+    head = tail = used = next = pending = 0;
+    releasedSlots.clear();
+
+    // 主机缓存的内存由 CPU 顺序读取时比写合并的内存快得多，没有时退回一致性内存
+    VkBool32 cachedFound = VK_FALSE;
+    device->getMemoryType(UINT32_MAX, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_CACHED_BIT, &cachedFound);
+    const VkMemoryPropertyFlags memoryFlags = cachedFound
+        ? VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_CACHED_BIT
+        : VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+    const VkDeviceSize size = static_cast<VkDeviceSize>(width) * height * 4;
+    slots.resize(std::max(slotCount, 1u));
+    for (Slot& slot : slots) {
+        VK_CHECK_RESULT(device->createBuffer(VK_BUFFER_USAGE_TRANSFER_DST_BIT, memoryFlags, &slot.buffer, size));
+        VK_CHECK_RESULT(slot.buffer.map());
+    }
+    coherent = (memoryFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) != 0;
+}
+
+void ReadbackRing::destroy()
+{
+    for (Slot& slot : slots) {
+        slot.buffer.destroy();
+    }
+    slots.clear();
+}
+
+bool ReadbackRing::record(VkCommandBuffer commandBuffer, VkImage image, VkImageLayout layout, bool synchronize, uint64_t timelineValue)
+{
+    if (used == slots.size()) {
+        statistics.dropped++;
+        return false;
+    }
+    Slot& slot = slots[head];
+    assert(slot.state == SlotState::Free);
+
+    VkImageMemoryBarrier imageBarrier = vks::initializers::imageMemoryBarrier();
+    imageBarrier.image = image;
+    imageBarrier.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+    if (synchronize) {
+        imageBarrier.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+        imageBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+        imageBarrier.oldLayout = layout;
+        imageBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &imageBarrier);
+    }
+
+    VkBufferImageCopy region{};
+    region.imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+    region.imageExtent = { width, height, 1 };
+    vkCmdCopyImageToBuffer(commandBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, slot.buffer.buffer, 1, &region);
+
+    // 时间线信号只保证执行完成，复制的写入还需要对主机读取可见
+    VkBufferMemoryBarrier bufferBarrier = vks::initializers::bufferMemoryBarrier();
+    bufferBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    bufferBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+    bufferBarrier.buffer = slot.buffer.buffer;
+    bufferBarrier.size = VK_WHOLE_SIZE;
+    uint32_t imageBarrierCount = 0;
+    if (synchronize && (layout != VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL)) {
+        // 之后的使用者(呈现)通过信号量同步，这里只需要布局转换
+        imageBarrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+        imageBarrier.dstAccessMask = 0;
+        imageBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+        imageBarrier.newLayout = layout;
+        imageBarrierCount = 1;
+    }
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT | VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 1, &bufferBarrier, imageBarrierCount, &imageBarrier);
+
+    slot.state = SlotState::Pending;
+    slot.timelineValue = timelineValue;
+    slot.sequence = statistics.recorded++;
+    head = (head + 1) % static_cast<uint32_t>(slots.size());
+    used++;
+    pending++;
+    return true;
+}
+
+void ReadbackRing::poll(uint64_t completedValue)
+{
+    // 提交按时间线值递增的顺序进行，遇到第一个未完成的槽位即可停止
+    while (pending > 0 && slots[next].timelineValue <= completedValue) {
+        Slot& slot = slots[next];
+        if (!coherent) {
+            VK_CHECK_RESULT(slot.buffer.invalidate());
+        }
+        slot.state = SlotState::Free;
+        if (callback) {
+            Frame frame;
+            frame.sequence = slot.sequence;
+            frame.slot = next;
+            frame.width = width;
+            frame.height = height;
+            frame.format = format;
+            frame.pixels = { static_cast<const uint8_t*>(slot.buffer.mapped), static_cast<size_t>(slot.buffer.size) };
+            callback(frame);
+        }
+        statistics.delivered++;
+        statistics.maxLatencyFrames = std::max(statistics.maxLatencyFrames, statistics.recorded - slot.sequence);
+        next = (next + 1) % static_cast<uint32_t>(slots.size());
+        pending--;
+    }
+    reclaim();
+}
+
+void ReadbackRing::reclaim()
+{
+    {
+        std::lock_guard<std::mutex> lock(releaseMutex);
+        for (uint32_t slot : releasedSlots) {
+            assert(slots[slot].state == SlotState::Retained);
+            slots[slot].state = SlotState::Free;
+        }
+        releasedSlots.clear();
+    }
+    // 只有最早的槽位连续空闲时环才能前进，保留时间较长的槽位会挡住之后的槽位
+    while (used > pending && slots[tail].state == SlotState::Free) {
+        tail = (tail + 1) % static_cast<uint32_t>(slots.size());
+        used--;
+    }
+}
+
+void ReadbackRing::drain(VkSemaphore timeline)
+{
+    if (pending == 0) {
+        reclaim();
+        return;
+    }
+    // 最后录制的槽位时间线值最大，等到它即可
+    const uint64_t value = slots[(head + slots.size() - 1) % slots.size()].timelineValue;
+    VkSemaphoreWaitInfo waitInfo{ .sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO };
+    waitInfo.semaphoreCount = 1;
+    waitInfo.pSemaphores = &timeline;
+    waitInfo.pValues = &value;
+    VK_CHECK_RESULT(vkWaitSemaphores(device->logicalDevice, &waitInfo, UINT64_MAX));
+    poll(value);
+}
+
+bool ReadbackRing::waitForSlot(VkSemaphore timeline)
+{
+    reclaim();
+    if (used < slots.size()) {
+        return true;
+    }
+    if (slots[tail].state != SlotState::Pending) {
+        return false;
+    }
+    const uint64_t value = slots[tail].timelineValue;
+    VkSemaphoreWaitInfo waitInfo{ .sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO };
+    waitInfo.semaphoreCount = 1;
+    waitInfo.pSemaphores = &timeline;
+    waitInfo.pValues = &value;
+    VK_CHECK_RESULT(vkWaitSemaphores(device->logicalDevice, &waitInfo, UINT64_MAX));
+    poll(value);
+    return used < slots.size();
+}
+
+void ReadbackRing::retain(uint32_t slot)
+{
+    assert(slots[slot].state == SlotState::Free);
+    slots[slot].state = SlotState::Retained;
+}
+
+void ReadbackRing::release(uint32_t slot)
+{
+    std::lock_guard<std::mutex> lock(releaseMutex);
+    releasedSlots.push_back(slot);
+}
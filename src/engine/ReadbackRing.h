@@ -0,0 +1,104 @@
+#pragma once
+#include <vulkan/vulkan.h>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <span>
+#include <vector>
+#include "VulkanDevice.h"
+#include "VulkanBuffer.h"
+
+// 渲染结果的异步读回
+// 每帧把完成的颜色图像用 vkCmdCopyImageToBuffer 复制到环形队列中的一个主机缓存(HOST_CACHED)缓冲，
+// 槽位记录复制所在提交会发出的时间线值；之后的帧里 poll 查询到时间线已经越过该值时，
+// 才把映射内存直接交给回调，整个过程不等待队列或设备，渲染吞吐与读回延迟无关
+// 所有槽位都在等待 GPU 或使用者时丢弃新的一帧而不是阻塞，丢弃数计入统计
+// 回调中调用 retain 可以保留槽位，在其他线程上处理完(例如编码)后再 release，期间不复制像素
+// 只支持每像素 4 字节的颜色格式，行之间紧密排列
+class ReadbackRing {
+public:
+    struct Frame {
+        // 第几次 record(从 0 开始，丢弃的帧不计)
+        uint64_t sequence{ 0 };
+        // 槽位编号，传给 retain/release
+        uint32_t slot{ 0 };
+        uint32_t width{ 0 };
+        uint32_t height{ 0 };
+        VkFormat format{ VK_FORMAT_UNDEFINED };
+        // 指向槽位的映射内存，不复制，只在回调期间有效
+        std::span<const uint8_t> pixels;
+    };
+    using Callback = std::function<void(const Frame&)>;
+
+    struct Statistics {
+        uint64_t recorded{ 0 };
+        uint64_t delivered{ 0 };
+        // 没有空闲槽位而未读回的帧
+        uint64_t dropped{ 0 };
+        // 从 record 到交给回调之间经过的最多帧数
+        uint64_t maxLatencyFrames{ 0 };
+    };
+
+    ~ReadbackRing();
+
+    void create(vks::VulkanDevice* device, uint32_t slotCount, uint32_t width, uint32_t height, VkFormat format);
+    // 调用前被保留的槽位必须都已释放
+    void destroy();
+    bool valid() const { return !slots.empty(); }
+    void setCallback(Callback callback) { this->callback = std::move(callback); }
+
+    // 在 commandBuffer 中录制 image 到下一个空闲槽位的复制，timelineValue 为这次提交完成时时间线信号量的值
+    // synchronize 为 false 时调用者已经把图像转换到 TRANSFER_SRC_OPTIMAL 并让颜色附件写入对传输可见(例如由渲染图)；
+    // 为 true 时在复制前插入从颜色附件输出开始的屏障，图像从 layout 转换到传输源，复制后再转换回 layout
+    // 没有空闲槽位时不录制并返回 false
+    bool record(VkCommandBuffer commandBuffer, VkImage image, VkImageLayout layout, bool synchronize, uint64_t timelineValue);
+    // 按录制顺序把时间线值不超过 completedValue 的槽位交给回调，回调中没有 retain 的槽位随即释放，不会等待
+    void poll(uint64_t completedValue);
+    // 等待全部在途的复制完成并交给回调，用于销毁或改变大小之前；保留的槽位需要使用者另行释放
+    void drain(VkSemaphore timeline);
+    // 下一次 record 没有空闲槽位时，等待最早的在途复制完成并交给回调；
+    // 最早的槽位被使用者保留时不等待并返回 false
+    bool waitForSlot(VkSemaphore timeline);
+
+    // 只能在回调中调用，槽位在 release 之前不会被复用，像素一直有效
+    void retain(uint32_t slot);
+    // 可以在任意线程调用，槽位在下一次 poll 时回到环中
+    void release(uint32_t slot);
+
+    const Statistics& getStatistics() const { return statistics; }
+
+private:
+    enum class SlotState : uint32_t {
+        Free,
+        // 复制已录制，等待 GPU 执行到 timelineValue
+        Pending,
+        // 已交给回调并被使用者保留
+        Retained,
+    };
+    struct Slot {
+        vks::Buffer buffer;
+        SlotState state{ SlotState::Free };
+        uint64_t timelineValue{ 0 };
+        uint64_t sequence{ 0 };
+    };
+
+    vks::VulkanDevice* device{ nullptr };
+    std::vector<Slot> slots;
+    // 槽位按环形顺序使用：[tail, head) 为在途或保留的槽位，其中从 next 开始的 pending 个尚未交给回调
+    uint32_t head{ 0 };
+    uint32_t tail{ 0 };
+    uint32_t used{ 0 };
+    uint32_t next{ 0 };
+    uint32_t pending{ 0 };
+    // 其他线程释放的槽位，在 poll 中回收
+    std::mutex releaseMutex;
+    std::vector<uint32_t> releasedSlots;
+    void reclaim();
+    uint32_t width{ 0 };
+    uint32_t height{ 0 };
+    VkFormat format{ VK_FORMAT_UNDEFINED };
+    // 没有要求 HOST_COHERENT 的内存在读取前需要 invalidate
+    bool coherent{ false };
+    Callback callback;
+    Statistics statistics;
+};
@@ -0,0 +1,561 @@
+#include "RenderGraph.h"
+#include <algorithm>
+#include <cassert>
+#include <tuple>
+#include "VulkanTools.h"
+#include "VulkanInitializers.hpp"
+#include "VulkanUtil.h"
+
+namespace {
+    struct UsageInfo {
+        VkImageLayout layout;
+        VkPipelineStageFlags2 stages;
+        VkAccessFlags2 readAccess;
+        VkAccessFlags2 writeAccess;
+        VkImageUsageFlags imageUsage;
+    };
+
+    // 阶段与访问类型只使用与旧接口数值相同的位，退回 vkCmdPipelineBarrier 时可以直接截断
+    UsageInfo usageInfo(RenderGraphUsage usage)
+    {
+        switch (usage) {
+        case RenderGraphUsage::ColorAttachment:
+            return { VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT,
+                VK_ACCESS_2_COLOR_ATTACHMENT_READ_BIT, VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT };
+        case RenderGraphUsage::DepthStencilAttachment:
+            return { VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT,
+                VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_READ_BIT, VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT };
+        case RenderGraphUsage::SampledFragment:
+            return { VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT,
+                VK_ACCESS_2_SHADER_READ_BIT, VK_ACCESS_2_NONE, VK_IMAGE_USAGE_SAMPLED_BIT };
+        case RenderGraphUsage::SampledCompute:
+            return { VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+                VK_ACCESS_2_SHADER_READ_BIT, VK_ACCESS_2_NONE, VK_IMAGE_USAGE_SAMPLED_BIT };
+        case RenderGraphUsage::Storage:
+            return { VK_IMAGE_LAYOUT_GENERAL, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+                VK_ACCESS_2_SHADER_READ_BIT, VK_ACCESS_2_SHADER_WRITE_BIT, VK_IMAGE_USAGE_STORAGE_BIT };
+        case RenderGraphUsage::TransferSrc:
+            return { VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_PIPELINE_STAGE_2_TRANSFER_BIT,
+                VK_ACCESS_2_TRANSFER_READ_BIT, VK_ACCESS_2_NONE, VK_IMAGE_USAGE_TRANSFER_SRC_BIT };
+        case RenderGraphUsage::TransferDst:
+            return { VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_PIPELINE_STAGE_2_TRANSFER_BIT,
+                VK_ACCESS_2_NONE, VK_ACCESS_2_TRANSFER_WRITE_BIT, VK_IMAGE_USAGE_TRANSFER_DST_BIT };
+        case RenderGraphUsage::Present:
+            return { VK_IMAGE_LAYOUT_PRESENT_SRC_KHR, VK_PIPELINE_STAGE_2_NONE, VK_ACCESS_2_NONE, VK_ACCESS_2_NONE, 0 };
+        }
+        return {};
+    }
+
+    // 除子资源范围外完全相同的屏障才能合并
+    auto barrierKey(const VkImageMemoryBarrier2& barrier)
+    {
+        return std::make_tuple((uint64_t)barrier.image, barrier.srcStageMask, barrier.srcAccessMask, barrier.dstStageMask, barrier.dstAccessMask,
+            barrier.oldLayout, barrier.newLayout, barrier.subresourceRange.aspectMask);
+    }
+
+    VkDeviceSize alignUp(VkDeviceSize value, VkDeviceSize alignment)
+    {
+        return (value + alignment - 1) / alignment * alignment;
+    }
+}
+
+RenderGraph::PassBuilder& RenderGraph::PassBuilder::read(RenderGraphImage image, RenderGraphUsage usage)
+{
+    const RenderGraphImageDesc& desc = graph.getDesc(image);
+    return read(image, usage, 0, desc.mipLevels, 0, desc.arrayLayers);
+}
+
+RenderGraph::PassBuilder& RenderGraph::PassBuilder::read(RenderGraphImage image, RenderGraphUsage usage, uint32_t baseMipLevel, uint32_t levelCount, uint32_t baseArrayLayer, uint32_t layerCount)
+{
+    graph.addUse(pass, image, usage, false, { graph.getDesc(image).aspectMask, baseMipLevel, levelCount, baseArrayLayer, layerCount });
+    return *this;
+}
+
+RenderGraph::PassBuilder& RenderGraph::PassBuilder::write(RenderGraphImage image, RenderGraphUsage usage)
+{
+    const RenderGraphImageDesc& desc = graph.getDesc(image);
+    return write(image, usage, 0, desc.mipLevels, 0, desc.arrayLayers);
+}
+
+RenderGraph::PassBuilder& RenderGraph::PassBuilder::write(RenderGraphImage image, RenderGraphUsage usage, uint32_t baseMipLevel, uint32_t levelCount, uint32_t baseArrayLayer, uint32_t layerCount)
+{
+    graph.addUse(pass, image, usage, true, { graph.getDesc(image).aspectMask, baseMipLevel, levelCount, baseArrayLayer, layerCount });
+    return *this;
+}
+
+RenderGraph::PassBuilder& RenderGraph::PassBuilder::sideEffect()
+{
+    graph.passes[pass].sideEffect = true;
+    return *this;
+}
+
+RenderGraph::RenderGraph(vks::VulkanDevice* device, bool synchronization2) : device(device), synchronization2(synchronization2)
+{
+}
+
+RenderGraph::~RenderGraph()
+{
+    destroy();
+}
+
+RenderGraphImage RenderGraph::importImage(const std::string& name, VkImage image, VkImageView view, const RenderGraphImageDesc& desc,
+    VkImageLayout initialLayout, VkPipelineStageFlags2 lastStage, VkAccessFlags2 lastAccess)
+{
+    assert(!compiled);
+    Resource resource;
+    resource.name = name;
+    resource.desc = desc;
+    resource.imported = true;
+    resource.image = image;
+    resource.view = view;
+    // 图之前的访问相当于一次写入，第一次使用时等待它
+    resource.initialState.layout = initialLayout;
+    resource.initialState.writeStages = lastStage;
+    resource.initialState.writeAccess = lastAccess;
+    resources.push_back(resource);
+    return { static_cast<uint32_t>(resources.size() - 1) };
+}
+
+RenderGraphImage RenderGraph::createImage(const std::string& name, const RenderGraphImageDesc& desc)
+{
+    assert(!compiled);
+    Resource resource;
+    resource.name = name;
+    resource.desc = desc;
+    resources.push_back(resource);
+    return { static_cast<uint32_t>(resources.size() - 1) };
+}
+
+void RenderGraph::setFinalUsage(RenderGraphImage image, RenderGraphUsage usage)
+{
+    assert(!compiled && image.index < resources.size());
+    // 临时图像的内容在图执行后就可能被覆盖，不能作为输出
+    assert(resources[image.index].imported);
+    resources[image.index].hasFinalUsage = true;
+    resources[image.index].finalUsage = usage;
+}
+
+RenderGraph::PassBuilder RenderGraph::addPass(const std::string& name, ExecuteFn execute)
+{
+    assert(!compiled);
+    Pass pass;
+    pass.name = name;
+    pass.execute = std::move(execute);
+    passes.push_back(std::move(pass));
+    return PassBuilder(*this, static_cast<uint32_t>(passes.size() - 1));
+}
+
+void RenderGraph::addUse(uint32_t pass, RenderGraphImage image, RenderGraphUsage usage, bool write, const VkImageSubresourceRange& range)
+{
+    assert(!compiled && image.index < resources.size());
+    const UsageInfo info = usageInfo(usage);
+    // Present 只能作为最终用法；只写的用法不能声明为读取，只读的用法不能声明为写入
+    assert(usage != RenderGraphUsage::Present);
+    assert(write ? info.writeAccess != VK_ACCESS_2_NONE : info.readAccess != VK_ACCESS_2_NONE);
+    const RenderGraphImageDesc& desc = resources[image.index].desc;
+    assert(range.baseMipLevel + range.levelCount <= desc.mipLevels && range.baseArrayLayer + range.layerCount <= desc.arrayLayers);
+    (void)info;
+    (void)desc;
+    passes[pass].uses.push_back({ image.index, usage, write, range });
+}
+
+void RenderGraph::compile()
+{
+    assert(!compiled);
+    statistics = {};
+    statistics.passes = static_cast<uint32_t>(passes.size());
+    cullPasses();
+    createTransientImages();
+    allocateTransientMemory();
+    computeBarriers();
+    compiled = true;
+}
+
+void RenderGraph::cullPasses()
+{
+    // 从后向前：写入了被需要的图像或有副作用的通道保留，它访问的图像也变为被需要
+    // 写入同样算作需要，部分写入的图像之前的写入者不会被剔除
+    std::vector<bool> needed(resources.size(), false);
+    for (size_t i = 0; i < resources.size(); i++) {
+        needed[i] = resources[i].hasFinalUsage;
+    }
+    for (size_t p = passes.size(); p-- > 0;) {
+        Pass& pass = passes[p];
+        bool live = pass.sideEffect;
+        for (const Use& use : pass.uses) {
+            live = live || (use.write && needed[use.resource]);
+        }
+        pass.culled = !live;
+        if (!live) {
+            statistics.culledPasses++;
+            continue;
+        }
+        for (const Use& use : pass.uses) {
+            needed[use.resource] = true;
+        }
+    }
+}
+
+void RenderGraph::createTransientImages()
+{
+    for (uint32_t p = 0; p < passes.size(); p++) {
+        if (passes[p].culled) {
+            continue;
+        }
+        for (const Use& use : passes[p].uses) {
+            Resource& resource = resources[use.resource];
+            if (resource.imported) {
+                continue;
+            }
+            const UsageInfo info = usageInfo(use.usage);
+            resource.firstPass = std::min(resource.firstPass, p);
+            resource.lastPass = std::max(resource.lastPass, p);
+            resource.usage |= info.imageUsage;
+            resource.usedStages |= info.stages;
+            if (use.write) {
+                resource.usedWriteAccess |= info.writeAccess;
+            }
+        }
+    }
+
+    for (Resource& resource : resources) {
+        // 只被剔除的通道使用的临时图像不创建
+        if (resource.imported || resource.firstPass == UINT32_MAX) {
+            continue;
+        }
+        VkImageCreateInfo imageCI = vks::initializers::imageCreateInfo();
+        imageCI.imageType = VK_IMAGE_TYPE_2D;
+        imageCI.format = resource.desc.format;
+        imageCI.extent = { resource.desc.width, resource.desc.height, 1 };
+        imageCI.mipLevels = resource.desc.mipLevels;
+        imageCI.arrayLayers = resource.desc.arrayLayers;
+        imageCI.samples = VK_SAMPLE_COUNT_1_BIT;
+        imageCI.tiling = VK_IMAGE_TILING_OPTIMAL;
+        imageCI.usage = resource.usage;
+        imageCI.flags = resource.desc.flags;
+        imageCI.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        imageCI.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        VK_CHECK_RESULT(vkCreateImage(device->logicalDevice, &imageCI, nullptr, &resource.image));
+        vkGetImageMemoryRequirements(device->logicalDevice, resource.image, &resource.memoryRequirements);
+    }
+}
+
+void RenderGraph::allocateTransientMemory()
+{
+    // 从大到小放置，每个图像放在第一个内存类型相同、且与已放置的图像在生存期重叠时内存不重叠的位置；
+    // 放不下时新建一块，块的大小就是第一个放入的(也是最大的)图像的大小
+    std::vector<uint32_t> order;
+    for (uint32_t i = 0; i < resources.size(); i++) {
+        if (!resources[i].imported && resources[i].image != VK_NULL_HANDLE) {
+            order.push_back(i);
+        }
+    }
+    std::stable_sort(order.begin(), order.end(), [this](uint32_t a, uint32_t b) {
+        return resources[a].memoryRequirements.size > resources[b].memoryRequirements.size;
+    });
+
+    auto lifetimesOverlap = [](const Resource& a, const Resource& b) {
+        return a.firstPass <= b.lastPass && b.firstPass <= a.lastPass;
+    };
+    auto memoryOverlaps = [](const Resource& a, VkDeviceSize offset, VkDeviceSize size) {
+        return a.memoryOffset < offset + size && offset < a.memoryOffset + a.memoryRequirements.size;
+    };
+
+    for (uint32_t index : order) {
+        Resource& resource = resources[index];
+        const VkMemoryRequirements& requirements = resource.memoryRequirements;
+        statistics.unaliasedTransientMemory += requirements.size;
+        const uint32_t memoryTypeIndex = device->getMemoryType(requirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+        for (uint32_t b = 0; b < memoryBlocks.size() && resource.memoryBlock == UINT32_MAX; b++) {
+            MemoryBlock& block = memoryBlocks[b];
+            if (block.memoryTypeIndex != memoryTypeIndex) {
+                continue;
+            }
+            std::vector<VkDeviceSize> candidates = { 0 };
+            for (uint32_t other : block.resources) {
+                candidates.push_back(alignUp(resources[other].memoryOffset + resources[other].memoryRequirements.size, requirements.alignment));
+            }
+            std::sort(candidates.begin(), candidates.end());
+            for (VkDeviceSize offset : candidates) {
+                if (offset + requirements.size > block.size) {
+                    break;
+                }
+                const bool conflict = std::any_of(block.resources.begin(), block.resources.end(), [&](uint32_t other) {
+                    return lifetimesOverlap(resource, resources[other]) && memoryOverlaps(resources[other], offset, requirements.size);
+                });
+                if (!conflict) {
+                    resource.memoryBlock = b;
+                    resource.memoryOffset = offset;
+                    block.resources.push_back(index);
+                    break;
+                }
+            }
+        }
+        if (resource.memoryBlock == UINT32_MAX) {
+            resource.memoryBlock = static_cast<uint32_t>(memoryBlocks.size());
+            resource.memoryOffset = 0;
+            memoryBlocks.push_back({ memoryTypeIndex, requirements.size, VK_NULL_HANDLE, { index } });
+        }
+    }
+
+    for (MemoryBlock& block : memoryBlocks) {
+        VkMemoryAllocateInfo memAlloc = vks::initializers::memoryAllocateInfo();
+        memAlloc.allocationSize = block.size;
+        memAlloc.memoryTypeIndex = block.memoryTypeIndex;
+        VK_CHECK_RESULT(vkAllocateMemory(device->logicalDevice, &memAlloc, nullptr, &block.memory));
+        statistics.transientMemory += block.size;
+
+        for (uint32_t index : block.resources) {
+            Resource& resource = resources[index];
+            VK_CHECK_RESULT(vkBindImageMemory(device->logicalDevice, resource.image, block.memory, resource.memoryOffset));
+            // 同一块内存之前的使用者：第一次使用时等待它们的全部访问完成，内容从 UNDEFINED 开始
+            for (uint32_t other : block.resources) {
+                const Resource& previous = resources[other];
+                if (previous.lastPass < resource.firstPass && memoryOverlaps(previous, resource.memoryOffset, resource.memoryRequirements.size)) {
+                    resource.aliased = true;
+                    resource.initialState.writeStages |= previous.usedStages;
+                    resource.initialState.writeAccess |= previous.usedWriteAccess;
+                }
+            }
+
+            const RenderGraphImageDesc& desc = resource.desc;
+            VkImageViewCreateInfo viewCI = vks::initializers::imageViewCreateInfo();
+            if ((desc.flags & VK_IMAGE_CREATE_CUBE_COMPATIBLE_BIT) && desc.arrayLayers == 6) {
+                viewCI.viewType = VK_IMAGE_VIEW_TYPE_CUBE;
+            } else {
+                viewCI.viewType = desc.arrayLayers > 1 ? VK_IMAGE_VIEW_TYPE_2D_ARRAY : VK_IMAGE_VIEW_TYPE_2D;
+            }
+            viewCI.format = desc.format;
+            viewCI.subresourceRange = { desc.aspectMask, 0, desc.mipLevels, 0, desc.arrayLayers };
+            viewCI.image = resource.image;
+            VK_CHECK_RESULT(vkCreateImageView(device->logicalDevice, &viewCI, nullptr, &resource.view));
+        }
+    }
+}
+
+bool RenderGraph::transition(SubresourceState& state, RenderGraphUsage usage, bool write, VkImageMemoryBarrier2& barrier)
+{
+    const UsageInfo info = usageInfo(usage);
+    barrier = { VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2 };
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstStageMask = info.stages;
+    barrier.dstAccessMask = info.readAccess | (write ? info.writeAccess : VK_ACCESS_2_NONE);
+    barrier.oldLayout = state.layout;
+    barrier.newLayout = info.layout;
+
+    if (state.layout != info.layout || write) {
+        // 布局转换或写入：等待之前的写入与读取(写后写、读后写)
+        const VkPipelineStageFlags2 srcStages = state.writeStages | state.readStages;
+        const bool needed = state.layout != info.layout || srcStages != VK_PIPELINE_STAGE_2_NONE;
+        barrier.srcStageMask = srcStages;
+        barrier.srcAccessMask = state.writeAccess;
+        // 布局转换本身是一次写入，对目标阶段可见
+        state.layout = info.layout;
+        state.writeStages = info.stages;
+        state.writeAccess = write ? info.writeAccess : VK_ACCESS_2_NONE;
+        state.readStages = write ? VK_PIPELINE_STAGE_2_NONE : info.stages;
+        state.visibleStages = write ? VK_PIPELINE_STAGE_2_NONE : info.stages;
+        return needed;
+    }
+
+    // 相同布局下的读取：只有尚未看到最近一次写入的阶段需要屏障，之后同一阶段的读取不再重复
+    state.readStages |= info.stages;
+    if (state.writeStages == VK_PIPELINE_STAGE_2_NONE || (info.stages & ~state.visibleStages) == 0) {
+        return false;
+    }
+    barrier.srcStageMask = state.writeStages;
+    barrier.srcAccessMask = state.writeAccess;
+    state.visibleStages |= info.stages;
+    return true;
+}
+
+void RenderGraph::mergeBarriers(std::vector<VkImageMemoryBarrier2>& barriers)
+{
+    if (barriers.size() < 2) {
+        return;
+    }
+    // 先合并同一 mip 中相邻的层，再合并层范围相同的相邻 mip
+    auto mergeAdjacent = [&barriers](auto order, auto canMerge, auto merge) {
+        std::sort(barriers.begin(), barriers.end(), order);
+        size_t count = 0;
+        for (size_t i = 1; i < barriers.size(); i++) {
+            VkImageMemoryBarrier2& last = barriers[count];
+            if (barrierKey(last) == barrierKey(barriers[i]) && canMerge(last.subresourceRange, barriers[i].subresourceRange)) {
+                merge(last.subresourceRange, barriers[i].subresourceRange);
+            } else {
+                barriers[++count] = barriers[i];
+            }
+        }
+        barriers.resize(count + 1);
+    };
+    mergeAdjacent(
+        [](const VkImageMemoryBarrier2& a, const VkImageMemoryBarrier2& b) {
+            return std::make_tuple(barrierKey(a), a.subresourceRange.baseMipLevel, a.subresourceRange.levelCount, a.subresourceRange.baseArrayLayer)
+                < std::make_tuple(barrierKey(b), b.subresourceRange.baseMipLevel, b.subresourceRange.levelCount, b.subresourceRange.baseArrayLayer);
+        },
+        [](const VkImageSubresourceRange& a, const VkImageSubresourceRange& b) {
+            return a.baseMipLevel == b.baseMipLevel && a.levelCount == b.levelCount && a.baseArrayLayer + a.layerCount == b.baseArrayLayer;
+        },
+        [](VkImageSubresourceRange& a, const VkImageSubresourceRange& b) { a.layerCount += b.layerCount; });
+    mergeAdjacent(
+        [](const VkImageMemoryBarrier2& a, const VkImageMemoryBarrier2& b) {
+            return std::make_tuple(barrierKey(a), a.subresourceRange.baseArrayLayer, a.subresourceRange.layerCount, a.subresourceRange.baseMipLevel)
+                < std::make_tuple(barrierKey(b), b.subresourceRange.baseArrayLayer, b.subresourceRange.layerCount, b.subresourceRange.baseMipLevel);
+        },
+        [](const VkImageSubresourceRange& a, const VkImageSubresourceRange& b) {
+            return a.baseArrayLayer == b.baseArrayLayer && a.layerCount == b.layerCount && a.baseMipLevel + a.levelCount == b.baseMipLevel;
+        },
+        [](VkImageSubresourceRange& a, const VkImageSubresourceRange& b) { a.levelCount += b.levelCount; });
+}
+
+void RenderGraph::computeBarriers()
+{
+    // 每个子资源(mip * 层数 + 层)一个状态
+    std::vector<std::vector<SubresourceState>> states(resources.size());
+    for (size_t i = 0; i < resources.size(); i++) {
+        const RenderGraphImageDesc& desc = resources[i].desc;
+        states[i].assign(static_cast<size_t>(desc.mipLevels) * desc.arrayLayers, resources[i].initialState);
+    }
+
+    auto forEachSubresource = [&](uint32_t resource, const VkImageSubresourceRange& range, RenderGraphUsage usage, bool write, std::vector<VkImageMemoryBarrier2>& out, std::vector<VkImageMemoryBarrier2>* initialOut) {
+        const Resource& res = resources[resource];
+        for (uint32_t mip = range.baseMipLevel; mip < range.baseMipLevel + range.levelCount; mip++) {
+            for (uint32_t layer = range.baseArrayLayer; layer < range.baseArrayLayer + range.layerCount; layer++) {
+                VkImageMemoryBarrier2 barrier;
+                if (!transition(states[resource][static_cast<size_t>(mip) * res.desc.arrayLayers + layer], usage, write, barrier)) {
+                    continue;
+                }
+                barrier.image = res.image;
+                barrier.subresourceRange = { res.desc.aspectMask, mip, 1, layer, 1 };
+                // 没有需要等待的先前访问，转换可以提前到第一个通道之前与其他初始转换一起提交
+                const bool initial = barrier.srcStageMask == VK_PIPELINE_STAGE_2_NONE && barrier.srcAccessMask == VK_ACCESS_2_NONE;
+                (initial && initialOut ? *initialOut : out).push_back(barrier);
+            }
+        }
+    };
+
+    Pass* firstPass = nullptr;
+    for (Pass& pass : passes) {
+        if (pass.culled) {
+            continue;
+        }
+        if (!firstPass) {
+            firstPass = &pass;
+        }
+        for (const Use& use : pass.uses) {
+            forEachSubresource(use.resource, use.range, use.usage, use.write, pass.barriers, &firstPass->barriers);
+        }
+    }
+
+    for (uint32_t i = 0; i < resources.size(); i++) {
+        if (resources[i].hasFinalUsage) {
+            const RenderGraphImageDesc& desc = resources[i].desc;
+            forEachSubresource(i, { desc.aspectMask, 0, desc.mipLevels, 0, desc.arrayLayers }, resources[i].finalUsage, false, finalBarriers, nullptr);
+        }
+    }
+
+    for (Pass& pass : passes) {
+        mergeBarriers(pass.barriers);
+        if (!pass.barriers.empty()) {
+            statistics.barrierBatches++;
+            statistics.imageBarriers += static_cast<uint32_t>(pass.barriers.size());
+        }
+    }
+    mergeBarriers(finalBarriers);
+    if (!finalBarriers.empty()) {
+        statistics.barrierBatches++;
+        statistics.imageBarriers += static_cast<uint32_t>(finalBarriers.size());
+    }
+}
+
+void RenderGraph::recordBarriers(VkCommandBuffer commandBuffer, const std::vector<VkImageMemoryBarrier2>& barriers) const
+{
+    if (synchronization2) {
+        VkDependencyInfo dependencyInfo{ VK_STRUCTURE_TYPE_DEPENDENCY_INFO };
+        dependencyInfo.imageMemoryBarrierCount = static_cast<uint32_t>(barriers.size());
+        dependencyInfo.pImageMemoryBarriers = barriers.data();
+        vkCmdPipelineBarrier2(commandBuffer, &dependencyInfo);
+        return;
+    }
+
+    // 旧接口每批只有一组阶段，取所有屏障的并集
+    VkPipelineStageFlags srcStages = 0;
+    VkPipelineStageFlags dstStages = 0;
+    std::vector<VkImageMemoryBarrier> imageBarriers(barriers.size());
+    for (size_t i = 0; i < barriers.size(); i++) {
+        const VkImageMemoryBarrier2& barrier = barriers[i];
+        srcStages |= static_cast<VkPipelineStageFlags>(barrier.srcStageMask);
+        dstStages |= static_cast<VkPipelineStageFlags>(barrier.dstStageMask);
+        imageBarriers[i] = vks::initializers::imageMemoryBarrier();
+        imageBarriers[i].srcAccessMask = static_cast<VkAccessFlags>(barrier.srcAccessMask);
+        imageBarriers[i].dstAccessMask = static_cast<VkAccessFlags>(barrier.dstAccessMask);
+        imageBarriers[i].oldLayout = barrier.oldLayout;
+        imageBarriers[i].newLayout = barrier.newLayout;
+        imageBarriers[i].image = barrier.image;
+        imageBarriers[i].subresourceRange = barrier.subresourceRange;
+    }
+    vkCmdPipelineBarrier(commandBuffer, srcStages ? srcStages : VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, dstStages ? dstStages : VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+        0, 0, nullptr, 0, nullptr, static_cast<uint32_t>(imageBarriers.size()), imageBarriers.data());
+}
+
+void RenderGraph::execute(VkCommandBuffer commandBuffer) const
+{
+    assert(compiled);
+    for (const Pass& pass : passes) {
+        if (pass.culled) {
+            continue;
+        }
+        if (!pass.barriers.empty()) {
+            recordBarriers(commandBuffer, pass.barriers);
+        }
+        // 每个通道是一个调试标签作用域，同时得到 GPU 耗时，通道前的屏障不计入
+        if (pass.execute) {
+            vkUtils::cmdBeginLabel(commandBuffer, pass.name.c_str(), { 1.0f, 1.0f, 1.0f, 1.0f });
+            pass.execute(commandBuffer, *this);
+            vkUtils::cmdEndLabel(commandBuffer);
+        }
+    }
+    if (!finalBarriers.empty()) {
+        recordBarriers(commandBuffer, finalBarriers);
+    }
+}
+
+void RenderGraph::destroy()
+{
+    for (Resource& resource : resources) {
+        if (resource.imported) {
+            continue;
+        }
+        if (resource.view != VK_NULL_HANDLE) {
+            vkDestroyImageView(device->logicalDevice, resource.view, nullptr);
+        }
+        if (resource.image != VK_NULL_HANDLE) {
+            vkDestroyImage(device->logicalDevice, resource.image, nullptr);
+        }
+        resource.view = VK_NULL_HANDLE;
+        resource.image = VK_NULL_HANDLE;
+    }
+    for (MemoryBlock& block : memoryBlocks) {
+        vkFreeMemory(device->logicalDevice, block.memory, nullptr);
+    }
+    memoryBlocks.clear();
+}
+
+VkImage RenderGraph::getImage(RenderGraphImage image) const
+{
+    assert(image.index < resources.size());
+    return resources[image.index].image;
+}
+
+VkImageView RenderGraph::getView(RenderGraphImage image) const
+{
+    assert(image.index < resources.size());
+    return resources[image.index].view;
+}
+
+const RenderGraphImageDesc& RenderGraph::getDesc(RenderGraphImage image) const
+{
+    assert(image.index < resources.size());
+    return resources[image.index].desc;
+}
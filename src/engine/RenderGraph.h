@@ -0,0 +1,188 @@
+#pragma once
+#include <vulkan/vulkan.h>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+#include "VulkanDevice.h"
+
+// 图像在通道中的用法，决定所需的布局、管线阶段、访问类型与图像 usage
+enum class RenderGraphUsage : uint32_t {
+    ColorAttachment,
+    DepthStencilAttachment,
+    SampledFragment,
+    SampledCompute,
+    // 计算着色器中的存储图像
+    Storage,
+    TransferSrc,
+    TransferDst,
+    // 只用作图的最终用法
+    Present,
+};
+
+struct RenderGraphImageDesc {
+    VkFormat format{ VK_FORMAT_UNDEFINED };
+    uint32_t width{ 0 };
+    uint32_t height{ 0 };
+    uint32_t mipLevels{ 1 };
+    uint32_t arrayLayers{ 1 };
+    VkImageCreateFlags flags{ 0 };
+    VkImageAspectFlags aspectMask{ VK_IMAGE_ASPECT_COLOR_BIT };
+};
+
+// 图像句柄，只在创建它的图中有效
+struct RenderGraphImage {
+    uint32_t index{ UINT32_MAX };
+    bool valid() const { return index != UINT32_MAX; }
+};
+
+// 渲染图
+// 通道按添加顺序执行，每个通道声明读写哪些图像的哪些子资源；compile 时：
+// 1. 从图的输出(设置了最终用法的导入图像)与有副作用的通道向前回溯，剔除结果没有被使用的通道
+// 2. 按 mip/层逐个跟踪子资源的布局与上一次访问，只在布局变化、写后读、读后写、写后写时生成屏障，
+//    同一通道前的屏障合并为一次 vkCmdPipelineBarrier2，相邻子资源的相同屏障合并为一个范围；
+//    没有先前访问的初始转换(从 UNDEFINED 或导入时的布局)提前到第一个通道前一起提交
+// 3. 图内创建的临时图像按首次与最后一次使用的通道计算生存期，生存期不重叠的图像共用同一块设备内存，
+//    后使用者的第一个屏障等待前一个使用者的全部访问并从 UNDEFINED 转换
+// 不支持 synchronization2 的设备退回 vkCmdPipelineBarrier，每批屏障的阶段取并集
+class RenderGraph {
+public:
+    // 通道的录制函数，临时图像的句柄此时已经创建，通过 getImage/getView 取得
+    using ExecuteFn = std::function<void(VkCommandBuffer, const RenderGraph&)>;
+
+    // addPass 返回，用于声明通道的读写
+    class PassBuilder {
+    public:
+        // 未指定范围时为图像的全部 mip 与层
+        PassBuilder& read(RenderGraphImage image, RenderGraphUsage usage);
+        PassBuilder& read(RenderGraphImage image, RenderGraphUsage usage, uint32_t baseMipLevel, uint32_t levelCount, uint32_t baseArrayLayer, uint32_t layerCount);
+        PassBuilder& write(RenderGraphImage image, RenderGraphUsage usage);
+        PassBuilder& write(RenderGraphImage image, RenderGraphUsage usage, uint32_t baseMipLevel, uint32_t levelCount, uint32_t baseArrayLayer, uint32_t layerCount);
+        // 通道的结果不在图内(例如写入缓冲区或交换链之外的对象)，不会被剔除
+        PassBuilder& sideEffect();
+
+    private:
+        friend class RenderGraph;
+        PassBuilder(RenderGraph& graph, uint32_t pass) : graph(graph), pass(pass) {}
+        RenderGraph& graph;
+        uint32_t pass;
+    };
+
+    struct Statistics {
+        uint32_t passes{ 0 };
+        uint32_t culledPasses{ 0 };
+        uint32_t barrierBatches{ 0 };
+        uint32_t imageBarriers{ 0 };
+        // 临时图像实际分配的内存与不共用内存时所需的内存
+        VkDeviceSize transientMemory{ 0 };
+        VkDeviceSize unaliasedTransientMemory{ 0 };
+    };
+
+    RenderGraph(vks::VulkanDevice* device, bool synchronization2);
+    ~RenderGraph();
+    RenderGraph(const RenderGraph&) = delete;
+    RenderGraph& operator=(const RenderGraph&) = delete;
+
+    // 外部图像，initialLayout 为当前布局，lastStage/lastAccess 为图之前尚未同步的访问
+    // (例如交换链图像等待获取信号量的阶段)，图之前的访问都已完成时保持为 NONE
+    RenderGraphImage importImage(const std::string& name, VkImage image, VkImageView view, const RenderGraphImageDesc& desc,
+        VkImageLayout initialLayout = VK_IMAGE_LAYOUT_UNDEFINED, VkPipelineStageFlags2 lastStage = VK_PIPELINE_STAGE_2_NONE, VkAccessFlags2 lastAccess = VK_ACCESS_2_NONE);
+    // 图内的临时图像，usage 由各通道声明的用法合成，内容只在图执行期间有效
+    RenderGraphImage createImage(const std::string& name, const RenderGraphImageDesc& desc);
+    // 图执行完后把导入图像转换到 usage 对应的布局；设置了最终用法的图像是图的输出
+    void setFinalUsage(RenderGraphImage image, RenderGraphUsage usage);
+
+    PassBuilder addPass(const std::string& name, ExecuteFn execute);
+
+    // 剔除通道、创建并分配临时图像、计算全部屏障，之后不能再添加通道或图像
+    void compile();
+    // 录制未被剔除的通道及其屏障，编译后的图可以重复执行(每次执行前导入图像的状态需要与导入时一致)
+    void execute(VkCommandBuffer commandBuffer) const;
+    // 释放临时图像与内存，图的命令缓冲执行完后才能调用
+    void destroy();
+
+    VkImage getImage(RenderGraphImage image) const;
+    VkImageView getView(RenderGraphImage image) const;
+    const RenderGraphImageDesc& getDesc(RenderGraphImage image) const;
+    const Statistics& getStatistics() const { return statistics; }
+
+private:
+    // 子资源的访问状态
+    // writeStages/writeAccess 为最近一次写入(布局转换也算写入，此时没有访问类型)，
+    // readStages 为之后的读取，visibleStages 为已经通过屏障看到该写入的阶段
+    struct SubresourceState {
+        VkImageLayout layout{ VK_IMAGE_LAYOUT_UNDEFINED };
+        VkPipelineStageFlags2 writeStages{ VK_PIPELINE_STAGE_2_NONE };
+        VkAccessFlags2 writeAccess{ VK_ACCESS_2_NONE };
+        VkPipelineStageFlags2 readStages{ VK_PIPELINE_STAGE_2_NONE };
+        VkPipelineStageFlags2 visibleStages{ VK_PIPELINE_STAGE_2_NONE };
+    };
+
+    struct Resource {
+        std::string name;
+        RenderGraphImageDesc desc;
+        bool imported{ false };
+        VkImage image{ VK_NULL_HANDLE };
+        VkImageView view{ VK_NULL_HANDLE };
+        SubresourceState initialState;
+        bool hasFinalUsage{ false };
+        RenderGraphUsage finalUsage{ RenderGraphUsage::SampledFragment };
+        // 以下只用于临时图像
+        VkImageUsageFlags usage{ 0 };
+        uint32_t firstPass{ UINT32_MAX };
+        uint32_t lastPass{ 0 };
+        // 生存期内所有访问的阶段与写访问，供共用内存的后继图像等待
+        VkPipelineStageFlags2 usedStages{ VK_PIPELINE_STAGE_2_NONE };
+        VkAccessFlags2 usedWriteAccess{ VK_ACCESS_2_NONE };
+        VkMemoryRequirements memoryRequirements{};
+        uint32_t memoryBlock{ UINT32_MAX };
+        VkDeviceSize memoryOffset{ 0 };
+        // 有生存期更早、内存重叠的临时图像
+        bool aliased{ false };
+    };
+
+    struct Use {
+        uint32_t resource;
+        RenderGraphUsage usage;
+        bool write;
+        VkImageSubresourceRange range;
+    };
+
+    struct Pass {
+        std::string name;
+        ExecuteFn execute;
+        std::vector<Use> uses;
+        bool sideEffect{ false };
+        bool culled{ false };
+        // 通道执行前的屏障，已合并
+        std::vector<VkImageMemoryBarrier2> barriers;
+    };
+
+    struct MemoryBlock {
+        uint32_t memoryTypeIndex;
+        VkDeviceSize size;
+        VkDeviceMemory memory{ VK_NULL_HANDLE };
+        // 放在该块中的临时图像
+        std::vector<uint32_t> resources;
+    };
+
+    void addUse(uint32_t pass, RenderGraphImage image, RenderGraphUsage usage, bool write, const VkImageSubresourceRange& range);
+    void cullPasses();
+    void createTransientImages();
+    void allocateTransientMemory();
+    void computeBarriers();
+    // 把一次访问应用到子资源的状态上，需要同步时返回 true 并填写屏障
+    static bool transition(SubresourceState& state, RenderGraphUsage usage, bool write, VkImageMemoryBarrier2& barrier);
+    static void mergeBarriers(std::vector<VkImageMemoryBarrier2>& barriers);
+    void recordBarriers(VkCommandBuffer commandBuffer, const std::vector<VkImageMemoryBarrier2>& barriers) const;
+
+    vks::VulkanDevice* device;
+    bool synchronization2;
+    bool compiled{ false };
+    std::vector<Resource> resources;
+    std::vector<Pass> passes;
+    std::vector<MemoryBlock> memoryBlocks;
+    // 最后一个通道之后转换到最终用法的屏障
+    std::vector<VkImageMemoryBarrier2> finalBarriers;
+    Statistics statistics;
+};
@@ -0,0 +1,420 @@
+#include "RenderService.h"
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <thread>
+#include "CommandLineParser.hpp"
+#include "PipelineCompileBatch.h"
+#include "VulkanUtil.h"
+
+namespace
+{
+    std::string trim(const std::string& value)
+    {
+        const size_t begin = value.find_first_not_of(" \t\r");
+        if (begin == std::string::npos) {
+            return "";
+        }
+        const size_t end = value.find_last_not_of(" \t\r");
+        return value.substr(begin, end - begin + 1);
+    }
+
+    // 任务中的资源路径与引擎的资源一样相对资源目录
+    std::string resolveAssetPath(const std::string& path)
+    {
+        return std::filesystem::path(path).is_absolute() ? path : getAssetPath() + path;
+    }
+}
+
+bool RenderService::runFromCommandLine(VulkanEngine& engine, const std::vector<const char*>& args, int& exitCode)
+{
+    CommandLineParser parser;
+    parser.add("service", { "--service" }, 1, "Render jobs from the given spool directory instead of running the render loop");
+    parser.add("serviceidle", { "--serviceidle" }, 1, "Stop the service after the given number of seconds without new jobs (default: keep running)");
+    parser.add("servicemodels", { "--servicemodels" }, 1, "Number of models the service keeps resident (default 4)");
+    parser.add("serviceenvironments", { "--serviceenvironments" }, 1, "Number of environments (environment map and IBL results) the service keeps resident (default 2)");
+    parser.add("serviceencoders", { "--serviceencoders" }, 1, "Number of image encoder threads (default: half of the hardware threads)");
+    parser.add("servicequeue", { "--servicequeue" }, 1, "Number of rendered images that may wait for an encoder thread before rendering blocks (default 4)");
+    parser.parse(args);
+    if (!parser.isSet("service")) {
+        return false;
+    }
+
+    const size_t modelCacheSize = static_cast<size_t>(std::max(parser.getValueAsInt("servicemodels", 4), 1));
+    const size_t environmentCacheSize = static_cast<size_t>(std::max(parser.getValueAsInt("serviceenvironments", 2), 1));
+    const uint32_t encoderThreads = static_cast<uint32_t>(std::max(parser.getValueAsInt("serviceencoders", 0), 0));
+    const size_t encoderQueueSize = static_cast<size_t>(std::max(parser.getValueAsInt("servicequeue", 4), 1));
+    RenderService service(engine, parser.getValueAsString("service", "spool"), modelCacheSize, environmentCacheSize, encoderThreads, encoderQueueSize);
+    const uint32_t failed = service.run(static_cast<uint32_t>(std::max(parser.getValueAsInt("serviceidle", 0), 0)));
+    exitCode = failed > 0 ? 1 : 0;
+    return true;
+}
+
+RenderService::RenderService(VulkanEngine& engine, const std::string& spoolDirectory, size_t modelCacheSize, size_t environmentCacheSize, uint32_t encoderThreads, size_t encoderQueueSize)
+    : engine(engine), spoolDirectory(spoolDirectory), models(modelCacheSize), environments(environmentCacheSize), encodeQueue(encoderThreads, encoderQueueSize)
+{
+    std::error_code ec;
+    std::filesystem::create_directories(this->spoolDirectory, ec);
+    if (!std::filesystem::is_directory(this->spoolDirectory)) {
+        vks::tools::exitFatal("Could not create the spool directory " + spoolDirectory, -1);
+    }
+
+    defaultDescriptorSet = engine.descriptorSet;
+    std::copy(std::begin(engine.uniformDataParams.irradianceSH), std::end(engine.uniformDataParams.irradianceSH), defaultIrradianceSH.begin());
+
+    models.setEvictCallback([this](const std::string&, vkglTF::Model& model) {
+        waitForGpu();
+        this->engine.bindless.releaseModelMaterials(model);
+    });
+    environments.setEvictCallback([this](const std::string&, Environment& environment) {
+        waitForGpu();
+        environment.environmentCube.destroy();
+        environment.prefilteredCube.destroy();
+        environment.lutBrdf.destroy();
+        freeDescriptorSets.push_back(environment.descriptorSet);
+    });
+
+    // 每个任务的图像都要读回，槽位比在途帧多，编码稍慢时 GPU 也不用等待；
+    // 排队与正在编码的图像都占用槽位，槽位不足时队列满之前就会在 waitForSlot 处等待
+    const uint32_t encodeSlots = static_cast<uint32_t>(encodeQueue.getCapacity()) + encodeQueue.getThreadCount();
+    engine.readbackSlots = std::max(engine.readbackSlots, engine.maxConcurrentFrames + std::min(encodeSlots, 8u));
+    vkDeviceWaitIdle(engine.device);
+    engine.setupReadback();
+    engine.setupFrameGraphs();
+    engine.readback.setCallback([this](const ReadbackRing::Frame& frame) { onFrame(frame); });
+}
+
+RenderService::~RenderService()
+{
+    flush();
+    engine.readback.setCallback({});
+    // 缓存中的资源可能仍被最后几帧使用，先切回引擎自己的模型与环境
+    engine.sceneModel = &engine.models.object;
+    engine.descriptorSet = defaultDescriptorSet;
+    std::copy(defaultIrradianceSH.begin(), defaultIrradianceSH.end(), engine.uniformDataParams.irradianceSH);
+    models.clear();
+    environments.clear();
+}
+
+uint32_t RenderService::run(uint32_t idleSeconds)
+{
+    std::cout << "Render service watching " << spoolDirectory.string() << " for *.job files" << std::endl;
+    auto lastJob = std::chrono::steady_clock::now();
+    auto firstJob = lastJob;
+    uint32_t submittedJobs = 0;
+    while (true) {
+        std::vector<JobDesc> jobs = claimJobs();
+        if (jobs.empty()) {
+            // 没有新任务时交出在途任务的结果，不让它们等到下一批
+            flush();
+            const auto idle = std::chrono::duration<double>(std::chrono::steady_clock::now() - lastJob).count();
+            if ((idleSeconds > 0) && (idle >= idleSeconds)) {
+                break;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+            continue;
+        }
+        if (submittedJobs == 0) {
+            firstJob = std::chrono::steady_clock::now();
+        }
+        // 同一批中尺寸相同的任务排在一起，减少重建离屏图像的次数
+        std::stable_sort(jobs.begin(), jobs.end(), [](const JobDesc& a, const JobDesc& b) {
+            return std::make_pair(a.width, a.height) < std::make_pair(b.width, b.height);
+        });
+        for (const JobDesc& job : jobs) {
+            renderJob(job);
+            submittedJobs++;
+        }
+        lastJob = std::chrono::steady_clock::now();
+    }
+    flush();
+
+    const double busySeconds = std::chrono::duration<double>(lastJob - firstJob).count();
+    const auto& modelStatistics = models.getStatistics();
+    const auto& environmentStatistics = environments.getStatistics();
+    std::cout << std::fixed << std::setprecision(2);
+    std::cout << "Render service: " << completedJobs << " jobs completed, " << failedJobs << " failed";
+    if ((completedJobs > 0) && (busySeconds > 0.0)) {
+        std::cout << ", " << completedJobs / busySeconds << " images/s";
+    }
+    std::cout << "\n";
+    std::cout << "  models      : " << modelStatistics.hits << " hits, " << modelStatistics.misses << " misses, " << modelStatistics.evictions << " evictions\n";
+    std::cout << "  environments: " << environmentStatistics.hits << " hits, " << environmentStatistics.misses << " misses, " << environmentStatistics.evictions << " evictions\n";
+    const EncodeQueue::Statistics encodeStatistics = encodeQueue.getStatistics();
+    std::cout << "  encoder     : " << encodeQueue.getThreadCount() << " threads, ";
+    if (encodeStatistics.encodeSeconds > 0.0) {
+        std::cout << encodeStatistics.pixels / encodeStatistics.encodeSeconds / 1.0e6 << " MP/s per thread, ";
+    }
+    std::cout << encodeStatistics.blockedPushes << " blocked pushes (" << encodeStatistics.blockedSeconds * 1000.0 << " ms)" << std::endl;
+    return failedJobs;
+}
+
+std::vector<RenderService::JobDesc> RenderService::claimJobs()
+{
+    std::vector<std::filesystem::path> files;
+    std::error_code ec;
+    for (const auto& entry : std::filesystem::directory_iterator(spoolDirectory, ec)) {
+        if (entry.is_regular_file() && (entry.path().extension() == ".job")) {
+            files.push_back(entry.path());
+        }
+    }
+    // 按文件名顺序处理，提交方可以用文件名控制先后
+    std::sort(files.begin(), files.end());
+
+    std::vector<JobDesc> jobs;
+    for (const std::filesystem::path& file : files) {
+        JobDesc job;
+        job.name = file.stem().string();
+        job.workingFile = file.string() + ".working";
+        // 改名失败说明任务已被其他工作进程领取
+        std::filesystem::rename(file, job.workingFile, ec);
+        if (ec) {
+            continue;
+        }
+        std::string error;
+        if (!parseJob(job, error)) {
+            finishJob(job, false, error);
+            continue;
+        }
+        jobs.push_back(std::move(job));
+    }
+    return jobs;
+}
+
+bool RenderService::parseJob(JobDesc& job, std::string& error) const
+{
+    std::ifstream file(job.workingFile);
+    if (!file.is_open()) {
+        error = "Could not open " + job.workingFile.string();
+        return false;
+    }
+    job.output = job.name + ".png";
+    std::string line;
+    uint32_t lineNumber = 0;
+    while (std::getline(file, line)) {
+        lineNumber++;
+        line = trim(line);
+        if (line.empty() || (line[0] == '#')) {
+            continue;
+        }
+        const size_t separator = line.find('=');
+        if (separator == std::string::npos) {
+            error = "Line " + std::to_string(lineNumber) + ": expected key = value";
+            return false;
+        }
+        const std::string key = trim(line.substr(0, separator));
+        const std::string value = trim(line.substr(separator + 1));
+        std::istringstream stream(value);
+        bool valid = true;
+        if (key == "model") {
+            job.model = value;
+        } else if (key == "environment") {
+            job.environment = value;
+        } else if (key == "width") {
+            valid = static_cast<bool>(stream >> job.width);
+        } else if (key == "height") {
+            valid = static_cast<bool>(stream >> job.height);
+        } else if (key == "position") {
+            valid = static_cast<bool>(stream >> job.position.x >> job.position.y >> job.position.z);
+        } else if (key == "rotation") {
+            valid = static_cast<bool>(stream >> job.rotation.x >> job.rotation.y >> job.rotation.z);
+        } else if (key == "fov") {
+            valid = static_cast<bool>(stream >> job.fov);
+        } else if (key == "exposure") {
+            valid = static_cast<bool>(stream >> job.exposure);
+        } else if (key == "output") {
+            job.output = value;
+        } else {
+            error = "Line " + std::to_string(lineNumber) + ": unknown key '" + key + "'";
+            return false;
+        }
+        if (!valid) {
+            error = "Line " + std::to_string(lineNumber) + ": invalid value for '" + key + "'";
+            return false;
+        }
+    }
+    const uint32_t maxDimension = engine.vulkanDevice->properties.limits.maxImageDimension2D;
+    if ((job.width == 0) || (job.height == 0) || (job.width > maxDimension) || (job.height > maxDimension)) {
+        error = "Output size must be between 1 and " + std::to_string(maxDimension);
+        return false;
+    }
+    if (!ImageEncoder::fileFormatFromPath(job.output, job.format)) {
+        error = "Unsupported output format '" + job.output.extension().string() + "', expected .png, .qoi, .ktx or .ppm";
+        return false;
+    }
+    if (job.output.is_relative()) {
+        job.output = spoolDirectory / job.output;
+    }
+    return true;
+}
+
+vkglTF::Model* RenderService::acquireModel(const std::string& path, std::string& error)
+{
+    if (vkglTF::Model* model = models.find(path)) {
+        return model;
+    }
+    const std::string file = resolveAssetPath(path);
+    if (!std::filesystem::exists(file)) {
+        error = "Model " + file + " does not exist";
+        return nullptr;
+    }
+    auto model = std::make_unique<vkglTF::Model>();
+    const uint32_t glTFLoadingFlags = vkglTF::FileLoadingFlags::PreTransformVertices | vkglTF::FileLoadingFlags::PreMultiplyVertexColors | vkglTF::FileLoadingFlags::FlipY;
+    model->loadFromFile(file, engine.vulkanDevice, engine.queue, glTFLoadingFlags);
+    // 在途帧仍在使用 bindless 描述符集，设备不支持 UPDATE_UNUSED_WHILE_PENDING 时要等它们完成才能写入
+    if (!engine.bindless.updatesWhilePending()) {
+        waitForGpu();
+    }
+    engine.bindless.registerModelMaterials(*model);
+    // 回退管线假定材质带有全部贴图，新模型的材质变体必须在第一次绘制之前编译好
+    PipelineCompileBatch batch;
+    engine.addMaterialVariants(batch, *model);
+    VK_CHECK_RESULT(batch.compile(engine.pipelineCache));
+    return &models.insert(path, std::move(model));
+}
+
+RenderService::Environment* RenderService::acquireEnvironment(const std::string& path, std::string& error)
+{
+    if (Environment* environment = environments.find(path)) {
+        return environment;
+    }
+    const std::string file = resolveAssetPath(path);
+    if (!std::filesystem::exists(file)) {
+        error = "Environment map " + file + " does not exist";
+        return nullptr;
+    }
+    // IBL 结果优先从磁盘缓存加载(可以用 --bakeibl 预先生成)，没有缓存时只有计算路径可以在运行时生成
+    const uint64_t cacheKey = vkUtils::iblCacheKey(file);
+    auto environment = std::make_unique<Environment>();
+    const bool cacheHit = vkUtils::loadIBLCache(engine.iblCacheDirectory, cacheKey, environment->lutBrdf, environment->prefilteredCube);
+    if (!cacheHit && !vkUtils::computeIBLSupported()) {
+        error = "No cached IBL results for " + file + " and the device cannot generate them at runtime";
+        return nullptr;
+    }
+    environment->environmentCube.loadFromFile(file, VK_FORMAT_R16G16B16A16_SFLOAT, engine.vulkanDevice, engine.queue);
+    if (!cacheHit) {
+        vkUtils::generateIBLCompute(environment->lutBrdf, environment->prefilteredCube, environment->environmentCube);
+        vkUtils::saveIBLCache(engine.iblCacheDirectory, cacheKey, environment->lutBrdf, environment->prefilteredCube);
+    }
+    vkUtils::generateIrradianceSH(file, environment->irradianceSH);
+
+    Environment& inserted = environments.insert(path, std::move(environment));
+    // 插入时淘汰的环境会留下描述符集
+    if (!freeDescriptorSets.empty()) {
+        inserted.descriptorSet = freeDescriptorSets.back();
+        freeDescriptorSets.pop_back();
+    } else {
+        inserted.descriptorSet = engine.descriptorAllocator.allocate(engine.descriptorSetLayout);
+    }
+    engine.writeSceneDescriptorSet(inserted.descriptorSet, inserted.environmentCube, inserted.lutBrdf, inserted.prefilteredCube);
+    return &inserted;
+}
+
+void RenderService::renderJob(const JobDesc& job)
+{
+    std::string error;
+    vkglTF::Model* model = job.model.empty() ? &engine.models.object : acquireModel(job.model, error);
+    Environment* environment = nullptr;
+    if (model && !job.environment.empty()) {
+        environment = acquireEnvironment(job.environment, error);
+    }
+    if (!model || (!job.environment.empty() && !environment)) {
+        finishJob(job, false, error);
+        return;
+    }
+
+    if ((job.width != engine.width) || (job.height != engine.height)) {
+        // 读回缓冲与离屏图像一起按新尺寸重建，旧尺寸的任务先全部完成
+        flush();
+        engine.resize(job.width, job.height);
+    }
+    // 读回槽位都被占用时等待最早的复制完成，槽位被编码占用时等待至少一张图像编码完成
+    while (!engine.readback.waitForSlot(engine.frameTimeline)) {
+        const size_t inFlight = encodeQueue.inFlight();
+        encodeQueue.wait(inFlight > 0 ? inFlight - 1 : 0);
+    }
+
+    engine.sceneModel = model;
+    engine.descriptorSet = environment ? environment->descriptorSet : defaultDescriptorSet;
+    const std::array<glm::vec4, 9>& irradianceSH = environment ? environment->irradianceSH : defaultIrradianceSH;
+    std::copy(irradianceSH.begin(), irradianceSH.end(), engine.uniformDataParams.irradianceSH);
+    engine.uniformDataParams.exposure = job.exposure;
+    engine.camera.setPerspective(job.fov, static_cast<float>(job.width) / static_cast<float>(job.height), engine.camera.getNearClip(), engine.camera.getFarClip());
+    engine.camera.setPosition(job.position);
+    engine.camera.setRotation(job.rotation);
+
+    auto active = std::make_unique<ActiveJob>();
+    active->desc = job;
+    active->sequence = engine.readback.getStatistics().recorded;
+    activeJobs.push_back(std::move(active));
+    engine.render();
+    if (engine.readback.getStatistics().recorded == activeJobs.back()->sequence) {
+        std::unique_ptr<ActiveJob> failed = std::move(activeJobs.back());
+        activeJobs.pop_back();
+        finishJob(failed->desc, false, "The frame was not rendered");
+    }
+}
+
+void RenderService::onFrame(const ReadbackRing::Frame& frame)
+{
+    // 帧按录制顺序交付，与任务一一对应；服务启动前录制的帧没有对应的任务
+    if (activeJobs.empty() || (activeJobs.front()->sequence != frame.sequence)) {
+        return;
+    }
+    ActiveJob* job = activeJobs.front().release();
+    activeJobs.pop_front();
+    job->frame = frame;
+    // 像素直接从读回缓冲编码，编码完成前槽位不会被复用；队列已满时在这里等待编码线程
+    engine.readback.retain(frame.slot);
+    EncodeQueue::Task task;
+    task.image = { frame.width, frame.height, frame.format, 0, frame.pixels };
+    task.format = job->desc.format;
+    task.options.exposure = job->desc.exposure;
+    task.output = job->desc.output;
+    task.onComplete = [this, job](bool succeeded, const std::string& error) { onEncoded(job, succeeded, error); };
+    encodeQueue.push(std::move(task));
+}
+
+void RenderService::onEncoded(ActiveJob* job, bool succeeded, const std::string& error)
+{
+    std::unique_ptr<ActiveJob> owned(job);
+    engine.readback.release(job->frame.slot);
+    finishJob(job->desc, succeeded, error);
+}
+
+void RenderService::finishJob(const JobDesc& job, bool succeeded, const std::string& error)
+{
+    const std::filesystem::path base = spoolDirectory / job.name;
+    std::error_code ec;
+    if (!succeeded) {
+        std::ofstream errorFile(base.string() + ".error");
+        errorFile << error << "\n";
+    }
+    std::filesystem::rename(job.workingFile, base.string() + (succeeded ? ".job.done" : ".job.failed"), ec);
+    (succeeded ? completedJobs : failedJobs)++;
+
+    std::lock_guard<std::mutex> lock(logMutex);
+    if (succeeded) {
+        std::cout << job.name << ": " << job.width << "x" << job.height << " -> " << job.output.string() << "\n";
+    } else {
+        std::cerr << job.name << ": failed, " << error << "\n";
+    }
+}
+
+void RenderService::flush()
+{
+    engine.readback.drain(engine.frameTimeline);
+    encodeQueue.wait();
+    // 已提交但没有读回的任务(例如读回环被重建)不会再有结果
+    while (!activeJobs.empty()) {
+        finishJob(activeJobs.front()->desc, false, "The frame was not read back");
+        activeJobs.pop_front();
+    }
+}
+
+void RenderService::waitForGpu()
+{
+    engine.waitForFrameTimeline(engine.frameTimelineValue);
+}
@@ -0,0 +1,103 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "VulkanEngine.h"
+#include "EncodeQueue.h"
+#include "LruCache.h"
+#include "ReadbackRing.h"
+
+// 渲染服务：把引擎作为渲染工作进程，从本地的任务目录(spool)中领取任务
+// 每个任务是目录中的一个 .job 文本文件(key = value)，指定模型、环境贴图、相机与输出尺寸；
+// 领取时原子地改名为 .job.working，多个工作进程可以共用一个目录，完成后改名为 .job.done 或 .job.failed(同时写出 .error)
+// 模型与环境(环境贴图、IBL 结果与球谐系数)按最近使用保留在显存中，连续的任务之间不重复加载；
+// 每个任务只渲染一帧，多个任务与普通的帧一样按在途帧数流水执行，图像通过读回环在几帧之后交给编码队列，
+// 由编码线程按输出文件的扩展名编码为 PNG、QOI、KTX 或 PPM；主线程只负责准备与提交，吞吐取决于 GPU 而不是单个任务的准备开销，
+// 编码跟不上时编码队列的背压让主线程等待，读回的图像不会无限积压
+class RenderService {
+public:
+    // 命令行中有 --service <目录> 时在已经 prepare 的引擎上运行服务并返回 true，exitCode 为有任务失败时的 1
+    static bool runFromCommandLine(VulkanEngine& engine, const std::vector<const char*>& args, int& exitCode);
+
+    // encoderThreads 为 0 时使用一半的硬件线程，encoderQueueSize 为等待编码的最多图像数
+    RenderService(VulkanEngine& engine, const std::string& spoolDirectory, size_t modelCacheSize, size_t environmentCacheSize, uint32_t encoderThreads, size_t encoderQueueSize);
+    ~RenderService();
+    RenderService(const RenderService&) = delete;
+    RenderService& operator=(const RenderService&) = delete;
+
+    // 处理任务直到连续 idleSeconds 秒没有新任务(为 0 时一直运行)，返回失败的任务数
+    uint32_t run(uint32_t idleSeconds);
+
+private:
+    struct JobDesc {
+        // 任务文件名去掉 .job
+        std::string name;
+        std::filesystem::path workingFile;
+        // 相对路径相对资源目录，为空时使用引擎启动时加载的模型与环境
+        std::string model;
+        std::string environment;
+        uint32_t width{ 1280 };
+        uint32_t height{ 720 };
+        glm::vec3 position{ 0.7f, 0.1f, 1.7f };
+        glm::vec3 rotation{ -7.75f, 150.25f, 0.0f };
+        float fov{ 60.0f };
+        float exposure{ 4.5f };
+        // 相对路径相对任务目录，默认为 <name>.png，扩展名决定文件格式
+        std::filesystem::path output;
+        ImageEncoder::FileFormat format{ ImageEncoder::FileFormat::PNG };
+    };
+
+    // 已提交、等待读回或编码的任务
+    struct ActiveJob {
+        JobDesc desc;
+        // 读回环中对应的帧序号
+        uint64_t sequence{ 0 };
+        ReadbackRing::Frame frame;
+    };
+
+    struct Environment {
+        vks::TextureCubeMap environmentCube;
+        vks::TextureCubeMap prefilteredCube;
+        vks::Texture2D lutBrdf;
+        std::array<glm::vec4, 9> irradianceSH{};
+        VkDescriptorSet descriptorSet{ VK_NULL_HANDLE };
+    };
+
+    std::vector<JobDesc> claimJobs();
+    bool parseJob(JobDesc& job, std::string& error) const;
+    vkglTF::Model* acquireModel(const std::string& path, std::string& error);
+    Environment* acquireEnvironment(const std::string& path, std::string& error);
+    void renderJob(const JobDesc& job);
+    // 读回环的回调，在主线程上按录制顺序调用
+    void onFrame(const ReadbackRing::Frame& frame);
+    // 在编码线程上调用，释放读回槽位并完成任务
+    void onEncoded(ActiveJob* job, bool succeeded, const std::string& error);
+    void finishJob(const JobDesc& job, bool succeeded, const std::string& error);
+    // 等待全部已提交任务的读回与编码完成
+    void flush();
+    // 淘汰缓存项之前等待 GPU 执行完全部已提交的帧
+    void waitForGpu();
+
+    VulkanEngine& engine;
+    std::filesystem::path spoolDirectory;
+    LruCache<vkglTF::Model> models;
+    LruCache<Environment> environments;
+    // 淘汰的环境留下的描述符集，描述符分配器不能单独释放描述符集，由之后加载的环境复用
+    std::vector<VkDescriptorSet> freeDescriptorSets;
+    VkDescriptorSet defaultDescriptorSet{ VK_NULL_HANDLE };
+    std::array<glm::vec4, 9> defaultIrradianceSH{};
+    std::deque<std::unique_ptr<ActiveJob>> activeJobs;
+    // 编码线程输出日志时使用
+    std::mutex logMutex;
+    std::atomic<uint32_t> completedJobs{ 0 };
+    std::atomic<uint32_t> failedJobs{ 0 };
+    // 编码线程调用 finishJob，放在最后最先销毁
+    EncodeQueue encodeQueue;
+};
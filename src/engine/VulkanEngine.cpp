@@ -1,24 +1,167 @@
 #include "VulkanEngine.h"
 #include "VulkanUtil.h"
+
+namespace
+{
+	// 帧的耗时显示滑动平均，一次性提交(启动时的 IBL 预计算)显示累计耗时
+	void printGpuTimingTree(const GpuProfiler::Node& node, uint32_t depth, bool total)
+	{
+		for (const GpuProfiler::Node& child : node.children) {
+			std::cout << std::string(depth * 2, ' ') << child.name << ": " << std::fixed << std::setprecision(3)
+				<< (total ? child.total : child.average) << " ms" << std::defaultfloat << "\n";
+			printGpuTimingTree(child, depth + 1, total);
+		}
+	}
+
+	void drawGpuTimingTree(const GpuProfiler::Node& node, bool total)
+	{
+		for (const GpuProfiler::Node& child : node.children) {
+			const ImGuiTreeNodeFlags flags = ImGuiTreeNodeFlags_DefaultOpen | (child.children.empty() ? ImGuiTreeNodeFlags_Leaf : 0);
+			if (ImGui::TreeNodeEx(child.name.c_str(), flags, "%s  %.3f ms", child.name.c_str(), total ? child.total : child.average)) {
+				drawGpuTimingTree(child, total);
+				ImGui::TreePop();
+			}
+		}
+	}
+}
+
 void VulkanEngine::getEnabledFeatures()
 {
 	if (deviceFeatures.samplerAnisotropy) {
 		enabledFeatures.samplerAnisotropy = VK_TRUE;
 	}
+	// 线框模式
+	if (deviceFeatures.fillModeNonSolid) {
+		enabledFeatures.fillModeNonSolid = VK_TRUE;
+	}
+	// 计算着色器生成 IBL 时 BRDF LUT 以 RG16F 存储图像写入
+	if (deviceFeatures.shaderStorageImageExtendedFormats) {
+		enabledFeatures.shaderStorageImageExtendedFormats = VK_TRUE;
+	}
 
 	vulkan11Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_1_FEATURES;
 	vulkan11Features.shaderDrawParameters = VK_TRUE;
 
+	VkPhysicalDeviceVulkan12Features supportedVulkan12Features{ VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES };
+	VkPhysicalDeviceFeatures2 supportedFeatures12{ VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2 };
+	supportedFeatures12.pNext = &supportedVulkan12Features;
+	vkGetPhysicalDeviceFeatures2(physicalDevice, &supportedFeatures12);
+
+	// Bindless 材质纹理所需的 descriptor indexing 特性与帧同步所需的 timeline semaphore，缺少任何一个都无法运行
+	const std::pair<const char*, VkBool32> requiredVulkan12Features[] = {
+		{ "descriptorIndexing", supportedVulkan12Features.descriptorIndexing },
+		{ "runtimeDescriptorArray", supportedVulkan12Features.runtimeDescriptorArray },
+		{ "descriptorBindingPartiallyBound", supportedVulkan12Features.descriptorBindingPartiallyBound },
+		{ "descriptorBindingVariableDescriptorCount", supportedVulkan12Features.descriptorBindingVariableDescriptorCount },
+		{ "descriptorBindingSampledImageUpdateAfterBind", supportedVulkan12Features.descriptorBindingSampledImageUpdateAfterBind },
+		{ "shaderSampledImageArrayNonUniformIndexing", supportedVulkan12Features.shaderSampledImageArrayNonUniformIndexing },
+		{ "timelineSemaphore", supportedVulkan12Features.timelineSemaphore },
+	};
+	std::string missingFeatures;
+	for (const auto& [name, supported] : requiredVulkan12Features) {
+		if (!supported) {
+			missingFeatures += missingFeatures.empty() ? name : std::string(", ") + name;
+		}
+	}
+	if (!missingFeatures.empty()) {
+		vks::tools::exitFatal("Selected GPU does not support the required Vulkan 1.2 features: " + missingFeatures, -1);
+	}
+	vulkan12Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+	vulkan12Features.descriptorIndexing = VK_TRUE;
+	vulkan12Features.runtimeDescriptorArray = VK_TRUE;
+	vulkan12Features.descriptorBindingPartiallyBound = VK_TRUE;
+	vulkan12Features.descriptorBindingVariableDescriptorCount = VK_TRUE;
+	vulkan12Features.descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
+	vulkan12Features.shaderSampledImageArrayNonUniformIndexing = VK_TRUE;
+	// 帧仍在执行时注册新模型的纹理，不支持时注册前要等待在途帧完成
+	if (supportedVulkan12Features.descriptorBindingUpdateUnusedWhilePending) {
+		vulkan12Features.descriptorBindingUpdateUnusedWhilePending = VK_TRUE;
+		descriptorUpdateWhilePendingSupported = true;
+	}
+	// 帧同步使用 timeline semaphore，每帧等待各自的目标值
+	vulkan12Features.timelineSemaphore = VK_TRUE;
+	// GPU 计时在读取结果后于主机上重置查询池，不需要在命令缓冲中录制重置
+	if (supportedVulkan12Features.hostQueryReset) {
+		vulkan12Features.hostQueryReset = VK_TRUE;
+		hostQueryResetSupported = true;
+	}
+	vulkan11Features.pNext = &vulkan12Features;
+
+	// synchronization2 与 dynamic rendering 是 Vulkan 1.3 的核心特性
+	if (deviceProperties.apiVersion >= VK_API_VERSION_1_3) {
+		VkPhysicalDeviceVulkan13Features supportedFeatures{ VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES };
+		VkPhysicalDeviceFeatures2 features2{ VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2 };
+		features2.pNext = &supportedFeatures;
+		vkGetPhysicalDeviceFeatures2(physicalDevice, &features2);
+		vulkan13Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES;
+		if (supportedFeatures.synchronization2) {
+			vulkan13Features.synchronization2 = VK_TRUE;
+			synchronization2Supported = true;
+		}
+		// 动态渲染不需要渲染通道与帧缓冲对象，窗口大小改变时只需要重建深度缓冲
+		// 交换链图像与深度缓冲的布局转换改由每帧的渲染图完成
+		if (supportedFeatures.dynamicRendering && !settings.renderPass) {
+			vulkan13Features.dynamicRendering = VK_TRUE;
+			dynamicRendering = true;
+		}
+		if (synchronization2Supported || dynamicRendering) {
+			vulkan12Features.pNext = &vulkan13Features;
+		}
+	}
+
 	deviceCreatepNextChain = &vulkan11Features;
 }
 
+void VulkanEngine::getEnabledExtensions()
+{
+	// maintenance5 允许把 SPIR-V 直接放进管线的着色器阶段信息，不再创建着色器模块对象
+	// Vulkan 1.4 中为核心功能，1.3 设备需要启用扩展
+	const bool maintenance5Core = deviceProperties.apiVersion >= VK_API_VERSION_1_4;
+	if (maintenance5Core || (deviceProperties.apiVersion >= VK_API_VERSION_1_3 && vulkanDevice->extensionSupported(VK_KHR_MAINTENANCE_5_EXTENSION_NAME))) {
+		maintenance5Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MAINTENANCE_5_FEATURES_KHR;
+		VkPhysicalDeviceFeatures2 features2{ VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2 };
+		features2.pNext = &maintenance5Features;
+		vkGetPhysicalDeviceFeatures2(physicalDevice, &features2);
+		if (maintenance5Features.maintenance5) {
+			if (!maintenance5Core) {
+				enabledDeviceExtensions.push_back(VK_KHR_MAINTENANCE_5_EXTENSION_NAME);
+			}
+			maintenance5Features.pNext = vulkan12Features.pNext;
+			vulkan12Features.pNext = &maintenance5Features;
+			shaderModuleCache.setInlineModules(true);
+		}
+	}
+
+	// 支持 graphics pipeline library 时，管线按部分编译成库再链接，新组合的创建开销主要是链接
+	if (!vulkanDevice->extensionSupported(VK_EXT_GRAPHICS_PIPELINE_LIBRARY_EXTENSION_NAME) || !vulkanDevice->extensionSupported(VK_KHR_PIPELINE_LIBRARY_EXTENSION_NAME)) {
+		return;
+	}
+	graphicsPipelineLibraryFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_GRAPHICS_PIPELINE_LIBRARY_FEATURES_EXT;
+	VkPhysicalDeviceFeatures2 features2{ VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2 };
+	features2.pNext = &graphicsPipelineLibraryFeatures;
+	vkGetPhysicalDeviceFeatures2(physicalDevice, &features2);
+	if (!graphicsPipelineLibraryFeatures.graphicsPipelineLibrary) {
+		return;
+	}
+	graphicsPipelineLibraryProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_GRAPHICS_PIPELINE_LIBRARY_PROPERTIES_EXT;
+	VkPhysicalDeviceProperties2 properties2{ VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2 };
+	properties2.pNext = &graphicsPipelineLibraryProperties;
+	vkGetPhysicalDeviceProperties2(physicalDevice, &properties2);
+
+	enabledDeviceExtensions.push_back(VK_KHR_PIPELINE_LIBRARY_EXTENSION_NAME);
+	enabledDeviceExtensions.push_back(VK_EXT_GRAPHICS_PIPELINE_LIBRARY_EXTENSION_NAME);
+	graphicsPipelineLibraryFeatures.pNext = vulkan12Features.pNext;
+	vulkan12Features.pNext = &graphicsPipelineLibraryFeatures;
+	graphicsPipelineLibrarySupported = true;
+}
+
 void VulkanEngine::loadAssets()
 {
 	auto tStart = std::chrono::high_resolution_clock::now();
 
 	uint32_t glTFLoadingFlags = vkglTF::FileLoadingFlags::PreTransformVertices | vkglTF::FileLoadingFlags::PreMultiplyVertexColors | vkglTF::FileLoadingFlags::FlipY;
 	models.object.loadFromFile(getAssetPath() + "models/cerberus/cerberus.gltf", vulkanDevice, queue, glTFLoadingFlags);
-	textures.environmentCube.loadFromFile(getAssetPath() + "textures/hdr/gcanyon_cube.ktx", VK_FORMAT_R16G16B16A16_SFLOAT, vulkanDevice, queue);
+	textures.environmentCube.loadFromFile(getAssetPath() + environmentMapFile, VK_FORMAT_R16G16B16A16_SFLOAT, vulkanDevice, queue);
 	textures.albedoMap.loadFromFile(getAssetPath() + "models/cerberus/albedo.ktx", VK_FORMAT_R8G8B8A8_UNORM, vulkanDevice, queue);
 	textures.normalMap.loadFromFile(getAssetPath() + "models/cerberus/normal.ktx", VK_FORMAT_R8G8B8A8_UNORM, vulkanDevice, queue);
 	textures.aoMap.loadFromFile(getAssetPath() + "models/cerberus/ao.ktx", VK_FORMAT_R8_UNORM, vulkanDevice, queue);
@@ -39,81 +182,100 @@ void VulkanEngine::loadAssets()
 
 }
 
-void VulkanEngine::setupDescriptors()
+void VulkanEngine::setupBindless()
 {
-	// Descriptor Pool
-	std::vector<VkDescriptorPoolSize> poolSizes = {
-		vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, maxConcurrentFrames * 4),
-		vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, maxConcurrentFrames * 16)
-	};
-	VkDescriptorPoolCreateInfo descriptorPoolInfo = vks::initializers::descriptorPoolCreateInfo(poolSizes, maxConcurrentFrames * 2);
-	VK_CHECK_RESULT(vkCreateDescriptorPool(device, &descriptorPoolInfo, nullptr, &descriptorPool));
-	vkUtils::setObjectDebugName(VK_OBJECT_TYPE_DESCRIPTOR_POOL, (uint64_t)descriptorPool, "descriptorPool");
+	bindless.create(vulkanDevice, descriptorUpdateWhilePendingSupported);
+	vkUtils::setObjectDebugName(VK_OBJECT_TYPE_DESCRIPTOR_SET, (uint64_t)bindless.descriptorSet, "bindless descriptorSet");
 
+	// Cerberus 的贴图不在 glTF 中，单独注册为一个材质
+	BindlessTable::MaterialData cerberus{};
+	cerberus.albedoMap = bindless.registerTexture(textures.albedoMap.descriptor);
+	cerberus.normalMap = bindless.registerTexture(textures.normalMap.descriptor);
+	cerberus.aoMap = bindless.registerTexture(textures.aoMap.descriptor);
+	cerberus.metallicMap = bindless.registerTexture(textures.metallicMap.descriptor);
+	cerberus.roughnessMap = bindless.registerTexture(textures.roughnessMap.descriptor);
+	const uint32_t cerberusIndex = bindless.registerMaterial(cerberus);
+	for (auto& material : models.object.materials) {
+		material.index = cerberusIndex;
+	}
+}
+
+void VulkanEngine::setupDescriptors()
+{
 	// Descriptor set layout
+	// 布局由 descriptorLayoutCache 按绑定哈希缓存并统一销毁
+	// uniform 绑定是动态的，每帧的数据位置在绑定描述符集时通过动态偏移指定
 	std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings = {
-		vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0),
-		vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_FRAGMENT_BIT, 1),
+		vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0),
+		vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, VK_SHADER_STAGE_FRAGMENT_BIT, 1),
 		vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT, 2),
 		vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT, 3),
 		vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT, 4),
-		vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT, 5),
-		vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT, 6),
-		vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT, 7),
-		vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT, 8),
-		vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT, 9),
 	};
-	VkDescriptorSetLayoutCreateInfo descriptorLayout = vks::initializers::descriptorSetLayoutCreateInfo(setLayoutBindings);
-	VK_CHECK_RESULT(vkCreateDescriptorSetLayout(device, &descriptorLayout, nullptr, &descriptorSetLayout));
+	descriptorSetLayout = descriptorLayoutCache.createDescriptorSetLayout(setLayoutBindings);
 	vkUtils::setObjectDebugName(VK_OBJECT_TYPE_DESCRIPTOR_SET_LAYOUT, (uint64_t)descriptorSetLayout, "descriptorSetLayout");
+}
 
-	// Sets per frame, just like the buffers themselves
-	// Images do not need to be duplicated per frame, we reuse the same one for each frame
-	VkDescriptorSetAllocateInfo allocInfo = vks::initializers::descriptorSetAllocateInfo(descriptorPool, &descriptorSetLayout, 1);
-	for (auto i = 0; i < uniformBuffers.size(); i++) {
-		// Scene
-		VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &allocInfo, &descriptorSets[i].scene)); 
-		vkUtils::setObjectDebugName(VK_OBJECT_TYPE_DESCRIPTOR_SET, (uint64_t)descriptorSets[i].scene, "descriptorSets[" + std::to_string(i) + "].scene ");
-		std::vector<VkWriteDescriptorSet> writeDescriptorSets = {
-			vks::initializers::writeDescriptorSet(descriptorSets[i].scene, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 0, &uniformBuffers[i].scene.descriptor),
-			vks::initializers::writeDescriptorSet(descriptorSets[i].scene, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1, &uniformBuffers[i].params.descriptor),
-			vks::initializers::writeDescriptorSet(descriptorSets[i].scene, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 2, &textures.irradianceCube.descriptor),
-			vks::initializers::writeDescriptorSet(descriptorSets[i].scene, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 3, &textures.lutBrdf.descriptor),
-			vks::initializers::writeDescriptorSet(descriptorSets[i].scene, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 4, &textures.prefilteredCube.descriptor),
-			vks::initializers::writeDescriptorSet(descriptorSets[i].scene, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 5, &textures.albedoMap.descriptor),
-			vks::initializers::writeDescriptorSet(descriptorSets[i].scene, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 6, &textures.normalMap.descriptor),
-			vks::initializers::writeDescriptorSet(descriptorSets[i].scene, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 7, &textures.aoMap.descriptor),
-			vks::initializers::writeDescriptorSet(descriptorSets[i].scene, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 8, &textures.metallicMap.descriptor),
-			vks::initializers::writeDescriptorSet(descriptorSets[i].scene, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 9, &textures.roughnessMap.descriptor),
-		};
-		vkUpdateDescriptorSets(device, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, nullptr);
-
-		// Sky box
-		VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &allocInfo, &descriptorSets[i].skybox));
-		vkUtils::setObjectDebugName(VK_OBJECT_TYPE_DESCRIPTOR_SET, (uint64_t)descriptorSets[i].skybox, "descriptorSets[" + std::to_string(i) + "].skybox ");
-		writeDescriptorSets = {
-			vks::initializers::writeDescriptorSet(descriptorSets[i].skybox, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 0, &uniformBuffers[i].skybox.descriptor),
-			vks::initializers::writeDescriptorSet(descriptorSets[i].skybox, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1, &uniformBuffers[i].params.descriptor),
-			vks::initializers::writeDescriptorSet(descriptorSets[i].skybox, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 2, &textures.environmentCube.descriptor),
-		};
-		vkUpdateDescriptorSets(device, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, nullptr);
-	}
+void VulkanEngine::writeDescriptors()
+{
+	// 所有在途帧的 uniform 数据都在同一个缓冲中，描述符集只需要一个，IBL 纹理生成或加载完成后写入一次
+	descriptorSet = descriptorAllocator.allocate(descriptorSetLayout);
+	writeSceneDescriptorSet(descriptorSet, textures.environmentCube, textures.lutBrdf, textures.prefilteredCube);
+}
+
+void VulkanEngine::writeSceneDescriptorSet(VkDescriptorSet set, vks::TextureCubeMap& environmentCube, vks::Texture2D& lutBrdf, vks::TextureCubeMap& prefilteredCube)
+{
+	VkDescriptorBufferInfo sceneDescriptor = frameUniforms.descriptor(sizeof(UniformDataMatrices));
+	VkDescriptorBufferInfo paramsDescriptor = frameUniforms.descriptor(sizeof(UniformDataParams));
+	std::vector<VkWriteDescriptorSet> writeDescriptorSets = {
+		vks::initializers::writeDescriptorSet(set, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 0, &sceneDescriptor),
+		vks::initializers::writeDescriptorSet(set, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1, &paramsDescriptor),
+		// 漫反射辐照度改用 params 中的球谐系数，binding 2 同时是天空盒采样的环境贴图
+		vks::initializers::writeDescriptorSet(set, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 2, &environmentCube.descriptor),
+		vks::initializers::writeDescriptorSet(set, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 3, &lutBrdf.descriptor),
+		vks::initializers::writeDescriptorSet(set, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 4, &prefilteredCube.descriptor),
+	};
+	vkUpdateDescriptorSets(device, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, nullptr);
 }
 
 void VulkanEngine::preparePipelines()
 {
 	auto tStart = std::chrono::high_resolution_clock::now();
-	PipelineBuilder builder(device);
 
-	VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo = vks::initializers::pipelineLayoutCreateInfo(&descriptorSetLayout, 1);
+	// set 0: 场景 UBO 与 IBL 纹理, set 1: bindless 材质表
+	// 推送常量只携带当前图元的材质索引
+	const std::array<VkDescriptorSetLayout, 2> setLayouts = { descriptorSetLayout, bindless.setLayout };
+	VkPushConstantRange pushConstantRange = vks::initializers::pushConstantRange(VK_SHADER_STAGE_FRAGMENT_BIT, sizeof(uint32_t), 0);
+	VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo = vks::initializers::pipelineLayoutCreateInfo(setLayouts.data(), static_cast<uint32_t>(setLayouts.size()));
+	pipelineLayoutCreateInfo.pushConstantRangeCount = 1;
+	pipelineLayoutCreateInfo.pPushConstantRanges = &pushConstantRange;
 	VK_CHECK_RESULT(vkCreatePipelineLayout(device, &pipelineLayoutCreateInfo, nullptr, &pipelineLayout));
 
+	// 天空盒: set 0 与顶点阶段的 MVP 推送常量
+	VkPushConstantRange skyboxPushConstantRange = vks::initializers::pushConstantRange(VK_SHADER_STAGE_VERTEX_BIT, sizeof(SkyboxPushConstants), 0);
+	pipelineLayoutCreateInfo = vks::initializers::pipelineLayoutCreateInfo(&descriptorSetLayout, 1);
+	pipelineLayoutCreateInfo.pushConstantRangeCount = 1;
+	pipelineLayoutCreateInfo.pPushConstantRanges = &skyboxPushConstantRange;
+	VK_CHECK_RESULT(vkCreatePipelineLayout(device, &pipelineLayoutCreateInfo, nullptr, &skyboxPipelineLayout));
+
+	// 不支持 graphics pipeline library 时保持整体创建管线
+	// 驱动不支持快速链接时仍然按库缓存各部分，但链接时直接做链接时优化
+	PipelineBuilder::setGraphicsPipelineLibrary(graphicsPipelineLibrarySupported, graphicsPipelineLibraryProperties.graphicsPipelineLibraryFastLinking == VK_TRUE);
+
+	// 所有布局都已创建，启动时需要的管线(包括 IBL 预计算管线)放进同一批次并行编译
+	PipelineCompileBatch batch;
+	PipelineBuilder builder(device);
+
+	// 动态渲染时没有渲染通道(renderPass 为 VK_NULL_HANDLE)，管线改为声明交换链与深度缓冲的格式
+	if (dynamicRendering) {
+		builder.setRenderingFormats({ swapChain.colorFormat }, depthFormat, stencilFormat());
+	}
+
 	// Skybox pipeline
 	builder.rasterizationState.cullMode = VK_CULL_MODE_FRONT_BIT;
 	builder.addShaderStage(loadShader(getShadersPath() + "skybox.vert.spv", VK_SHADER_STAGE_VERTEX_BIT));
 	builder.addShaderStage(loadShader(getShadersPath() + "skybox.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT));
-	builder.buildPipeline(renderPass, pipelineCache, pipelineLayout, pipelines.skybox);
-	vkUtils::setObjectDebugName(VK_OBJECT_TYPE_PIPELINE, (uint64_t)pipelines.skybox, "skybox pipeline");
+	batch.add(builder, renderPass, skyboxPipelineLayout, &pipelines.skybox, "skybox pipeline");
 	builder.clearShaderStage();
 
 	// PBR pipeline
@@ -123,31 +285,107 @@ void VulkanEngine::preparePipelines()
 	builder.depthStencilState.depthTestEnable = VK_TRUE;
 	builder.addShaderStage(loadShader(getShadersPath() + "pbrtexture.vert.spv", VK_SHADER_STAGE_VERTEX_BIT));
 	builder.addShaderStage(loadShader(getShadersPath() + "pbrtexture.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT));
-	builder.buildPipeline(renderPass, pipelineCache, pipelineLayout, pipelines.pbr);
-	vkUtils::setObjectDebugName(VK_OBJECT_TYPE_PIPELINE, (uint64_t)pipelines.pbr, "pbrtexture pipeline");
+	batch.add(builder, renderPass, pipelineLayout, &pipelines.pbr, "pbrtexture pipeline");
+	pbrBuilder = builder;
+
+	// 每个材质的纹理组合对应一个特化变体，启动时用到的变体与其他管线一起编译
+	addMaterialVariants(batch, models.object);
+	// 其他变体(线框、切换色调映射或光源数量)只在界面中修改时才需要，首次使用时由后台线程编译
+	asyncPipelines.start(pipelineCache);
+
+	// IBL 结果从磁盘缓存加载时不需要预计算管线
+	if (!iblCacheHit) {
+		vkUtils::prepareIBLPipelines(batch);
+	}
+	VK_CHECK_RESULT(batch.compile(pipelineCache));
 
 	auto tEnd = std::chrono::high_resolution_clock::now();
 	auto takeTime = std::chrono::duration<double, std::milli>(tEnd - tStart).count();
 	std::cout << "preparePipelines cost time:" << (float)takeTime / 1000.0f << "ms" << std::endl;
+	const vks::ShaderModuleCache::Statistics shaderStatistics = shaderModuleCache.getStatistics();
+	std::cout << "Shader modules: " << shaderStatistics.loads << " loads, " << shaderStatistics.fileReads << " file reads, " << shaderStatistics.archiveHits << " from archive, " << shaderStatistics.modules << (shaderModuleCache.inlineModules() ? " inline" : "") << " modules" << std::endl;
 }
 
-void VulkanEngine::prepareUniformBuffers()
+void VulkanEngine::addMaterialVariants(PipelineCompileBatch& batch, const vkglTF::Model& model)
+{
+	for (const vkglTF::Material& material : model.materials) {
+		const PbrPermutation permutation = pbrPermutation(material);
+		const uint32_t key = pbrVariantKey(permutation, wireframe);
+		if (pbrVariants.count(key) == 0) {
+			batch.add(pbrVariantBuilder(permutation, wireframe), renderPass, pipelineLayout, &pbrVariants[key], "pbrtexture variant " + std::to_string(key));
+		}
+	}
+}
+
+VulkanEngine::PbrPermutation VulkanEngine::pbrPermutation(const vkglTF::Material& material) const
+{
+	PbrPermutation permutation{};
+	permutation.lightCount = lightCount;
+	permutation.materialTextures = 0;
+	permutation.tonemap = tonemap ? 1 : 0;
+	// 没有注册到 bindless 表的材质没有任何贴图
+	if (material.index == BindlessTable::invalidIndex) {
+		return permutation;
+	}
+	const BindlessTable::MaterialData& data = bindless.getMaterial(material.index);
+	const std::array<uint32_t, 5> maps = { data.albedoMap, data.normalMap, data.aoMap, data.metallicMap, data.roughnessMap };
+	for (uint32_t i = 0; i < maps.size(); i++) {
+		if (maps[i] != BindlessTable::invalidIndex) {
+			permutation.materialTextures |= 1u << i;
+		}
+	}
+	return permutation;
+}
+
+uint32_t VulkanEngine::pbrVariantKey(const PbrPermutation& permutation, bool wireframe)
+{
+	// 光源数量 3 位，贴图 5 位，色调映射与线框各 1 位
+	return (permutation.lightCount & 0x7) | (permutation.materialTextures << 3) | (permutation.tonemap << 8) | ((wireframe ? 1u : 0u) << 9);
+}
+
+PipelineBuilder VulkanEngine::pbrVariantBuilder(const PbrPermutation& permutation, bool wireframe) const
+{
+	static const std::vector<VkSpecializationMapEntry> mapEntries = {
+		vks::initializers::specializationMapEntry(0, offsetof(PbrPermutation, lightCount), sizeof(uint32_t)),
+		vks::initializers::specializationMapEntry(1, offsetof(PbrPermutation, materialTextures), sizeof(uint32_t)),
+		vks::initializers::specializationMapEntry(2, offsetof(PbrPermutation, tonemap), sizeof(uint32_t)),
+	};
+	PipelineBuilder builder = pbrBuilder;
+	builder.setSpecializationConstants(VK_SHADER_STAGE_FRAGMENT_BIT, mapEntries, &permutation, sizeof(PbrPermutation));
+	if (wireframe) {
+		builder.rasterizationState.polygonMode = VK_POLYGON_MODE_LINE;
+	}
+	return builder;
+}
+
+VkPipeline VulkanEngine::pbrVariantPipeline(const vkglTF::Material& material, VkPipeline fallback)
 {
-	for (auto& buffer : uniformBuffers) {
-		// Scene matrices uniform buffer
-		VK_CHECK_RESULT(vulkanDevice->createBuffer(VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &buffer.scene, sizeof(UniformDataMatrices)));
-		VK_CHECK_RESULT(buffer.scene.map());
-		// Skybox matrices uniform buffer
-		VK_CHECK_RESULT(vulkanDevice->createBuffer(VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &buffer.skybox, sizeof(UniformDataMatrices)));
-		VK_CHECK_RESULT(buffer.skybox.map());
-		// Shared parameter uniform buffer
-		VK_CHECK_RESULT(vulkanDevice->createBuffer(VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &buffer.params, sizeof(UniformDataParams)));
-		VK_CHECK_RESULT(buffer.params.map());
+	const PbrPermutation permutation = pbrPermutation(material);
+	const uint32_t key = pbrVariantKey(permutation, wireframe);
+	auto it = pbrVariants.find(key);
+	if (it != pbrVariants.end()) {
+		return it->second;
+	}
+	VkPipeline pipeline = asyncPipelines.request(pbrVariantBuilder(permutation, wireframe), renderPass, pipelineLayout, VK_NULL_HANDLE);
+	if (pipeline == VK_NULL_HANDLE) {
+		return fallback;
 	}
+	pbrVariants[key] = pipeline;
+	return pipeline;
+}
+
+void VulkanEngine::prepareUniformBuffers()
+{
+	// 参数每个在途帧保留一份，场景矩阵每帧从线性区域分配，预留少量余量给以后每帧新增的数据
+	paramsBlock = frameUniforms.reserveBlock(sizeof(UniformDataParams));
+	frameUniforms.create(vulkanDevice, maxConcurrentFrames, 4 * sizeof(UniformDataMatrices));
 }
 
 void VulkanEngine::updateUniformBuffers()
 {
+	// 本帧的区域在 prepareFrame 等到该帧上次提交完成后才能重用
+	frameUniforms.beginFrame(currentBuffer);
+
 	// 3D object
 	uniformDataMatrices.projection = camera.matrices.perspective;
 	uniformDataMatrices.view = camera.matrices.view;
@@ -155,13 +393,10 @@ void VulkanEngine::updateUniformBuffers()
 	uniformDataMatrices.model = glm::mat4(1);
 	uniformDataMatrices.camPos = camera.position * -1.0f;
 	//uniformDataMatrices.camPos = camera.viewPos;
-	memcpy(uniformBuffers[currentBuffer].scene.mapped, &uniformDataMatrices, sizeof(UniformDataMatrices));
+	uniformOffsets[0] = frameUniforms.push(uniformDataMatrices);
 
-	// Skybox
-	uniformDataMatrices.model = glm::mat4(glm::mat3(camera.matrices.view));
-	memcpy(uniformBuffers[currentBuffer].skybox.mapped, &uniformDataMatrices, sizeof(UniformDataMatrices));
-
-	memcpy(uniformBuffers[currentBuffer].params.mapped, &uniformDataParams, sizeof(UniformDataParams));
+	// 参数只在界面修改时变化，内容与该帧上次写入的相同时不写入映射内存
+	uniformOffsets[1] = frameUniforms.updateBlock(paramsBlock, &uniformDataParams, sizeof(UniformDataParams));
 }
 
 void VulkanEngine::prepare()
@@ -169,64 +404,287 @@ void VulkanEngine::prepare()
 	VulkanEngineBase::prepare();
 	vkUtils::Init(this);
 	loadAssets();
-	vkUtils::generateBRDFLUT(textures.lutBrdf);
-	vkUtils::generateIrradianceCube(textures.irradianceCube, textures.environmentCube);
-	vkUtils::generatePrefilteredCube(textures.prefilteredCube, textures.environmentCube);
 	prepareUniformBuffers();
+	setupBindless();
 	setupDescriptors();
+	// 辐照度球谐只需要环境贴图的低分辨率 mip，每次启动直接投影，不依赖 IBL 缓存
+	std::array<glm::vec4, 9> irradianceSH;
+	vkUtils::generateIrradianceSH(getAssetPath() + environmentMapFile, irradianceSH);
+	std::copy(irradianceSH.begin(), irradianceSH.end(), uniformDataParams.irradianceSH);
+	// IBL 结果按环境贴图内容与生成参数缓存在磁盘上，命中时跳过整个预计算
+	const uint64_t iblCacheKey = vkUtils::iblCacheKey(getAssetPath() + environmentMapFile);
+	iblCacheHit = vkUtils::loadIBLCache(iblCacheDirectory, iblCacheKey, textures.lutBrdf, textures.prefilteredCube);
+	jobSystem = std::make_unique<JobSystem>(jobThreads);
+	commandRecorder.create(device, swapChain.queueNodeIndex, maxConcurrentFrames, *jobSystem);
+	// IBL 预计算之前创建，启动时的一次性提交同样计时
+	if (hostQueryResetSupported) {
+		gpuProfiler.create(vulkanDevice, vulkanDevice->queueFamilyIndices.graphics, maxConcurrentFrames, synchronization2Supported);
+	}
+	setupReadback();
+	readback.setCallback([this](const ReadbackRing::Frame& frame) { onFrameReadback(frame); });
+	setupFrameGraphs();
+	// 先编译全部管线，IBL 预计算直接使用编译好的管线
 	preparePipelines();
+	if (!iblCacheHit) {
+		vkUtils::generateIBL(textures.lutBrdf, textures.prefilteredCube, textures.environmentCube);
+		vkUtils::destroyIBLPipelines();
+		vkUtils::saveIBLCache(iblCacheDirectory, iblCacheKey, textures.lutBrdf, textures.prefilteredCube);
+	}
+	writeDescriptors();
 	prepared = true;
 }
 
+void VulkanEngine::setupReadback()
+{
+	if (readbackSlots == 0) {
+		return;
+	}
+	// 大小改变时先交出旧尺寸的在途帧
+	if (readback.valid()) {
+		readback.drain(frameTimeline);
+		readback.destroy();
+	}
+	readback.create(vulkanDevice, readbackSlots, width, height, swapChain.colorFormat);
+}
+
+void VulkanEngine::onFrameReadback(const ReadbackRing::Frame& frame)
+{
+	readbackHash = vks::tools::hashBytes(frame.pixels.data(), frame.pixels.size());
+}
+
+void VulkanEngine::finishReadback()
+{
+	if (!readback.valid()) {
+		return;
+	}
+	readback.drain(frameTimeline);
+	const ReadbackRing::Statistics& statistics = readback.getStatistics();
+	std::cout << "Readback: " << statistics.delivered << " frames delivered, " << statistics.dropped << " dropped, up to "
+		<< statistics.maxLatencyFrames << " frames latency, last frame hash " << std::hex << readbackHash << std::dec << "\n";
+	readback.destroy();
+}
+
+void VulkanEngine::finishGpuProfile()
+{
+	if (!gpuProfiler.valid()) {
+		return;
+	}
+	// 最后几帧的结果在它们的提交完成后才能读取
+	waitForFrameTimeline(frameTimelineValue);
+	gpuProfiler.resolvePending();
+	const GpuProfiler::Statistics& statistics = gpuProfiler.getStatistics();
+	std::cout << "GPU timing: " << statistics.resolvedFrames << " frames resolved, " << statistics.incompleteFrames << " incomplete, "
+		<< statistics.droppedScopes << " scopes dropped\n";
+	printGpuTimingTree(gpuProfiler.getFrameTree(), 1, false);
+	printGpuTimingTree(gpuProfiler.getImmediateTree(), 1, true);
+	if (!gpuProfileFile.empty()) {
+		exportGpuProfile(gpuProfileFile);
+	}
+	gpuProfiler.destroy();
+}
+
+void VulkanEngine::exportGpuProfile(const std::string& fileName)
+{
+	std::string error;
+	if (gpuProfiler.writeJson(fileName, error)) {
+		std::cout << "Wrote GPU timings to \"" << fileName << "\"\n";
+	} else {
+		std::cerr << "Could not export GPU timings: " << error << "\n";
+	}
+}
+
+VkFormat VulkanEngine::stencilFormat() const
+{
+	return vks::tools::formatHasStencil(depthFormat) ? depthFormat : VK_FORMAT_UNDEFINED;
+}
+
+void VulkanEngine::setupFrameGraphs()
+{
+	frameGraphs.clear();
+	if (!dynamicRendering) {
+		return;
+	}
+	const VkImageAspectFlags depthAspect = VK_IMAGE_ASPECT_DEPTH_BIT | (stencilFormat() != VK_FORMAT_UNDEFINED ? VK_IMAGE_ASPECT_STENCIL_BIT : 0);
+	for (uint32_t i = 0; i < swapChain.images.size(); i++) {
+		auto graph = std::make_unique<RenderGraph>(vulkanDevice, synchronization2Supported);
+		// 交换链图像的内容不需要保留，获取信号量在颜色附件输出阶段等待，第一次写入之前的转换也在这个阶段
+		// 无头构建的离屏图像没有呈现引擎把关，在途帧多于图像数时之前的帧可能还在读回复制这张图像，
+		// 第一次写入还要等待传输阶段(读之后写只需要执行依赖，访问掩码为空)
+		const bool offscreen = swapChain.finalLayout == VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+		const VkPipelineStageFlags2 colorLastStage = VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT | (offscreen ? VK_PIPELINE_STAGE_2_TRANSFER_BIT : VK_PIPELINE_STAGE_2_NONE);
+		const RenderGraphImage color = graph->importImage("swapchain", swapChain.images[i], swapChain.imageViews[i], { swapChain.colorFormat, width, height },
+			VK_IMAGE_LAYOUT_UNDEFINED, colorLastStage, VK_ACCESS_2_NONE);
+		// 深度缓冲由所有在途帧共用，需要等待上一帧的深度写入
+		const RenderGraphImage depth = graph->importImage("depthStencil", depthStencil.image, depthStencil.view, { depthFormat, width, height, 1, 1, 0, depthAspect },
+			VK_IMAGE_LAYOUT_UNDEFINED, VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT, VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT);
+		// 无头构建没有呈现，图像留在传输源布局以便读回
+		graph->setFinalUsage(color, swapChain.finalLayout == VK_IMAGE_LAYOUT_PRESENT_SRC_KHR ? RenderGraphUsage::Present : RenderGraphUsage::TransferSrc);
+		graph->addPass("Scene", [this, i](VkCommandBuffer commandBuffer, const RenderGraph&) {
+			VkRenderingAttachmentInfo colorAttachment{ VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO };
+			colorAttachment.imageView = swapChain.imageViews[i];
+			colorAttachment.imageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+			colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+			colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+			colorAttachment.clearValue.color = { { 0.25f, 0.25f, 0.25f, 1.0f } };
+			// 深度只在本帧内使用，结束后不需要写回
+			VkRenderingAttachmentInfo depthAttachment{ VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO };
+			depthAttachment.imageView = depthStencil.view;
+			depthAttachment.imageLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+			depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+			depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+			depthAttachment.clearValue.depthStencil = { 1.0f, 0 };
+
+			VkRenderingInfo renderingInfo{ VK_STRUCTURE_TYPE_RENDERING_INFO };
+			// 渲染内容全部来自二级命令缓冲
+			renderingInfo.flags = VK_RENDERING_CONTENTS_SECONDARY_COMMAND_BUFFERS_BIT;
+			renderingInfo.renderArea = { { 0, 0 }, { width, height } };
+			renderingInfo.layerCount = 1;
+			renderingInfo.colorAttachmentCount = 1;
+			renderingInfo.pColorAttachments = &colorAttachment;
+			renderingInfo.pDepthAttachment = &depthAttachment;
+			renderingInfo.pStencilAttachment = stencilFormat() != VK_FORMAT_UNDEFINED ? &depthAttachment : nullptr;
+			vkCmdBeginRendering(commandBuffer, &renderingInfo);
+			vkUtils::cmdExecuteCommands(commandBuffer, secondaryCommandBuffers);
+			vkCmdEndRendering(commandBuffer);
+		}).write(color, RenderGraphUsage::ColorAttachment).write(depth, RenderGraphUsage::DepthStencilAttachment);
+		if (readback.valid()) {
+			// 渲染图负责颜色附件写入到传输读取的屏障，复制目标的槽位在每次执行时选择
+			graph->addPass("Readback", [this, i](VkCommandBuffer commandBuffer, const RenderGraph&) {
+				readback.record(commandBuffer, swapChain.images[i], VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, false, frameTimelineValue + 1);
+			}).read(color, RenderGraphUsage::TransferSrc).sideEffect();
+		}
+		graph->compile();
+		frameGraphs.push_back(std::move(graph));
+	}
+}
+
 void VulkanEngine::buildCommandBuffer()
 {
 	VkCommandBuffer cmdBuffer = drawCmdBuffers[currentBuffer];
 
 	VkCommandBufferBeginInfo cmdBufInfo = vks::initializers::commandBufferBeginInfo();
 
-	VkClearValue clearValues[3]{};
-	clearValues[0].color = { { 0.25f, 0.25f, 0.25f, 1.0f } };;
-	clearValues[1].depthStencil = { 1.0f, 0 };
-	clearValues[2].color = { {0.0f, 0.0f, 0.0f, 0.0f} };
-
-	VkRenderPassBeginInfo renderPassBeginInfo = vks::initializers::renderPassBeginInfo();
-	renderPassBeginInfo.renderPass = renderPass;
-	renderPassBeginInfo.renderArea.offset.x = 0;
-	renderPassBeginInfo.renderArea.offset.y = 0;
-	renderPassBeginInfo.renderArea.extent.width = width;
-	renderPassBeginInfo.renderArea.extent.height = height;
-	renderPassBeginInfo.clearValueCount = 3;
-	renderPassBeginInfo.pClearValues = clearValues;
-	renderPassBeginInfo.framebuffer = frameBuffers[currentImageIndex];
-
 	const VkViewport viewport = vks::initializers::viewport((float)width, (float)height, 0.0f, 1.0f);
 	const VkRect2D scissor = vks::initializers::rect2D(width, height, 0, 0);
 
-	VK_CHECK_RESULT(vkBeginCommandBuffer(cmdBuffer, &cmdBufInfo));
-	vkCmdBeginRenderPass(cmdBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
-	vkCmdSetViewport(cmdBuffer, 0, 1, &viewport);
-	vkCmdSetScissor(cmdBuffer, 0, 1, &scissor);
+	// 材质管线的选择会修改变体表并向后台编译提交请求，在主线程上完成，录制线程只读取结果
+	// 每个材质绑定与其纹理组合匹配的特化管线，新变体编译完成前沿用之前的管线，不会阻塞命令录制
+	// 快速链接的管线在后台完成链接时优化后替换成优化版本，持有的句柄全部换过之后被替换的版本才能销毁
+	pipelines.pbr = PipelineBuilder::resolvePipeline(pipelines.pbr);
+	pipelines.skybox = PipelineBuilder::resolvePipeline(pipelines.skybox);
+	for (auto& [key, pipeline] : pbrVariants) {
+		pipeline = PipelineBuilder::resolvePipeline(pipeline);
+	}
+	// 其他模型的材质管线只在它是场景模型时更新，可能已经被销毁，重新成为场景模型时不再沿用
+	if (pipelineSceneModel != sceneModel) {
+		for (vkglTF::Material& material : sceneModel->materials) {
+			material.pipeline = VK_NULL_HANDLE;
+		}
+		pipelineSceneModel = sceneModel;
+	}
+	for (vkglTF::Material& material : sceneModel->materials) {
+		const VkPipeline fallback = material.pipeline != VK_NULL_HANDLE ? material.pipeline : pipelines.pbr;
+		material.pipeline = PipelineBuilder::resolvePipeline(pbrVariantPipeline(material, fallback));
+	}
+	// 本帧录制的命令最晚引用到这里为止被替换的管线
+	PipelineBuilder::retirePipelines(device, frameTimeline, frameTimelineValue + 1);
+
+	// 二级命令缓冲不继承动态状态与绑定，每个都要重新设置
+	VkCommandBufferInheritanceInfo inheritanceInfo = vks::initializers::commandBufferInheritanceInfo();
+	// 动态渲染时继承附件格式而不是渲染通道与帧缓冲
+	const VkFormat colorFormat = swapChain.colorFormat;
+	VkCommandBufferInheritanceRenderingInfo inheritanceRenderingInfo{ VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_RENDERING_INFO };
+	if (dynamicRendering) {
+		inheritanceRenderingInfo.colorAttachmentCount = 1;
+		inheritanceRenderingInfo.pColorAttachmentFormats = &colorFormat;
+		inheritanceRenderingInfo.depthAttachmentFormat = depthFormat;
+		inheritanceRenderingInfo.stencilAttachmentFormat = stencilFormat();
+		inheritanceRenderingInfo.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+		inheritanceInfo.pNext = &inheritanceRenderingInfo;
+	} else {
+		inheritanceInfo.renderPass = renderPass;
+		inheritanceInfo.subpass = 0;
+		inheritanceInfo.framebuffer = frameBuffers[currentImageIndex];
+	}
+	// 本帧的命令池在 prepareFrame 等到该帧上次提交完成后才重置
+	commandRecorder.beginFrame(currentBuffer);
+	secondaryCommandBuffers.clear();
 
 	// Skybox
 	if (displaySkybox)
 	{
-		vkUtils::cmdBeginLabel(cmdBuffer, "Pipeline skybox", { 1.0f, 1.0f, 1.0f });
-		vkCmdBindDescriptorSets(cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSets[currentBuffer].skybox, 0, nullptr);
-		vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.skybox);
-		models.skybox.draw(cmdBuffer);
-		vkUtils::cmdEndLabel(cmdBuffer);
+		secondaryCommandBuffers.push_back(commandRecorder.record(inheritanceInfo, [&](VkCommandBuffer commandBuffer) {
+			vkUtils::cmdBeginLabel(commandBuffer, "Pipeline skybox", { 1.0f, 1.0f, 1.0f, 1.0f });
+			vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+			vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+			vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, skyboxPipelineLayout, 0, 1, &descriptorSet, static_cast<uint32_t>(uniformOffsets.size()), uniformOffsets.data());
+			// 天空盒只使用视图矩阵的旋转部分
+			const SkyboxPushConstants pushConstants{ camera.matrices.perspective * glm::mat4(glm::mat3(camera.matrices.view)) };
+			vkCmdPushConstants(commandBuffer, skyboxPipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(SkyboxPushConstants), &pushConstants);
+			vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, PipelineBuilder::resolvePipeline(pipelines.skybox));
+			models.skybox.drawRange(commandBuffer, 0, static_cast<uint32_t>(models.skybox.drawList.size()));
+			vkUtils::cmdEndLabel(commandBuffer);
+		}));
 	}
 
 	//PBR
-	vkUtils::cmdBeginLabel(cmdBuffer, "Pipeline PBR", { 1.0f, 1.0f, 1.0f });
-	vkCmdBindDescriptorSets(cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSets[currentBuffer].scene, 0, nullptr);
-	vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.pbr);
-	models.object.draw(cmdBuffer);
-	vkUtils::cmdEndLabel(cmdBuffer);
+	// 绘制列表按块分给录制线程，每块不少于 minDrawsPerTask 个绘制，绘制很少时只在主线程录制一块
+	constexpr uint32_t minDrawsPerTask = 256;
+	commandRecorder.recordRanges(inheritanceInfo, static_cast<uint32_t>(sceneModel->drawList.size()), minDrawsPerTask, [&](VkCommandBuffer commandBuffer, uint32_t first, uint32_t count) {
+		vkUtils::cmdBeginLabel(commandBuffer, "Pipeline PBR", { 1.0f, 1.0f, 1.0f, 1.0f });
+		vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+		vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+		// Bindless 表每个命令缓冲只绑定一次，之后的绘制只推送材质索引
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 1, 1, &bindless.descriptorSet, 0, nullptr);
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSet, static_cast<uint32_t>(uniformOffsets.size()), uniformOffsets.data());
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.pbr);
+		sceneModel->drawRange(commandBuffer, first, count, vkglTF::RenderFlags::PushMaterialIndex | vkglTF::RenderFlags::BindMaterialPipelines, pipelineLayout);
+		vkUtils::cmdEndLabel(commandBuffer);
+	}, secondaryCommandBuffers);
 
 	// UI
-	drawUI(cmdBuffer);
-	vkCmdEndRenderPass(cmdBuffer);
+	secondaryCommandBuffers.push_back(commandRecorder.record(inheritanceInfo, [&](VkCommandBuffer commandBuffer) {
+		vkUtils::cmdBeginLabel(commandBuffer, "UI", { 1.0f, 1.0f, 1.0f, 1.0f });
+		drawUI(commandBuffer);
+		vkUtils::cmdEndLabel(commandBuffer);
+	}));
+
+	VK_CHECK_RESULT(vkBeginCommandBuffer(cmdBuffer, &cmdBufInfo));
+	// 整帧的作用域，各通道与二级命令缓冲中的作用域都在它之下
+	vkUtils::cmdBeginLabel(cmdBuffer, "Frame", { 1.0f, 1.0f, 1.0f, 1.0f });
+	if (dynamicRendering) {
+		// 渲染图在动态渲染的前后转换交换链图像与深度缓冲的布局
+		frameGraphs[currentImageIndex]->execute(cmdBuffer);
+	} else {
+		VkClearValue clearValues[3]{};
+		clearValues[0].color = { { 0.25f, 0.25f, 0.25f, 1.0f } };
+		clearValues[1].depthStencil = { 1.0f, 0 };
+		clearValues[2].color = { {0.0f, 0.0f, 0.0f, 0.0f} };
+
+		VkRenderPassBeginInfo renderPassBeginInfo = vks::initializers::renderPassBeginInfo();
+		renderPassBeginInfo.renderPass = renderPass;
+		renderPassBeginInfo.renderArea.offset.x = 0;
+		renderPassBeginInfo.renderArea.offset.y = 0;
+		renderPassBeginInfo.renderArea.extent.width = width;
+		renderPassBeginInfo.renderArea.extent.height = height;
+		renderPassBeginInfo.clearValueCount = 3;
+		renderPassBeginInfo.pClearValues = clearValues;
+		renderPassBeginInfo.framebuffer = frameBuffers[currentImageIndex];
+
+		// 渲染通道的内容全部来自二级命令缓冲
+		// 作用域与动态渲染时渲染图的通道同名
+		vkUtils::cmdBeginLabel(cmdBuffer, "Scene", { 1.0f, 1.0f, 1.0f, 1.0f });
+		vkCmdBeginRenderPass(cmdBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+		vkUtils::cmdExecuteCommands(cmdBuffer, secondaryCommandBuffers);
+		vkCmdEndRenderPass(cmdBuffer);
+		vkUtils::cmdEndLabel(cmdBuffer);
+		if (readback.valid()) {
+			vkUtils::cmdBeginLabel(cmdBuffer, "Readback", { 1.0f, 1.0f, 1.0f, 1.0f });
+			readback.record(cmdBuffer, swapChain.images[currentImageIndex], swapChain.finalLayout, true, frameTimelineValue + 1);
+			vkUtils::cmdEndLabel(cmdBuffer);
+		}
+	}
+	vkUtils::cmdEndLabel(cmdBuffer);
 	VK_CHECK_RESULT(vkEndCommandBuffer(cmdBuffer));
 }
 
@@ -235,11 +693,27 @@ void VulkanEngine::render()
 	if (!prepared)
 		return;
 	VulkanEngineBase::prepareFrame();
+	// 该帧槽位上一次提交已经完成，读取它的 GPU 耗时，之后录制的作用域属于本帧
+	gpuProfiler.beginFrame(currentBuffer);
+	// 只查询时间线当前的值，已经完成的读回交给使用者，未完成的留到之后的帧
+	if (readback.valid()) {
+		uint64_t completedValue = 0;
+		VK_CHECK_RESULT(vkGetSemaphoreCounterValue(device, frameTimeline, &completedValue));
+		readback.poll(completedValue);
+	}
 	updateUniformBuffers();
 	buildCommandBuffer();
+	gpuProfiler.endFrame();
 	VulkanEngineBase::submitFrame();
 }
 
+void VulkanEngine::windowResized()
+{
+	// 交换链图像与深度缓冲已经重建，设备此时空闲
+	setupReadback();
+	setupFrameGraphs();
+}
+
 void VulkanEngine::OnUpdateUIOverlay(vks::UIOverlay* overlay)
 {
 	if (ImGui::CollapsingHeader("相机"), ImGuiTreeNodeFlags_DefaultOpen) {
@@ -272,11 +746,40 @@ void VulkanEngine::OnUpdateUIOverlay(vks::UIOverlay* overlay)
 			ImGui::SliderFloat("粗糙度", &uniformDataParams.globalRoughness, 0.01f, 1);
 			ImGui::SliderFloat("金属度", &uniformDataParams.globalMetallic, 0.01f, 1);
 			ImGui::Checkbox("Skybox", &displaySkybox);
+			// 以下选项对应 pbrtexture 的特化常量，修改后切换到对应的管线变体
+			int lights = static_cast<int>(lightCount);
+			if (ImGui::SliderInt("光源数量", &lights, 0, 4)) {
+				lightCount = static_cast<uint32_t>(lights);
+			}
+			ImGui::Checkbox("色调映射", &tonemap);
+			if (enabledFeatures.fillModeNonSolid) {
+				ImGui::Checkbox("线框", &wireframe);
+			}
+		}
+		ImGui::Unindent();
+	}
+	if (gpuProfiler.valid() && ImGui::CollapsingHeader("GPU 耗时", ImGuiTreeNodeFlags_DefaultOpen)) {
+		ImGui::Indent();
+		{
+			// 结果比录制晚 maxConcurrentFrames 帧
+			ImGui::Text("帧 %.3f ms (平均)", gpuProfiler.getFrameTree().average);
+			drawGpuTimingTree(gpuProfiler.getFrameTree(), false);
+			if (!gpuProfiler.getImmediateTree().children.empty()) {
+				ImGui::Text("启动 (累计)");
+				ImGui::PushID("immediate");
+				drawGpuTimingTree(gpuProfiler.getImmediateTree(), true);
+				ImGui::PopID();
+			}
+			if (overlay->button("导出 JSON")) {
+				exportGpuProfile(gpuProfileFile.empty() ? "gpuprofile.json" : gpuProfileFile);
+			}
 		}
 		ImGui::Unindent();
 	}
 }
+#if defined(_WIN32)
 void VulkanEngine::OnHandleMessage(HWND hWnd, UINT uMsg, WPARAM wParam, LPARAM lParam)
 {
 	
-}
\ No newline at end of file
+}
+#endif
\ No newline at end of file
@@ -17,6 +17,7 @@
 #include <assert.h>
 #include <fstream>
 #include <vector>
+#include <array>
 #include <exception>
 
 #define GLM_FORCE_RADIANS
@@ -28,17 +29,29 @@
 #include "vulkanEngineBase.h"
 #include "VulkanglTFModel.h"
 #include "PipelineBuilder.h"
+#include "AsyncPipelineCompiler.h"
+#include "BindlessTable.h"
+#include "ParallelCommandRecorder.h"
+#include "RenderGraph.h"
+#include "FrameUniformAllocator.h"
+#include "ReadbackRing.h"
+#include "GpuProfiler.h"
 
 class VulkanEngine : public VulkanEngineBase
 {
 public:
 	bool displaySkybox = true;
+	bool wireframe = false;
+	bool tonemap = true;
+	uint32_t lightCount = 4;
+	// 环境贴图(相对资源目录)，其内容哈希是 IBL 磁盘缓存键的一部分
+	std::string environmentMapFile = "textures/hdr/gcanyon_cube.ktx";
+	bool iblCacheHit = false;
 
 	struct Textures {
 		vks::TextureCubeMap environmentCube;
 		// Generated at runtime
 		vks::Texture2D lutBrdf;
-		vks::TextureCubeMap irradianceCube;
 		vks::TextureCubeMap prefilteredCube;
 		// Object texture maps
 		vks::Texture2D albedoMap;
@@ -52,13 +65,17 @@ public:
 		vkglTF::Model skybox;
 		vkglTF::Model object;
 	} models;
+	// 当前绘制的模型，默认是 models.object，渲染服务按任务切换到缓存中的模型
+	vkglTF::Model* sceneModel{ &models.object };
+	// 上一帧选择材质管线时的场景模型
+	const vkglTF::Model* pipelineSceneModel{ nullptr };
 
-	struct UniformBuffers {
-		vks::Buffer scene;
-		vks::Buffer skybox;
-		vks::Buffer params;
-	};
-	std::array<UniformBuffers, maxConcurrentFrames> uniformBuffers;
+	// 所有在途帧的 uniform 数据放在同一个常驻映射的缓冲中，以动态偏移绑定
+	// 场景矩阵每帧线性分配，参数放在固定块中，只在内容变化时写入
+	FrameUniformAllocator frameUniforms;
+	uint32_t paramsBlock{ 0 };
+	// 本帧 set 0 两个动态 uniform 绑定(场景矩阵、参数)的偏移
+	std::array<uint32_t, 2> uniformOffsets{};
 
 	struct UniformDataMatrices {
 		glm::mat4 projection;
@@ -76,21 +93,67 @@ public:
 		float gamma = 2.2f;
 		float globalRoughness = 1.0f;
 		float globalMetallic = 1.0f;
+		// 漫反射辐照度的 L2 球谐系数(rgb)，在 prepare 中从环境贴图投影得到，代替辐照度立方体贴图
+		glm::vec4 irradianceSH[9]{};
 	} uniformDataParams;
 
 	VkPipelineLayout pipelineLayout{ VK_NULL_HANDLE };
+	// 天空盒只需要 set 0，变换矩阵通过推送常量传入
+	VkPipelineLayout skyboxPipelineLayout{ VK_NULL_HANDLE };
+	struct SkyboxPushConstants {
+		glm::mat4 mvp;
+	};
 	struct {
 		VkPipeline skybox{ VK_NULL_HANDLE };
 		VkPipeline pbr{ VK_NULL_HANDLE };
 	} pipelines;
+	// pbrtexture.frag 的特化常量(constant_id 0..2)，每种组合对应一条管线
+	// materialTextures 只包含材质实际拥有的贴图(与 shader 中的 MATERIAL_TEXTURE_* 位一致)
+	struct PbrPermutation {
+		uint32_t lightCount = 4;
+		uint32_t materialTextures = 0x1F;
+		uint32_t tonemap = 1;
+	};
+	// 不带特化常量的 PBR 构建器，各变体在它的基础上设置特化常量
+	PipelineBuilder pbrBuilder;
+	// 变体键 -> 管线，管线本身归 PipelineBuilder 的状态缓存所有
+	std::unordered_map<uint32_t, VkPipeline> pbrVariants;
+	// 运行时才用到的管线变体在后台编译，编译完成前沿用材质之前的管线
+	AsyncPipelineCompiler asyncPipelines;
 
 	VkDescriptorSetLayout descriptorSetLayout{ VK_NULL_HANDLE };
-	struct DescriptorSets {
-		VkDescriptorSet scene{ VK_NULL_HANDLE };
-		VkDescriptorSet skybox{ VK_NULL_HANDLE };
-	};
-	std::array<DescriptorSets, maxConcurrentFrames> descriptorSets{};
+	// 材质纹理通过全局 bindless 表按索引访问(set 1)
+	BindlessTable bindless;
+	// 场景与天空盒共用，uniform 绑定是动态的，整个运行期间只写入一次
+	VkDescriptorSet descriptorSet{ VK_NULL_HANDLE };
+	// 工作窃取任务系统，线程数由 jobThreads 决定
+	std::unique_ptr<JobSystem> jobSystem;
+	// 场景绘制分块后由任务系统的多个线程录制到二级命令缓冲，主命令缓冲只负责渲染通道与执行
+	ParallelCommandRecorder commandRecorder;
+	std::vector<VkCommandBuffer> secondaryCommandBuffers;
+	// 动态渲染时每个交换链图像一个编译好的渲染图，负责附件的布局转换并在 vkCmdBeginRendering 内执行二级命令缓冲
+	// 只在窗口大小改变(深度缓冲与交换链图像重建)时重新生成
+	std::vector<std::unique_ptr<RenderGraph>> frameGraphs;
+	// readbackSlots 不为 0 时每帧的颜色图像复制回主机，几帧之后在 render 中交给 onFrameReadback
+	ReadbackRing readback;
+	// 最近一帧读回图像的内容哈希，读回的使用者可以替换成编码或上传
+	uint64_t readbackHash{ 0 };
+	// vkUtils::cmdBeginLabel/cmdEndLabel 的作用域写入时间戳，几帧之后在 render 中读取成按通道的耗时树，显示在界面中
+	// 设备不支持 hostQueryReset 或图形队列不支持时间戳时不创建
+	GpuProfiler gpuProfiler;
 	VkPhysicalDeviceVulkan11Features vulkan11Features{};
+	VkPhysicalDeviceVulkan12Features vulkan12Features{};
+	VkPhysicalDeviceVulkan13Features vulkan13Features{};
+	// 渲染图用 vkCmdPipelineBarrier2 提交屏障，不支持时退回 vkCmdPipelineBarrier
+	bool synchronization2Supported = false;
+	// GPU 计时在主机上重置查询池
+	bool hostQueryResetSupported = false;
+	// bindless 纹理可以在帧执行期间注册
+	bool descriptorUpdateWhilePendingSupported = false;
+	VkPhysicalDeviceMaintenance5FeaturesKHR maintenance5Features{};
+	VkPhysicalDeviceGraphicsPipelineLibraryFeaturesEXT graphicsPipelineLibraryFeatures{};
+	VkPhysicalDeviceGraphicsPipelineLibraryPropertiesEXT graphicsPipelineLibraryProperties{};
+	bool graphicsPipelineLibrarySupported = false;
 
 	VulkanEngine() : VulkanEngineBase()
 	{
@@ -106,12 +169,14 @@ public:
 	~VulkanEngine()
 	{
 		if (device) {
-			vkDestroyPipeline(device, pipelines.skybox, nullptr);
-			vkDestroyPipeline(device, pipelines.pbr, nullptr);
+			// 先停止后台编译，再销毁缓存中的管线
+			asyncPipelines.stop();
+			commandRecorder.destroy();
+			// 管线归 PipelineBuilder 的状态缓存所有
+			PipelineBuilder::destroyCachedPipelines(device);
 			vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
-			vkDestroyDescriptorSetLayout(device, descriptorSetLayout, nullptr);
+			vkDestroyPipelineLayout(device, skyboxPipelineLayout, nullptr);
 			textures.environmentCube.destroy();
-			textures.irradianceCube.destroy();
 			textures.prefilteredCube.destroy();
 			textures.lutBrdf.destroy();
 			textures.albedoMap.destroy();
@@ -119,24 +184,47 @@ public:
 			textures.aoMap.destroy();
 			textures.metallicMap.destroy();
 			textures.roughnessMap.destroy();
-			for (auto& buffer : uniformBuffers) {
-				buffer.scene.destroy();
-				buffer.params.destroy();
-				buffer.skybox.destroy();
-			}
+			bindless.destroy();
+			frameUniforms.destroy();
+			finishReadback();
+			finishGpuProfile();
 		}
 	}
 
 	virtual void getEnabledFeatures() override;
+	virtual void getEnabledExtensions() override;
+	void setupFrameGraphs();
+	void setupReadback();
+	void onFrameReadback(const ReadbackRing::Frame& frame);
+	// 交出全部在途的读回并输出统计，之后释放读回缓冲
+	void finishReadback();
+	// 读取全部在途帧的 GPU 耗时，输出统计并按 gpuProfileFile 导出，之后释放查询池
+	void finishGpuProfile();
+	void exportGpuProfile(const std::string& fileName);
+	// 深度格式不含模板分量时动态渲染的模板附件格式为 VK_FORMAT_UNDEFINED
+	VkFormat stencilFormat() const;
 	void buildCommandBuffer();
 	void loadAssets();
+	void setupBindless();
 	void setupDescriptors();
+	void writeDescriptors();
+	// 写入 set 0 的全部绑定，环境贴图与 IBL 结果不同的场景(例如渲染服务缓存的环境)各用一个描述符集
+	void writeSceneDescriptorSet(VkDescriptorSet set, vks::TextureCubeMap& environmentCube, vks::Texture2D& lutBrdf, vks::TextureCubeMap& prefilteredCube);
 	void preparePipelines();
+	// 把模型材质用到、尚未编译的特化变体加入 batch
+	void addMaterialVariants(PipelineCompileBatch& batch, const vkglTF::Model& model);
+	PbrPermutation pbrPermutation(const vkglTF::Material& material) const;
+	static uint32_t pbrVariantKey(const PbrPermutation& permutation, bool wireframe);
+	PipelineBuilder pbrVariantBuilder(const PbrPermutation& permutation, bool wireframe) const;
+	VkPipeline pbrVariantPipeline(const vkglTF::Material& material, VkPipeline fallback);
 	void prepareUniformBuffers();
 	void updateUniformBuffers();
 	void prepare() override;
 	virtual void render() override;
+	virtual void windowResized() override;
 	virtual void OnUpdateUIOverlay(vks::UIOverlay* overlay) override;
+#if defined(_WIN32)
 	virtual void OnHandleMessage(HWND hWnd, UINT uMsg, WPARAM wParam, LPARAM lParam) override;
+#endif
 };
 
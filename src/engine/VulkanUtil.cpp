@@ -1,4 +1,8 @@
 #include "VulkanUtil.h"
+#include "VulkanTextureCache.h"
+#include "IBLParameters.h"
+#include "IBLBaker.h"
+#include "RenderGraph.h"
 VulkanEngine* vkUtils::vkEngine = nullptr;
 bool vkUtils::init = false;
 bool vkUtils::debugUtilsSupported = false;
@@ -11,6 +15,33 @@ PFN_vkQueueBeginDebugUtilsLabelEXT vkUtils::vkQueueBeginDebugUtilsLabelEXT{ null
 PFN_vkQueueInsertDebugUtilsLabelEXT vkUtils::vkQueueInsertDebugUtilsLabelEXT{ nullptr };
 PFN_vkQueueEndDebugUtilsLabelEXT vkUtils::vkQueueEndDebugUtilsLabelEXT{ nullptr };
 PFN_vkSetDebugUtilsObjectNameEXT vkUtils::vkSetDebugUtilsObjectNameEXT{ nullptr };
+vkUtils::IBLPipelines vkUtils::iblPipelines{};
+
+namespace
+{
+	// 参数与缓存文件约定定义在 IBLParameters.h，与 CPU 烘焙器共用
+	using ibl::lutFormat;
+	using ibl::prefilteredFormat;
+	using ibl::mipLevelCount;
+	constexpr const ibl::Parameters& iblParameters = ibl::parameters;
+
+	// 立方体贴图滤波的推送常量，管线布局与生成函数共用
+	struct PrefilterPushBlock {
+		glm::mat4 mvp;
+		float roughness;
+		uint32_t numSamples;
+		uint32_t filtered;
+		float lodBias;
+	};
+
+	// 计算路径的推送常量对应 computeMain 的 uniform 参数，不包含变换矩阵
+	struct PrefilterComputePushBlock {
+		float roughness;
+		uint32_t numSamples;
+		uint32_t filtered;
+		float lodBias;
+	};
+}
 
 void vkUtils::Init(VulkanEngine* Engine)
 {
@@ -63,8 +94,12 @@ void vkUtils::InitDebugUtils()
 	}
 }
 
+// 标签的作用域同时由 GPU 计时器写入时间戳，没有调试器时也计时
 void vkUtils::cmdBeginLabel(VkCommandBuffer command_buffer, const char* label_name, std::vector<float> color)
 {
+	if (vkEngine) {
+		vkEngine->gpuProfiler.beginScope(command_buffer, label_name);
+	}
 	if (!debugUtilsSupported) {
 		return;
 	}
@@ -87,12 +122,23 @@ void vkUtils::cmdInsertLabel(VkCommandBuffer command_buffer, const char* label_n
 
 void vkUtils::cmdEndLabel(VkCommandBuffer command_buffer)
 {
+	if (vkEngine) {
+		vkEngine->gpuProfiler.endScope(command_buffer);
+	}
 	if (!debugUtilsSupported) {
 		return;
 	}
 	vkCmdEndDebugUtilsLabelEXT(command_buffer);
 }
 
+void vkUtils::cmdExecuteCommands(VkCommandBuffer command_buffer, const std::vector<VkCommandBuffer>& secondary_command_buffers)
+{
+	if (vkEngine) {
+		vkEngine->gpuProfiler.executeCommands(command_buffer, secondary_command_buffers);
+	}
+	vkCmdExecuteCommands(command_buffer, static_cast<uint32_t>(secondary_command_buffers.size()), secondary_command_buffers.data());
+}
+
 // Functions for putting labels into a queue
 // Labels consist of a name and an optional color
 // How or if these are diplayed depends on the debugger used (RenderDoc e.g. displays both)
@@ -141,64 +187,8 @@ void vkUtils::setObjectDebugName(VkObjectType object_type, uint64_t object_handl
 	vkSetDebugUtilsObjectNameEXT(vkEngine->device, &name_info);
 }
 
-void vkUtils::generateBRDFLUT(vks::Texture2D& lutBrdf)
+VkRenderPass vkUtils::createOffscreenRenderPass(VkFormat format)
 {
-	if (!init)
-		return;
-	auto tStart = std::chrono::high_resolution_clock::now();
-
-	const VkFormat format = VK_FORMAT_R16G16_SFLOAT;	// R16G16 is supported pretty much everywhere
-	const int32_t dim = 512;
-
-	// Image
-	VkImageCreateInfo imageCI = vks::initializers::imageCreateInfo();
-	imageCI.imageType = VK_IMAGE_TYPE_2D;
-	imageCI.format = format;
-	imageCI.extent.width = dim;
-	imageCI.extent.height = dim;
-	imageCI.extent.depth = 1;
-	imageCI.mipLevels = 1;
-	imageCI.arrayLayers = 1;
-	imageCI.samples = VK_SAMPLE_COUNT_1_BIT;
-	imageCI.tiling = VK_IMAGE_TILING_OPTIMAL;
-	imageCI.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
-	VK_CHECK_RESULT(vkCreateImage(vkEngine->device, &imageCI, nullptr, &lutBrdf.image));
-	VkMemoryAllocateInfo memAlloc = vks::initializers::memoryAllocateInfo();
-	VkMemoryRequirements memReqs;
-	vkGetImageMemoryRequirements(vkEngine->device, lutBrdf.image, &memReqs);
-	memAlloc.allocationSize = memReqs.size;
-	memAlloc.memoryTypeIndex = vkEngine->vulkanDevice->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-	VK_CHECK_RESULT(vkAllocateMemory(vkEngine->device, &memAlloc, nullptr, &lutBrdf.deviceMemory));
-	VK_CHECK_RESULT(vkBindImageMemory(vkEngine->device, lutBrdf.image, lutBrdf.deviceMemory, 0));
-	// Image view
-	VkImageViewCreateInfo viewCI = vks::initializers::imageViewCreateInfo();
-	viewCI.viewType = VK_IMAGE_VIEW_TYPE_2D;
-	viewCI.format = format;
-	viewCI.subresourceRange = {};
-	viewCI.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-	viewCI.subresourceRange.levelCount = 1;
-	viewCI.subresourceRange.layerCount = 1;
-	viewCI.image = lutBrdf.image;
-	VK_CHECK_RESULT(vkCreateImageView(vkEngine->device, &viewCI, nullptr, &lutBrdf.view));
-	// Sampler
-	VkSamplerCreateInfo samplerCI = vks::initializers::samplerCreateInfo();
-	samplerCI.magFilter = VK_FILTER_LINEAR;
-	samplerCI.minFilter = VK_FILTER_LINEAR;
-	samplerCI.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
-	samplerCI.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
-	samplerCI.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
-	samplerCI.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
-	samplerCI.minLod = 0.0f;
-	samplerCI.maxLod = 1.0f;
-	samplerCI.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
-	VK_CHECK_RESULT(vkCreateSampler(vkEngine->device, &samplerCI, nullptr, &lutBrdf.sampler));
-
-	lutBrdf.descriptor.imageView = lutBrdf.view;
-	lutBrdf.descriptor.sampler = lutBrdf.sampler;
-	lutBrdf.descriptor.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-	lutBrdf.device = vkEngine->vulkanDevice;
-
-	// FB, Att, RP, Pipe, etc.
 	VkAttachmentDescription attDesc = {};
 	// Color attachment
 	attDesc.format = format;
@@ -207,8 +197,9 @@ void vkUtils::generateBRDFLUT(vks::Texture2D& lutBrdf)
 	attDesc.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
 	attDesc.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
 	attDesc.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-	attDesc.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-	attDesc.finalLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	// 布局转换与同步由渲染图在渲染通道外完成，渲染通道内不再转换布局，也不需要外部依赖
+	attDesc.initialLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+	attDesc.finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
 	VkAttachmentReference colorReference = { 0, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL };
 
 	VkSubpassDescription subpassDescription = {};
@@ -216,148 +207,210 @@ void vkUtils::generateBRDFLUT(vks::Texture2D& lutBrdf)
 	subpassDescription.colorAttachmentCount = 1;
 	subpassDescription.pColorAttachments = &colorReference;
 
-	// Use subpass dependencies for layout transitions
-	std::array<VkSubpassDependency, 2> dependencies{};
-	dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
-	dependencies[0].dstSubpass = 0;
-	dependencies[0].srcStageMask = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
-	dependencies[0].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-	dependencies[0].srcAccessMask = VK_ACCESS_MEMORY_READ_BIT;
-	dependencies[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-	dependencies[0].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
-	dependencies[1].srcSubpass = 0;
-	dependencies[1].dstSubpass = VK_SUBPASS_EXTERNAL;
-	dependencies[1].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-	dependencies[1].dstStageMask = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
-	dependencies[1].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-	dependencies[1].dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
-	dependencies[1].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
-
-	// Create the actual renderpass
 	VkRenderPassCreateInfo renderPassCI = vks::initializers::renderPassCreateInfo();
 	renderPassCI.attachmentCount = 1;
 	renderPassCI.pAttachments = &attDesc;
 	renderPassCI.subpassCount = 1;
 	renderPassCI.pSubpasses = &subpassDescription;
-	renderPassCI.dependencyCount = 2;
-	renderPassCI.pDependencies = dependencies.data();
+	VkRenderPass renderPass;
+	VK_CHECK_RESULT(vkCreateRenderPass(vkEngine->device, &renderPassCI, nullptr, &renderPass));
+	return renderPass;
+}
 
-	VkRenderPass renderpass;
-	VK_CHECK_RESULT(vkCreateRenderPass(vkEngine->device, &renderPassCI, nullptr, &renderpass));
+void vkUtils::cmdBeginOffscreenRendering(VkCommandBuffer commandBuffer, VkRenderPass renderPass, VkFramebuffer framebuffer, VkImageView view, uint32_t width, uint32_t height, const VkClearColorValue& clearColor)
+{
+	if (vkEngine->dynamicRendering) {
+		VkRenderingAttachmentInfo colorAttachment{ VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO };
+		colorAttachment.imageView = view;
+		colorAttachment.imageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+		colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+		colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+		colorAttachment.clearValue.color = clearColor;
+		VkRenderingInfo renderingInfo{ VK_STRUCTURE_TYPE_RENDERING_INFO };
+		renderingInfo.renderArea.extent = { width, height };
+		renderingInfo.layerCount = 1;
+		renderingInfo.colorAttachmentCount = 1;
+		renderingInfo.pColorAttachments = &colorAttachment;
+		vkCmdBeginRendering(commandBuffer, &renderingInfo);
+		return;
+	}
+	VkClearValue clearValue{};
+	clearValue.color = clearColor;
+	VkRenderPassBeginInfo renderPassBeginInfo = vks::initializers::renderPassBeginInfo();
+	renderPassBeginInfo.renderPass = renderPass;
+	renderPassBeginInfo.framebuffer = framebuffer;
+	renderPassBeginInfo.renderArea.extent.width = width;
+	renderPassBeginInfo.renderArea.extent.height = height;
+	renderPassBeginInfo.clearValueCount = 1;
+	renderPassBeginInfo.pClearValues = &clearValue;
+	vkCmdBeginRenderPass(commandBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+}
 
-	VkFramebufferCreateInfo framebufferCI = vks::initializers::framebufferCreateInfo();
-	framebufferCI.renderPass = renderpass;
-	framebufferCI.attachmentCount = 1;
-	framebufferCI.pAttachments = &lutBrdf.view;
-	framebufferCI.width = dim;
-	framebufferCI.height = dim;
-	framebufferCI.layers = 1;
+void vkUtils::cmdEndOffscreenRendering(VkCommandBuffer commandBuffer)
+{
+	if (vkEngine->dynamicRendering) {
+		vkCmdEndRendering(commandBuffer);
+	} else {
+		vkCmdEndRenderPass(commandBuffer);
+	}
+}
 
-	VkFramebuffer framebuffer;
-	VK_CHECK_RESULT(vkCreateFramebuffer(vkEngine->device, &framebufferCI, nullptr, &framebuffer));
+void vkUtils::prepareIBLPipelines(PipelineCompileBatch& batch)
+{
+	if (!init)
+		return;
+	if (computeIBLSupported()) {
+		prepareIBLComputePipelines();
+	} else {
+		prepareIBLGraphicsPipelines(batch);
+	}
+}
 
-	// Descriptors
-	VkDescriptorSetLayout descriptorsetlayout;
-	std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings = {};
-	VkDescriptorSetLayoutCreateInfo descriptorsetlayoutCI = vks::initializers::descriptorSetLayoutCreateInfo(setLayoutBindings);
-	VK_CHECK_RESULT(vkCreateDescriptorSetLayout(vkEngine->device, &descriptorsetlayoutCI, nullptr, &descriptorsetlayout));
+void vkUtils::prepareIBLGraphicsPipelines(PipelineCompileBatch& batch)
+{
+	VkDevice device = vkEngine->device;
 
-	// Descriptor Pool
-	std::vector<VkDescriptorPoolSize> poolSizes = { vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1) };
-	VkDescriptorPoolCreateInfo descriptorPoolCI = vks::initializers::descriptorPoolCreateInfo(poolSizes, 2);
-	VkDescriptorPool descriptorpool;
-	VK_CHECK_RESULT(vkCreateDescriptorPool(vkEngine->device, &descriptorPoolCI, nullptr, &descriptorpool));
+	// 渲染通道只取决于输出格式，动态渲染时渲染通道保持为 VK_NULL_HANDLE
+	const bool dynamicRendering = vkEngine->dynamicRendering;
+	if (!dynamicRendering) {
+		iblPipelines.brdfRenderPass = createOffscreenRenderPass(lutFormat);
+		iblPipelines.prefilterRenderPass = createOffscreenRenderPass(prefilteredFormat);
+	}
 
-	// Descriptor sets
-	VkDescriptorSet descriptorset;
-	VkDescriptorSetAllocateInfo allocInfo = vks::initializers::descriptorSetAllocateInfo(descriptorpool, &descriptorsetlayout, 1);
-	VK_CHECK_RESULT(vkAllocateDescriptorSets(vkEngine->device, &allocInfo, &descriptorset));
+	// 环境贴图的描述符布局由布局缓存持有
+	std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings = {
+		vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT, 0),
+	};
+	iblPipelines.environmentSetLayout = vkEngine->descriptorLayoutCache.createDescriptorSetLayout(setLayoutBindings);
 
-	// Pipeline layout
-	VkPipelineLayout pipelinelayout;
-	VkPipelineLayoutCreateInfo pipelineLayoutCI = vks::initializers::pipelineLayoutCreateInfo(&descriptorsetlayout, 1);
-	VK_CHECK_RESULT(vkCreatePipelineLayout(vkEngine->device, &pipelineLayoutCI, nullptr, &pipelinelayout));
-
-	// Pipeline
-	VkPipelineInputAssemblyStateCreateInfo inputAssemblyState = vks::initializers::pipelineInputAssemblyStateCreateInfo(VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST, 0, VK_FALSE);
-	VkPipelineRasterizationStateCreateInfo rasterizationState = vks::initializers::pipelineRasterizationStateCreateInfo(VK_POLYGON_MODE_FILL, VK_CULL_MODE_NONE, VK_FRONT_FACE_COUNTER_CLOCKWISE);
-	VkPipelineColorBlendAttachmentState blendAttachmentState = vks::initializers::pipelineColorBlendAttachmentState(0xf, VK_FALSE);
-	VkPipelineColorBlendStateCreateInfo colorBlendState = vks::initializers::pipelineColorBlendStateCreateInfo(1, &blendAttachmentState);
-	VkPipelineDepthStencilStateCreateInfo depthStencilState = vks::initializers::pipelineDepthStencilStateCreateInfo(VK_FALSE, VK_FALSE, VK_COMPARE_OP_LESS_OR_EQUAL);
-	VkPipelineViewportStateCreateInfo viewportState = vks::initializers::pipelineViewportStateCreateInfo(1, 1);
-	VkPipelineMultisampleStateCreateInfo multisampleState = vks::initializers::pipelineMultisampleStateCreateInfo(VK_SAMPLE_COUNT_1_BIT);
-	std::vector<VkDynamicState> dynamicStateEnables = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
-	VkPipelineDynamicStateCreateInfo dynamicState = vks::initializers::pipelineDynamicStateCreateInfo(dynamicStateEnables);
-	VkPipelineVertexInputStateCreateInfo emptyInputState = vks::initializers::pipelineVertexInputStateCreateInfo();
-	std::array<VkPipelineShaderStageCreateInfo, 2> shaderStages{};
-
-	VkGraphicsPipelineCreateInfo pipelineCI = vks::initializers::pipelineCreateInfo(pipelinelayout, renderpass);
-	pipelineCI.pInputAssemblyState = &inputAssemblyState;
-	pipelineCI.pRasterizationState = &rasterizationState;
-	pipelineCI.pColorBlendState = &colorBlendState;
-	pipelineCI.pMultisampleState = &multisampleState;
-	pipelineCI.pViewportState = &viewportState;
-	pipelineCI.pDepthStencilState = &depthStencilState;
-	pipelineCI.pDynamicState = &dynamicState;
-	pipelineCI.stageCount = 2;
-	pipelineCI.pStages = shaderStages.data();
-	pipelineCI.pVertexInputState = &emptyInputState;
+	// Pipeline layouts
+	VkPipelineLayoutCreateInfo pipelineLayoutCI = vks::initializers::pipelineLayoutCreateInfo(0);
+	VK_CHECK_RESULT(vkCreatePipelineLayout(device, &pipelineLayoutCI, nullptr, &iblPipelines.brdfLayout));
+	VkPushConstantRange pushConstantRange = vks::initializers::pushConstantRange(VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, sizeof(PrefilterPushBlock), 0);
+	pipelineLayoutCI = vks::initializers::pipelineLayoutCreateInfo(&iblPipelines.environmentSetLayout, 1);
+	pipelineLayoutCI.pushConstantRangeCount = 1;
+	pipelineLayoutCI.pPushConstantRanges = &pushConstantRange;
+	VK_CHECK_RESULT(vkCreatePipelineLayout(device, &pipelineLayoutCI, nullptr, &iblPipelines.prefilterLayout));
 
-	// Look-up-table (from BRDF) pipeline
-	shaderStages[0] = vkEngine->loadShader(vkEngine->getShadersPath() + "genbrdflut.vert.spv", VK_SHADER_STAGE_VERTEX_BIT);
-	shaderStages[1] = vkEngine->loadShader(vkEngine->getShadersPath() + "genbrdflut.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT);
-	VkPipeline pipeline;
-	VK_CHECK_RESULT(vkCreateGraphicsPipelines(vkEngine->device, vkEngine->pipelineCache, 1, &pipelineCI, nullptr, &pipeline));
+	// Pipelines
+	PipelineBuilder builder(device);
+	builder.setRasterizationState(VK_POLYGON_MODE_FILL, VK_CULL_MODE_NONE);
 
-	// Render
-	VkClearValue clearValues[1]{};
-	clearValues[0].color = { { 0.0f, 0.0f, 0.0f, 1.0f } };
+	// 着色器由引擎的着色器模块缓存持有
+	const std::string shadersPath = vkEngine->getShadersPath();
+	const VkPipelineShaderStageCreateInfo brdfVertStage = vkEngine->loadShader(shadersPath + "genbrdflut.vert.spv", VK_SHADER_STAGE_VERTEX_BIT);
+	const VkPipelineShaderStageCreateInfo brdfFragStage = vkEngine->loadShader(shadersPath + "genbrdflut.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT);
+	const VkPipelineShaderStageCreateInfo filterCubeStage = vkEngine->loadShader(shadersPath + "filtercube.vert.spv", VK_SHADER_STAGE_VERTEX_BIT);
+	const VkPipelineShaderStageCreateInfo prefilterStage = vkEngine->loadShader(shadersPath + "prefilterenvmap.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT);
+	iblPipelines.shaderStages.insert(iblPipelines.shaderStages.end(), { brdfVertStage, brdfFragStage, filterCubeStage, prefilterStage });
 
-	VkRenderPassBeginInfo renderPassBeginInfo = vks::initializers::renderPassBeginInfo();
-	renderPassBeginInfo.renderPass = renderpass;
-	renderPassBeginInfo.renderArea.extent.width = dim;
-	renderPassBeginInfo.renderArea.extent.height = dim;
-	renderPassBeginInfo.clearValueCount = 1;
-	renderPassBeginInfo.pClearValues = clearValues;
-	renderPassBeginInfo.framebuffer = framebuffer;
+	// Look-up-table (from BRDF) pipeline
+	builder.setEmptyVertexInputState();
+	if (dynamicRendering) {
+		builder.setRenderingFormats({ lutFormat });
+	}
+	builder.addShaderStage(brdfVertStage);
+	builder.addShaderStage(brdfFragStage);
+	batch.add(builder, iblPipelines.brdfRenderPass, iblPipelines.brdfLayout, &iblPipelines.brdf, "genbrdflut pipeline");
+	builder.clearShaderStage();
+
+	// Cube map filter pipeline
+	builder.setVertexInputState(vkglTF::Vertex::getPipelineVertexInputState({ vkglTF::VertexComponent::Position, vkglTF::VertexComponent::Normal, vkglTF::VertexComponent::UV }));
+	if (dynamicRendering) {
+		builder.setRenderingFormats({ prefilteredFormat });
+	}
+	builder.addShaderStage(filterCubeStage);
+	builder.addShaderStage(prefilterStage);
+	batch.add(builder, iblPipelines.prefilterRenderPass, iblPipelines.prefilterLayout, &iblPipelines.prefilter, "prefilterenvmap pipeline");
+}
 
-	VkCommandBuffer cmdBuf = vkEngine->vulkanDevice->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
-	vkCmdBeginRenderPass(cmdBuf, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
-	VkViewport viewport = vks::initializers::viewport((float)dim, (float)dim, 0.0f, 1.0f);
-	VkRect2D scissor = vks::initializers::rect2D(dim, dim, 0, 0);
-	vkCmdSetViewport(cmdBuf, 0, 1, &viewport);
-	vkCmdSetScissor(cmdBuf, 0, 1, &scissor);
-	vkCmdBindPipeline(cmdBuf, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
-	vkCmdDraw(cmdBuf, 3, 1, 0, 0);
-	vkCmdEndRenderPass(cmdBuf);
-	vkEngine->vulkanDevice->flushCommandBuffer(cmdBuf, vkEngine->queue);
+void vkUtils::prepareIBLComputePipelines()
+{
+	if (iblPipelines.lutCompute != VK_NULL_HANDLE)
+		return;
+	VkDevice device = vkEngine->device;
 
-	vkQueueWaitIdle(vkEngine->queue);
+	// set 0: LUT 只有输出图像；立方体贴图滤波为环境贴图 + 当前 mip 的输出图像
+	std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings = {
+		vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_SHADER_STAGE_COMPUTE_BIT, 0),
+	};
+	iblPipelines.lutStorageSetLayout = vkEngine->descriptorLayoutCache.createDescriptorSetLayout(setLayoutBindings);
+	setLayoutBindings = {
+		vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_COMPUTE_BIT, 0),
+		vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_SHADER_STAGE_COMPUTE_BIT, 1),
+	};
+	iblPipelines.filterStorageSetLayout = vkEngine->descriptorLayoutCache.createDescriptorSetLayout(setLayoutBindings);
 
-	vkDestroyPipeline(vkEngine->device, pipeline, nullptr);
-	vkDestroyPipelineLayout(vkEngine->device, pipelinelayout, nullptr);
-	vkDestroyRenderPass(vkEngine->device, renderpass, nullptr);
-	vkDestroyFramebuffer(vkEngine->device, framebuffer, nullptr);
-	vkDestroyDescriptorSetLayout(vkEngine->device, descriptorsetlayout, nullptr);
-	vkDestroyDescriptorPool(vkEngine->device, descriptorpool, nullptr);
+	// Pipeline layouts
+	VkPipelineLayoutCreateInfo pipelineLayoutCI = vks::initializers::pipelineLayoutCreateInfo(&iblPipelines.lutStorageSetLayout, 1);
+	VK_CHECK_RESULT(vkCreatePipelineLayout(device, &pipelineLayoutCI, nullptr, &iblPipelines.lutComputeLayout));
+	VkPushConstantRange pushConstantRange = vks::initializers::pushConstantRange(VK_SHADER_STAGE_COMPUTE_BIT, sizeof(PrefilterComputePushBlock), 0);
+	pipelineLayoutCI = vks::initializers::pipelineLayoutCreateInfo(&iblPipelines.filterStorageSetLayout, 1);
+	pipelineLayoutCI.pushConstantRangeCount = 1;
+	pipelineLayoutCI.pPushConstantRanges = &pushConstantRange;
+	VK_CHECK_RESULT(vkCreatePipelineLayout(device, &pipelineLayoutCI, nullptr, &iblPipelines.prefilterComputeLayout));
+
+	// 两条计算管线一次创建，计算管线不经过 PipelineBuilder 的状态缓存
+	const std::string shadersPath = vkEngine->getShadersPath();
+	const std::array<VkPipelineShaderStageCreateInfo, 2> computeStages = {
+		vkEngine->loadShader(shadersPath + "genbrdflut.comp.spv", VK_SHADER_STAGE_COMPUTE_BIT),
+		vkEngine->loadShader(shadersPath + "prefilterenvmap.comp.spv", VK_SHADER_STAGE_COMPUTE_BIT),
+	};
+	iblPipelines.shaderStages.insert(iblPipelines.shaderStages.end(), computeStages.begin(), computeStages.end());
+	const std::array<VkPipelineLayout, 2> layouts = { iblPipelines.lutComputeLayout, iblPipelines.prefilterComputeLayout };
+	std::array<VkComputePipelineCreateInfo, 2> pipelineCIs{};
+	for (size_t i = 0; i < pipelineCIs.size(); i++) {
+		pipelineCIs[i] = vks::initializers::computePipelineCreateInfo(layouts[i], 0);
+		pipelineCIs[i].stage = computeStages[i];
+	}
+	std::array<VkPipeline, 2> pipelines{};
+	VK_CHECK_RESULT(vkCreateComputePipelines(device, vkEngine->pipelineCache, static_cast<uint32_t>(pipelineCIs.size()), pipelineCIs.data(), nullptr, pipelines.data()));
+	iblPipelines.lutCompute = pipelines[0];
+	iblPipelines.prefilterCompute = pipelines[1];
+}
 
-	setObjectDebugName(VK_OBJECT_TYPE_IMAGE, (uint64_t)lutBrdf.image, "LutBRDF");
-	auto tEnd = std::chrono::high_resolution_clock::now();
-	auto tDiff = std::chrono::duration<double, std::milli>(tEnd - tStart).count();
-	std::cout << "Generating BRDF LUT took " << tDiff << " ms" << std::endl;
+void vkUtils::ensureIBLPipelines()
+{
+	if (iblPipelines.brdf != VK_NULL_HANDLE)
+		return;
+	PipelineCompileBatch batch;
+	prepareIBLGraphicsPipelines(batch);
+	VK_CHECK_RESULT(batch.compile(vkEngine->pipelineCache));
 }
 
-void vkUtils::generateIrradianceCube(vks::TextureCubeMap& irradianceCube, vks::TextureCubeMap& environmentCube)
+void vkUtils::destroyIBLPipelines()
 {
 	if (!init)
 		return;
-	auto tStart = std::chrono::high_resolution_clock::now();
-
-	const VkFormat format = VK_FORMAT_R32G32B32A32_SFLOAT;
-	const int32_t dim = 64;
-	const uint32_t numMips = static_cast<uint32_t>(floor(log2(dim))) + 1;
+	VkDevice device = vkEngine->device;
+	// 这些管线只在启动时使用一次，连同渲染通道一起从状态缓存中释放，避免之后复用的句柄误命中
+	// 计算路径、缓存命中或动态渲染时没有创建渲染通道，动态渲染的管线按布局释放
+	for (VkRenderPass renderPass : { iblPipelines.brdfRenderPass, iblPipelines.prefilterRenderPass }) {
+		if (renderPass != VK_NULL_HANDLE) {
+			PipelineBuilder::releaseRenderPass(device, renderPass);
+		}
+	}
+	for (VkPipelineLayout layout : { iblPipelines.brdfLayout, iblPipelines.prefilterLayout }) {
+		if (layout != VK_NULL_HANDLE) {
+			PipelineBuilder::releasePipelineLayout(device, layout);
+		}
+	}
+	vkDestroyPipeline(device, iblPipelines.lutCompute, nullptr);
+	vkDestroyPipeline(device, iblPipelines.prefilterCompute, nullptr);
+	vkDestroyPipelineLayout(device, iblPipelines.lutComputeLayout, nullptr);
+	vkDestroyPipelineLayout(device, iblPipelines.prefilterComputeLayout, nullptr);
+	vkDestroyPipelineLayout(device, iblPipelines.brdfLayout, nullptr);
+	vkDestroyPipelineLayout(device, iblPipelines.prefilterLayout, nullptr);
+	vkDestroyRenderPass(device, iblPipelines.brdfRenderPass, nullptr);
+	vkDestroyRenderPass(device, iblPipelines.prefilterRenderPass, nullptr);
+	for (const VkPipelineShaderStageCreateInfo& shaderStage : iblPipelines.shaderStages) {
+		vkEngine->releaseShader(shaderStage);
+	}
+	iblPipelines = {};
+}
 
-	// Pre-filtered cube map
+void vkUtils::createIBLTarget(vks::Texture& texture, VkFormat format, uint32_t dim, uint32_t mipLevels, uint32_t layers, VkImageUsageFlags usage)
+{
 	// Image
 	VkImageCreateInfo imageCI = vks::initializers::imageCreateInfo();
 	imageCI.imageType = VK_IMAGE_TYPE_2D;
@@ -365,30 +418,30 @@ void vkUtils::generateIrradianceCube(vks::TextureCubeMap& irradianceCube, vks::T
 	imageCI.extent.width = dim;
 	imageCI.extent.height = dim;
 	imageCI.extent.depth = 1;
-	imageCI.mipLevels = numMips;
-	imageCI.arrayLayers = 6;
+	imageCI.mipLevels = mipLevels;
+	imageCI.arrayLayers = layers;
 	imageCI.samples = VK_SAMPLE_COUNT_1_BIT;
 	imageCI.tiling = VK_IMAGE_TILING_OPTIMAL;
-	imageCI.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
-	imageCI.flags = VK_IMAGE_CREATE_CUBE_COMPATIBLE_BIT;
-	VK_CHECK_RESULT(vkCreateImage(vkEngine->device, &imageCI, nullptr, &irradianceCube.image));
+	imageCI.usage = usage;
+	imageCI.flags = layers == 6 ? VK_IMAGE_CREATE_CUBE_COMPATIBLE_BIT : 0;
+	VK_CHECK_RESULT(vkCreateImage(vkEngine->device, &imageCI, nullptr, &texture.image));
 	VkMemoryAllocateInfo memAlloc = vks::initializers::memoryAllocateInfo();
 	VkMemoryRequirements memReqs;
-	vkGetImageMemoryRequirements(vkEngine->device, irradianceCube.image, &memReqs);
+	vkGetImageMemoryRequirements(vkEngine->device, texture.image, &memReqs);
 	memAlloc.allocationSize = memReqs.size;
 	memAlloc.memoryTypeIndex = vkEngine->vulkanDevice->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-	VK_CHECK_RESULT(vkAllocateMemory(vkEngine->device, &memAlloc, nullptr, &irradianceCube.deviceMemory));
-	VK_CHECK_RESULT(vkBindImageMemory(vkEngine->device, irradianceCube.image, irradianceCube.deviceMemory, 0));
+	VK_CHECK_RESULT(vkAllocateMemory(vkEngine->device, &memAlloc, nullptr, &texture.deviceMemory));
+	VK_CHECK_RESULT(vkBindImageMemory(vkEngine->device, texture.image, texture.deviceMemory, 0));
 	// Image view
 	VkImageViewCreateInfo viewCI = vks::initializers::imageViewCreateInfo();
-	viewCI.viewType = VK_IMAGE_VIEW_TYPE_CUBE;
+	viewCI.viewType = layers == 6 ? VK_IMAGE_VIEW_TYPE_CUBE : VK_IMAGE_VIEW_TYPE_2D;
 	viewCI.format = format;
 	viewCI.subresourceRange = {};
 	viewCI.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-	viewCI.subresourceRange.levelCount = numMips;
-	viewCI.subresourceRange.layerCount = 6;
-	viewCI.image = irradianceCube.image;
-	VK_CHECK_RESULT(vkCreateImageView(vkEngine->device, &viewCI, nullptr, &irradianceCube.view));
+	viewCI.subresourceRange.levelCount = mipLevels;
+	viewCI.subresourceRange.layerCount = layers;
+	viewCI.image = texture.image;
+	VK_CHECK_RESULT(vkCreateImageView(vkEngine->device, &viewCI, nullptr, &texture.view));
 	// Sampler
 	VkSamplerCreateInfo samplerCI = vks::initializers::samplerCreateInfo();
 	samplerCI.magFilter = VK_FILTER_LINEAR;
@@ -398,134 +451,94 @@ void vkUtils::generateIrradianceCube(vks::TextureCubeMap& irradianceCube, vks::T
 	samplerCI.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
 	samplerCI.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
 	samplerCI.minLod = 0.0f;
-	samplerCI.maxLod = static_cast<float>(numMips);
+	samplerCI.maxLod = static_cast<float>(mipLevels);
 	samplerCI.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
-	VK_CHECK_RESULT(vkCreateSampler(vkEngine->device, &samplerCI, nullptr, &irradianceCube.sampler));
+	VK_CHECK_RESULT(vkCreateSampler(vkEngine->device, &samplerCI, nullptr, &texture.sampler));
+
+	texture.width = dim;
+	texture.height = dim;
+	texture.mipLevels = mipLevels;
+	texture.layerCount = layers;
+	texture.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	texture.descriptor.imageView = texture.view;
+	texture.descriptor.sampler = texture.sampler;
+	texture.descriptor.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	texture.device = vkEngine->vulkanDevice;
+}
 
-	irradianceCube.descriptor.imageView = irradianceCube.view;
-	irradianceCube.descriptor.sampler = irradianceCube.sampler;
-	irradianceCube.descriptor.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-	irradianceCube.device = vkEngine->vulkanDevice;
+void vkUtils::generateBRDFLUT(vks::Texture2D& lutBrdf)
+{
+	if (!init)
+		return;
+	ensureIBLPipelines();
+	auto tStart = std::chrono::high_resolution_clock::now();
 
-	// FB, Att, RP, Pipe, etc.
-	VkAttachmentDescription attDesc = {};
-	// Color attachment
-	attDesc.format = format;
-	attDesc.samples = VK_SAMPLE_COUNT_1_BIT;
-	attDesc.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-	attDesc.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
-	attDesc.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-	attDesc.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-	attDesc.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-	attDesc.finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
-	VkAttachmentReference colorReference = { 0, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL };
+	const VkFormat format = lutFormat;
+	const int32_t dim = iblParameters.lutDim;
+
+	// TRANSFER_SRC: 结果会被读回写入磁盘缓存
+	createIBLTarget(lutBrdf, format, dim, 1, 1, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT);
+
+	// 动态渲染时直接渲染到纹理的视图，不需要帧缓冲
+	VkFramebuffer framebuffer{ VK_NULL_HANDLE };
+	if (!vkEngine->dynamicRendering) {
+		VkFramebufferCreateInfo framebufferCI = vks::initializers::framebufferCreateInfo();
+		framebufferCI.renderPass = iblPipelines.brdfRenderPass;
+		framebufferCI.attachmentCount = 1;
+		framebufferCI.pAttachments = &lutBrdf.view;
+		framebufferCI.width = dim;
+		framebufferCI.height = dim;
+		framebufferCI.layers = 1;
+		VK_CHECK_RESULT(vkCreateFramebuffer(vkEngine->device, &framebufferCI, nullptr, &framebuffer));
+	}
 
-	VkSubpassDescription subpassDescription = {};
-	subpassDescription.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
-	subpassDescription.colorAttachmentCount = 1;
-	subpassDescription.pColorAttachments = &colorReference;
+	// 渲染图负责进入渲染通道前转换到附件布局、结束后转换到着色器只读布局
+	RenderGraph graph(vkEngine->vulkanDevice, vkEngine->synchronization2Supported);
+	const RenderGraphImage lut = graph.importImage("LutBRDF", lutBrdf.image, lutBrdf.view, { format, static_cast<uint32_t>(dim), static_cast<uint32_t>(dim) });
+	graph.setFinalUsage(lut, RenderGraphUsage::SampledFragment);
+	graph.addPass("BRDF LUT", [&](VkCommandBuffer cmdBuf, const RenderGraph&) {
+		cmdBeginOffscreenRendering(cmdBuf, iblPipelines.brdfRenderPass, framebuffer, lutBrdf.view, dim, dim, { { 0.0f, 0.0f, 0.0f, 1.0f } });
+		VkViewport viewport = vks::initializers::viewport((float)dim, (float)dim, 0.0f, 1.0f);
+		VkRect2D scissor = vks::initializers::rect2D(dim, dim, 0, 0);
+		vkCmdSetViewport(cmdBuf, 0, 1, &viewport);
+		vkCmdSetScissor(cmdBuf, 0, 1, &scissor);
+		vkCmdBindPipeline(cmdBuf, VK_PIPELINE_BIND_POINT_GRAPHICS, iblPipelines.brdf);
+		vkCmdDraw(cmdBuf, 3, 1, 0, 0);
+		cmdEndOffscreenRendering(cmdBuf);
+	}).write(lut, RenderGraphUsage::ColorAttachment);
+	graph.compile();
 
-	// Use subpass dependencies for layout transitions
-	std::array<VkSubpassDependency, 2> dependencies{};
-	dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
-	dependencies[0].dstSubpass = 0;
-	dependencies[0].srcStageMask = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
-	dependencies[0].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-	dependencies[0].srcAccessMask = VK_ACCESS_MEMORY_READ_BIT;
-	dependencies[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-	dependencies[0].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
-	dependencies[1].srcSubpass = 0;
-	dependencies[1].dstSubpass = VK_SUBPASS_EXTERNAL;
-	dependencies[1].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-	dependencies[1].dstStageMask = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
-	dependencies[1].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-	dependencies[1].dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
-	dependencies[1].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
-
-	// Renderpass
-	VkRenderPassCreateInfo renderPassCI = vks::initializers::renderPassCreateInfo();
-	renderPassCI.attachmentCount = 1;
-	renderPassCI.pAttachments = &attDesc;
-	renderPassCI.subpassCount = 1;
-	renderPassCI.pSubpasses = &subpassDescription;
-	renderPassCI.dependencyCount = 2;
-	renderPassCI.pDependencies = dependencies.data();
-	VkRenderPass renderpass;
-	VK_CHECK_RESULT(vkCreateRenderPass(vkEngine->device, &renderPassCI, nullptr, &renderpass));
+	VkCommandBuffer cmdBuf = vkEngine->vulkanDevice->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+	cmdBeginLabel(cmdBuf, "IBL", { 1.0f, 1.0f, 1.0f, 1.0f });
+	graph.execute(cmdBuf);
+	cmdEndLabel(cmdBuf);
+	vkEngine->vulkanDevice->flushCommandBuffer(cmdBuf, vkEngine->queue);
+	vkEngine->gpuProfiler.resolveImmediate();
 
-	struct {
-		VkImage image;
-		VkImageView view;
-		VkDeviceMemory memory;
-		VkFramebuffer framebuffer;
-	} offscreen{};
-
-	// Offfscreen framebuffer
-	{
-		// Color attachment
-		VkImageCreateInfo imageCreateInfo = vks::initializers::imageCreateInfo();
-		imageCreateInfo.imageType = VK_IMAGE_TYPE_2D;
-		imageCreateInfo.format = format;
-		imageCreateInfo.extent.width = dim;
-		imageCreateInfo.extent.height = dim;
-		imageCreateInfo.extent.depth = 1;
-		imageCreateInfo.mipLevels = 1;
-		imageCreateInfo.arrayLayers = 1;
-		imageCreateInfo.samples = VK_SAMPLE_COUNT_1_BIT;
-		imageCreateInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
-		imageCreateInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-		imageCreateInfo.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
-		imageCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-		VK_CHECK_RESULT(vkCreateImage(vkEngine->device, &imageCreateInfo, nullptr, &offscreen.image));
-
-		VkMemoryAllocateInfo memAlloc = vks::initializers::memoryAllocateInfo();
-		VkMemoryRequirements memReqs;
-		vkGetImageMemoryRequirements(vkEngine->device, offscreen.image, &memReqs);
-		memAlloc.allocationSize = memReqs.size;
-		memAlloc.memoryTypeIndex = vkEngine->vulkanDevice->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-		VK_CHECK_RESULT(vkAllocateMemory(vkEngine->device, &memAlloc, nullptr, &offscreen.memory));
-		VK_CHECK_RESULT(vkBindImageMemory(vkEngine->device, offscreen.image, offscreen.memory, 0));
-
-		VkImageViewCreateInfo colorImageView = vks::initializers::imageViewCreateInfo();
-		colorImageView.viewType = VK_IMAGE_VIEW_TYPE_2D;
-		colorImageView.format = format;
-		colorImageView.flags = 0;
-		colorImageView.subresourceRange = {};
-		colorImageView.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-		colorImageView.subresourceRange.baseMipLevel = 0;
-		colorImageView.subresourceRange.levelCount = 1;
-		colorImageView.subresourceRange.baseArrayLayer = 0;
-		colorImageView.subresourceRange.layerCount = 1;
-		colorImageView.image = offscreen.image;
-		VK_CHECK_RESULT(vkCreateImageView(vkEngine->device, &colorImageView, nullptr, &offscreen.view));
+	vkQueueWaitIdle(vkEngine->queue);
 
-		VkFramebufferCreateInfo fbufCreateInfo = vks::initializers::framebufferCreateInfo();
-		fbufCreateInfo.renderPass = renderpass;
-		fbufCreateInfo.attachmentCount = 1;
-		fbufCreateInfo.pAttachments = &offscreen.view;
-		fbufCreateInfo.width = dim;
-		fbufCreateInfo.height = dim;
-		fbufCreateInfo.layers = 1;
-		VK_CHECK_RESULT(vkCreateFramebuffer(vkEngine->device, &fbufCreateInfo, nullptr, &offscreen.framebuffer));
-
-		VkCommandBuffer layoutCmd = vkEngine->vulkanDevice->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
-		vks::tools::setImageLayout(
-			layoutCmd,
-			offscreen.image,
-			VK_IMAGE_ASPECT_COLOR_BIT,
-			VK_IMAGE_LAYOUT_UNDEFINED,
-			VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
-		vkEngine->vulkanDevice->flushCommandBuffer(layoutCmd, vkEngine->queue, true);
-	}
+	vkDestroyFramebuffer(vkEngine->device, framebuffer, nullptr);
 
-	// Descriptors
-	VkDescriptorSetLayout descriptorsetlayout;
-	std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings = {
-		vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT, 0),
-	};
-	VkDescriptorSetLayoutCreateInfo descriptorsetlayoutCI = vks::initializers::descriptorSetLayoutCreateInfo(setLayoutBindings);
-	VK_CHECK_RESULT(vkCreateDescriptorSetLayout(vkEngine->device, &descriptorsetlayoutCI, nullptr, &descriptorsetlayout));
+	setObjectDebugName(VK_OBJECT_TYPE_IMAGE, (uint64_t)lutBrdf.image, "LutBRDF");
+	auto tEnd = std::chrono::high_resolution_clock::now();
+	auto tDiff = std::chrono::duration<double, std::milli>(tEnd - tStart).count();
+	std::cout << "Generating BRDF LUT took " << tDiff << " ms" << std::endl;
+}
+
+void vkUtils::generatePrefilteredCube(vks::TextureCubeMap& prefilteredCube, vks::TextureCubeMap& environmentCube, const ibl::PrefilterSettings& settings)
+{
+	if (!init)
+		return;
+	ensureIBLPipelines();
+	auto tStart = std::chrono::high_resolution_clock::now();
+
+	const VkFormat format = prefilteredFormat;
+	const int32_t dim = iblParameters.prefilteredDim;
+	const uint32_t numMips = mipLevelCount(dim);
+
+	createIBLTarget(prefilteredCube, format, dim, numMips, 6, VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT);
 
+	// Descriptors
 	// Descriptor Pool
 	std::vector<VkDescriptorPoolSize> poolSizes = { vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1) };
 	VkDescriptorPoolCreateInfo descriptorPoolCI = vks::initializers::descriptorPoolCreateInfo(poolSizes, 2);
@@ -534,73 +547,12 @@ void vkUtils::generateIrradianceCube(vks::TextureCubeMap& irradianceCube, vks::T
 
 	// Descriptor sets
 	VkDescriptorSet descriptorset;
-	VkDescriptorSetAllocateInfo allocInfo = vks::initializers::descriptorSetAllocateInfo(descriptorpool, &descriptorsetlayout, 1);
+	VkDescriptorSetAllocateInfo allocInfo = vks::initializers::descriptorSetAllocateInfo(descriptorpool, &iblPipelines.environmentSetLayout, 1);
 	VK_CHECK_RESULT(vkAllocateDescriptorSets(vkEngine->device, &allocInfo, &descriptorset));
 	VkWriteDescriptorSet writeDescriptorSet = vks::initializers::writeDescriptorSet(descriptorset, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 0, &environmentCube.descriptor);
 	vkUpdateDescriptorSets(vkEngine->device, 1, &writeDescriptorSet, 0, nullptr);
 
-	// Pipeline layout
-	struct PushBlock {
-		glm::mat4 mvp;
-		// Sampling deltas
-		float deltaPhi = (2.0f * float(M_PI)) / 180.0f;
-		float deltaTheta = (0.5f * float(M_PI)) / 64.0f;
-	} pushBlock;
-
-	VkPipelineLayout pipelinelayout;
-	std::vector<VkPushConstantRange> pushConstantRanges = {
-		vks::initializers::pushConstantRange(VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, sizeof(PushBlock), 0),
-	};
-	VkPipelineLayoutCreateInfo pipelineLayoutCI = vks::initializers::pipelineLayoutCreateInfo(&descriptorsetlayout, 1);
-	pipelineLayoutCI.pushConstantRangeCount = 1;
-	pipelineLayoutCI.pPushConstantRanges = pushConstantRanges.data();
-	VK_CHECK_RESULT(vkCreatePipelineLayout(vkEngine->device, &pipelineLayoutCI, nullptr, &pipelinelayout));
-
-	// Pipeline
-	VkPipelineInputAssemblyStateCreateInfo inputAssemblyState = vks::initializers::pipelineInputAssemblyStateCreateInfo(VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST, 0, VK_FALSE);
-	VkPipelineRasterizationStateCreateInfo rasterizationState = vks::initializers::pipelineRasterizationStateCreateInfo(VK_POLYGON_MODE_FILL, VK_CULL_MODE_NONE, VK_FRONT_FACE_COUNTER_CLOCKWISE);
-	VkPipelineColorBlendAttachmentState blendAttachmentState = vks::initializers::pipelineColorBlendAttachmentState(0xf, VK_FALSE);
-	VkPipelineColorBlendStateCreateInfo colorBlendState = vks::initializers::pipelineColorBlendStateCreateInfo(1, &blendAttachmentState);
-	VkPipelineDepthStencilStateCreateInfo depthStencilState = vks::initializers::pipelineDepthStencilStateCreateInfo(VK_FALSE, VK_FALSE, VK_COMPARE_OP_LESS_OR_EQUAL);
-	VkPipelineViewportStateCreateInfo viewportState = vks::initializers::pipelineViewportStateCreateInfo(1, 1);
-	VkPipelineMultisampleStateCreateInfo multisampleState = vks::initializers::pipelineMultisampleStateCreateInfo(VK_SAMPLE_COUNT_1_BIT);
-	std::vector<VkDynamicState> dynamicStateEnables = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
-	VkPipelineDynamicStateCreateInfo dynamicState = vks::initializers::pipelineDynamicStateCreateInfo(dynamicStateEnables);
-	std::array<VkPipelineShaderStageCreateInfo, 2> shaderStages{};
-
-	VkGraphicsPipelineCreateInfo pipelineCI = vks::initializers::pipelineCreateInfo(pipelinelayout, renderpass);
-	pipelineCI.pInputAssemblyState = &inputAssemblyState;
-	pipelineCI.pRasterizationState = &rasterizationState;
-	pipelineCI.pColorBlendState = &colorBlendState;
-	pipelineCI.pMultisampleState = &multisampleState;
-	pipelineCI.pViewportState = &viewportState;
-	pipelineCI.pDepthStencilState = &depthStencilState;
-	pipelineCI.pDynamicState = &dynamicState;
-	pipelineCI.stageCount = 2;
-	pipelineCI.pStages = shaderStages.data();
-	pipelineCI.renderPass = renderpass;
-	pipelineCI.pVertexInputState = vkglTF::Vertex::getPipelineVertexInputState({ vkglTF::VertexComponent::Position, vkglTF::VertexComponent::Normal, vkglTF::VertexComponent::UV });
-
-	shaderStages[0] = vkEngine->loadShader(vkEngine->getShadersPath() + "filtercube.vert.spv", VK_SHADER_STAGE_VERTEX_BIT);
-	shaderStages[1] = vkEngine->loadShader(vkEngine->getShadersPath() + "irradiancecube.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT);
-	VkPipeline pipeline;
-	VK_CHECK_RESULT(vkCreateGraphicsPipelines(vkEngine->device, vkEngine->pipelineCache, 1, &pipelineCI, nullptr, &pipeline));
-
-	// Render
-
-	VkClearValue clearValues[1]{};
-	clearValues[0].color = { { 0.0f, 0.0f, 0.2f, 0.0f } };
-
-	VkRenderPassBeginInfo renderPassBeginInfo = vks::initializers::renderPassBeginInfo();
-	// Reuse render pass from example pass
-	renderPassBeginInfo.renderPass = renderpass;
-	renderPassBeginInfo.framebuffer = offscreen.framebuffer;
-	renderPassBeginInfo.renderArea.extent.width = dim;
-	renderPassBeginInfo.renderArea.extent.height = dim;
-	renderPassBeginInfo.clearValueCount = 1;
-	renderPassBeginInfo.pClearValues = clearValues;
-
-	std::vector<glm::mat4> matrices = {
+	const std::array<glm::mat4, 6> matrices = {
 		// POSITIVE_X
 		glm::rotate(glm::rotate(glm::mat4(1.0f), glm::radians(90.0f), glm::vec3(0.0f, 1.0f, 0.0f)), glm::radians(180.0f), glm::vec3(1.0f, 0.0f, 0.0f)),
 		// NEGATIVE_X
@@ -615,496 +567,307 @@ void vkUtils::generateIrradianceCube(vks::TextureCubeMap& irradianceCube, vks::T
 		glm::rotate(glm::mat4(1.0f), glm::radians(180.0f), glm::vec3(0.0f, 0.0f, 1.0f)),
 	};
 
-	VkCommandBuffer cmdBuf = vkEngine->vulkanDevice->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
-
-	VkViewport viewport = vks::initializers::viewport((float)dim, (float)dim, 0.0f, 1.0f);
-	VkRect2D scissor = vks::initializers::rect2D(dim, dim, 0, 0);
-
-	vkCmdSetViewport(cmdBuf, 0, 1, &viewport);
-	vkCmdSetScissor(cmdBuf, 0, 1, &scissor);
-
-	VkImageSubresourceRange subresourceRange = {};
-	subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-	subresourceRange.baseMipLevel = 0;
-	subresourceRange.levelCount = numMips;
-	subresourceRange.layerCount = 6;
-
-	// Change image layout for all cubemap faces to transfer destination
-	vks::tools::setImageLayout(
-		cmdBuf,
-		irradianceCube.image,
-		VK_IMAGE_LAYOUT_UNDEFINED,
-		VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-		subresourceRange);
-
+	// 每个 mip 渲染到与其大小相同的临时图像再复制到立方体贴图的对应面，各 mip 的临时图像生存期互不重叠，
+	// 由渲染图放在同一块内存中；渲染区域只覆盖当前 mip，不再每个面都清除整张 mip 0 大小的图像
+	RenderGraph graph(vkEngine->vulkanDevice, vkEngine->synchronization2Supported);
+	// 纹理不记录格式，只读的导入图像只用到 mip 与层数
+	const RenderGraphImage environment = graph.importImage("environmentCube", environmentCube.image, environmentCube.view,
+		{ VK_FORMAT_UNDEFINED, environmentCube.width, environmentCube.height, environmentCube.mipLevels, environmentCube.layerCount, VK_IMAGE_CREATE_CUBE_COMPATIBLE_BIT }, environmentCube.imageLayout);
+	const RenderGraphImage cube = graph.importImage("prefilteredCube", prefilteredCube.image, prefilteredCube.view,
+		{ format, static_cast<uint32_t>(dim), static_cast<uint32_t>(dim), numMips, 6, VK_IMAGE_CREATE_CUBE_COMPATIBLE_BIT });
+	graph.setFinalUsage(cube, RenderGraphUsage::SampledFragment);
+
+	std::vector<RenderGraphImage> offscreen(numMips);
+	// 临时图像在编译后才创建，帧缓冲在编译后按 mip 创建(动态渲染时直接使用临时图像的视图)
+	std::vector<VkFramebuffer> framebuffers(numMips, VK_NULL_HANDLE);
+	uint64_t totalSamples = 0;
 	for (uint32_t m = 0; m < numMips; m++) {
-		for (uint32_t f = 0; f < 6; f++) {
-			viewport.width = static_cast<float>(dim * std::pow(0.5f, m));
-			viewport.height = static_cast<float>(dim * std::pow(0.5f, m));
-			vkCmdSetViewport(cmdBuf, 0, 1, &viewport);
+		const uint32_t mipDim = std::max(1u, static_cast<uint32_t>(dim) >> m);
+		offscreen[m] = graph.createImage("prefilterOffscreen", { format, mipDim, mipDim });
 
+		PrefilterPushBlock pushBlock{};
+		pushBlock.filtered = settings.filteredSampling ? 1 : 0;
+		pushBlock.lodBias = settings.lodBias;
+		pushBlock.roughness = (float)m / (float)(numMips - 1);
+		pushBlock.numSamples = settings.sampleCount(m);
+		totalSamples += static_cast<uint64_t>(mipDim) * mipDim * 6 * pushBlock.numSamples;
+		for (uint32_t f = 0; f < 6; f++) {
 			// Render scene from cube face's point of view
-			vkCmdBeginRenderPass(cmdBuf, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
-
-			// Update shader push constant block
 			pushBlock.mvp = glm::perspective((float)(M_PI / 2.0), 1.0f, 0.1f, 512.0f) * matrices[f];
-
-			vkCmdPushConstants(cmdBuf, pipelinelayout, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(PushBlock), &pushBlock);
-
-			vkCmdBindPipeline(cmdBuf, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
-			vkCmdBindDescriptorSets(cmdBuf, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelinelayout, 0, 1, &descriptorset, 0, NULL);
-
-			vkEngine->models.skybox.draw(cmdBuf);
-
-			vkCmdEndRenderPass(cmdBuf);
-
-			vks::tools::setImageLayout(
-				cmdBuf,
-				offscreen.image,
-				VK_IMAGE_ASPECT_COLOR_BIT,
-				VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
-				VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL);
+			graph.addPass("Prefilter face", [&, m, mipDim, pushBlock](VkCommandBuffer cmdBuf, const RenderGraph&) {
+				cmdBeginOffscreenRendering(cmdBuf, iblPipelines.prefilterRenderPass, framebuffers[m], graph.getView(offscreen[m]), mipDim, mipDim, { { 0.0f, 0.0f, 0.2f, 0.0f } });
+				VkViewport viewport = vks::initializers::viewport((float)mipDim, (float)mipDim, 0.0f, 1.0f);
+				VkRect2D scissor = vks::initializers::rect2D(mipDim, mipDim, 0, 0);
+				vkCmdSetViewport(cmdBuf, 0, 1, &viewport);
+				vkCmdSetScissor(cmdBuf, 0, 1, &scissor);
+				vkCmdPushConstants(cmdBuf, iblPipelines.prefilterLayout, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(pushBlock), &pushBlock);
+				vkCmdBindPipeline(cmdBuf, VK_PIPELINE_BIND_POINT_GRAPHICS, iblPipelines.prefilter);
+				vkCmdBindDescriptorSets(cmdBuf, VK_PIPELINE_BIND_POINT_GRAPHICS, iblPipelines.prefilterLayout, 0, 1, &descriptorset, 0, NULL);
+				vkEngine->models.skybox.draw(cmdBuf);
+				cmdEndOffscreenRendering(cmdBuf);
+			}).write(offscreen[m], RenderGraphUsage::ColorAttachment).read(environment, RenderGraphUsage::SampledFragment);
 
 			// Copy region for transfer from framebuffer to cube face
-			VkImageCopy copyRegion = {};
-
-			copyRegion.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-			copyRegion.srcSubresource.baseArrayLayer = 0;
-			copyRegion.srcSubresource.mipLevel = 0;
-			copyRegion.srcSubresource.layerCount = 1;
-			copyRegion.srcOffset = { 0, 0, 0 };
-
-			copyRegion.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-			copyRegion.dstSubresource.baseArrayLayer = f;
-			copyRegion.dstSubresource.mipLevel = m;
-			copyRegion.dstSubresource.layerCount = 1;
-			copyRegion.dstOffset = { 0, 0, 0 };
-
-			copyRegion.extent.width = static_cast<uint32_t>(viewport.width);
-			copyRegion.extent.height = static_cast<uint32_t>(viewport.height);
-			copyRegion.extent.depth = 1;
-
-			vkCmdCopyImage(
-				cmdBuf,
-				offscreen.image,
-				VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-				irradianceCube.image,
-				VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-				1,
-				&copyRegion);
-
-			// Transform framebuffer color attachment back
-			vks::tools::setImageLayout(
-				cmdBuf,
-				offscreen.image,
-				VK_IMAGE_ASPECT_COLOR_BIT,
-				VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-				VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
+			graph.addPass("Copy to cube face", [&, m, f, mipDim](VkCommandBuffer cmdBuf, const RenderGraph&) {
+				VkImageCopy copyRegion = {};
+				copyRegion.srcSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+				copyRegion.dstSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, m, f, 1 };
+				copyRegion.extent = { mipDim, mipDim, 1 };
+				vkCmdCopyImage(cmdBuf, graph.getImage(offscreen[m]), VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, prefilteredCube.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &copyRegion);
+			}).read(offscreen[m], RenderGraphUsage::TransferSrc).write(cube, RenderGraphUsage::TransferDst, m, 1, f, 1);
 		}
 	}
+	graph.compile();
 
-	vks::tools::setImageLayout(
-		cmdBuf,
-		irradianceCube.image,
-		VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-		VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-		subresourceRange);
+	for (uint32_t m = 0; m < numMips && !vkEngine->dynamicRendering; m++) {
+		const VkImageView view = graph.getView(offscreen[m]);
+		VkFramebufferCreateInfo fbufCreateInfo = vks::initializers::framebufferCreateInfo();
+		fbufCreateInfo.renderPass = iblPipelines.prefilterRenderPass;
+		fbufCreateInfo.attachmentCount = 1;
+		fbufCreateInfo.pAttachments = &view;
+		fbufCreateInfo.width = graph.getDesc(offscreen[m]).width;
+		fbufCreateInfo.height = graph.getDesc(offscreen[m]).height;
+		fbufCreateInfo.layers = 1;
+		VK_CHECK_RESULT(vkCreateFramebuffer(vkEngine->device, &fbufCreateInfo, nullptr, &framebuffers[m]));
+	}
 
+	VkCommandBuffer cmdBuf = vkEngine->vulkanDevice->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+	cmdBeginLabel(cmdBuf, "IBL", { 1.0f, 1.0f, 1.0f, 1.0f });
+	graph.execute(cmdBuf);
+	cmdEndLabel(cmdBuf);
 	vkEngine->vulkanDevice->flushCommandBuffer(cmdBuf, vkEngine->queue);
+	vkEngine->gpuProfiler.resolveImmediate();
 
-	vkDestroyRenderPass(vkEngine->device, renderpass, nullptr);
-	vkDestroyFramebuffer(vkEngine->device, offscreen.framebuffer, nullptr);
-	vkFreeMemory(vkEngine->device, offscreen.memory, nullptr);
-	vkDestroyImageView(vkEngine->device, offscreen.view, nullptr);
-	vkDestroyImage(vkEngine->device, offscreen.image, nullptr);
+	const RenderGraph::Statistics& statistics = graph.getStatistics();
+	for (VkFramebuffer framebuffer : framebuffers) {
+		vkDestroyFramebuffer(vkEngine->device, framebuffer, nullptr);
+	}
+	graph.destroy();
 	vkDestroyDescriptorPool(vkEngine->device, descriptorpool, nullptr);
-	vkDestroyDescriptorSetLayout(vkEngine->device, descriptorsetlayout, nullptr);
-	vkDestroyPipeline(vkEngine->device, pipeline, nullptr);
-	vkDestroyPipelineLayout(vkEngine->device, pipelinelayout, nullptr);
 
-	setObjectDebugName(VK_OBJECT_TYPE_IMAGE, (uint64_t)irradianceCube.image, "irradianceCube");
+	vkUtils::setObjectDebugName(VK_OBJECT_TYPE_IMAGE, (uint64_t)prefilteredCube.image, "prefilteredCube");
 	auto tEnd = std::chrono::high_resolution_clock::now();
 	auto tDiff = std::chrono::duration<double, std::milli>(tEnd - tStart).count();
-	std::cout << "Generating irradiance cube with " << numMips << " mip levels took " << tDiff << " ms" << std::endl;
+	std::cout << "Generating pre-filtered enivornment cube with " << numMips << " mip levels (" << totalSamples << " samples) took " << tDiff << " ms" << std::endl;
+	std::cout << "  render graph: " << statistics.passes << " passes, " << statistics.barrierBatches << " barrier batches, transient memory "
+		<< statistics.transientMemory / 1024 << " KB (" << statistics.unaliasedTransientMemory / 1024 << " KB without aliasing)" << std::endl;
 }
 
-void vkUtils::generatePrefilteredCube(vks::TextureCubeMap& prefilteredCube, vks::TextureCubeMap& environmentCube)
+void vkUtils::generateIrradianceSH(const std::string& environmentFile, std::array<glm::vec4, 9>& coefficients)
 {
-	if (!init)
-		return;
 	auto tStart = std::chrono::high_resolution_clock::now();
+	coefficients = {};
+	// 只解码投影用到的 mip，环境贴图读取失败时系数保持为零(没有漫反射环境光)
+	IBLBaker baker;
+	if (baker.loadEnvironment(environmentFile, ibl::parameters.shProjectionDim)) {
+		baker.projectIrradianceSH();
+		coefficients = baker.getIrradianceSH();
+	}
+	auto tEnd = std::chrono::high_resolution_clock::now();
+	auto tDiff = std::chrono::duration<double, std::milli>(tEnd - tStart).count();
+	std::cout << "Projecting irradiance to spherical harmonics took " << tDiff << " ms" << std::endl;
+}
 
-	const VkFormat format = VK_FORMAT_R16G16B16A16_SFLOAT;
-	const int32_t dim = 512;
-	const uint32_t numMips = static_cast<uint32_t>(floor(log2(dim))) + 1;
-
-	// Pre-filtered cube map
-	// Image
-	VkImageCreateInfo imageCI = vks::initializers::imageCreateInfo();
-	imageCI.imageType = VK_IMAGE_TYPE_2D;
-	imageCI.format = format;
-	imageCI.extent.width = dim;
-	imageCI.extent.height = dim;
-	imageCI.extent.depth = 1;
-	imageCI.mipLevels = numMips;
-	imageCI.arrayLayers = 6;
-	imageCI.samples = VK_SAMPLE_COUNT_1_BIT;
-	imageCI.tiling = VK_IMAGE_TILING_OPTIMAL;
-	imageCI.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
-	imageCI.flags = VK_IMAGE_CREATE_CUBE_COMPATIBLE_BIT;
-	VK_CHECK_RESULT(vkCreateImage(vkEngine->device, &imageCI, nullptr, &prefilteredCube.image));
-	VkMemoryAllocateInfo memAlloc = vks::initializers::memoryAllocateInfo();
-	VkMemoryRequirements memReqs;
-	vkGetImageMemoryRequirements(vkEngine->device, prefilteredCube.image, &memReqs);
-	memAlloc.allocationSize = memReqs.size;
-	memAlloc.memoryTypeIndex = vkEngine->vulkanDevice->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-	VK_CHECK_RESULT(vkAllocateMemory(vkEngine->device, &memAlloc, nullptr, &prefilteredCube.deviceMemory));
-	VK_CHECK_RESULT(vkBindImageMemory(vkEngine->device, prefilteredCube.image, prefilteredCube.deviceMemory, 0));
-	// Image view
-	VkImageViewCreateInfo viewCI = vks::initializers::imageViewCreateInfo();
-	viewCI.viewType = VK_IMAGE_VIEW_TYPE_CUBE;
-	viewCI.format = format;
-	viewCI.subresourceRange = {};
-	viewCI.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-	viewCI.subresourceRange.levelCount = numMips;
-	viewCI.subresourceRange.layerCount = 6;
-	viewCI.image = prefilteredCube.image;
-	VK_CHECK_RESULT(vkCreateImageView(vkEngine->device, &viewCI, nullptr, &prefilteredCube.view));
-	// Sampler
-	VkSamplerCreateInfo samplerCI = vks::initializers::samplerCreateInfo();
-	samplerCI.magFilter = VK_FILTER_LINEAR;
-	samplerCI.minFilter = VK_FILTER_LINEAR;
-	samplerCI.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
-	samplerCI.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
-	samplerCI.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
-	samplerCI.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
-	samplerCI.minLod = 0.0f;
-	samplerCI.maxLod = static_cast<float>(numMips);
-	samplerCI.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
-	VK_CHECK_RESULT(vkCreateSampler(vkEngine->device, &samplerCI, nullptr, &prefilteredCube.sampler));
-
-	prefilteredCube.descriptor.imageView = prefilteredCube.view;
-	prefilteredCube.descriptor.sampler = prefilteredCube.sampler;
-	prefilteredCube.descriptor.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-	prefilteredCube.device = vkEngine->vulkanDevice;
-
-	// FB, Att, RP, Pipe, etc.
-	VkAttachmentDescription attDesc = {};
-	// Color attachment
-	attDesc.format = format;
-	attDesc.samples = VK_SAMPLE_COUNT_1_BIT;
-	attDesc.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-	attDesc.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
-	attDesc.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-	attDesc.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-	attDesc.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-	attDesc.finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
-	VkAttachmentReference colorReference = { 0, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL };
-
-	VkSubpassDescription subpassDescription = {};
-	subpassDescription.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
-	subpassDescription.colorAttachmentCount = 1;
-	subpassDescription.pColorAttachments = &colorReference;
+bool vkUtils::computeIBLSupported()
+{
+	if (!init)
+		return false;
+	// RG16F 属于扩展存储格式，需要启用 shaderStorageImageExtendedFormats
+	if (!vkEngine->enabledFeatures.shaderStorageImageExtendedFormats)
+		return false;
+	for (VkFormat format : { lutFormat, prefilteredFormat }) {
+		VkFormatProperties formatProperties;
+		vkGetPhysicalDeviceFormatProperties(vkEngine->physicalDevice, format, &formatProperties);
+		if (!(formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_STORAGE_IMAGE_BIT))
+			return false;
+	}
+	return true;
+}
 
-	// Use subpass dependencies for layout transitions
-	std::array<VkSubpassDependency, 2> dependencies{};
-	dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
-	dependencies[0].dstSubpass = 0;
-	dependencies[0].srcStageMask = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
-	dependencies[0].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-	dependencies[0].srcAccessMask = VK_ACCESS_MEMORY_READ_BIT;
-	dependencies[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-	dependencies[0].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
-	dependencies[1].srcSubpass = 0;
-	dependencies[1].dstSubpass = VK_SUBPASS_EXTERNAL;
-	dependencies[1].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-	dependencies[1].dstStageMask = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
-	dependencies[1].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-	dependencies[1].dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
-	dependencies[1].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
-
-	// Renderpass
-	VkRenderPassCreateInfo renderPassCI = vks::initializers::renderPassCreateInfo();
-	renderPassCI.attachmentCount = 1;
-	renderPassCI.pAttachments = &attDesc;
-	renderPassCI.subpassCount = 1;
-	renderPassCI.pSubpasses = &subpassDescription;
-	renderPassCI.dependencyCount = 2;
-	renderPassCI.pDependencies = dependencies.data();
-	VkRenderPass renderpass;
-	VK_CHECK_RESULT(vkCreateRenderPass(vkEngine->device, &renderPassCI, nullptr, &renderpass));
+void vkUtils::generateIBL(vks::Texture2D& lutBrdf, vks::TextureCubeMap& prefilteredCube, vks::TextureCubeMap& environmentCube)
+{
+	if (computeIBLSupported()) {
+		generateIBLCompute(lutBrdf, prefilteredCube, environmentCube, ibl::prefilterSettings);
+		return;
+	}
+	generateBRDFLUT(lutBrdf);
+	generatePrefilteredCube(prefilteredCube, environmentCube, ibl::prefilterSettings);
+}
 
-	struct {
-		VkImage image;
+void vkUtils::generateIBLCompute(vks::Texture2D& lutBrdf, vks::TextureCubeMap& prefilteredCube, vks::TextureCubeMap& environmentCube, const ibl::PrefilterSettings& settings)
+{
+	if (!init)
+		return;
+	prepareIBLComputePipelines();
+	auto tStart = std::chrono::high_resolution_clock::now();
+	VkDevice device = vkEngine->device;
+
+	const uint32_t prefilteredMips = mipLevelCount(iblParameters.prefilteredDim);
+	const VkImageUsageFlags usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+	createIBLTarget(lutBrdf, lutFormat, iblParameters.lutDim, 1, 1, usage);
+	createIBLTarget(prefilteredCube, prefilteredFormat, iblParameters.prefilteredDim, prefilteredMips, 6, usage);
+
+	// 每个 mip 一个存储视图，以 2D 数组的形式覆盖 6 个面
+	std::vector<VkImageView> storageViews;
+	auto createStorageView = [&](VkImage image, VkFormat format, uint32_t mipLevel, uint32_t layers) {
+		VkImageViewCreateInfo viewCI = vks::initializers::imageViewCreateInfo();
+		viewCI.viewType = layers == 6 ? VK_IMAGE_VIEW_TYPE_2D_ARRAY : VK_IMAGE_VIEW_TYPE_2D;
+		viewCI.format = format;
+		viewCI.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, mipLevel, 1, 0, layers };
+		viewCI.image = image;
 		VkImageView view;
-		VkDeviceMemory memory;
-		VkFramebuffer framebuffer;
-	} offscreen{};
-
-	// Offfscreen framebuffer
-	{
-		// Color attachment
-		VkImageCreateInfo imageCreateInfo = vks::initializers::imageCreateInfo();
-		imageCreateInfo.imageType = VK_IMAGE_TYPE_2D;
-		imageCreateInfo.format = format;
-		imageCreateInfo.extent.width = dim;
-		imageCreateInfo.extent.height = dim;
-		imageCreateInfo.extent.depth = 1;
-		imageCreateInfo.mipLevels = 1;
-		imageCreateInfo.arrayLayers = 1;
-		imageCreateInfo.samples = VK_SAMPLE_COUNT_1_BIT;
-		imageCreateInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
-		imageCreateInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-		imageCreateInfo.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
-		imageCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-		VK_CHECK_RESULT(vkCreateImage(vkEngine->device, &imageCreateInfo, nullptr, &offscreen.image));
-
-		VkMemoryAllocateInfo memAlloc = vks::initializers::memoryAllocateInfo();
-		VkMemoryRequirements memReqs;
-		vkGetImageMemoryRequirements(vkEngine->device, offscreen.image, &memReqs);
-		memAlloc.allocationSize = memReqs.size;
-		memAlloc.memoryTypeIndex = vkEngine->vulkanDevice->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-		VK_CHECK_RESULT(vkAllocateMemory(vkEngine->device, &memAlloc, nullptr, &offscreen.memory));
-		VK_CHECK_RESULT(vkBindImageMemory(vkEngine->device, offscreen.image, offscreen.memory, 0));
-
-		VkImageViewCreateInfo colorImageView = vks::initializers::imageViewCreateInfo();
-		colorImageView.viewType = VK_IMAGE_VIEW_TYPE_2D;
-		colorImageView.format = format;
-		colorImageView.flags = 0;
-		colorImageView.subresourceRange = {};
-		colorImageView.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-		colorImageView.subresourceRange.baseMipLevel = 0;
-		colorImageView.subresourceRange.levelCount = 1;
-		colorImageView.subresourceRange.baseArrayLayer = 0;
-		colorImageView.subresourceRange.layerCount = 1;
-		colorImageView.image = offscreen.image;
-		VK_CHECK_RESULT(vkCreateImageView(vkEngine->device, &colorImageView, nullptr, &offscreen.view));
-
-		VkFramebufferCreateInfo fbufCreateInfo = vks::initializers::framebufferCreateInfo();
-		fbufCreateInfo.renderPass = renderpass;
-		fbufCreateInfo.attachmentCount = 1;
-		fbufCreateInfo.pAttachments = &offscreen.view;
-		fbufCreateInfo.width = dim;
-		fbufCreateInfo.height = dim;
-		fbufCreateInfo.layers = 1;
-		VK_CHECK_RESULT(vkCreateFramebuffer(vkEngine->device, &fbufCreateInfo, nullptr, &offscreen.framebuffer));
-
-		VkCommandBuffer layoutCmd = vkEngine->vulkanDevice->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
-		vks::tools::setImageLayout(
-			layoutCmd,
-			offscreen.image,
-			VK_IMAGE_ASPECT_COLOR_BIT,
-			VK_IMAGE_LAYOUT_UNDEFINED,
-			VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
-		vkEngine->vulkanDevice->flushCommandBuffer(layoutCmd, vkEngine->queue, true);
-	}
+		VK_CHECK_RESULT(vkCreateImageView(device, &viewCI, nullptr, &view));
+		storageViews.push_back(view);
+		return view;
+	};
 
 	// Descriptors
-	VkDescriptorSetLayout descriptorsetlayout;
-	std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings = {
-		vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT, 0),
+	const uint32_t setCount = 1 + prefilteredMips;
+	std::vector<VkDescriptorPoolSize> poolSizes = {
+		vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, prefilteredMips),
+		vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, setCount),
 	};
-	VkDescriptorSetLayoutCreateInfo descriptorsetlayoutCI = vks::initializers::descriptorSetLayoutCreateInfo(setLayoutBindings);
-	VK_CHECK_RESULT(vkCreateDescriptorSetLayout(vkEngine->device, &descriptorsetlayoutCI, nullptr, &descriptorsetlayout));
-
-	// Descriptor Pool
-	std::vector<VkDescriptorPoolSize> poolSizes = { vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1) };
-	VkDescriptorPoolCreateInfo descriptorPoolCI = vks::initializers::descriptorPoolCreateInfo(poolSizes, 2);
-	VkDescriptorPool descriptorpool;
-	VK_CHECK_RESULT(vkCreateDescriptorPool(vkEngine->device, &descriptorPoolCI, nullptr, &descriptorpool));
-
-	// Descriptor sets
-	VkDescriptorSet descriptorset;
-	VkDescriptorSetAllocateInfo allocInfo = vks::initializers::descriptorSetAllocateInfo(descriptorpool, &descriptorsetlayout, 1);
-	VK_CHECK_RESULT(vkAllocateDescriptorSets(vkEngine->device, &allocInfo, &descriptorset));
-	VkWriteDescriptorSet writeDescriptorSet = vks::initializers::writeDescriptorSet(descriptorset, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 0, &environmentCube.descriptor);
-	vkUpdateDescriptorSets(vkEngine->device, 1, &writeDescriptorSet, 0, nullptr);
-
-	// Pipeline layout
-	struct PushBlock {
-		glm::mat4 mvp;
-		float roughness;
-		uint32_t numSamples = 32u;
-	}pushBlock{};
-
-	VkPipelineLayout pipelinelayout;
-	std::vector<VkPushConstantRange> pushConstantRanges = {
-		vks::initializers::pushConstantRange(VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, sizeof(PushBlock), 0),
+	VkDescriptorPoolCreateInfo descriptorPoolCI = vks::initializers::descriptorPoolCreateInfo(poolSizes, setCount);
+	VkDescriptorPool descriptorPool;
+	VK_CHECK_RESULT(vkCreateDescriptorPool(device, &descriptorPoolCI, nullptr, &descriptorPool));
+
+	auto allocateSet = [&](VkDescriptorSetLayout setLayout, VkImageView storageView, bool withEnvironment) {
+		VkDescriptorSet descriptorSet;
+		VkDescriptorSetAllocateInfo allocInfo = vks::initializers::descriptorSetAllocateInfo(descriptorPool, &setLayout, 1);
+		VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &allocInfo, &descriptorSet));
+		VkDescriptorImageInfo storageImage = { VK_NULL_HANDLE, storageView, VK_IMAGE_LAYOUT_GENERAL };
+		std::vector<VkWriteDescriptorSet> writeDescriptorSets;
+		if (withEnvironment) {
+			writeDescriptorSets.push_back(vks::initializers::writeDescriptorSet(descriptorSet, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 0, &environmentCube.descriptor));
+		}
+		writeDescriptorSets.push_back(vks::initializers::writeDescriptorSet(descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, withEnvironment ? 1 : 0, &storageImage));
+		vkUpdateDescriptorSets(device, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, nullptr);
+		return descriptorSet;
 	};
-	VkPipelineLayoutCreateInfo pipelineLayoutCI = vks::initializers::pipelineLayoutCreateInfo(&descriptorsetlayout, 1);
-	pipelineLayoutCI.pushConstantRangeCount = 1;
-	pipelineLayoutCI.pPushConstantRanges = pushConstantRanges.data();
-	VK_CHECK_RESULT(vkCreatePipelineLayout(vkEngine->device, &pipelineLayoutCI, nullptr, &pipelinelayout));
-
-	// Pipeline
-	VkPipelineInputAssemblyStateCreateInfo inputAssemblyState = vks::initializers::pipelineInputAssemblyStateCreateInfo(VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST, 0, VK_FALSE);
-	VkPipelineRasterizationStateCreateInfo rasterizationState = vks::initializers::pipelineRasterizationStateCreateInfo(VK_POLYGON_MODE_FILL, VK_CULL_MODE_NONE, VK_FRONT_FACE_COUNTER_CLOCKWISE);
-	VkPipelineColorBlendAttachmentState blendAttachmentState = vks::initializers::pipelineColorBlendAttachmentState(0xf, VK_FALSE);
-	VkPipelineColorBlendStateCreateInfo colorBlendState = vks::initializers::pipelineColorBlendStateCreateInfo(1, &blendAttachmentState);
-	VkPipelineDepthStencilStateCreateInfo depthStencilState = vks::initializers::pipelineDepthStencilStateCreateInfo(VK_FALSE, VK_FALSE, VK_COMPARE_OP_LESS_OR_EQUAL);
-	VkPipelineViewportStateCreateInfo viewportState = vks::initializers::pipelineViewportStateCreateInfo(1, 1);
-	VkPipelineMultisampleStateCreateInfo multisampleState = vks::initializers::pipelineMultisampleStateCreateInfo(VK_SAMPLE_COUNT_1_BIT);
-	std::vector<VkDynamicState> dynamicStateEnables = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
-	VkPipelineDynamicStateCreateInfo dynamicState = vks::initializers::pipelineDynamicStateCreateInfo(dynamicStateEnables);
-	std::array<VkPipelineShaderStageCreateInfo, 2> shaderStages{};
-
-	VkGraphicsPipelineCreateInfo pipelineCI = vks::initializers::pipelineCreateInfo(pipelinelayout, renderpass);
-	pipelineCI.pInputAssemblyState = &inputAssemblyState;
-	pipelineCI.pRasterizationState = &rasterizationState;
-	pipelineCI.pColorBlendState = &colorBlendState;
-	pipelineCI.pMultisampleState = &multisampleState;
-	pipelineCI.pViewportState = &viewportState;
-	pipelineCI.pDepthStencilState = &depthStencilState;
-	pipelineCI.pDynamicState = &dynamicState;
-	pipelineCI.stageCount = 2;
-	pipelineCI.pStages = shaderStages.data();
-	pipelineCI.renderPass = renderpass;
-	pipelineCI.pVertexInputState = vkglTF::Vertex::getPipelineVertexInputState({ vkglTF::VertexComponent::Position, vkglTF::VertexComponent::Normal, vkglTF::VertexComponent::UV });
-
-	shaderStages[0] = vkEngine->loadShader(vkEngine->getShadersPath() + "filtercube.vert.spv", VK_SHADER_STAGE_VERTEX_BIT);
-	shaderStages[1] = vkEngine->loadShader(vkEngine->getShadersPath() + "prefilterenvmap.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT);
-	VkPipeline pipeline;
-	VK_CHECK_RESULT(vkCreateGraphicsPipelines(vkEngine->device, vkEngine->pipelineCache, 1, &pipelineCI, nullptr, &pipeline));
-
-	// Render
-
-	VkClearValue clearValues[1]{};
-	clearValues[0].color = { { 0.0f, 0.0f, 0.2f, 0.0f } };
 
-	VkRenderPassBeginInfo renderPassBeginInfo = vks::initializers::renderPassBeginInfo();
-	// Reuse render pass from example pass
-	renderPassBeginInfo.renderPass = renderpass;
-	renderPassBeginInfo.framebuffer = offscreen.framebuffer;
-	renderPassBeginInfo.renderArea.extent.width = dim;
-	renderPassBeginInfo.renderArea.extent.height = dim;
-	renderPassBeginInfo.clearValueCount = 1;
-	renderPassBeginInfo.pClearValues = clearValues;
+	const VkDescriptorSet lutSet = allocateSet(iblPipelines.lutStorageSetLayout, createStorageView(lutBrdf.image, lutFormat, 0, 1), false);
+	std::vector<VkDescriptorSet> prefilteredSets(prefilteredMips);
+	for (uint32_t m = 0; m < prefilteredMips; m++) {
+		prefilteredSets[m] = allocateSet(iblPipelines.filterStorageSetLayout, createStorageView(prefilteredCube.image, prefilteredFormat, m, 6), true);
+	}
 
-	std::vector<glm::mat4> matrices = {
-		// POSITIVE_X
-		glm::rotate(glm::rotate(glm::mat4(1.0f), glm::radians(90.0f), glm::vec3(0.0f, 1.0f, 0.0f)), glm::radians(180.0f), glm::vec3(1.0f, 0.0f, 0.0f)),
-		// NEGATIVE_X
-		glm::rotate(glm::rotate(glm::mat4(1.0f), glm::radians(-90.0f), glm::vec3(0.0f, 1.0f, 0.0f)), glm::radians(180.0f), glm::vec3(1.0f, 0.0f, 0.0f)),
-		// POSITIVE_Y
-		glm::rotate(glm::mat4(1.0f), glm::radians(-90.0f), glm::vec3(1.0f, 0.0f, 0.0f)),
-		// NEGATIVE_Y
-		glm::rotate(glm::mat4(1.0f), glm::radians(90.0f), glm::vec3(1.0f, 0.0f, 0.0f)),
-		// POSITIVE_Z
-		glm::rotate(glm::mat4(1.0f), glm::radians(180.0f), glm::vec3(1.0f, 0.0f, 0.0f)),
-		// NEGATIVE_Z
-		glm::rotate(glm::mat4(1.0f), glm::radians(180.0f), glm::vec3(0.0f, 0.0f, 1.0f)),
-	};
+	auto groupCount = [](uint32_t dim) { return (dim + 7) / 8; };
+
+	// 两张结果图像在一个命令缓冲中生成，只提交并等待一次
+	// 各 mip 写入不同的子资源，渲染图不会在 dispatch 之间插入屏障；初始与最终的布局转换各合并为一批
+	RenderGraph graph(vkEngine->vulkanDevice, vkEngine->synchronization2Supported);
+	const RenderGraphImage lut = graph.importImage("LutBRDF", lutBrdf.image, lutBrdf.view, { lutFormat, iblParameters.lutDim, iblParameters.lutDim });
+	const RenderGraphImage cube = graph.importImage("prefilteredCube", prefilteredCube.image, prefilteredCube.view,
+		{ prefilteredFormat, iblParameters.prefilteredDim, iblParameters.prefilteredDim, prefilteredMips, 6, VK_IMAGE_CREATE_CUBE_COMPATIBLE_BIT });
+	// 纹理不记录格式，只读的导入图像只用到 mip 与层数
+	const RenderGraphImage environment = graph.importImage("environmentCube", environmentCube.image, environmentCube.view,
+		{ VK_FORMAT_UNDEFINED, environmentCube.width, environmentCube.height, environmentCube.mipLevels, environmentCube.layerCount, VK_IMAGE_CREATE_CUBE_COMPATIBLE_BIT }, environmentCube.imageLayout);
+	graph.setFinalUsage(lut, RenderGraphUsage::SampledFragment);
+	graph.setFinalUsage(cube, RenderGraphUsage::SampledFragment);
+
+	// BRDF LUT
+	graph.addPass("BRDF LUT", [&](VkCommandBuffer cmdBuf, const RenderGraph&) {
+		vkCmdBindPipeline(cmdBuf, VK_PIPELINE_BIND_POINT_COMPUTE, iblPipelines.lutCompute);
+		vkCmdBindDescriptorSets(cmdBuf, VK_PIPELINE_BIND_POINT_COMPUTE, iblPipelines.lutComputeLayout, 0, 1, &lutSet, 0, nullptr);
+		vkCmdDispatch(cmdBuf, groupCount(iblParameters.lutDim), groupCount(iblParameters.lutDim), 1);
+	}).write(lut, RenderGraphUsage::Storage);
+
+	// Pre-filtered cube，粗糙度随 mip 线性增加
+	for (uint32_t m = 0; m < prefilteredMips; m++) {
+		const uint32_t mipDim = std::max(1u, iblParameters.prefilteredDim >> m);
+		PrefilterComputePushBlock prefilterPushBlock{};
+		prefilterPushBlock.filtered = settings.filteredSampling ? 1 : 0;
+		prefilterPushBlock.lodBias = settings.lodBias;
+		prefilterPushBlock.roughness = (float)m / (float)(prefilteredMips - 1);
+		prefilterPushBlock.numSamples = settings.sampleCount(m);
+		graph.addPass("Prefilter mip", [&, m, mipDim, prefilterPushBlock](VkCommandBuffer cmdBuf, const RenderGraph&) {
+			vkCmdBindPipeline(cmdBuf, VK_PIPELINE_BIND_POINT_COMPUTE, iblPipelines.prefilterCompute);
+			vkCmdPushConstants(cmdBuf, iblPipelines.prefilterComputeLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(prefilterPushBlock), &prefilterPushBlock);
+			vkCmdBindDescriptorSets(cmdBuf, VK_PIPELINE_BIND_POINT_COMPUTE, iblPipelines.prefilterComputeLayout, 0, 1, &prefilteredSets[m], 0, nullptr);
+			vkCmdDispatch(cmdBuf, groupCount(mipDim), groupCount(mipDim), 6);
+		}).write(cube, RenderGraphUsage::Storage, m, 1, 0, 6).read(environment, RenderGraphUsage::SampledCompute);
+	}
+	graph.compile();
 
 	VkCommandBuffer cmdBuf = vkEngine->vulkanDevice->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+	cmdBeginLabel(cmdBuf, "IBL", { 1.0f, 1.0f, 1.0f, 1.0f });
+	graph.execute(cmdBuf);
+	cmdEndLabel(cmdBuf);
+	vkEngine->vulkanDevice->flushCommandBuffer(cmdBuf, vkEngine->queue);
+	vkEngine->gpuProfiler.resolveImmediate();
 
-	VkViewport viewport = vks::initializers::viewport((float)dim, (float)dim, 0.0f, 1.0f);
-	VkRect2D scissor = vks::initializers::rect2D(dim, dim, 0, 0);
-
-	vkCmdSetViewport(cmdBuf, 0, 1, &viewport);
-	vkCmdSetScissor(cmdBuf, 0, 1, &scissor);
-
-	VkImageSubresourceRange subresourceRange = {};
-	subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-	subresourceRange.baseMipLevel = 0;
-	subresourceRange.levelCount = numMips;
-	subresourceRange.layerCount = 6;
-
-	// Change image layout for all cubemap faces to transfer destination
-	vks::tools::setImageLayout(
-		cmdBuf,
-		prefilteredCube.image,
-		VK_IMAGE_LAYOUT_UNDEFINED,
-		VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-		subresourceRange);
+	for (VkImageView view : storageViews) {
+		vkDestroyImageView(device, view, nullptr);
+	}
+	vkDestroyDescriptorPool(device, descriptorPool, nullptr);
 
-	for (uint32_t m = 0; m < numMips; m++) {
-		pushBlock.roughness = (float)m / (float)(numMips - 1);
-		for (uint32_t f = 0; f < 6; f++) {
-			viewport.width = static_cast<float>(dim * std::pow(0.5f, m));
-			viewport.height = static_cast<float>(dim * std::pow(0.5f, m));
-			vkCmdSetViewport(cmdBuf, 0, 1, &viewport);
+	setObjectDebugName(VK_OBJECT_TYPE_IMAGE, (uint64_t)lutBrdf.image, "LutBRDF");
+	setObjectDebugName(VK_OBJECT_TYPE_IMAGE, (uint64_t)prefilteredCube.image, "prefilteredCube");
+	auto tEnd = std::chrono::high_resolution_clock::now();
+	auto tDiff = std::chrono::duration<double, std::milli>(tEnd - tStart).count();
+	std::cout << "Generating IBL maps with compute shaders (" << 1 + prefilteredMips << " dispatches) took " << tDiff << " ms" << std::endl;
+}
 
-			// Render scene from cube face's point of view
-			vkCmdBeginRenderPass(cmdBuf, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+uint64_t vkUtils::iblCacheKey(const std::string& environmentFile)
+{
+	return ibl::cacheKey(environmentFile, computeIBLSupported());
+}
 
-			// Update shader push constant block
-			pushBlock.mvp = glm::perspective((float)(M_PI / 2.0), 1.0f, 0.1f, 512.0f) * matrices[f];
+bool vkUtils::loadIBLCache(const std::string& directory, uint64_t key, vks::Texture2D& lutBrdf, vks::TextureCubeMap& prefilteredCube)
+{
+	if (!init || directory.empty())
+		return false;
+	auto tStart = std::chrono::high_resolution_clock::now();
 
-			vkCmdPushConstants(cmdBuf, pipelinelayout, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(PushBlock), &pushBlock);
+	const std::array<ibl::CacheFile, 2> files = ibl::cacheFiles(directory, key);
+	// 只在所有文件都完整时使用缓存，避免混用不同批次的结果
+	for (const ibl::CacheFile& file : files) {
+		if (!vks::texturecache::isValid(file.fileName, file.info))
+			return false;
+	}
 
-			vkCmdBindPipeline(cmdBuf, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
-			vkCmdBindDescriptorSets(cmdBuf, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelinelayout, 0, 1, &descriptorset, 0, NULL);
+	lutBrdf.loadFromFile(files[0].fileName, lutFormat, vkEngine->vulkanDevice, vkEngine->queue);
+	prefilteredCube.loadFromFile(files[1].fileName, prefilteredFormat, vkEngine->vulkanDevice, vkEngine->queue);
 
-			vkEngine->models.skybox.draw(cmdBuf);
+	// Texture2D 默认使用重复寻址，LUT 需要钳制到边缘
+	vkDestroySampler(vkEngine->device, lutBrdf.sampler, nullptr);
+	VkSamplerCreateInfo samplerCI = vks::initializers::samplerCreateInfo();
+	samplerCI.magFilter = VK_FILTER_LINEAR;
+	samplerCI.minFilter = VK_FILTER_LINEAR;
+	samplerCI.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+	samplerCI.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerCI.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerCI.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerCI.minLod = 0.0f;
+	samplerCI.maxLod = 1.0f;
+	samplerCI.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
+	VK_CHECK_RESULT(vkCreateSampler(vkEngine->device, &samplerCI, nullptr, &lutBrdf.sampler));
+	lutBrdf.descriptor.sampler = lutBrdf.sampler;
 
-			vkCmdEndRenderPass(cmdBuf);
+	setObjectDebugName(VK_OBJECT_TYPE_IMAGE, (uint64_t)lutBrdf.image, "LutBRDF");
+	setObjectDebugName(VK_OBJECT_TYPE_IMAGE, (uint64_t)prefilteredCube.image, "prefilteredCube");
+	auto tEnd = std::chrono::high_resolution_clock::now();
+	auto tDiff = std::chrono::duration<double, std::milli>(tEnd - tStart).count();
+	std::cout << "Loaded IBL maps from cache \"" << directory << "\" took " << tDiff << " ms" << std::endl;
+	return true;
+}
 
-			vks::tools::setImageLayout(
-				cmdBuf,
-				offscreen.image,
-				VK_IMAGE_ASPECT_COLOR_BIT,
-				VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
-				VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL);
+void vkUtils::saveIBLCache(const std::string& directory, uint64_t key, vks::Texture2D& lutBrdf, vks::TextureCubeMap& prefilteredCube)
+{
+	if (!init || directory.empty())
+		return;
+	auto tStart = std::chrono::high_resolution_clock::now();
 
-			// Copy region for transfer from framebuffer to cube face
-			VkImageCopy copyRegion = {};
-
-			copyRegion.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-			copyRegion.srcSubresource.baseArrayLayer = 0;
-			copyRegion.srcSubresource.mipLevel = 0;
-			copyRegion.srcSubresource.layerCount = 1;
-			copyRegion.srcOffset = { 0, 0, 0 };
-
-			copyRegion.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-			copyRegion.dstSubresource.baseArrayLayer = f;
-			copyRegion.dstSubresource.mipLevel = m;
-			copyRegion.dstSubresource.layerCount = 1;
-			copyRegion.dstOffset = { 0, 0, 0 };
-
-			copyRegion.extent.width = static_cast<uint32_t>(viewport.width);
-			copyRegion.extent.height = static_cast<uint32_t>(viewport.height);
-			copyRegion.extent.depth = 1;
-
-			vkCmdCopyImage(
-				cmdBuf,
-				offscreen.image,
-				VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-				prefilteredCube.image,
-				VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-				1,
-				&copyRegion);
-
-			// Transform framebuffer color attachment back
-			vks::tools::setImageLayout(
-				cmdBuf,
-				offscreen.image,
-				VK_IMAGE_ASPECT_COLOR_BIT,
-				VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-				VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
-		}
+	const std::array<ibl::CacheFile, 2> files = ibl::cacheFiles(directory, key);
+	const std::array<VkImage, 2> images = { lutBrdf.image, prefilteredCube.image };
+	bool saved = true;
+	for (size_t i = 0; i < files.size() && saved; i++) {
+		saved = vks::texturecache::save(files[i].fileName, vkEngine->vulkanDevice, vkEngine->queue, images[i], VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, files[i].info);
 	}
+	if (!saved)
+		return;
 
-	vks::tools::setImageLayout(
-		cmdBuf,
-		prefilteredCube.image,
-		VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-		VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-		subresourceRange);
-
-	vkEngine->vulkanDevice->flushCommandBuffer(cmdBuf, vkEngine->queue);
-
-	vkDestroyRenderPass(vkEngine->device, renderpass, nullptr);
-	vkDestroyFramebuffer(vkEngine->device, offscreen.framebuffer, nullptr);
-	vkFreeMemory(vkEngine->device, offscreen.memory, nullptr);
-	vkDestroyImageView(vkEngine->device, offscreen.view, nullptr);
-	vkDestroyImage(vkEngine->device, offscreen.image, nullptr);
-	vkDestroyDescriptorPool(vkEngine->device, descriptorpool, nullptr);
-	vkDestroyDescriptorSetLayout(vkEngine->device, descriptorsetlayout, nullptr);
-	vkDestroyPipeline(vkEngine->device, pipeline, nullptr);
-	vkDestroyPipelineLayout(vkEngine->device, pipelinelayout, nullptr);
-
-	vkUtils::setObjectDebugName(VK_OBJECT_TYPE_IMAGE, (uint64_t)prefilteredCube.image, "prefilteredCube");
 	auto tEnd = std::chrono::high_resolution_clock::now();
 	auto tDiff = std::chrono::duration<double, std::milli>(tEnd - tStart).count();
-	std::cout << "Generating pre-filtered enivornment cube with " << numMips << " mip levels took " << tDiff << " ms" << std::endl;
+	std::cout << "Saving IBL maps to cache \"" << directory << "\" took " << tDiff << " ms" << std::endl;
 }
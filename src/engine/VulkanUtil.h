@@ -2,6 +2,8 @@
 #include <vulkan/vulkan.h>
 #include "vulkanEngine.h"
 #include "VulkanglTFModel.h"
+#include "PipelineCompileBatch.h"
+#include "IBLParameters.h"
 
 class vkUtils
 {
@@ -17,6 +19,40 @@ private:
 	static PFN_vkQueueInsertDebugUtilsLabelEXT vkQueueInsertDebugUtilsLabelEXT;
 	static PFN_vkQueueEndDebugUtilsLabelEXT vkQueueEndDebugUtilsLabelEXT;
 	static PFN_vkSetDebugUtilsObjectNameEXT vkSetDebugUtilsObjectNameEXT;
+
+	// IBL 预计算使用的渲染通道、布局与管线
+	// 管线在 prepareIBLPipelines 中加入启动时的编译批次，与场景管线一起并行编译
+	// 引擎使用动态渲染时不创建渲染通道与帧缓冲，管线按输出格式创建
+	struct IBLPipelines {
+		VkRenderPass brdfRenderPass{ VK_NULL_HANDLE };
+		VkRenderPass prefilterRenderPass{ VK_NULL_HANDLE };
+		VkDescriptorSetLayout environmentSetLayout{ VK_NULL_HANDLE };
+		VkPipelineLayout brdfLayout{ VK_NULL_HANDLE };
+		VkPipelineLayout prefilterLayout{ VK_NULL_HANDLE };
+		VkPipeline brdf{ VK_NULL_HANDLE };
+		VkPipeline prefilter{ VK_NULL_HANDLE };
+		// 计算着色器路径，每个 mip 一次 dispatch 写入全部 6 个面，不需要渲染通道与中间图像
+		VkDescriptorSetLayout lutStorageSetLayout{ VK_NULL_HANDLE };
+		VkDescriptorSetLayout filterStorageSetLayout{ VK_NULL_HANDLE };
+		VkPipelineLayout lutComputeLayout{ VK_NULL_HANDLE };
+		VkPipelineLayout prefilterComputeLayout{ VK_NULL_HANDLE };
+		VkPipeline lutCompute{ VK_NULL_HANDLE };
+		VkPipeline prefilterCompute{ VK_NULL_HANDLE };
+		// 加载的着色器，预计算完成后释放引用
+		std::vector<VkPipelineShaderStageCreateInfo> shaderStages;
+	};
+	static IBLPipelines iblPipelines;
+	// 附件保持在 COLOR_ATTACHMENT_OPTIMAL，进出渲染通道的布局转换由渲染图负责
+	static VkRenderPass createOffscreenRenderPass(VkFormat format);
+	// 开始/结束渲染到单个颜色附件，动态渲染时直接使用 view，否则使用 renderPass 与 framebuffer
+	static void cmdBeginOffscreenRendering(VkCommandBuffer commandBuffer, VkRenderPass renderPass, VkFramebuffer framebuffer, VkImageView view, uint32_t width, uint32_t height, const VkClearColorValue& clearColor);
+	static void cmdEndOffscreenRendering(VkCommandBuffer commandBuffer);
+	static void prepareIBLGraphicsPipelines(PipelineCompileBatch& batch);
+	static void prepareIBLComputePipelines();
+	// 未经过批次编译时(单独调用生成函数)就地编译
+	static void ensureIBLPipelines();
+	// 创建 IBL 结果图像、视图与采样器，layers 为 6 时创建立方体贴图
+	static void createIBLTarget(vks::Texture& texture, VkFormat format, uint32_t dim, uint32_t mipLevels, uint32_t layers, VkImageUsageFlags usage);
 public:
 	static VulkanEngine* vkEngine;
 
@@ -30,6 +66,8 @@ public:
 	static void cmdBeginLabel(VkCommandBuffer command_buffer, const char* label_name, std::vector<float> color);
 	static void cmdInsertLabel(VkCommandBuffer command_buffer, const char* label_name, std::vector<float> color);
 	static void cmdEndLabel(VkCommandBuffer command_buffer);
+	// 执行二级命令缓冲，其中的标签作用域在 GPU 计时的结果中成为当前作用域的子节点
+	static void cmdExecuteCommands(VkCommandBuffer command_buffer, const std::vector<VkCommandBuffer>& secondary_command_buffers);
 	static void queueBeginLabel(VkQueue queue, const char* label_name, std::vector<float> color);
 	static void queueInsertLabel(VkQueue queue, const char* label_name, std::vector<float> color);
 	static void queueEndLabel(VkQueue queue);
@@ -37,9 +75,26 @@ public:
 
 public:
 	//PBR生成相关
+	static void prepareIBLPipelines(PipelineCompileBatch& batch);
+	static void destroyIBLPipelines();
+
+	// 设备支持把两种结果格式用作存储图像时走计算着色器路径，否则走原来的离屏渲染路径
+	static bool computeIBLSupported();
+	static void generateIBL(vks::Texture2D& lutBrdf, vks::TextureCubeMap& prefilteredCube, vks::TextureCubeMap& environmentCube);
+	static void generateIBLCompute(vks::Texture2D& lutBrdf, vks::TextureCubeMap& prefilteredCube, vks::TextureCubeMap& environmentCube, const ibl::PrefilterSettings& settings = ibl::prefilterSettings);
+
+	// IBL 磁盘缓存，键由环境贴图文件内容与生成参数组成
+	static uint64_t iblCacheKey(const std::string& environmentFile);
+	// 所有结果文件都有效时加载并返回 true，否则不创建任何纹理
+	static bool loadIBLCache(const std::string& directory, uint64_t key, vks::Texture2D& lutBrdf, vks::TextureCubeMap& prefilteredCube);
+	static void saveIBLCache(const std::string& directory, uint64_t key, vks::Texture2D& lutBrdf, vks::TextureCubeMap& prefilteredCube);
 
 	static void generateBRDFLUT(vks::Texture2D& lutBrdf);
-	static void generateIrradianceCube(vks::TextureCubeMap& irradianceCube, vks::TextureCubeMap& environmentCube);
-	static void generatePrefilteredCube(vks::TextureCubeMap& prefilteredCube, vks::TextureCubeMap& environmentCube);
+	// settings 选择是否按 PDF 从环境贴图 mip 链采样(filtered importance sampling)、采样层级的偏移以及是否按 mip 调整采样数
+	// 默认设置与磁盘缓存一致；ibl::referencePrefilterSettings 为高采样数的基准，只用于质量对比
+	static void generatePrefilteredCube(vks::TextureCubeMap& prefilteredCube, vks::TextureCubeMap& environmentCube, const ibl::PrefilterSettings& settings = ibl::prefilterSettings);
+	// 漫反射辐照度用 L2 球谐表示，在 CPU 上从环境贴图的低分辨率 mip 投影得到 9 个 RGB 系数
+	// 系数已乘以各阶的余弦卷积因子并除以 π，着色器中直接求值即得到原辐照度立方体贴图中的值
+	static void generateIrradianceSH(const std::string& environmentFile, std::array<glm::vec4, 9>& coefficients);
 
 };
\ No newline at end of file
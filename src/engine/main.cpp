@@ -1,8 +1,40 @@
 #include "VulkanEngine.h"
+#include "IBLBaker.h"
+#include "EncoderBenchmark.h"
+#include "JobBenchmark.h"
+#include "RenderService.h"
 
 // OS specific main entry points
 // Most of the code base is shared for the different supported operating systems, but stuff like message handling differs
 
+// 构建时确定的着色器与资源路径，放在命令行参数之后由解析器读取
+static void addBuildArguments()
+{
+	VulkanEngine::args.push_back("--shaders");
+	VulkanEngine::args.push_back("slang");
+#if defined(ENGINE_SOURCE_DIR)
+	VulkanEngine::args.push_back("--resourcepath");
+	VulkanEngine::args.push_back(ENGINE_SOURCE_DIR);
+#endif
+#if defined(SHADERS_SPV_DIR)
+	VulkanEngine::args.push_back("--shadersspvpath");
+	VulkanEngine::args.push_back(SHADERS_SPV_DIR);
+#endif
+}
+
+// 只烘焙 IBL 资源或运行任务系统、图像编码基准时不创建窗口与 Vulkan 实例，可以在没有 GPU 的构建机上运行
+static bool runTools(int& exitCode)
+{
+	if (IBLBaker::runFromCommandLine(VulkanEngine::args, exitCode)) {
+		return true;
+	}
+	if (EncoderBenchmark::runFromCommandLine(VulkanEngine::args, exitCode)) {
+		return true;
+	}
+	return JobBenchmark::runFromCommandLine(VulkanEngine::args, exitCode);
+}
+
+#if defined(_WIN32)
 // Windows entry point
 VulkanEngine* vulkanEngineBase;
 LRESULT CALLBACK WndProc(HWND hWnd, UINT uMsg, WPARAM wParam, LPARAM lParam)
@@ -18,20 +50,16 @@ int APIENTRY WinMain(_In_ HINSTANCE hInstance, _In_opt_  HINSTANCE hPrevInstance
 	for (size_t i = 0; i < __argc; i++) { VulkanEngine::args.push_back(__argv[i]); };
 	VulkanEngine::args.push_back("--validation");
 	VulkanEngine::args.push_back("--vsync");
-	VulkanEngine::args.push_back("--shaders");
-	VulkanEngine::args.push_back("slang");
 	VulkanEngine::args.push_back("--width");
 	VulkanEngine::args.push_back("2560");
 	VulkanEngine::args.push_back("--height");
 	VulkanEngine::args.push_back("1440");
-#if defined(ENGINE_SOURCE_DIR)
-	VulkanEngine::args.push_back("--resourcepath");
-	VulkanEngine::args.push_back(ENGINE_SOURCE_DIR);
-#endif
-#if defined(SHADERS_SPV_DIR)
-	VulkanEngine::args.push_back("--shadersspvpath");
-	VulkanEngine::args.push_back(SHADERS_SPV_DIR);
-#endif
+	addBuildArguments();
+
+	int exitCode = 0;
+	if (runTools(exitCode)) {
+		return exitCode;
+	}
 
 	vulkanEngineBase = new VulkanEngine();
 	vulkanEngineBase->initVulkan();
@@ -40,4 +68,28 @@ int APIENTRY WinMain(_In_ HINSTANCE hInstance, _In_opt_  HINSTANCE hPrevInstance
 	vulkanEngineBase->renderLoop();
 	delete(vulkanEngineBase);
 	return 0;
-}
\ No newline at end of file
+}
+#else
+// 无头入口：渲染到离屏图像，不创建窗口，分辨率与帧数由命令行指定(-w/-h/--frames)，-o 保存最后一帧
+// --service 时作为渲染工作进程处理任务目录中的任务，不运行渲染循环
+// 不强制开启验证层与垂直同步，便于在 CI 或 lavapipe 上直接运行
+int main(int argc, char* argv[])
+{
+	for (int i = 0; i < argc; i++) { VulkanEngine::args.push_back(argv[i]); };
+	addBuildArguments();
+
+	int exitCode = 0;
+	if (runTools(exitCode)) {
+		return exitCode;
+	}
+
+	VulkanEngine* vulkanEngine = new VulkanEngine();
+	vulkanEngine->initVulkan();
+	vulkanEngine->prepare();
+	if (!RenderService::runFromCommandLine(*vulkanEngine, VulkanEngine::args, exitCode)) {
+		vulkanEngine->renderLoop();
+	}
+	delete(vulkanEngine);
+	return exitCode;
+}
+#endif